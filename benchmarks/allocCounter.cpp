@@ -0,0 +1,54 @@
+#include "allocCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<std::uint64_t> g_allocations{0};
+    std::atomic<std::uint64_t> g_bytes{0};
+
+    void* counted_alloc(std::size_t size)
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(size, std::memory_order_relaxed);
+        return std::malloc(size ? size : 1);
+    }
+};
+
+allocCounter::snapshot allocCounter::now()
+{
+    return snapshot{
+        g_allocations.load(std::memory_order_relaxed),
+        g_bytes.load(std::memory_order_relaxed)};
+}
+
+void* operator new(std::size_t size)
+{
+    if(void* ptr = counted_alloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    if(void* ptr = counted_alloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return counted_alloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return counted_alloc(size);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
@@ -0,0 +1,30 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+/**
+ * @brief Process-wide heap allocation counters for the benchmarks.
+ *
+ * Linking allocCounter.cpp replaces the global operator new/delete so that every
+ * allocation made by any thread is counted.
+ */
+namespace allocCounter
+{
+    /**
+     * @brief Totals of allocations made since the process started.
+     */
+    struct snapshot
+    {
+        std::uint64_t allocations; ///< Number of calls to operator new.
+        std::uint64_t bytes;       ///< Number of bytes requested from operator new.
+    };
+
+    /**
+     * @brief Reads the current totals.
+     * @return The allocations made so far.
+     */
+    snapshot now();
+};
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,153 @@
+#include <string>
+#include <fstream>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "allocCounter.h"
+#include "loopbackServer.h"
+
+/*
+    Broadcast fan-out
+
+    One message is broadcast to every session and delivered before the next one is sent.
+    Allocations and allocated bytes per message should not grow with the number of sessions.
+    The body is passed as a view and copied once, into the pooled message every session
+    shares; bytes_alloc/msg stands in for the bytes copied on top of that, since any other
+    copy of the body would be a heap string, and should stay 0.
+*/
+
+static void BM_BroadcastFanOut(benchmark::State &state)
+{
+    loopbackServer fixture(state.range(0));
+    const std::string body(state.range(1), 'x');
+    const std::uint64_t per_message = (body.size() + 1) * fixture.sessions();
+
+    std::uint64_t expected = fixture.received();
+    allocCounter::snapshot before = allocCounter::now();
+    for(auto _ : state){
+        fixture.server().write_broadcast(body);
+        expected += per_message;
+        fixture.wait_for(expected);
+    }
+    allocCounter::snapshot after = allocCounter::now();
+
+    state.counters["sessions"] = fixture.sessions();
+    state.counters["allocs/msg"] = benchmark::Counter(after.allocations - before.allocations, benchmark::Counter::kAvgIterations);
+    state.counters["bytes_alloc/msg"] = benchmark::Counter(after.bytes - before.bytes, benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(state.iterations() * per_message);
+}
+BENCHMARK(BM_BroadcastFanOut)
+    ->ArgsProduct({{1, 16, 256, 1024}, {128}})
+    ->UseRealTime();
+
+/*
+    Receive and broadcast
+
+    A client sends chat lines which the server parses, prefixes with the sender's name and
+    broadcasts. Receive buffers and messages come from the buffer pool, so once warmed up
+    the path from the socket back to the sockets should not touch the heap. With 2 and 4
+    per-core loops the message also passes through the other loops' mailboxes.
+*/
+
+static void BM_ReceiveBroadcast(benchmark::State &state)
+{
+    loopbackServer fixture(state.range(0), 0, loopbackServer::quiet_config(), state.range(2));
+    const std::string line = std::string(state.range(1), 'x') + "\n";
+    const std::uint64_t per_message = (std::string("bench0 : ").size() + line.size()) * fixture.sessions();
+
+    // Warm up the pools and the outbound queues before counting
+    std::uint64_t expected = fixture.received();
+    for(int i=0; i<1000; ++i){
+        fixture.send(0, line);
+        expected += per_message;
+        fixture.wait_for(expected);
+    }
+
+    allocCounter::snapshot before = allocCounter::now();
+    for(auto _ : state){
+        fixture.send(0, line);
+        expected += per_message;
+        fixture.wait_for(expected);
+    }
+    allocCounter::snapshot after = allocCounter::now();
+
+    state.counters["sessions"] = fixture.sessions();
+    state.counters["loops"] = state.range(2);
+    state.counters["allocs/msg"] = benchmark::Counter(after.allocations - before.allocations, benchmark::Counter::kAvgIterations);
+    state.counters["bytes_alloc/msg"] = benchmark::Counter(after.bytes - before.bytes, benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(state.iterations() * per_message);
+    // Messages, queue slots and operation state all come from the pools once warm
+    if(after.allocations != before.allocations) state.SkipWithError("heap allocation on the broadcast path");
+}
+BENCHMARK(BM_ReceiveBroadcast)
+    ->ArgsProduct({{1, 16, 256}, {128, 4096}, {0, 1, 2, 4}})
+    ->UseRealTime();
+
+/*
+    Event loop topology
+
+    The same fan-out with the sessions spread over several per-core event loops. Broadcasts
+    reach the other loops through their mailboxes.
+*/
+
+static void BM_BroadcastPerCoreLoops(benchmark::State &state)
+{
+    loopbackServer fixture(state.range(0), 0, loopbackServer::quiet_config(), state.range(1));
+    const std::string body(128, 'x');
+    const std::uint64_t per_message = (body.size() + 1) * fixture.sessions();
+
+    std::uint64_t expected = fixture.received();
+    for(auto _ : state){
+        fixture.server().write_broadcast(body);
+        expected += per_message;
+        fixture.wait_for(expected);
+    }
+
+    state.counters["loops"] = state.range(1);
+    state.SetBytesProcessed(state.iterations() * per_message);
+}
+BENCHMARK(BM_BroadcastPerCoreLoops)
+    ->ArgsProduct({{256}, {1, 2, 4, 8}})
+    ->UseRealTime();
+
+/*
+    Slow consumer
+
+    One client stops reading while the others keep up. Its outbound queue is bounded by the
+    high watermark, so resident memory stays flat and delivery to the others is not delayed.
+*/
+
+static std::uint64_t resident_bytes()
+{
+    std::uint64_t pages = 0, resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void BM_BroadcastStalledClient(benchmark::State &state)
+{
+    networkLibrary::Server::serverConfig config = loopbackServer::quiet_config();
+    config.slow_consumer_policy = static_cast<networkLibrary::Server::serverConfig::SlowConsumerPolicy>(state.range(1));
+    loopbackServer fixture(state.range(0), 1, config);
+    const std::string body(4096, 'x');
+    const std::uint64_t per_message = (body.size() + 1) * fixture.sessions();
+
+    std::uint64_t expected = fixture.received();
+    std::uint64_t rss_before = resident_bytes();
+    for(auto _ : state){
+        fixture.server().write_broadcast(body);
+        expected += per_message;
+        fixture.wait_for(expected);
+    }
+    std::uint64_t rss_after = resident_bytes();
+
+    state.counters["sessions"] = fixture.sessions();
+    state.counters["rss_growth_kb"] = double(rss_after > rss_before ? rss_after - rss_before : 0) / 1024;
+    state.SetBytesProcessed(state.iterations() * per_message);
+}
+BENCHMARK(BM_BroadcastStalledClient)
+    ->ArgsProduct({{16}, {networkLibrary::Server::serverConfig::DROP, networkLibrary::Server::serverConfig::DISCONNECT}})
+    ->Iterations(20000)
+    ->UseRealTime();
@@ -0,0 +1,111 @@
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include "../networkLibrary/networkLibrary.h"
+
+/*
+    Client send throughput
+
+    Another thread writes lines through asyncClient::write as fast as it can, the way a bot
+    relaying a feed does, to a loopback sink that discards them. Each iteration writes a
+    batch of lines and waits until the sink has received all of them.
+*/
+
+namespace
+{
+    constexpr std::size_t kLines = 1000;
+
+    /**
+     * @brief Accepts one connection on loopback and discards everything it reads.
+     */
+    class sinkServer
+    {
+    private:
+        boost::asio::io_context m_io;
+        boost::asio::ip::tcp::acceptor m_acceptor;
+        boost::asio::ip::tcp::socket m_socket;
+        std::array<char, 64 * 1024> m_buffer;
+        std::atomic<std::uint64_t> m_received;
+        std::atomic<bool> m_connected;
+        std::thread m_thread;
+
+        void drain()
+        {
+            m_socket.async_read_some(boost::asio::buffer(m_buffer), [this](boost::system::error_code ec, std::size_t size){
+                if(ec) return;
+                m_received.fetch_add(size, std::memory_order_relaxed);
+                drain();
+            });
+        }
+
+    public:
+        sinkServer()
+            : m_acceptor(m_io, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+              m_socket(m_io),
+              m_received(0),
+              m_connected(false)
+        {
+            m_acceptor.async_accept(m_socket, [this](boost::system::error_code ec){
+                if(ec) return;
+                m_connected = true;
+                drain();
+            });
+            m_thread = std::thread([this](){ m_io.run(); });
+        }
+
+        ~sinkServer()
+        {
+            boost::asio::post(m_io, [this](){
+                boost::system::error_code ec;
+                m_acceptor.close(ec);
+                m_socket.close(ec);
+            });
+            m_thread.join();
+        }
+
+        unsigned int port() const
+        {
+            return m_acceptor.local_endpoint().port();
+        }
+
+        bool connected() const
+        {
+            return m_connected;
+        }
+
+        void wait_for(std::uint64_t total) const
+        {
+            while(m_received.load(std::memory_order_relaxed) < total) std::this_thread::yield();
+        }
+    };
+};
+
+static void BM_ClientWrite(benchmark::State &state)
+{
+    sinkServer sink;
+    boost::asio::io_context io_context;
+    networkLibrary::Client::clientConfig config;
+    config.print_status = false;
+    auto client = std::make_unique<networkLibrary::Client::asyncClient>(io_context, "127.0.0.1", sink.port(), config);
+    std::thread thread([&io_context](){ io_context.run(); });
+    while(!sink.connected()) std::this_thread::yield();
+
+    std::string line(state.range(0), 'x');
+    std::uint64_t expected = 0;
+    for(auto _ : state){
+        for(std::size_t i=0; i<kLines; ++i) client->write(line);
+        expected += kLines * (line.size() + 1);
+        sink.wait_for(expected);
+    }
+
+    client->close_connection();
+    thread.join();
+    client.reset();
+    state.counters["lines/s"] = benchmark::Counter(state.iterations() * kLines, benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(state.iterations() * kLines * (line.size() + 1));
+}
+BENCHMARK(BM_ClientWrite)->Arg(64)->Arg(1024)->UseRealTime();
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Compares Asio's I/O backends, e.g. epoll and io_uring, with the load generator.
+
+Takes one build directory per backend, e.g. one configured with -DCHATAPP_IO_URING=ON and
+one without. For each one it starts asyncServer on loopback, drives it with its chatLoadGen
+and prints the server's backend, delivered lines/sec, latency percentiles, the server's CPU
+time per message written and its system calls per message written.
+
+    compare_backends.py <BUILD_DIR>... [chatLoadGen options...]
+
+System calls are counted by a second run under strace -c, which slows the server down too
+much to measure anything else; without strace the column stays empty. A build whose
+backend the kernel refuses is reported as unavailable. Any other options are passed to
+chatLoadGen, e.g. --clients 2000 --rate 2000.
+"""
+
+import argparse
+import os
+import re
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+SERVER_PORT = 47700
+METRICS_PORT = 47701
+
+
+def scrape(port):
+    with socket.create_connection(("127.0.0.1", port), timeout=5) as s:
+        s.sendall(b"GET /metrics HTTP/1.0\r\n\r\n")
+        data = b""
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    metrics = {}
+    for line in data.decode().splitlines():
+        m = re.match(r"^(chat_\w+) (\d+)$", line)
+        if m:
+            metrics[m.group(1)] = int(m.group(2))
+    return metrics
+
+
+def cpu_seconds(pid):
+    with open("/proc/%d/stat" % pid) as f:
+        # The command name may contain spaces, the fields after it do not
+        fields = f.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+def run(build, loadgen_args, trace):
+    log = tempfile.TemporaryFile(mode="w+")
+    server = subprocess.Popen([build + "/chatServer/asyncServer", str(SERVER_PORT), "--metrics-port", str(METRICS_PORT)],
+                              stdout=log, stderr=subprocess.DEVNULL)
+    result = {}
+    tracer = None
+    summary = tempfile.NamedTemporaryFile(mode="r")
+    try:
+        time.sleep(0.5)
+        log.seek(0)
+        m = re.search(r"I/O Backend (\S+)( is unavailable)?", log.read())
+        result["backend"] = m.group(1) if m else "?"
+        if server.poll() is not None or (m and m.group(2)):
+            result["backend"] += " (unavailable)"
+            return result
+
+        if trace:
+            tracer = subprocess.Popen(["strace", "-c", "-f", "-q", "-p", str(server.pid), "-o", summary.name],
+                                      stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+            time.sleep(0.5)
+        before = scrape(METRICS_PORT)
+        cpu_before = cpu_seconds(server.pid)
+        out = subprocess.run([build + "/chatClient/chatLoadGen", "127.0.0.1", str(SERVER_PORT)] + loadgen_args,
+                             capture_output=True, text=True, check=True).stdout
+        cpu_after = cpu_seconds(server.pid)
+        after = scrape(METRICS_PORT)
+        if tracer:
+            tracer.send_signal(signal.SIGINT)
+            tracer.wait()
+    finally:
+        server.terminate()
+        server.wait()
+
+    messages = after["chat_messages_out_total"] - before["chat_messages_out_total"]
+    if trace:
+        m = re.search(r"^\s*100\.00\s+\S+\s+\S+\s+(\d+)(?:\s+\d+)?\s+total\s*$", summary.read(), re.M)
+        if m and messages:
+            result["syscalls/msg"] = int(m.group(1)) / messages
+        return result
+
+    m = re.search(r"delivered/sec (\d+)", out)
+    result["delivered/s"] = int(m.group(1)) if m else 0
+    m = re.search(r"p50 ([\d.]+)\s+p99 ([\d.]+)\s+p999 ([\d.]+)", out)
+    if m:
+        result["p50 us"], result["p99 us"], result["p999 us"] = (float(g) for g in m.groups())
+    if messages:
+        result["cpu us/msg"] = (cpu_after - cpu_before) * 1e6 / messages
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("builds", nargs="+")
+    args, loadgen_args = parser.parse_known_args()
+    trace = shutil.which("strace") is not None
+
+    columns = ["delivered/s", "p50 us", "p99 us", "p999 us", "cpu us/msg", "syscalls/msg"]
+    print("{:<24}".format("backend") + "".join("{:>14}".format(c) for c in columns))
+    for build in args.builds:
+        result = run(build, loadgen_args, False)
+        if trace and "delivered/s" in result:
+            result.update(run(build, loadgen_args, True))
+        cells = ["{:>14.2f}".format(result[c]) if c in result else "{:>14}".format("-") for c in columns]
+        print("{:<24}".format(result["backend"]) + "".join(cells))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
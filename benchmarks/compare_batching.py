@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Compares immediate and micro-batched broadcast writes with the load generator.
+
+Starts asyncServer once per mode on loopback, drives it with chatLoadGen and scrapes the
+metrics endpoint afterwards. Prints delivered lines/sec, latency percentiles, the number
+of writes (about one system call each) and the messages per write of every mode.
+
+    compare_batching.py <BUILD_DIR> [--windows US,...] [chatLoadGen options...]
+
+--windows lists the batch windows to try in microseconds; 0 batches per event loop turn.
+Any other options are passed to chatLoadGen, e.g. --clients 2000 --rate 2000.
+"""
+
+import argparse
+import re
+import socket
+import subprocess
+import sys
+import time
+
+SERVER_PORT = 47100
+METRICS_PORT = 47101
+
+
+def scrape(port):
+    with socket.create_connection(("127.0.0.1", port), timeout=5) as s:
+        s.sendall(b"GET /metrics HTTP/1.0\r\n\r\n")
+        data = b""
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    metrics = {}
+    for line in data.decode().splitlines():
+        m = re.match(r"^(chat_\w+) (\d+)$", line)
+        if m:
+            metrics[m.group(1)] = int(m.group(2))
+    return metrics
+
+
+def run(build, window, loadgen_args):
+    server_cmd = [build + "/chatServer/asyncServer", str(SERVER_PORT), "--metrics-port", str(METRICS_PORT)]
+    if window is not None:
+        server_cmd += ["--batch-window", str(window)]
+    server = subprocess.Popen(server_cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        time.sleep(0.5)
+        before = scrape(METRICS_PORT)
+        out = subprocess.run([build + "/chatClient/chatLoadGen", "127.0.0.1", str(SERVER_PORT)] + loadgen_args,
+                             capture_output=True, text=True, check=True).stdout
+        after = scrape(METRICS_PORT)
+    finally:
+        server.terminate()
+        server.wait()
+
+    result = {}
+    m = re.search(r"delivered/sec (\d+)", out)
+    result["delivered/s"] = int(m.group(1)) if m else 0
+    m = re.search(r"p50 ([\d.]+)\s+p99 ([\d.]+)\s+p999 ([\d.]+)", out)
+    if m:
+        result["p50 us"], result["p99 us"], result["p999 us"] = (float(g) for g in m.groups())
+    writes = after["chat_writes_out_total"] - before["chat_writes_out_total"]
+    messages = after["chat_messages_out_total"] - before["chat_messages_out_total"]
+    result["writes"] = writes
+    result["msgs/write"] = messages / writes if writes else 0.0
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("build")
+    parser.add_argument("--windows", default="0,200,1000")
+    args, loadgen_args = parser.parse_known_args()
+
+    modes = [("immediate", None)] + [("batch %sus" % w, int(w)) for w in args.windows.split(",")]
+    columns = ["delivered/s", "p50 us", "p99 us", "p999 us", "writes", "msgs/write"]
+    print("{:<14}".format("mode") + "".join("{:>14}".format(c) for c in columns))
+    for name, window in modes:
+        result = run(args.build, window, loadgen_args)
+        print("{:<14}".format(name) + "".join("{:>14.1f}".format(result.get(c, 0)) for c in columns))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
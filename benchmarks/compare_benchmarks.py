@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Compares two Google Benchmark JSON files, e.g. written by the benchmark_json target.
+
+Prints time per iteration and every per-op counter (allocs/op, allocs/msg, ...) of each
+benchmark present in both files, with the relative change from the old to the new build.
+
+    compare_benchmarks.py <OLD_JSON> <NEW_JSON> [--threshold PERCENT]
+
+Exits with status 1 if any time or counter grew by more than the threshold (default 10%).
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    results = {}
+    for run in data["benchmarks"]:
+        # Skip mean/median/stddev rows of repeated runs
+        if run.get("run_type", "iteration") != "iteration":
+            continue
+        metrics = {"time/" + run.get("time_unit", "ns"): run["real_time"]}
+        for key, value in run.items():
+            if "/" in key and isinstance(value, (int, float)):
+                metrics[key] = value
+        results[run["name"]] = metrics
+    return results
+
+
+def change(old, new):
+    if old == 0:
+        return 0.0 if new == 0 else float("inf")
+    return (new - old) / old * 100.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0, help="regression threshold in percent")
+    args = parser.parse_args()
+
+    old = load(args.old)
+    new = load(args.new)
+    regressed = False
+
+    print("{:<60} {:<14} {:>14} {:>14} {:>9}".format("Benchmark", "Metric", "Old", "New", "Change"))
+    for name in old:
+        if name not in new:
+            continue
+        for metric, old_value in old[name].items():
+            if metric not in new[name]:
+                continue
+            new_value = new[name][metric]
+            delta = change(old_value, new_value)
+            flag = ""
+            if delta > args.threshold:
+                flag = "  <-- regression"
+                regressed = True
+            print("{:<60} {:<14} {:>14.2f} {:>14.2f} {:>+8.1f}%{}".format(name, metric, old_value, new_value, delta, flag))
+
+    for name in sorted(set(old) ^ set(new)):
+        print("{:<60} only in {}".format(name, "old" if name in old else "new"))
+
+    return 1 if regressed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
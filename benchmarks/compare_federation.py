@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Measures how a federation of asyncServer instances scales with the number of nodes.
+
+Starts 1, 2, ... N federated servers on loopback, every pair joined by one relay link,
+drives every node with its own chatLoadGen at the same time and scrapes the metrics
+endpoints afterwards. Prints, per federation size, the lines delivered per second summed
+over the load generators, the messages written to clients per second summed over the
+nodes and the relay frames sent per second.
+
+    compare_federation.py <BUILD_DIR> [--nodes N] [chatLoadGen options...]
+
+Any other options are passed to every chatLoadGen, e.g. --clients 500 --rate 500. Every
+node and load generator is a process of its own, so the numbers only mean something with
+a core or more for each; on a single core the nodes just share it.
+"""
+
+import argparse
+import re
+import socket
+import subprocess
+import sys
+import time
+
+SERVER_PORT = 47200
+RELAY_PORT = 47300
+METRICS_PORT = 47400
+
+
+def scrape(port):
+    with socket.create_connection(("127.0.0.1", port), timeout=5) as s:
+        s.sendall(b"GET /metrics HTTP/1.0\r\n\r\n")
+        data = b""
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    metrics = {}
+    for line in data.decode().splitlines():
+        m = re.match(r"^(chat_\w+) (\d+)$", line)
+        if m:
+            metrics[m.group(1)] = int(m.group(2))
+    return metrics
+
+
+def run(build, nodes, loadgen_args):
+    servers = []
+    try:
+        for i in range(nodes):
+            server_cmd = [build + "/chatServer/asyncServer", str(SERVER_PORT + i),
+                          "--node-id", str(i + 1),
+                          "--federation-port", str(RELAY_PORT + i),
+                          "--metrics-port", str(METRICS_PORT + i)]
+            # Node i links to every earlier node, so every pair has exactly one link
+            for j in range(i):
+                server_cmd += ["--peer", "127.0.0.1:%d" % (RELAY_PORT + j)]
+            servers.append(subprocess.Popen(server_cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL))
+        time.sleep(0.5 + 0.2 * nodes)
+
+        before = [scrape(METRICS_PORT + i) for i in range(nodes)]
+        started = time.time()
+        loadgens = [subprocess.Popen([build + "/chatClient/chatLoadGen", "127.0.0.1", str(SERVER_PORT + i)] + loadgen_args,
+                                     stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+                    for i in range(nodes)]
+        outputs = [loadgen.communicate()[0] for loadgen in loadgens]
+        seconds = time.time() - started
+        after = [scrape(METRICS_PORT + i) for i in range(nodes)]
+    finally:
+        for server in servers:
+            server.terminate()
+        for server in servers:
+            server.wait()
+
+    def delta(name):
+        return sum(a.get(name, 0) - b.get(name, 0) for a, b in zip(after, before))
+
+    result = {}
+    result["delivered/s"] = sum(int(m.group(1)) for m in (re.search(r"delivered/sec (\d+)", out) for out in outputs) if m)
+    result["written/s"] = delta("chat_messages_out_total") / seconds
+    result["relayed/s"] = delta("chat_relay_frames_out_total") / seconds
+    result["duplicates"] = delta("chat_relay_duplicates_total")
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("build")
+    parser.add_argument("--nodes", type=int, default=3)
+    args, loadgen_args = parser.parse_known_args()
+
+    columns = ["delivered/s", "written/s", "relayed/s", "duplicates"]
+    print("{:<8}".format("nodes") + "".join("{:>14}".format(c) for c in columns))
+    for nodes in range(1, args.nodes + 1):
+        result = run(args.build, nodes, loadgen_args)
+        print("{:<8}".format(nodes) + "".join("{:>14.1f}".format(result.get(c, 0)) for c in columns))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,77 @@
+#include <random>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "../networkLibrary/networkLibrary.h"
+
+/*
+    Compressed broadcasts
+
+    A broadcast is compressed by its first compressed recipient and every other one sends the
+    same frame, so compressing a message costs the same whether it goes to one session or to a
+    thousand. Bodies are chat-like text: words from a small vocabulary, as in a \list roster
+    or a burst of chat lines. Decompressing is what each compressed client pays per message.
+*/
+
+namespace
+{
+    std::string chat_text(std::size_t size)
+    {
+        static const char* const words[] = {"hello", "room", "lobby", "user", "message", "the", "server",
+                                            "joined", "left", "is", "typing", "and", "a", "chat", "ok"};
+        std::mt19937 random(42);
+        std::string text;
+        while(text.size() < size){
+            text += words[random() % (sizeof(words) / sizeof(words[0]))];
+            text += (random() % 8 == 0) ? std::to_string(random() % 1000) + " " : " ";
+        }
+        text.resize(size);
+        return text;
+    }
+};
+
+static void BM_CompressMessage(benchmark::State &state)
+{
+    const std::string body = chat_text(state.range(0));
+    std::size_t wire = 0;
+    for(auto _ : state){
+        networkLibrary::messagePtr message = networkLibrary::chatMessage::make(body);
+        wire = message->compressed_buffer().size();
+        benchmark::DoNotOptimize(wire);
+    }
+    state.counters["ratio"] = static_cast<double>(wire) / (networkLibrary::Protocol::header_size + body.size());
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+BENCHMARK(BM_CompressMessage)->Arg(512)->Arg(4096)->Arg(65536);
+
+static void BM_CompressedFanOut(benchmark::State &state)
+{
+    const std::string body = chat_text(4096);
+    const std::size_t recipients = state.range(0);
+    for(auto _ : state){
+        networkLibrary::messagePtr message = networkLibrary::chatMessage::make(body);
+        for(std::size_t i=0; i<recipients; ++i){
+            benchmark::DoNotOptimize(message->compressed_buffer().data());
+        }
+    }
+    state.counters["recipients"] = recipients;
+}
+BENCHMARK(BM_CompressedFanOut)->Arg(1)->Arg(64)->Arg(1024);
+
+static void BM_DecompressMessage(benchmark::State &state)
+{
+    const std::string body = chat_text(state.range(0));
+    networkLibrary::messagePtr message = networkLibrary::chatMessage::make(body);
+    boost::asio::const_buffer frame = message->compressed_buffer();
+    std::string_view stream(static_cast<const char*>(frame.data()) + networkLibrary::Protocol::header_size, frame.size() - networkLibrary::Protocol::header_size);
+
+    std::string out;
+    for(auto _ : state){
+        bool ok = networkLibrary::Protocol::decompress(stream, 1 << 20, out);
+        benchmark::DoNotOptimize(ok);
+    }
+    if(out != body) state.SkipWithError("round trip mismatch");
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+BENCHMARK(BM_DecompressMessage)->Arg(512)->Arg(4096)->Arg(65536);
@@ -0,0 +1,52 @@
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "allocCounter.h"
+#include "loopbackServer.h"
+
+/*
+    Handler allocation
+
+    A client sends chat lines that are broadcast to every session, with operation state
+    allocated either from the buffer pool or by Asio's default per-thread recycling. Every
+    heap allocation left on this path belongs to an asynchronous operation or its executor.
+*/
+
+static void BM_HandlerAllocation(benchmark::State &state)
+{
+    networkLibrary::Server::serverConfig config = loopbackServer::quiet_config();
+    config.recycle_handlers = state.range(2) != 0;
+
+    loopbackServer fixture(state.range(0), 0, config, state.range(1));
+    const std::string line = std::string(128, 'x') + "\n";
+    const std::uint64_t per_message = (std::string("bench0 : ").size() + line.size()) * fixture.sessions();
+
+    std::uint64_t expected = fixture.received();
+    for(int i=0; i<1000; ++i){
+        fixture.send(0, line);
+        expected += per_message;
+        fixture.wait_for(expected);
+    }
+
+    allocCounter::snapshot before = allocCounter::now();
+    for(auto _ : state){
+        fixture.send(0, line);
+        expected += per_message;
+        fixture.wait_for(expected);
+    }
+    allocCounter::snapshot after = allocCounter::now();
+
+    state.counters["sessions"] = fixture.sessions();
+    state.counters["loops"] = state.range(1);
+    state.counters["recycle"] = state.range(2);
+    state.counters["allocs/msg"] = benchmark::Counter(after.allocations - before.allocations, benchmark::Counter::kAvgIterations);
+    state.counters["bytes_alloc/msg"] = benchmark::Counter(after.bytes - before.bytes, benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations());
+    // Only Asio's default allocation is expected to reach the heap
+    if(config.recycle_handlers && after.allocations != before.allocations) state.SkipWithError("heap allocation with recycled handlers");
+}
+BENCHMARK(BM_HandlerAllocation)
+    ->ArgNames({"sessions", "loops", "recycle"})
+    ->ArgsProduct({{1, 16, 256}, {0, 1}, {0, 1}})
+    ->UseRealTime();
@@ -0,0 +1,51 @@
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "../networkLibrary/networkLibrary.h"
+
+/*
+    Recording history
+
+    Every chat line is pushed onto its room's ring and appended to the segment log, as io
+    threads do. The append only serialises the record into the pending batch; the background
+    writer copies it into the mapping and syncs, so the time is what an io thread pays.
+*/
+
+namespace
+{
+    const std::string kHistoryDirectory = "/tmp/chatBenchmarks_history";
+
+    std::unique_ptr<networkLibrary::segmentLog> g_log;
+    std::unique_ptr<networkLibrary::chatHistory> g_history;
+};
+
+static void BM_HistoryRecord(benchmark::State &state)
+{
+    if(state.thread_index() == 0){
+        std::filesystem::remove_all(kHistoryDirectory);
+        g_log = std::make_unique<networkLibrary::segmentLog>(kHistoryDirectory, 64 * 1024 * 1024, 2, std::chrono::milliseconds(100));
+        g_history = std::make_unique<networkLibrary::chatHistory>(50);
+    }
+    const std::string room = "room" + std::to_string(state.thread_index());
+    networkLibrary::historyPtr history;
+    networkLibrary::messagePtr message = networkLibrary::chatMessage::make({"bench : ", std::string(128, 'x')});
+
+    for(auto _ : state){
+        // The log is only guaranteed to exist once every thread has entered the loop
+        if(!history) history = g_history->get(room);
+        history->push(message);
+        g_log->append(history->name(), message->view());
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if(state.thread_index() == 0){
+        state.counters["dropped"] = g_log->dropped();
+        g_log.reset();
+        g_history.reset();
+        std::filesystem::remove_all(kHistoryDirectory);
+    }
+}
+BENCHMARK(BM_HistoryRecord)->ThreadRange(1, 4)->UseRealTime();
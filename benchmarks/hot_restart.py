@@ -0,0 +1,196 @@
+#!/usr/bin/env python3
+"""Restarts asyncServer under load and measures what the clients notice.
+
+Starts a server with a handoff path, connects clients that all talk in the default room,
+each sending numbered lines at a steady rate, and halfway through starts a second server
+with the same arguments, which takes the sockets over from the first. Every client checks
+that it receives every other client's lines in order. Prints, per restart:
+
+    handoff ms    from starting the new server until the old one has exited
+    stall ms      longest time no client received anything, around the restart
+    adopted       chat_sessions_adopted_total of the new server
+
+and at the end the lines sent but never received, summed over the receivers, and the
+clients whose connection was closed.
+
+    hot_restart.py <BUILD_DIR> [--clients N] [--rate LINES_PER_SECOND] [--seconds S] [--restarts R]
+"""
+
+import argparse
+import os
+import re
+import selectors
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+SERVER_PORT = 47500
+METRICS_PORT = 47501
+
+
+def scrape(port):
+    with socket.create_connection(("127.0.0.1", port), timeout=5) as s:
+        s.sendall(b"GET /metrics HTTP/1.0\r\n\r\n")
+        data = b""
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    metrics = {}
+    for line in data.decode().splitlines():
+        m = re.match(r"^(chat_\w+) (\d+)$", line)
+        if m:
+            metrics[m.group(1)] = int(m.group(2))
+    return metrics
+
+
+class Client:
+    def __init__(self, index):
+        self.name = "c%d" % index
+        self.sock = socket.create_connection(("127.0.0.1", SERVER_PORT))
+        self.sock.setblocking(False)
+        self.buffer = b""
+        self.named = False
+        self.sent = 0
+        self.closed = False
+        # Highest number received from every other client, and how many were skipped
+        self.last = {}
+        self.lost = 0
+
+    def send(self, line):
+        try:
+            self.sock.sendall(line.encode() + b"\n")
+        except (BlockingIOError, OSError):
+            # The test never sends enough to fill a socket buffer
+            self.closed = True
+
+    def receive(self, now, deliveries):
+        try:
+            data = self.sock.recv(65536)
+        except BlockingIOError:
+            return
+        except OSError:
+            data = b""
+        if not data:
+            self.closed = True
+            return
+        self.buffer += data
+        if not self.named and b"Username" in self.buffer:
+            self.named = True
+            self.buffer = b""
+            self.send(self.name)
+            return
+        *lines, self.buffer = self.buffer.split(b"\n")
+        for line in lines:
+            m = re.match(rb"^(c\d+) : (\d+)$", line)
+            if not m:
+                continue
+            deliveries.append(now)
+            sender, seq = m.group(1).decode(), int(m.group(2))
+            if sender == self.name:
+                continue
+            # Every client is named before anyone sends, so numbering starts at 0 for all
+            last = self.last.get(sender, -1)
+            if seq > last + 1:
+                self.lost += seq - last - 1
+            self.last[sender] = max(seq, last)
+
+
+def start_server(build, handoff):
+    return subprocess.Popen([build + "/chatServer/asyncServer", str(SERVER_PORT),
+                             "--handoff", handoff, "--metrics-port", str(METRICS_PORT)],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def pump(selector, clients, deliveries, until, rate, sending):
+    interval = 1.0 / rate
+    next_send = time.time()
+    while True:
+        now = time.time()
+        if now >= until:
+            return
+        if sending and now >= next_send:
+            for client in clients:
+                if client.named and not client.closed:
+                    client.send(str(client.sent))
+                    client.sent += 1
+            next_send += interval
+        timeout = max(0.0, min(until, next_send if sending else until) - now)
+        for key, _ in selector.select(timeout):
+            client = key.data
+            client.receive(time.time(), deliveries)
+            if client.closed:
+                selector.unregister(client.sock)
+
+
+def run(build, clients_count, rate, seconds, restarts):
+    handoff = os.path.join(tempfile.mkdtemp(), "handoff.sock")
+    server = start_server(build, handoff)
+    time.sleep(0.5)
+    selector = selectors.DefaultSelector()
+    clients = [Client(i) for i in range(clients_count)]
+    for client in clients:
+        selector.register(client.sock, selectors.EVENT_READ, client)
+    deliveries = []
+    results = []
+    try:
+        # Everyone is named and in the room before the lines are counted
+        pump(selector, clients, deliveries, time.time() + 1.0, rate, False)
+        for _ in range(restarts):
+            pump(selector, clients, deliveries, time.time() + seconds / 2, rate, True)
+            old = server
+            restarted = time.time()
+            server = start_server(build, handoff)
+            # The clients keep sending while the sockets change hands
+            while old.poll() is None and time.time() - restarted < 10:
+                pump(selector, clients, deliveries, time.time() + 0.01, rate, True)
+            handoff_ms = (time.time() - restarted) * 1000
+            pump(selector, clients, deliveries, time.time() + seconds / 2, rate, True)
+
+            window = [t for t in deliveries if restarted - 1 <= t <= restarted + 2]
+            stall_ms = max((b - a for a, b in zip(window, window[1:])), default=0) * 1000
+            results.append({"handoff ms": handoff_ms, "stall ms": stall_ms,
+                            "adopted": scrape(METRICS_PORT).get("chat_sessions_adopted_total", 0)})
+
+        # Lines still in flight arrive before the count
+        pump(selector, clients, deliveries, time.time() + 1.0, rate, False)
+        for client in clients:
+            # Lines after the last one received never arrived either
+            for other in clients:
+                if other is client or client.closed:
+                    continue
+                client.lost += other.sent - 1 - client.last.get(other.name, -1)
+        lost = sum(client.lost for client in clients)
+        sent = sum(client.sent for client in clients) * (clients_count - 1)
+        disconnected = sum(client.closed for client in clients)
+    finally:
+        for client in clients:
+            client.sock.close()
+        server.terminate()
+        server.wait()
+    return results, lost, sent, disconnected
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("build")
+    parser.add_argument("--clients", type=int, default=20)
+    parser.add_argument("--rate", type=float, default=50)
+    parser.add_argument("--seconds", type=float, default=4)
+    parser.add_argument("--restarts", type=int, default=3)
+    args = parser.parse_args()
+
+    results, lost, sent, disconnected = run(args.build, args.clients, args.rate, args.seconds, args.restarts)
+    columns = ["handoff ms", "stall ms", "adopted"]
+    print("{:<10}".format("restart") + "".join("{:>14}".format(c) for c in columns))
+    for i, result in enumerate(results):
+        print("{:<10}".format(i + 1) + "".join("{:>14.1f}".format(result[c]) for c in columns))
+    print("lost %d of %d lines, %d of %d clients disconnected" % (lost, sent, disconnected, args.clients))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
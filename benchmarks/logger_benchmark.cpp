@@ -0,0 +1,98 @@
+#include <memory>
+#include <string>
+#include <cstdio>
+
+#include <benchmark/benchmark.h>
+
+#include "allocCounter.h"
+#include "../utils/Logger.h"
+
+/*
+    Logging under contention
+
+    Several threads log chat lines to a file at once, as io threads do when every message is
+    logged. The synchronous logger serialises them on its mutex and flushes every line; the
+    asynchronous one only claims a ring slot and copies the text. The asynchronous logger drops
+    what the writer thread cannot keep up with, so the time is what a logging io thread pays.
+
+    The formatted variants log the same line through LOG_DEBUG, as the server logs chat traffic,
+    once as text and once as binary records. The last one logs below the compiled-in level.
+*/
+
+namespace
+{
+    const std::string kLogFile = "/tmp/chatBenchmarks_log.txt";
+
+    std::unique_ptr<Logger> g_logger;
+
+    enum class callStyle {
+        LIST,       // Logger::log() with an initializer_list of strings
+        FORMATTED,  // LOG_DEBUG with the raw arguments
+        TRACE       // LOG_TRACE, compiled out unless CHATAPP_LOG_LEVEL is TRACE
+    };
+
+    void run_logger(benchmark::State &state, Logger::Location location, Logger::Mode mode, callStyle style)
+    {
+        if(state.thread_index() == 0){
+            g_logger = std::make_unique<Logger>(location, kLogFile, mode, Logger::OverflowPolicy::BLOCK, 1 << 16);
+        }
+        const std::string name = "bench" + std::to_string(state.thread_index());
+        const std::string line(100, 'x');
+
+        allocCounter::snapshot before = allocCounter::now();
+        for(auto _ : state){
+            switch(style){
+                case callStyle::LIST:
+                    g_logger->log({name, " : ", line}, "");
+                    break;
+                case callStyle::FORMATTED:
+                    LOG_DEBUG(*g_logger, "{} : {}", name, line);
+                    break;
+                case callStyle::TRACE:
+                    LOG_TRACE(*g_logger, "{} : {}", name, line);
+                    benchmark::ClobberMemory();
+                    break;
+            }
+        }
+        allocCounter::snapshot after = allocCounter::now();
+        state.SetItemsProcessed(state.iterations());
+
+        if(state.thread_index() == 0){
+            // Counted process-wide, so this covers the writer thread and every logging thread
+            state.counters["allocs/op"] = benchmark::Counter(after.allocations - before.allocations, benchmark::Counter::kAvgIterations);
+            state.counters["dropped"] = g_logger->dropped();
+            g_logger.reset();
+            std::remove(kLogFile.c_str());
+        }
+    }
+};
+
+static void BM_LoggerSynchronous(benchmark::State &state)
+{
+    run_logger(state, Logger::Location::TEXT_FILE, Logger::Mode::SYNCHRONOUS, callStyle::LIST);
+}
+BENCHMARK(BM_LoggerSynchronous)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_LoggerAsynchronous(benchmark::State &state)
+{
+    run_logger(state, Logger::Location::TEXT_FILE, Logger::Mode::ASYNCHRONOUS, callStyle::LIST);
+}
+BENCHMARK(BM_LoggerAsynchronous)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_LoggerFormattedText(benchmark::State &state)
+{
+    run_logger(state, Logger::Location::TEXT_FILE, Logger::Mode::ASYNCHRONOUS, callStyle::FORMATTED);
+}
+BENCHMARK(BM_LoggerFormattedText)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_LoggerFormattedBinary(benchmark::State &state)
+{
+    run_logger(state, Logger::Location::BINARY_FILE, Logger::Mode::ASYNCHRONOUS, callStyle::FORMATTED);
+}
+BENCHMARK(BM_LoggerFormattedBinary)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_LoggerBelowLevel(benchmark::State &state)
+{
+    run_logger(state, Logger::Location::BINARY_FILE, Logger::Mode::ASYNCHRONOUS, callStyle::TRACE);
+}
+BENCHMARK(BM_LoggerBelowLevel)->UseRealTime();
@@ -0,0 +1,198 @@
+#ifndef LOOPBACK_SERVER_H
+#define LOOPBACK_SERVER_H
+
+#include "../networkLibrary/networkLibrary.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+/**
+ * @brief Benchmark fixture running an asyncServer on loopback with many connected clients.
+ *
+ * The server runs on its own thread. Every client completes the username handshake and
+ * then drains whatever the server sends, counting the bytes it receives. Stalled clients
+ * complete the handshake but never read again.
+ */
+class loopbackServer
+{
+private:
+    /**
+     * @brief A raw client that discards everything it reads.
+     */
+    struct drainClient
+    {
+        boost::asio::ip::tcp::socket m_socket;   ///< Connection to the server.
+        std::array<char, 64 * 1024> m_buffer;    ///< Scratch buffer for reads.
+
+        explicit drainClient(boost::asio::io_context &io_context)
+            : m_socket(io_context)
+        {
+        }
+    };
+
+    std::vector<std::unique_ptr<boost::asio::io_context>> m_server_io; ///< IO contexts of the server.
+    std::unique_ptr<networkLibrary::Server::asyncServer> m_server; ///< The server under test.
+    std::vector<std::thread> m_server_threads; ///< Threads running the server, one per IO context.
+
+    boost::asio::io_context m_client_io; ///< IO context shared by all clients.
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_client_work; ///< Keeps the client thread alive.
+    std::vector<std::unique_ptr<drainClient>> m_clients; ///< Connected clients.
+    std::vector<std::unique_ptr<drainClient>> m_stalled; ///< Connected clients that never read.
+    std::thread m_client_thread; ///< Thread running the clients.
+
+    std::atomic<std::uint64_t> m_received; ///< Bytes received by all clients.
+    bool m_recycle_handlers; ///< Whether the clients allocate their reads like the server does.
+
+    void drain(drainClient &client)
+    {
+        client.m_socket.async_read_some(
+            boost::asio::buffer(client.m_buffer),
+            networkLibrary::make_handler(m_recycle_handlers,
+            [this, &client](boost::system::error_code ec, std::size_t size){
+                if(ec) return;
+                m_received.fetch_add(size, std::memory_order_relaxed);
+                drain(client);
+            }));
+    }
+
+public:
+    /**
+     * @brief Starts the server and connects the given number of named clients.
+     * @param sessions Number of draining client connections to open.
+     * @param stalled Number of additional clients that stop reading after the handshake.
+     * @param config Settings of the server, logging is disabled by default.
+     * @param loops Number of per-core event loops, 0 for one IO context shared by one thread.
+     */
+    explicit loopbackServer(std::size_t sessions, std::size_t stalled = 0, networkLibrary::Server::serverConfig config = quiet_config(), std::size_t loops = 0)
+        : m_client_work(boost::asio::make_work_guard(m_client_io)),
+          m_received(0),
+          m_recycle_handlers(config.recycle_handlers)
+    {
+        if(loops == 0){
+            m_server_io.push_back(std::make_unique<boost::asio::io_context>());
+            m_server = std::make_unique<networkLibrary::Server::asyncServer>(*m_server_io.front(), 0, config);
+        }
+        else{
+            std::vector<std::reference_wrapper<boost::asio::io_context>> io_contexts;
+            for(std::size_t i=0; i<loops; ++i){
+                m_server_io.push_back(std::make_unique<boost::asio::io_context>(1));
+                io_contexts.push_back(std::ref(*m_server_io.back()));
+            }
+            m_server = std::make_unique<networkLibrary::Server::asyncServer>(io_contexts, 0, config);
+        }
+        for(auto& io_context : m_server_io){
+            boost::asio::io_context* io = io_context.get();
+            m_server_threads.emplace_back([io](){ io->run(); });
+        }
+
+        boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), m_server->port());
+        for(std::size_t i=0; i<sessions + stalled; ++i){
+            auto client = std::make_unique<drainClient>(m_client_io);
+            client->m_socket.connect(endpoint);
+
+            std::string prompt;
+            boost::asio::read_until(client->m_socket, boost::asio::dynamic_buffer(prompt), '\n');
+            boost::asio::write(client->m_socket, boost::asio::buffer("bench" + std::to_string(i) + "\n"));
+            (i < sessions ? m_clients : m_stalled).push_back(std::move(client));
+        }
+        for(auto& client : m_clients) drain(*client);
+        m_client_thread = std::thread([this](){ m_client_io.run(); });
+        settle();
+    }
+
+    loopbackServer(const loopbackServer &) = delete;
+
+    ~loopbackServer()
+    {
+        m_server->stop();
+        for(auto& thread : m_server_threads) thread.join();
+        m_server.reset();
+
+        m_client_work.reset();
+        boost::asio::post(m_client_io, [this](){
+            boost::system::error_code ec;
+            for(auto& client : m_clients) client->m_socket.close(ec);
+            for(auto& client : m_stalled) client->m_socket.close(ec);
+        });
+        m_client_thread.join();
+    }
+
+    /**
+     * @brief Server settings with logging disabled, so the benchmark output stays readable.
+     */
+    static networkLibrary::Server::serverConfig quiet_config()
+    {
+        networkLibrary::Server::serverConfig config;
+        config.log_location = Logger::Location::DISABLED;
+        return config;
+    }
+
+    /**
+     * @brief The server under test.
+     */
+    networkLibrary::Server::asyncServer &server()
+    {
+        return *m_server;
+    }
+
+    /**
+     * @brief Number of draining clients connected to the server.
+     */
+    std::size_t sessions() const
+    {
+        return m_clients.size();
+    }
+
+    /**
+     * @brief Writes raw bytes to the server from one of the draining clients.
+     * @param client Index of the client, which is named "bench<client>".
+     * @param data Bytes to send, e.g. newline terminated chat lines.
+     */
+    void send(std::size_t client, const std::string &data)
+    {
+        boost::system::error_code ec;
+        boost::asio::write(m_clients[client]->m_socket, boost::asio::buffer(data), ec);
+    }
+
+    /**
+     * @brief Total bytes received by all clients so far.
+     */
+    std::uint64_t received() const
+    {
+        return m_received.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Spins until the clients have received at least the given number of bytes.
+     * @param total Total number of bytes to wait for.
+     */
+    void wait_for(std::uint64_t total) const
+    {
+        while(received() < total) std::this_thread::yield();
+    }
+
+    /**
+     * @brief Waits until the clients stop receiving data, e.g. after the join announcements.
+     */
+    void settle() const
+    {
+        std::uint64_t last = received();
+        for(int quiet = 0; quiet < 2; ){
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            std::uint64_t current = received();
+            quiet = (current == last) ? quiet + 1 : 0;
+            last = current;
+        }
+    }
+};
+
+#endif // LOOPBACK_SERVER_H
@@ -0,0 +1,43 @@
+#include <benchmark/benchmark.h>
+
+#include "../networkLibrary/metricsRegistry.h"
+
+/*
+    Metric updates
+
+    Every read and write of a session updates a few counters and histograms. Each thread adds
+    to its own shard, so the cost should stay flat as threads are added.
+*/
+
+namespace
+{
+    networkLibrary::metricsRegistry g_metrics;
+};
+
+static void BM_MetricsAdd(benchmark::State &state)
+{
+    for(auto _ : state){
+        g_metrics.add(networkLibrary::metricsRegistry::MESSAGES_OUT);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MetricsAdd)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_MetricsRecord(benchmark::State &state)
+{
+    std::uint64_t value = 1;
+    for(auto _ : state){
+        g_metrics.record(networkLibrary::metricsRegistry::HANDLER_LATENCY, value);
+        value = value * 3 + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MetricsRecord)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_MetricsRender(benchmark::State &state)
+{
+    for(auto _ : state){
+        benchmark::DoNotOptimize(g_metrics.render());
+    }
+}
+BENCHMARK(BM_MetricsRender);
@@ -0,0 +1,69 @@
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "../networkLibrary/protocol.h"
+
+/*
+    Wire format throughput
+
+    A receive buffer full of messages is split the way chatSession::process_input does it:
+    newline scanning in text mode, header decoding in binary mode. Bodies are views into
+    the buffer in both modes.
+*/
+
+namespace
+{
+    constexpr std::size_t kBufferSize = 256 * 1024;
+
+    std::string text_stream(std::size_t message_size)
+    {
+        std::string stream;
+        while(stream.size() + message_size + 1 <= kBufferSize){
+            stream.append(message_size, 'x');
+            stream += '\n';
+        }
+        return stream;
+    }
+
+    std::string binary_stream(std::size_t message_size)
+    {
+        std::string stream;
+        char header[networkLibrary::Protocol::header_size];
+        networkLibrary::Protocol::encode_header(header, networkLibrary::Protocol::frameHeader{static_cast<std::uint32_t>(message_size), networkLibrary::Protocol::MESSAGE, 0});
+        while(stream.size() + message_size + sizeof(header) <= kBufferSize){
+            stream.append(header, sizeof(header));
+            stream.append(message_size, 'x');
+        }
+        return stream;
+    }
+
+    template <typename Extract>
+    void run_extract(benchmark::State &state, const std::string &stream, Extract extract)
+    {
+        std::size_t messages = 0;
+        for(auto _ : state){
+            networkLibrary::Protocol::extracted input;
+            std::size_t offset = 0;
+            while(extract(stream.data() + offset, stream.size() - offset, 1 << 20, input) == networkLibrary::Protocol::COMPLETE){
+                benchmark::DoNotOptimize(input.body.data());
+                offset += input.consumed;
+                ++messages;
+            }
+        }
+        state.SetBytesProcessed(state.iterations() * stream.size());
+        state.counters["msgs/s"] = benchmark::Counter(messages, benchmark::Counter::kIsRate);
+    }
+}
+
+static void BM_ExtractText(benchmark::State &state)
+{
+    run_extract(state, text_stream(state.range(0)), networkLibrary::Protocol::extract_line);
+}
+BENCHMARK(BM_ExtractText)->Arg(32)->Arg(256)->Arg(4096);
+
+static void BM_ExtractBinary(benchmark::State &state)
+{
+    run_extract(state, binary_stream(state.range(0)), networkLibrary::Protocol::extract_frame);
+}
+BENCHMARK(BM_ExtractBinary)->Arg(32)->Arg(256)->Arg(4096);
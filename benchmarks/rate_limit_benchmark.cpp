@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "loopbackServer.h"
+
+/*
+    Noisy neighbour
+
+    One client floods the lobby with chat lines as fast as the server reads them while a
+    quiet client sends one line at a time and waits for its own broadcast to come back, next
+    to the fixture's draining clients. Without limits the flood fills the read handlers and
+    every outbound queue ahead of the quiet line; with a per-session message rate the flooder's
+    reads stop and TCP holds the flood back in its socket buffers.
+*/
+
+namespace
+{
+    /**
+     * @brief A raw named connection on loopback.
+     */
+    int connect_named(unsigned int port, const std::string &name)
+    {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+            if(fd >= 0) ::close(fd);
+            return -1;
+        }
+        std::string line = name + "\n";
+        ::send(fd, line.data(), line.size(), MSG_NOSIGNAL);
+        return fd;
+    }
+
+    /**
+     * @brief Sends lines as fast as the connection takes them and discards what comes back.
+     */
+    class flooder
+    {
+    private:
+        int m_fd;
+        std::atomic<bool> m_stop;
+        std::thread m_writer;
+        std::thread m_reader;
+
+    public:
+        explicit flooder(unsigned int port)
+            : m_fd(connect_named(port, "flood")),
+              m_stop(false)
+        {
+            m_writer = std::thread([this](){
+                std::string chunk;
+                for(int i=0; i<1024; ++i) chunk += std::string(63, 'x') + "\n";
+                while(!m_stop.load(std::memory_order_relaxed)){
+                    if(::send(m_fd, chunk.data(), chunk.size(), MSG_NOSIGNAL) < 0) break;
+                }
+            });
+            m_reader = std::thread([this](){
+                char buffer[64 * 1024];
+                while(::recv(m_fd, buffer, sizeof(buffer), 0) > 0){
+                }
+            });
+        }
+
+        ~flooder()
+        {
+            m_stop = true;
+            ::shutdown(m_fd, SHUT_RDWR);
+            m_writer.join();
+            m_reader.join();
+            ::close(m_fd);
+        }
+    };
+
+    /**
+     * @brief Reads until the given line arrives, skipping everything before it.
+     * @return False if it did not arrive within a second.
+     */
+    bool wait_for_line(int fd, std::string &pending, const std::string &line)
+    {
+        char buffer[64 * 1024];
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while(true){
+            std::size_t found = pending.find(line);
+            if(found != std::string::npos){
+                pending.erase(0, found + line.size());
+                return true;
+            }
+            // Keep only what may be the start of the line
+            if(pending.size() > line.size()) pending.erase(0, pending.size() - line.size());
+
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            pollfd waiting{fd, POLLIN, 0};
+            if(left.count() <= 0 || ::poll(&waiting, 1, left.count()) <= 0) return false;
+            ssize_t size = ::recv(fd, buffer, sizeof(buffer), 0);
+            if(size <= 0) return false;
+            pending.append(buffer, size);
+        }
+    }
+};
+
+static void BM_NoisyNeighbour(benchmark::State &state)
+{
+    networkLibrary::Server::serverConfig config = loopbackServer::quiet_config();
+    config.history_size = 0;
+    if(state.range(0)) config.session_message_rate = 1000;
+
+    loopbackServer fixture(16, 0, config);
+    int probe = connect_named(fixture.server().port(), "probe");
+    std::string pending;
+    wait_for_line(probe, pending, "probe joined the Server\n");
+
+    auto in_before = fixture.server().metrics().read().m_counters[networkLibrary::metricsRegistry::MESSAGES_IN];
+    auto started = std::chrono::steady_clock::now();
+    flooder noise(fixture.server().port());
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::vector<double> latencies;
+    std::size_t lost = 0;
+    std::uint64_t sequence = 0;
+    for(auto _ : state){
+        std::string line = "p" + std::to_string(++sequence) + "\n";
+        auto sent = std::chrono::steady_clock::now();
+        ::send(probe, line.data(), line.size(), MSG_NOSIGNAL);
+        if(!wait_for_line(probe, pending, "probe : " + line)) ++lost;
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - sent).count();
+        latencies.push_back(elapsed);
+        state.SetIterationTime(elapsed);
+    }
+
+    auto in_after = fixture.server().metrics().read().m_counters[networkLibrary::metricsRegistry::MESSAGES_IN];
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::sort(latencies.begin(), latencies.end());
+    state.counters["p99_us"] = latencies.empty() ? 0 : 1e6 * latencies[latencies.size() * 99 / 100];
+    state.counters["flood_lines/s"] = (in_after - in_before) / seconds;
+    state.counters["lost"] = lost;
+    ::close(probe);
+}
+BENCHMARK(BM_NoisyNeighbour)
+    ->Arg(0)
+    ->Arg(1)
+    ->Iterations(200)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,213 @@
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "../networkLibrary/sessionRegistry.h"
+
+/*
+    Session registry contention
+
+    Every thread plays the part of an io thread: it mostly broadcasts (iterates all sessions)
+    and now and then a client connects or disconnects. The sharded registry is compared with
+    the former std::set guarded by one server mutex. Snapshot only takes the snapshot every
+    broadcast starts with, which pins the thread and shares no reference count or lock.
+
+    Churn runs only joins and leaves against a registry already holding N sessions, which
+    shows how a membership change scales with N; the former copy-on-write registry, which
+    copied a whole shard on every change, is kept here for comparison.
+*/
+
+namespace
+{
+    struct dummySession
+    {
+        std::size_t m_id;
+    };
+
+    constexpr std::size_t kSessions = 4096;
+    constexpr std::size_t kChurnEvery = 64; ///< One membership change per this many broadcasts.
+
+    /**
+     * @brief The former registry: a std::set under a single mutex held for the whole fan-out.
+     */
+    class lockedSet
+    {
+    private:
+        std::mutex m_mutex;
+        std::set<std::shared_ptr<dummySession>> m_sessions;
+
+    public:
+        void insert(const std::shared_ptr<dummySession> &session)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_sessions.insert(session);
+        }
+
+        void erase(const std::shared_ptr<dummySession> &session)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_sessions.erase(session);
+        }
+
+        template <typename Fn>
+        void for_each(Fn &&fn)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(auto const& session : m_sessions) fn(session);
+        }
+    };
+
+    /**
+     * @brief The former registry: every change copies its shard's vector and publishes the copy.
+     */
+    class copyOnWrite
+    {
+    private:
+        using members = std::vector<std::shared_ptr<dummySession>>;
+        struct alignas(64) shard
+        {
+            std::mutex m_mutex;
+            std::shared_ptr<const members> m_members = std::make_shared<const members>();
+        };
+        std::array<shard, 16> m_shards;
+
+        shard &shard_of(const dummySession *session)
+        {
+            return m_shards[(std::hash<const dummySession*>()(session) >> 4) % 16];
+        }
+
+    public:
+        void insert(const std::shared_ptr<dummySession> &session)
+        {
+            shard& sh = shard_of(session.get());
+            std::lock_guard<std::mutex> lock(sh.m_mutex);
+            auto next = std::make_shared<members>(*sh.m_members);
+            next->push_back(session);
+            std::atomic_store(&sh.m_members, std::shared_ptr<const members>(std::move(next)));
+        }
+
+        void erase(const std::shared_ptr<dummySession> &session)
+        {
+            shard& sh = shard_of(session.get());
+            std::lock_guard<std::mutex> lock(sh.m_mutex);
+            auto next = std::make_shared<members>();
+            for(auto const& member : *sh.m_members){
+                if(member != session) next->push_back(member);
+            }
+            std::atomic_store(&sh.m_members, std::shared_ptr<const members>(std::move(next)));
+        }
+    };
+
+    template <typename Registry>
+    Registry &shared_registry()
+    {
+        static Registry registry;
+        static std::once_flag filled;
+        std::call_once(filled, [](){
+            for(std::size_t i=0; i<kSessions; ++i) registry.insert(std::make_shared<dummySession>(dummySession{i}));
+        });
+        return registry;
+    }
+
+    template <typename Registry>
+    void run_contention(benchmark::State &state)
+    {
+        Registry& registry = shared_registry<Registry>();
+        auto own = std::make_shared<dummySession>(dummySession{kSessions + std::size_t(state.thread_index())});
+        bool joined = false;
+        std::size_t round = 0;
+
+        for(auto _ : state){
+            if(++round % kChurnEvery == 0){
+                if(joined) registry.erase(own);
+                else registry.insert(own);
+                joined = !joined;
+            }
+            std::size_t sum = 0;
+            registry.for_each([&sum](const std::shared_ptr<dummySession> &session){
+                sum += session->m_id;
+            });
+            benchmark::DoNotOptimize(sum);
+        }
+        if(joined) registry.erase(own);
+        state.SetItemsProcessed(state.iterations());
+    }
+};
+
+static void BM_RegistryLockedSet(benchmark::State &state)
+{
+    run_contention<lockedSet>(state);
+}
+BENCHMARK(BM_RegistryLockedSet)->ThreadRange(1, 32)->UseRealTime();
+
+static void BM_RegistrySharded(benchmark::State &state)
+{
+    run_contention<networkLibrary::sessionRegistry<dummySession>>(state);
+}
+BENCHMARK(BM_RegistrySharded)->ThreadRange(1, 32)->UseRealTime();
+
+static void BM_RegistrySnapshot(benchmark::State &state)
+{
+    // Only the snapshot a broadcast starts with, taken by every thread at once
+    auto& registry = shared_registry<networkLibrary::sessionRegistry<dummySession>>();
+    for(auto _ : state){
+        auto snap = registry.view();
+        benchmark::DoNotOptimize(snap);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RegistrySnapshot)->ThreadRange(1, 32)->UseRealTime();
+
+namespace
+{
+    /**
+     * @brief A registry holding a given number of sessions, filled once and shared by the threads.
+     */
+    template <typename Registry>
+    Registry &filled_registry(std::size_t sessions)
+    {
+        static std::mutex mutex;
+        static std::map<std::size_t, std::unique_ptr<Registry>> registries;
+        static std::vector<std::shared_ptr<dummySession>> members;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& registry = registries[sessions];
+        if(!registry){
+            registry = std::make_unique<Registry>();
+            for(std::size_t i=0; i<sessions; ++i){
+                members.push_back(std::make_shared<dummySession>(dummySession{i}));
+                registry->insert(members.back());
+            }
+        }
+        return *registry;
+    }
+
+    template <typename Registry>
+    void run_churn(benchmark::State &state)
+    {
+        Registry& registry = filled_registry<Registry>(state.range(0));
+        auto own = std::make_shared<dummySession>(dummySession{std::size_t(state.range(0)) + std::size_t(state.thread_index())});
+        for(auto _ : state){
+            registry.insert(own);
+            registry.erase(own);
+        }
+        // One join and one leave per iteration
+        state.SetItemsProcessed(2 * state.iterations());
+    }
+};
+
+static void BM_RegistryChurnCopyOnWrite(benchmark::State &state)
+{
+    run_churn<copyOnWrite>(state);
+}
+BENCHMARK(BM_RegistryChurnCopyOnWrite)->ArgName("sessions")->Arg(1000)->Arg(10000)->Arg(100000)->Threads(16)->UseRealTime();
+
+static void BM_RegistryChurn(benchmark::State &state)
+{
+    run_churn<networkLibrary::sessionRegistry<dummySession>>(state);
+}
+BENCHMARK(BM_RegistryChurn)->ArgName("sessions")->Arg(1000)->Arg(10000)->Arg(100000)->Threads(16)->UseRealTime();
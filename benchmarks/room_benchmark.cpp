@@ -0,0 +1,74 @@
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "../networkLibrary/roomIndex.h"
+#include "loopbackServer.h"
+
+/*
+    Room fan-out
+
+    The connected sessions are split into rooms of equal size and one client talks in its room.
+    Only the room's members receive the line, so the time per message should follow the room
+    size and stay flat as the total number of connections grows.
+*/
+
+static void BM_RoomFanOut(benchmark::State &state)
+{
+    loopbackServer fixture(state.range(0));
+    const std::size_t room_size = state.range(1);
+    const std::string line = std::string(128, 'x') + "\n";
+    const std::uint64_t per_message = (std::string("bench0 : ").size() + line.size()) * room_size;
+
+    for(std::size_t i=0; i<fixture.sessions(); ++i){
+        fixture.send(i, "\\join {room" + std::to_string(i / room_size) + "}\n");
+    }
+    fixture.settle();
+
+    std::uint64_t expected = fixture.received();
+    for(auto _ : state){
+        fixture.send(0, line);
+        expected += per_message;
+        fixture.wait_for(expected);
+    }
+
+    state.counters["sessions"] = fixture.sessions();
+    state.counters["room_size"] = room_size;
+    state.SetBytesProcessed(state.iterations() * per_message);
+}
+BENCHMARK(BM_RoomFanOut)
+    ->ArgsProduct({{256, 1024}, {1, 16, 256}})
+    ->UseRealTime();
+
+/*
+    Room churn
+
+    A session joins a room nobody is in and leaves it again, so every iteration creates and
+    tears down a room, with members partitioned over the given number of event loops.
+*/
+
+namespace
+{
+    struct dummySession
+    {
+        std::size_t m_id;
+    };
+};
+
+static void BM_RoomCreateTeardown(benchmark::State &state)
+{
+    networkLibrary::roomIndex<dummySession> rooms(state.range(0));
+    for(int i=0; i<1024; ++i) rooms.join("busy" + std::to_string(i), 0, std::make_shared<dummySession>(dummySession{std::size_t(i)}));
+
+    auto session = std::make_shared<dummySession>(dummySession{0});
+    const std::string name = "room";
+    for(auto _ : state){
+        auto room = rooms.join(name, 0, session);
+        rooms.leave(room, 0, session);
+    }
+
+    state.counters["loops"] = state.range(0);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RoomCreateTeardown)->Arg(1)->Arg(8);
@@ -0,0 +1,120 @@
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "allocCounter.h"
+#include "loopbackServer.h"
+
+/*
+    Line parsing
+
+    asyncServer::parse splits a "name : message" line, copying both halves out character by
+    character.
+*/
+
+static void BM_ParseLine(benchmark::State &state)
+{
+    const std::string line = "bench0 : " + std::string(state.range(0), 'x') + "\n";
+
+    allocCounter::snapshot before = allocCounter::now();
+    for(auto _ : state){
+        std::string input = line;
+        auto parsed = networkLibrary::Server::asyncServer::parse(input);
+        benchmark::DoNotOptimize(parsed);
+    }
+    allocCounter::snapshot after = allocCounter::now();
+
+    state.counters["allocs/op"] = benchmark::Counter(after.allocations - before.allocations, benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(state.iterations() * line.size());
+}
+BENCHMARK(BM_ParseLine)->Arg(16)->Arg(128)->Arg(1024);
+
+/*
+    Command lookup
+
+    Parsing a command line and finding its handler in the command table, without running it.
+    Neither step allocates and every command costs about the same.
+*/
+
+namespace
+{
+    const char* const kLookupLines[] = {
+        "\\help",
+        "\\quit",
+        "\\name_change {someone}",
+        "\\msg {bench0}{hello there}",
+        "\\unknown"
+    };
+};
+
+static void BM_CommandLookup(benchmark::State &state)
+{
+    networkLibrary::commandTable<void(*)(const networkLibrary::commandCall &)> table;
+    for(auto name : {"help", "list", "name_change", "msg", "join", "leave", "rooms", "stats", "quit"}){
+        table.add(name, "", "", [](const networkLibrary::commandCall &call){ benchmark::DoNotOptimize(call.m_argc); });
+    }
+    const std::string line = kLookupLines[state.range(0)];
+
+    allocCounter::snapshot before = allocCounter::now();
+    for(auto _ : state){
+        networkLibrary::commandCall call;
+        networkLibrary::commandCall::parse(line, call);
+        auto command = table.find(call.m_name);
+        if(command) command->m_handler(call);
+        benchmark::DoNotOptimize(command);
+    }
+    allocCounter::snapshot after = allocCounter::now();
+
+    state.SetLabel(line);
+    state.counters["allocs/op"] = benchmark::Counter(after.allocations - before.allocations, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_CommandLookup)->DenseRange(0, 4);
+
+/*
+    Command dispatch
+
+    A client sends one line and waits for every byte the server sends back because of it, so
+    each iteration covers reading the line, matching it against the commands, running the
+    command and writing the reply. The reply size is measured once before timing.
+*/
+
+namespace
+{
+    const char* const kCommands[] = {
+        "hello everyone\n",
+        "\\help\n",
+        "\\list\n",
+        "\\rooms\n",
+        "\\msg {bench0}{hello there}\n",
+        "\\unknown\n"
+    };
+
+    const char* const kCommandNames[] = {"chat", "help", "list", "rooms", "msg", "unknown"};
+};
+
+static void BM_CommandDispatch(benchmark::State &state)
+{
+    loopbackServer fixture(state.range(1));
+    const std::string line = kCommands[state.range(0)];
+
+    std::uint64_t start = fixture.received();
+    fixture.send(0, line);
+    fixture.settle();
+    const std::uint64_t per_command = fixture.received() - start;
+
+    std::uint64_t expected = fixture.received();
+    allocCounter::snapshot before = allocCounter::now();
+    for(auto _ : state){
+        fixture.send(0, line);
+        expected += per_command;
+        fixture.wait_for(expected);
+    }
+    allocCounter::snapshot after = allocCounter::now();
+
+    state.SetLabel(kCommandNames[state.range(0)]);
+    state.counters["allocs/op"] = benchmark::Counter(after.allocations - before.allocations, benchmark::Counter::kAvgIterations);
+    state.counters["reply_bytes"] = per_command;
+}
+BENCHMARK(BM_CommandDispatch)
+    ->ArgsProduct({{0, 1, 2, 3, 4, 5}, {1, 256}})
+    ->UseRealTime();
@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../networkLibrary/networkLibrary.h"
+
+/*
+    Session timers
+
+    Every session has one intrusive timer in its loop's timing wheel, re-armed only when it
+    fires: a read just stores the time. The wheel benchmarks use 100k timers spread like idle
+    sessions with a 30 s heartbeat on 100 ms ticks; the idle session benchmark runs a server
+    with real loopback connections that never send anything, as many as the open file limit
+    allows, and reports the server thread's CPU use and heap memory per session. When the
+    limit keeps it below the count asked for, the CPU use at that count is extrapolated
+    linearly from the sessions it could open, and labelled as such. Once measured, every
+    session is left to time out, which must close all of them.
+*/
+
+namespace
+{
+    constexpr std::uint64_t kHeartbeatTicks = 300; ///< 30 s heartbeat on 100 ms ticks.
+
+    /**
+     * @brief Stands in for a session: its timer and the tick of its last read.
+     */
+    struct idleSession
+    {
+        networkLibrary::timingWheel<idleSession>::timer m_timer;
+        std::uint64_t m_last_input = 0;
+    };
+
+    using wheel = networkLibrary::timingWheel<idleSession>;
+
+    /**
+     * @brief Arms every session at a random point of its heartbeat interval.
+     */
+    void arm_spread(wheel &timers, std::vector<idleSession> &sessions)
+    {
+        std::mt19937 random(42);
+        for(auto& session : sessions){
+            session.m_last_input = 1 + random() % kHeartbeatTicks;
+            timers.arm(session.m_timer, session, session.m_last_input);
+        }
+    }
+
+    /**
+     * @brief Heap bytes in use by the process, freed memory kept by malloc excluded.
+     */
+    std::int64_t heap_in_use()
+    {
+        struct mallinfo2 info = mallinfo2();
+        return static_cast<std::int64_t>(info.uordblks + info.hblkhd);
+    }
+
+    /**
+     * @brief CPU time used so far by a thread.
+     */
+    std::chrono::nanoseconds thread_cpu(std::thread &thread)
+    {
+        clockid_t clock;
+        timespec ts{};
+        if(pthread_getcpuclockid(thread.native_handle(), &clock) == 0) clock_gettime(clock, &ts);
+        return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+    }
+
+    /**
+     * @brief Raises the open file limit for a number of loopback connections, as far as allowed.
+     * @return How many connections fit, the client's and the server's end each taking a descriptor.
+     */
+    std::size_t raise_file_limit(std::size_t connections)
+    {
+        // Some to spare for the server's own descriptors
+        constexpr rlim_t spare = 64;
+        const rlim_t wanted = 2 * connections + spare;
+        rlimit limit{};
+        if(::getrlimit(RLIMIT_NOFILE, &limit) != 0) return connections;
+        if(limit.rlim_cur < wanted){
+            // Raising the hard limit needs privileges, without them the soft one goes up to it
+            rlimit raised{wanted, std::max(wanted, limit.rlim_max)};
+            if(::setrlimit(RLIMIT_NOFILE, &raised) != 0){
+                limit.rlim_cur = std::min(wanted, limit.rlim_max);
+                ::setrlimit(RLIMIT_NOFILE, &limit);
+            }
+            ::getrlimit(RLIMIT_NOFILE, &limit);
+        }
+        return limit.rlim_cur >= wanted ? connections : static_cast<std::size_t>((limit.rlim_cur - std::min(limit.rlim_cur, spare)) / 2);
+    }
+
+    /**
+     * @brief Connects a raw client from one of the loopback addresses 127.0.0.1 and up.
+     * @details One source address runs out of ephemeral ports at about 28k connections to the
+     * same server port, so every 16k clients take the next one.
+     * @return The socket, -1 if it could not connect.
+     */
+    int connect_idle(std::uint16_t port, std::size_t index)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0) return -1;
+        sockaddr_in source{};
+        source.sin_family = AF_INET;
+        source.sin_addr.s_addr = htonl(INADDR_LOOPBACK + static_cast<std::uint32_t>(index / 16384));
+        int one = 1;
+        // The port is picked at connect, unique per destination instead of per source address
+        ::setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(::bind(fd, reinterpret_cast<sockaddr*>(&source), sizeof(source)) != 0
+           || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+};
+
+static void BM_WheelArmCancel(benchmark::State &state)
+{
+    wheel timers;
+    std::vector<idleSession> sessions(state.range(0));
+    arm_spread(timers, sessions);
+
+    // What a connect and a disconnect cost, among a full wheel
+    std::size_t next = 0;
+    for(auto _ : state){
+        idleSession& session = sessions[next];
+        timers.cancel(session.m_timer);
+        timers.arm(session.m_timer, session, 1 + next % kHeartbeatTicks);
+        if(++next == sessions.size()) next = 0;
+    }
+    state.counters["timers"] = timers.size();
+    state.counters["bytes/timer"] = sizeof(wheel::timer) + static_cast<double>(sizeof(wheel)) / sessions.size();
+}
+BENCHMARK(BM_WheelArmCancel)->Arg(1000)->Arg(100000);
+
+static void BM_WheelTick(benchmark::State &state)
+{
+    auto timers = std::make_unique<wheel>();
+    std::vector<idleSession> sessions(state.range(0));
+    arm_spread(*timers, sessions);
+
+    // Idle sessions: every fired timer sends its heartbeat and is armed for the next one
+    std::uint64_t fired = 0;
+    for(auto _ : state){
+        timers->advance(timers->now() + 1, [&timers, &fired](idleSession &session){
+            ++fired;
+            timers->arm(session.m_timer, session, kHeartbeatTicks - (timers->now() - session.m_last_input) % kHeartbeatTicks);
+        });
+    }
+    state.counters["timers"] = timers->size();
+    state.counters["fired/tick"] = benchmark::Counter(fired, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_WheelTick)->Arg(1000)->Arg(100000);
+
+static void BM_IdleSessions(benchmark::State &state)
+{
+    const std::size_t count = state.range(0);
+    // Long enough to connect every client and measure before the first one times out
+    const auto timeout = std::chrono::seconds(5) + std::chrono::microseconds(100) * count;
+    networkLibrary::Server::serverConfig config;
+    config.log_location = Logger::Location::DISABLED;
+    config.history_size = 0;
+    if(state.range(1)){
+        // Sessions past the handshake with a heartbeat every second
+        config.handshake_timeout = std::chrono::milliseconds(0);
+        config.heartbeat_interval = std::chrono::seconds(1);
+        config.idle_timeout = std::chrono::duration_cast<std::chrono::milliseconds>(timeout);
+    }
+    else{
+        // Clients that never send a username, waiting for the handshake timeout
+        config.handshake_timeout = std::chrono::duration_cast<std::chrono::milliseconds>(timeout);
+    }
+    // Past the limit the clients would take the descriptors the server needs to accept them
+    const std::size_t fit = raise_file_limit(count);
+
+    boost::asio::io_context io_context(1);
+    auto server = std::make_unique<networkLibrary::Server::asyncServer>(io_context, 0, config);
+    std::thread thread([&io_context](){ io_context.run(); });
+
+    // Raw sockets, so the clients add nothing to the process's heap
+    std::vector<int> clients;
+    clients.reserve(fit);
+    std::int64_t heap = heap_in_use();
+    for(std::size_t i=0; i<fit; ++i){
+        int fd = connect_idle(server->port(), i);
+        if(fd < 0) break;
+        clients.push_back(fd);
+    }
+    while(server->session_count() < clients.size()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::int64_t heap_per_session = clients.empty() ? 0 : (heap_in_use() - heap) / static_cast<std::int64_t>(clients.size());
+
+    std::chrono::nanoseconds cpu(0);
+    for(auto _ : state){
+        auto before = thread_cpu(thread);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        cpu += thread_cpu(thread) - before;
+    }
+
+    auto timed_out = [&server](){
+        return server->metrics().read().m_counters[networkLibrary::metricsRegistry::CONNECTIONS_TIMED_OUT];
+    };
+    const bool early = timed_out() != 0;
+    // Every session must be closed by its timer, not much later than it is due
+    auto deadline = std::chrono::steady_clock::now() + timeout + std::chrono::seconds(5);
+    while(timed_out() < clients.size() && std::chrono::steady_clock::now() < deadline){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    const double cpu_percent = 100.0 * cpu.count() / (state.iterations() * 1e9);
+    state.counters["sessions"] = clients.size();
+    state.counters["server_cpu_%"] = cpu_percent;
+    state.counters["heap_bytes/session"] = heap_per_session;
+    state.counters["timed_out"] = timed_out();
+    if(clients.size() < count && !clients.empty()){
+        // Both grow with the sessions, one timer and one socket each
+        state.counters["server_cpu_%_extrapolated"] = cpu_percent * count / clients.size();
+        state.SetLabel("limited by the open file limit, CPU use at " + std::to_string(count)
+                       + " sessions extrapolated from " + std::to_string(clients.size()));
+    }
+    if(early) state.SkipWithError("sessions timed out before the measurement ended");
+    else if(timed_out() != clients.size()) state.SkipWithError("not every idle session timed out");
+
+    server->stop();
+    thread.join();
+    server.reset();
+    for(int fd : clients) ::close(fd);
+}
+BENCHMARK(BM_IdleSessions)
+    ->ArgsProduct({{1000, 8000, 100000}, {0, 1}})
+    ->Iterations(3)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
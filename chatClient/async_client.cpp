@@ -1,6 +1,12 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <thread>
+#include <stdexcept>
+#include <utility>
 #include <boost/asio.hpp>
 
 #include "../networkLibrary/networkLibrary.h"
@@ -9,30 +15,74 @@
 int main(int argc, char* argv[]){
     std::string IPAddress;
     unsigned int port;
+    networkLibrary::Client::clientConfig config;
+    std::string script;
+    bool quiet = false;
     try{
-        if(argc != 3) throw;
+        if(argc < 3) throw std::invalid_argument("address");
         IPAddress = argv[1];
         port = stoi(std::string(argv[2]));
+        for(int i=3; i<argc; ++i){
+            std::string option = argv[i];
+            if(option == "--binary") config.binary_protocol = true;
+            else if(option == "--compress") config.compression = true;
+            else if(option == "--script" && i + 1 < argc) script = argv[++i];
+            else if(option == "--quiet") quiet = true;
+            else throw std::invalid_argument(option);
+        }
     }
     catch(...){
         std::cout << "Incorrect Format" << std::endl;
-        std::cout << "Required - <Client> <Server-IPAddress> <Server-Port>" << std::endl;
+        std::cout << "Required - <Client> <Server-IPAddress> <Server-Port> [--binary] [--compress] [--script <File|->] [--quiet]" << std::endl;
         return 0;
     }
+    if(quiet){
+        config.print_status = false;
+        config.on_message = [](std::string_view){};
+    }
+
+    if(!networkLibrary::ioBackend::ensure_usable(argv)) return 1;
+
+    std::ifstream script_file;
+    if(!script.empty() && script != "-"){
+        script_file.open(script);
+        if(!script_file){
+            std::cout << "Cannot open script " << script << std::endl;
+            return 0;
+        }
+    }
+    // Unsynchronised streams read a piped script much faster; nothing has been printed yet
+    if(!script.empty()) std::ios::sync_with_stdio(false);
 
     boost::asio::io_context clt_io_context;
-    networkLibrary::Client::asyncClient client(clt_io_context, IPAddress, port);
+    networkLibrary::Client::asyncClient client(clt_io_context, IPAddress, port, config);
     
     std::thread t([&clt_io_context](){
         clt_io_context.run();
     });
 
     std::string clt_input;
-    while(std::getline(std::cin, clt_input)){
-        if(!client.write(clt_input)) break;
+    if(script.empty()){
+        while(std::getline(std::cin, clt_input)){
+            if(!client.write(clt_input)) break;
+        }
+        t.join();
+        return 0;
     }
 
+    // Scripted: stream every line at full speed, then leave once all of them are written
+    std::istream& input = script_file.is_open() ? static_cast<std::istream&>(script_file) : std::cin;
+    std::size_t lines = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while(std::getline(input, clt_input)){
+        ++lines;
+        if(!client.write(clt_input)) break;
+    }
+    client.close_when_flushed();
     t.join();
 
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cerr << "Sent " << lines << " lines in " << seconds << " s (" << static_cast<std::uint64_t>(lines / std::max(seconds, 1e-9)) << " lines/s)" << std::endl;
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <boost/asio.hpp>
+
+#include "../networkLibrary/networkLibrary.h"
+
+/*
+    Chat Load Generator
+
+    Opens many asyncClient connections from one process, spread over a few IO threads. Every
+    client completes the username handshake (and joins its room), then a subset of them sends
+    chat lines at a fixed aggregate rate. Each line carries the time it was scheduled to be
+    sent, so every copy the server delivers yields one end-to-end broadcast latency sample.
+    Latency is measured from the scheduled send time, not the actual one, so a stalled sender
+    does not hide the delay it causes.
+*/
+
+namespace
+{
+    using steadyClock = std::chrono::steady_clock;
+
+    constexpr std::string_view kTag = "lg "; ///< Prefix of the lines sent by the generator.
+
+    /**
+     * @brief Settings of a load run, taken from the command line.
+     */
+    struct loadConfig
+    {
+        std::string m_ip;
+        unsigned int m_port = 0;
+        std::size_t m_clients = 1000;   ///< Connections to open.
+        std::size_t m_threads = 2;      ///< IO threads running the connections.
+        std::size_t m_senders = 100;    ///< Connections that send, the others only receive.
+        double m_rate = 200;            ///< Chat lines per second, summed over all senders.
+        std::vector<std::size_t> m_sizes = {128}; ///< Line sizes, each line picks one at random.
+        std::size_t m_rooms = 1;        ///< Rooms the clients are spread over, 1 keeps everyone in the lobby.
+        double m_warmup = 2;            ///< Seconds of sending before samples are kept.
+        double m_duration = 10;         ///< Seconds over which samples are kept.
+        double m_connect_timeout = 30;  ///< Seconds allowed for every client to become ready.
+        bool m_binary = false;          ///< Negotiate the binary protocol.
+        bool m_compress = false;        ///< Negotiate compressed frames, implies the binary protocol.
+    };
+
+    /**
+     * @brief Log-linear latency histogram with 64 sub-buckets per power of two, below 2% error.
+     */
+    class latencyHistogram
+    {
+    private:
+        static constexpr int kSubBits = 6;
+        static constexpr int kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+        std::vector<std::uint64_t> m_counts;
+        std::uint64_t m_total;
+        std::uint64_t m_max;
+
+        static int bucket_of(std::uint64_t value)
+        {
+            if(value < (1u << kSubBits)) return static_cast<int>(value);
+            int msb = 63 - __builtin_clzll(value);
+            int shift = msb - kSubBits;
+            return ((shift + 1) << kSubBits) | static_cast<int>((value >> shift) & ((1u << kSubBits) - 1));
+        }
+
+        static std::uint64_t value_of(int bucket)
+        {
+            int group = bucket >> kSubBits;
+            std::uint64_t sub = bucket & ((1u << kSubBits) - 1);
+            if(group == 0) return sub;
+            // Upper end of the bucket, so percentiles never understate
+            int shift = group - 1;
+            return (((1ull << kSubBits) | sub) << shift) + ((1ull << shift) - 1);
+        }
+
+    public:
+        latencyHistogram()
+            : m_counts(kBuckets, 0),
+              m_total(0),
+              m_max(0)
+        {
+        }
+
+        void record(std::uint64_t value)
+        {
+            ++m_counts[bucket_of(value)];
+            ++m_total;
+            m_max = std::max(m_max, value);
+        }
+
+        void merge(const latencyHistogram &other)
+        {
+            for(int i=0; i<kBuckets; ++i) m_counts[i] += other.m_counts[i];
+            m_total += other.m_total;
+            m_max = std::max(m_max, other.m_max);
+        }
+
+        std::uint64_t total() const
+        {
+            return m_total;
+        }
+
+        std::uint64_t max() const
+        {
+            return m_max;
+        }
+
+        /**
+         * @brief Smallest recorded value not exceeded by the given fraction of the samples.
+         */
+        std::uint64_t percentile(double fraction) const
+        {
+            if(m_total == 0) return 0;
+            std::uint64_t rank = static_cast<std::uint64_t>(fraction * m_total);
+            if(rank >= m_total) rank = m_total - 1;
+            std::uint64_t seen = 0;
+            for(int i=0; i<kBuckets; ++i){
+                seen += m_counts[i];
+                if(seen > rank) return std::min(value_of(i), m_max);
+            }
+            return m_max;
+        }
+    };
+
+    /**
+     * @brief Samples and counters of the clients of one IO thread; only touched by that thread.
+     */
+    struct threadStats
+    {
+        latencyHistogram m_latency;     ///< Latency of the copies sent inside the window, in nanoseconds.
+        std::uint64_t m_delivered = 0;  ///< Copies received of lines sent inside the window.
+        std::uint64_t m_sent = 0;       ///< Lines sent inside the window.
+    };
+
+    /**
+     * @brief State shared by all clients of a run.
+     */
+    struct loadRun
+    {
+        loadConfig m_config;
+        std::uint32_t m_id;                     ///< Random run ID, lines of other runs are ignored.
+        std::atomic<std::size_t> m_ready{0};    ///< Clients that completed the handshake.
+        steadyClock::time_point m_start;        ///< When the senders start.
+        steadyClock::time_point m_window_begin; ///< Start of the measured window.
+        steadyClock::time_point m_window_end;   ///< End of the measured window, senders stop here.
+    };
+
+    /**
+     * @brief One connection, driven by the messages it receives from the server.
+     */
+    class loadClient
+    {
+    private:
+        enum class stage { CONNECTING, NAMING, JOINING, READY };
+
+        loadRun &m_run;
+        threadStats &m_stats;
+        const std::size_t m_index;
+        const std::string m_name;
+        const std::string m_room;
+        stage m_stage;
+        boost::asio::steady_timer m_timer;
+        std::mt19937 m_random;
+        std::unique_ptr<networkLibrary::Client::asyncClient> m_client;
+
+        void on_message(std::string_view message)
+        {
+            switch(m_stage){
+                case stage::CONNECTING:
+                    // The first message is the username prompt
+                    m_stage = stage::NAMING;
+                    send(m_name);
+                    break;
+                case stage::NAMING:
+                    if(message != m_name + " joined the Server") break;
+                    if(m_room.empty()) ready();
+                    else{
+                        m_stage = stage::JOINING;
+                        send("\\join {" + m_room + "}");
+                    }
+                    break;
+                case stage::JOINING:
+                    if(message == m_name + " joined room " + m_room) ready();
+                    break;
+                case stage::READY:
+                    sample(message);
+                    break;
+            }
+        }
+
+        void ready()
+        {
+            m_stage = stage::READY;
+            m_run.m_ready.fetch_add(1, std::memory_order_release);
+        }
+
+        void send(std::string line)
+        {
+            m_client->write(line);
+        }
+
+        /**
+         * @brief Records the latency of a received generator line.
+         */
+        void sample(std::string_view message)
+        {
+            // "<name> : lg <run> <sender> <scheduled ns> <padding>"
+            std::size_t pos = message.find(" : ");
+            if(pos == std::string_view::npos) return;
+            message.remove_prefix(pos + 3);
+            if(message.substr(0, kTag.size()) != kTag) return;
+            message.remove_prefix(kTag.size());
+
+            std::uint32_t run = 0;
+            std::size_t sender = 0;
+            std::int64_t scheduled = 0;
+            const char* first = message.data();
+            const char* last = message.data() + message.size();
+            auto res = std::from_chars(first, last, run);
+            if(res.ec != std::errc() || run != m_run.m_id || res.ptr == last) return;
+            res = std::from_chars(res.ptr + 1, last, sender);
+            if(res.ec != std::errc() || res.ptr == last) return;
+            res = std::from_chars(res.ptr + 1, last, scheduled);
+            if(res.ec != std::errc()) return;
+
+            steadyClock::time_point sent_at{steadyClock::duration(scheduled)};
+            if(sent_at < m_run.m_window_begin || sent_at >= m_run.m_window_end) return;
+            auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(steadyClock::now() - sent_at).count();
+            m_stats.m_latency.record(latency < 0 ? 0 : static_cast<std::uint64_t>(latency));
+            ++m_stats.m_delivered;
+        }
+
+        /**
+         * @brief Sends the line scheduled for the timer's expiry and schedules the next one.
+         */
+        void send_next(steadyClock::duration interval)
+        {
+            m_timer.async_wait([this, interval](boost::system::error_code ec){
+                if(ec) return;
+                steadyClock::time_point scheduled = m_timer.expiry();
+                if(scheduled >= m_run.m_window_end) return;
+
+                const auto& sizes = m_run.m_config.m_sizes;
+                std::size_t size = sizes[m_random() % sizes.size()];
+                std::string line = std::string(kTag) + std::to_string(m_run.m_id) + ' ' + std::to_string(m_index) + ' '
+                                 + std::to_string(scheduled.time_since_epoch().count()) + ' ';
+                if(line.size() < size) line.append(size - line.size(), 'x');
+                send(std::move(line));
+                if(scheduled >= m_run.m_window_begin) ++m_stats.m_sent;
+
+                // Scheduled on absolute times, so a late wakeup does not shift the following lines
+                m_timer.expires_at(scheduled + interval);
+                send_next(interval);
+            });
+        }
+
+    public:
+        loadClient(boost::asio::io_context &io_context, loadRun &run, threadStats &stats, std::size_t index)
+            : m_run(run),
+              m_stats(stats),
+              m_index(index),
+              m_name("lg" + std::to_string(run.m_id) + "_" + std::to_string(index)),
+              m_room(run.m_config.m_rooms > 1 ? "load" + std::to_string(index % run.m_config.m_rooms) : ""),
+              m_stage(stage::CONNECTING),
+              m_timer(io_context),
+              m_random(static_cast<std::uint32_t>(run.m_id + index))
+        {
+            networkLibrary::Client::clientConfig config;
+            config.binary_protocol = run.m_config.m_binary;
+            config.compression = run.m_config.m_compress;
+            config.print_status = false;
+            config.on_message = [this](std::string_view message){ on_message(message); };
+            m_client = std::make_unique<networkLibrary::Client::asyncClient>(io_context, run.m_config.m_ip, run.m_config.m_port, config);
+        }
+
+        /**
+         * @brief Starts sending at the given interval, from a random phase after the start.
+         */
+        void start(steadyClock::duration interval)
+        {
+            boost::asio::post(m_timer.get_executor(), [this, interval](){
+                auto phase = std::chrono::duration_cast<steadyClock::duration>(interval * std::uniform_real_distribution<double>(0, 1)(m_random));
+                m_timer.expires_at(m_run.m_start + phase);
+                send_next(interval);
+            });
+        }
+    };
+
+    std::vector<std::size_t> parse_sizes(const std::string &list)
+    {
+        std::vector<std::size_t> sizes;
+        std::stringstream ss(list);
+        std::string item;
+        while(std::getline(ss, item, ',')) sizes.push_back(std::stoul(item));
+        if(sizes.empty()) throw std::invalid_argument(list);
+        return sizes;
+    }
+
+    /**
+     * @brief Raises the descriptor limit to the hard limit, every client needs one.
+     */
+    void raise_descriptor_limit()
+    {
+        rlimit limit;
+        if(getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    double to_us(std::uint64_t ns)
+    {
+        return ns / 1000.0;
+    }
+};
+
+int main(int argc, char* argv[]){
+    loadRun run;
+    loadConfig& config = run.m_config;
+    try{
+        if(argc < 3) throw std::invalid_argument("address");
+        config.m_ip = argv[1];
+        config.m_port = stoi(std::string(argv[2]));
+        for(int i=3; i<argc; ++i){
+            std::string option = argv[i];
+            if(option == "--binary"){
+                config.m_binary = true;
+                continue;
+            }
+            if(option == "--compress"){
+                config.m_binary = config.m_compress = true;
+                continue;
+            }
+            if(i + 1 >= argc) throw std::invalid_argument(option);
+            std::string value = argv[++i];
+            if(option == "--clients") config.m_clients = std::stoul(value);
+            else if(option == "--threads") config.m_threads = std::stoul(value);
+            else if(option == "--senders") config.m_senders = std::stoul(value);
+            else if(option == "--rate") config.m_rate = std::stod(value);
+            else if(option == "--sizes") config.m_sizes = parse_sizes(value);
+            else if(option == "--rooms") config.m_rooms = std::stoul(value);
+            else if(option == "--warmup") config.m_warmup = std::stod(value);
+            else if(option == "--duration") config.m_duration = std::stod(value);
+            else if(option == "--connect-timeout") config.m_connect_timeout = std::stod(value);
+            else throw std::invalid_argument(option);
+        }
+        if(config.m_clients == 0 || config.m_threads == 0 || config.m_rate <= 0 || config.m_duration <= 0 || config.m_rooms == 0) throw std::invalid_argument("range");
+        config.m_senders = std::min(std::max<std::size_t>(config.m_senders, 1), config.m_clients);
+    }
+    catch(...){
+        std::cout << "Incorrect Format" << std::endl;
+        std::cout << "Required - <Load Generator> <Server-IPAddress> <Server-Port> [--clients N] [--threads N] [--senders N]" << std::endl;
+        std::cout << "           [--rate Lines/sec] [--sizes Bytes,...] [--rooms N] [--warmup Sec] [--duration Sec]" << std::endl;
+        std::cout << "           [--connect-timeout Sec] [--binary] [--compress]" << std::endl;
+        return 0;
+    }
+
+    if(!networkLibrary::ioBackend::ensure_usable(argv)) return 1;
+
+    raise_descriptor_limit();
+    run.m_id = std::random_device()() % 1000000000u;
+
+    /* Connect */
+    // Declared before the clients, which must be destroyed first
+    std::vector<std::unique_ptr<boost::asio::io_context>> io_contexts;
+    std::vector<threadStats> stats(config.m_threads);
+    for(std::size_t i=0; i<config.m_threads; ++i) io_contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+
+    std::vector<std::unique_ptr<loadClient>> clients;
+    clients.reserve(config.m_clients);
+    auto connect_begin = steadyClock::now();
+    try{
+        for(std::size_t i=0; i<config.m_clients; ++i){
+            std::size_t t = i % config.m_threads;
+            clients.push_back(std::make_unique<loadClient>(*io_contexts[t], run, stats[t], i));
+        }
+    }
+    catch(std::exception &e){
+        std::cout << "Cannot connect to " << config.m_ip << ":" << config.m_port << " : " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<std::thread> threads;
+    for(auto& io_context : io_contexts){
+        threads.emplace_back([&io_context](){
+            auto work = boost::asio::make_work_guard(*io_context);
+            io_context->run();
+        });
+    }
+
+    auto connect_deadline = connect_begin + std::chrono::duration_cast<steadyClock::duration>(std::chrono::duration<double>(config.m_connect_timeout));
+    while(run.m_ready.load(std::memory_order_acquire) < config.m_clients && steadyClock::now() < connect_deadline){
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::size_t ready = run.m_ready.load(std::memory_order_acquire);
+    double connect_seconds = std::chrono::duration<double>(steadyClock::now() - connect_begin).count();
+    std::cout << ready << "/" << config.m_clients << " clients ready in " << connect_seconds << " s" << std::endl;
+
+    int status = 0;
+    if(ready < config.m_clients){
+        std::cout << "Not every client completed the handshake, aborting" << std::endl;
+        status = 1;
+    }
+    else{
+        /* Send */
+        auto seconds = [](double s){ return std::chrono::duration_cast<steadyClock::duration>(std::chrono::duration<double>(s)); };
+        run.m_start = steadyClock::now() + std::chrono::milliseconds(100);
+        run.m_window_begin = run.m_start + seconds(config.m_warmup);
+        run.m_window_end = run.m_window_begin + seconds(config.m_duration);
+
+        // Senders are spread evenly over the clients, and so over the IO threads
+        steadyClock::duration interval = seconds(config.m_senders / config.m_rate);
+        for(std::size_t s=0; s<config.m_senders; ++s) clients[s * config.m_clients / config.m_senders]->start(interval);
+
+        std::this_thread::sleep_until(run.m_window_end + std::chrono::seconds(1));
+    }
+
+    /* Report */
+    for(auto& io_context : io_contexts) io_context->stop();
+    for(auto& t : threads) t.join();
+    if(status != 0) return status;
+
+    latencyHistogram latency;
+    std::uint64_t sent = 0, delivered = 0;
+    for(auto const& st : stats){
+        latency.merge(st.m_latency);
+        sent += st.m_sent;
+        delivered += st.m_delivered;
+    }
+
+    std::string sizes;
+    for(auto size : config.m_sizes) sizes += (sizes.empty() ? "" : ",") + std::to_string(size);
+    std::printf("clients %zu  threads %zu  senders %zu  rooms %zu  rate %.0f/s  sizes %s  %s\n",
+                config.m_clients, config.m_threads, config.m_senders, config.m_rooms, config.m_rate, sizes.c_str(), config.m_compress ? "binary+deflate" : config.m_binary ? "binary" : "text");
+    std::printf("sent %llu  delivered %llu  delivered/sec %.0f\n",
+                static_cast<unsigned long long>(sent), static_cast<unsigned long long>(delivered), delivered / config.m_duration);
+    std::printf("latency us  p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+                to_us(latency.percentile(0.50)), to_us(latency.percentile(0.99)), to_us(latency.percentile(0.999)), to_us(latency.max()));
+    return 0;
+}
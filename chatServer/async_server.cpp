@@ -1,30 +1,118 @@
 #include <iostream>
 #include <string>
 #include <thread>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <utility>
 #include <boost/asio.hpp>
 
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
 #include "../networkLibrary/networkLibrary.h"
 #include "../utils/Logger.h"
 
+/**
+ * @brief Pins the calling thread to one core, so a loop's sessions stay in that core's cache.
+ * @param core Index of the core.
+ */
+static void pin_to_core(std::size_t core){
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core, &cpu_set);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#endif
+}
+
 int main(int argc, char* argv[]){
     unsigned int port;
+    bool per_core = false;
+    networkLibrary::Server::serverConfig config;
     try{
-        if(argc != 2) throw;
+        if(argc < 2) throw std::invalid_argument("port");
         port = stoi(std::string(argv[1]));
+        for(int i=2; i<argc; ++i){
+            std::string option = argv[i];
+            if(option == "--per-core") per_core = true;
+            else if(option == "--history" && i + 1 < argc) config.history_directory = argv[++i];
+            else if(option == "--metrics-port" && i + 1 < argc) config.metrics_port = stoi(std::string(argv[++i]));
+            else if(option == "--batch-window" && i + 1 < argc){
+                config.batch_writes = true;
+                config.batch_window = std::chrono::microseconds(stoi(std::string(argv[++i])));
+            }
+            else if(option == "--batch-max" && i + 1 < argc) config.batch_max_messages = stoul(std::string(argv[++i]));
+            else if(option == "--no-compression") config.compression = false;
+            else if(option == "--compression-threshold" && i + 1 < argc) config.compression_threshold = stoul(std::string(argv[++i]));
+            else if(option == "--handshake-timeout" && i + 1 < argc) config.handshake_timeout = std::chrono::seconds(stoi(std::string(argv[++i])));
+            else if(option == "--heartbeat" && i + 1 < argc) config.heartbeat_interval = std::chrono::seconds(stoi(std::string(argv[++i])));
+            else if(option == "--idle-timeout" && i + 1 < argc) config.idle_timeout = std::chrono::seconds(stoi(std::string(argv[++i])));
+            else if(option == "--max-connections" && i + 1 < argc) config.max_connections = stoul(std::string(argv[++i]));
+            else if(option == "--max-per-address" && i + 1 < argc) config.max_connections_per_address = stoul(std::string(argv[++i]));
+            else if(option == "--message-rate" && i + 1 < argc) config.session_message_rate = stod(std::string(argv[++i]));
+            else if(option == "--byte-rate" && i + 1 < argc) config.session_byte_rate = stod(std::string(argv[++i]));
+            else if(option == "--address-message-rate" && i + 1 < argc) config.address_message_rate = stod(std::string(argv[++i]));
+            else if(option == "--address-byte-rate" && i + 1 < argc) config.address_byte_rate = stod(std::string(argv[++i]));
+            else if(option == "--node-id" && i + 1 < argc) config.node_id = stoull(std::string(argv[++i]));
+            else if(option == "--federation-port" && i + 1 < argc) config.federation_port = stoi(std::string(argv[++i]));
+            else if(option == "--peer" && i + 1 < argc) config.federation_peers.push_back(argv[++i]);
+            else if(option == "--handoff" && i + 1 < argc) config.handoff_path = argv[++i];
+            else throw std::invalid_argument(option);
+        }
     }
     catch(...){
         std::cout << "Incorrect Format" << std::endl;
-        std::cout << "Required - <Server> <Port>" << std::endl;
+        std::cout << "Required - <Server> <Port> [--per-core] [--history <Directory>] [--metrics-port <Port>]" << std::endl;
+        std::cout << "           [--batch-window <Microseconds>] [--batch-max <Messages>]" << std::endl;
+        std::cout << "           [--no-compression] [--compression-threshold <Bytes>]" << std::endl;
+        std::cout << "           [--handshake-timeout <Seconds>] [--heartbeat <Seconds>] [--idle-timeout <Seconds>]" << std::endl;
+        std::cout << "           [--max-connections <Sessions>] [--max-per-address <Sessions>]" << std::endl;
+        std::cout << "           [--message-rate <Per Second>] [--byte-rate <Per Second>]" << std::endl;
+        std::cout << "           [--address-message-rate <Per Second>] [--address-byte-rate <Per Second>]" << std::endl;
+        std::cout << "           [--node-id <ID>] [--federation-port <Port>] [--peer <Host:Port>]..." << std::endl;
+        std::cout << "           [--handoff <Path>]" << std::endl;
         return 0;
     }
-    
-    boost::asio::io_context io_context;
-    networkLibrary::Server::asyncServer server(io_context, port);
 
-    std::cout << "Threads Available " << std::thread::hardware_concurrency() << std::endl;
+    if(!networkLibrary::ioBackend::ensure_usable(argv)) return 1;
+    std::cout << "I/O Backend " << networkLibrary::ioBackend::name() << std::endl;
+
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "Threads Available " << threads << std::endl;
 
     std::vector<std::thread> all_threads;
-    for(std::size_t i=0; i<std::thread::hardware_concurrency(); ++i){
+
+    if(per_core){
+        // One io_context and one acceptor per core, each run by a single pinned thread
+        std::vector<std::unique_ptr<boost::asio::io_context>> io_contexts;
+        std::vector<std::reference_wrapper<boost::asio::io_context>> loops;
+        for(std::size_t i=0; i<threads; ++i){
+            io_contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+            loops.push_back(std::ref(*io_contexts.back()));
+        }
+        networkLibrary::Server::asyncServer server(loops, port, config);
+
+        for(std::size_t i=0; i<threads; ++i){
+            all_threads.emplace_back(
+                [&io_contexts, i](){
+                    pin_to_core(i);
+                    io_contexts[i]->run();
+                }
+            );
+        }
+        for(auto& my_thread : all_threads){
+            my_thread.join();
+        }
+        return 0;
+    }
+
+    boost::asio::io_context io_context;
+    networkLibrary::Server::asyncServer server(io_context, port, config);
+
+    for(std::size_t i=0; i<threads; ++i){
         all_threads.emplace_back(
             [&io_context](){
                 io_context.run();
@@ -37,4 +125,4 @@ int main(int argc, char* argv[]){
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,134 @@
+#include "admissionControl.h"
+
+/*
+    Admission Control
+*/
+
+networkLibrary::admissionControl::admissionControl(std::size_t max_connections, std::size_t max_per_address, double message_rate, double byte_rate, std::chrono::duration<double> burst)
+    : m_max_connections(max_connections),
+      m_max_per_address(max_per_address),
+      m_message_rate(message_rate),
+      m_byte_rate(byte_rate),
+      m_burst(burst),
+      m_connections(0)
+{
+}
+
+networkLibrary::admissionControl::verdict networkLibrary::admissionControl::admit(const std::string &ip, ticket &admitted)
+{
+    admitted = ticket();
+    std::size_t _open = m_connections.fetch_add(1, std::memory_order_relaxed);
+    if(m_max_connections != 0 && _open >= m_max_connections){
+        m_connections.fetch_sub(1, std::memory_order_relaxed);
+        return SERVER_FULL;
+    }
+    admitted.m_control = this;
+
+    // Without per-address limits connecting and disconnecting never take the lock
+    if(m_max_per_address == 0 && m_message_rate <= 0 && m_byte_rate <= 0) return ADMITTED;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    expire_idle(std::chrono::steady_clock::now());
+    auto _entry = m_addresses.try_emplace(ip, m_message_rate, m_byte_rate, m_burst).first;
+    if(m_max_per_address != 0 && _entry->second.m_connections >= m_max_per_address){
+        // The ticket only holds the server slot yet
+        admitted = ticket();
+        return ADDRESS_FULL;
+    }
+    ++_entry->second.m_connections;
+    admitted.m_address = &*_entry;
+    return ADMITTED;
+}
+
+void networkLibrary::admissionControl::expire_idle(std::chrono::steady_clock::time_point now)
+{
+    for(std::size_t i=0; i<expire_per_admit && !m_idle.empty(); ++i){
+        addressTable::value_type* _entry = m_idle.front();
+        m_idle.pop_front();
+        address& _address = _entry->second;
+        // Connected again, it is queued anew when that connection closes
+        if(_address.m_connections != 0){
+            _address.m_idle_queued = false;
+            continue;
+        }
+        bool _refilled;
+        {
+            std::lock_guard<std::mutex> lock(_address.m_mutex);
+            _refilled = _address.m_messages.full(now) && _address.m_bytes.full(now);
+        }
+        if(_refilled) m_addresses.erase(m_addresses.find(_entry->first));
+        else m_idle.push_back(_entry);
+    }
+}
+
+std::size_t networkLibrary::admissionControl::connections() const
+{
+    return m_connections.load(std::memory_order_relaxed);
+}
+
+/*
+    Ticket
+*/
+
+networkLibrary::admissionControl::ticket::ticket(ticket &&other)
+    : m_control(other.m_control),
+      m_address(other.m_address)
+{
+    other.m_control = nullptr;
+    other.m_address = nullptr;
+}
+
+networkLibrary::admissionControl::ticket &networkLibrary::admissionControl::ticket::operator=(ticket &&other)
+{
+    if(this != &other){
+        release();
+        m_control = other.m_control;
+        m_address = other.m_address;
+        other.m_control = nullptr;
+        other.m_address = nullptr;
+    }
+    return *this;
+}
+
+networkLibrary::admissionControl::ticket::~ticket()
+{
+    release();
+}
+
+void networkLibrary::admissionControl::ticket::release()
+{
+    if(!m_control) return;
+    if(m_address){
+        std::lock_guard<std::mutex> lock(m_control->m_mutex);
+        // The entry outlives the last connection until its buckets refill, see expire_idle()
+        address& _address = m_address->second;
+        if(--_address.m_connections == 0 && !_address.m_idle_queued){
+            _address.m_idle_queued = true;
+            m_control->m_idle.push_back(m_address);
+        }
+    }
+    m_control->m_connections.fetch_sub(1, std::memory_order_relaxed);
+    m_control = nullptr;
+    m_address = nullptr;
+}
+
+bool networkLibrary::admissionControl::ticket::take(std::size_t bytes, std::chrono::steady_clock::time_point now)
+{
+    if(!m_address) return true;
+    address& _address = m_address->second;
+    if(!_address.m_messages.limited() && !_address.m_bytes.limited()) return true;
+
+    std::lock_guard<std::mutex> lock(_address.m_mutex);
+    if(!_address.m_messages.ready(now) || !_address.m_bytes.ready(now)) return false;
+    _address.m_messages.take(1);
+    _address.m_bytes.take(bytes);
+    return true;
+}
+
+std::chrono::steady_clock::duration networkLibrary::admissionControl::ticket::wait(std::chrono::steady_clock::time_point now)
+{
+    if(!m_address) return std::chrono::steady_clock::duration::zero();
+    address& _address = m_address->second;
+    std::lock_guard<std::mutex> lock(_address.m_mutex);
+    return std::max(_address.m_messages.wait(now), _address.m_bytes.wait(now));
+}
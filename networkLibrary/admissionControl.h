@@ -0,0 +1,242 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace networkLibrary
+{
+    /**
+     * @brief A token bucket limiting a rate, refilled from the elapsed time whenever it is checked.
+     *
+     * The bucket holds at most a burst of tokens and gains rate tokens per second. Anything
+     * passes while a whole token is left and takes its full cost, which may leave the bucket
+     * in debt: a message larger than the burst still passes and is paid off afterwards.
+     * A rate of 0 means no limit.
+     */
+    class tokenBucket;
+
+    /**
+     * @brief Decides which connections a server admits and limits what each client address sends.
+     *
+     * Counts the open connections of the server and, when per-address limits are set, those
+     * of every client address, whose token buckets are shared by all its sessions. Every
+     * admitted connection holds a ticket, which gives its slots back when destroyed.
+     *
+     * An address keeps its buckets after its last connection closes, until they have refilled,
+     * so reconnecting does not hand out a fresh burst. Idle addresses are expired by admit().
+     */
+    class admissionControl;
+};
+
+class networkLibrary::tokenBucket
+{
+private:
+    double m_rate;   ///< Tokens added per second, 0 for no limit.
+    double m_burst;  ///< Most tokens the bucket holds.
+    double m_tokens; ///< Tokens left, negative while a cost larger than the balance is paid off.
+    std::chrono::steady_clock::time_point m_updated; ///< Time the tokens were last refilled.
+
+    /**
+     * @brief Adds the tokens earned since the last refill.
+     */
+    void refill(std::chrono::steady_clock::time_point now)
+    {
+        if(now <= m_updated) return;
+        m_tokens = std::min(m_burst, m_tokens + m_rate * std::chrono::duration<double>(now - m_updated).count());
+        m_updated = now;
+    }
+
+public:
+    /**
+     * @brief Constructs a full bucket.
+     * @param rate Tokens added per second, 0 for no limit.
+     * @param burst Time at the full rate the bucket holds, at least one token.
+     */
+    explicit tokenBucket(double rate = 0, std::chrono::duration<double> burst = std::chrono::seconds(1))
+        : m_rate(rate),
+          m_burst(std::max(1.0, rate * burst.count())),
+          m_tokens(m_burst),
+          m_updated(std::chrono::steady_clock::now())
+    {
+    }
+
+    /**
+     * @brief Whether the bucket limits anything.
+     */
+    bool limited() const
+    {
+        return m_rate > 0;
+    }
+
+    /**
+     * @brief Whether a whole token is left.
+     */
+    bool ready(std::chrono::steady_clock::time_point now)
+    {
+        if(!limited()) return true;
+        refill(now);
+        return m_tokens >= 1;
+    }
+
+    /**
+     * @brief Takes tokens, possibly leaving the bucket in debt; ready() decides whether to.
+     */
+    void take(double cost)
+    {
+        if(limited()) m_tokens -= cost;
+    }
+
+    /**
+     * @brief Whether the bucket has refilled to its burst, so a new one would be no different.
+     */
+    bool full(std::chrono::steady_clock::time_point now)
+    {
+        if(!limited()) return true;
+        refill(now);
+        return m_tokens >= m_burst;
+    }
+
+    /**
+     * @brief Time until a whole token is left, zero if one is.
+     */
+    std::chrono::steady_clock::duration wait(std::chrono::steady_clock::time_point now)
+    {
+        if(ready(now)) return std::chrono::steady_clock::duration::zero();
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((1 - m_tokens) / m_rate));
+    }
+};
+
+class networkLibrary::admissionControl
+{
+public:
+    /**
+     * @brief Outcome of a connection attempt.
+     */
+    enum verdict {
+        ADMITTED,       ///< The connection holds a ticket.
+        SERVER_FULL,    ///< The server has as many connections as it admits.
+        ADDRESS_FULL    ///< The client address has as many connections as it may open.
+    };
+
+private:
+    /**
+     * @brief Open connections and shared token buckets of one client address.
+     */
+    struct address
+    {
+        std::size_t m_connections; ///< Open connections from the address, guarded by the control's mutex.
+        bool m_idle_queued;        ///< Whether the address is in the idle queue, guarded by the control's mutex.
+        std::mutex m_mutex;        ///< Guards the buckets.
+        tokenBucket m_messages;    ///< Lines or frames all sessions of the address may send.
+        tokenBucket m_bytes;       ///< Bytes all sessions of the address may send.
+
+        address(double message_rate, double byte_rate, std::chrono::duration<double> burst)
+            : m_connections(0),
+              m_idle_queued(false),
+              m_messages(message_rate, burst),
+              m_bytes(byte_rate, burst)
+        {
+        }
+    };
+
+    using addressTable = std::unordered_map<std::string, address>;
+
+    const std::size_t m_max_connections;             ///< Connections admitted at once, 0 for no limit.
+    const std::size_t m_max_per_address;             ///< Connections admitted at once from one address, 0 for no limit.
+    const double m_message_rate;                     ///< Lines or frames per second of one address, 0 for no limit.
+    const double m_byte_rate;                        ///< Bytes per second of one address, 0 for no limit.
+    const std::chrono::duration<double> m_burst;     ///< Time at the full rate an address's buckets hold.
+    std::atomic<std::size_t> m_connections;          ///< Connections holding a ticket.
+    std::mutex m_mutex;                              ///< Guards the address table and the idle queue.
+    addressTable m_addresses;                        ///< Addresses with open connections or buckets not yet refilled, only kept with per-address limits.
+    std::deque<addressTable::value_type*> m_idle;    ///< Addresses whose last connection closed, oldest first.
+
+    static constexpr std::size_t expire_per_admit = 2; ///< Idle addresses admit() looks at, so expiring stays O(1).
+
+    /**
+     * @brief Forgets idle addresses whose buckets have refilled; m_mutex must be held.
+     */
+    void expire_idle(std::chrono::steady_clock::time_point now);
+
+public:
+    /**
+     * @brief An admitted connection's hold on its slots, given back when destroyed.
+     */
+    class ticket
+    {
+    private:
+        admissionControl* m_control = nullptr;       ///< The issuing control, nullptr for an empty ticket.
+        addressTable::value_type* m_address = nullptr; ///< Entry of the client address, nullptr without per-address limits.
+
+        friend class networkLibrary::admissionControl;
+
+        /**
+         * @brief Gives the slots back.
+         */
+        void release();
+
+    public:
+        ticket() = default;
+        ticket(const ticket &) = delete;
+        ticket &operator=(const ticket &) = delete;
+        ticket(ticket &&other);
+        ticket &operator=(ticket &&other);
+        ~ticket();
+
+        /**
+         * @brief Whether the ticket admits a connection.
+         */
+        explicit operator bool() const
+        {
+            return m_control != nullptr;
+        }
+
+        /**
+         * @brief Charges one message to the address's buckets if both have a token left.
+         * @param bytes Size of the message.
+         * @param now The current time.
+         * @return False if a bucket is empty, in which case nothing is taken.
+         */
+        bool take(std::size_t bytes, std::chrono::steady_clock::time_point now);
+
+        /**
+         * @brief Time until both of the address's buckets have a token left.
+         */
+        std::chrono::steady_clock::duration wait(std::chrono::steady_clock::time_point now);
+    };
+
+    /**
+     * @brief Constructs the control; a limit of 0 disables it.
+     * @param max_connections Connections admitted at once.
+     * @param max_per_address Connections admitted at once from one client address.
+     * @param message_rate Lines or frames per second all sessions of one address may send.
+     * @param byte_rate Bytes per second all sessions of one address may send.
+     * @param burst Time at the full rate an address may send at once.
+     */
+    admissionControl(std::size_t max_connections, std::size_t max_per_address, double message_rate, double byte_rate, std::chrono::duration<double> burst);
+
+    admissionControl(const admissionControl &) = delete;
+    admissionControl &operator=(const admissionControl &) = delete;
+
+    /**
+     * @brief Admits a connection if neither the server nor its address is full.
+     * @param ip Client address of the connection.
+     * @param[out] admitted The connection's ticket, left empty unless admitted.
+     * @return Whether the connection was admitted, or why not.
+     */
+    verdict admit(const std::string &ip, ticket &admitted);
+
+    /**
+     * @brief Number of connections holding a ticket.
+     */
+    std::size_t connections() const;
+};
+
+#endif // ADMISSION_CONTROL_H
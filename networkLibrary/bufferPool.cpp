@@ -0,0 +1,226 @@
+#include "bufferPool.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace
+{
+    constexpr std::size_t kClasses = 11;                // 64 B ... 64 KiB
+    constexpr std::size_t kSlabSize = 256 * 1024;       // Bytes carved per slab refill
+    constexpr std::size_t kCacheBytes = 512 * 1024;     // Bytes a thread may keep per size class
+
+    struct freeBlock
+    {
+        freeBlock* next;
+    };
+
+    std::size_t class_of(std::size_t size)
+    {
+        std::size_t index = 0;
+        std::size_t block = networkLibrary::bufferPool::min_block_size;
+        while(block < size){
+            block <<= 1;
+            ++index;
+        }
+        return index;
+    }
+
+    std::size_t class_size(std::size_t index)
+    {
+        return networkLibrary::bufferPool::min_block_size << index;
+    }
+
+    /*
+        Shared free lists, one per size class. Slabs are never returned to the heap.
+    */
+    class globalPool
+    {
+    private:
+        struct alignas(64) sizeClass
+        {
+            std::mutex m_mutex;
+            freeBlock* m_free = nullptr;
+        };
+
+        std::array<sizeClass, kClasses> m_classes;
+
+    public:
+        // Hands out up to count blocks as a linked list
+        freeBlock* take(std::size_t index, std::size_t count, std::size_t& taken)
+        {
+            sizeClass& sc = m_classes[index];
+            std::lock_guard<std::mutex> lock(sc.m_mutex);
+            if(sc.m_free == nullptr){
+                const std::size_t block = class_size(index);
+                const std::size_t blocks = std::max<std::size_t>(kSlabSize / block, 4);
+                char* slab = static_cast<char*>(::operator new(blocks * block));
+                for(std::size_t i=0; i<blocks; ++i){
+                    freeBlock* fb = reinterpret_cast<freeBlock*>(slab + i * block);
+                    fb->next = sc.m_free;
+                    sc.m_free = fb;
+                }
+            }
+
+            freeBlock* head = sc.m_free;
+            freeBlock* tail = head;
+            taken = 1;
+            while(taken < count && tail->next != nullptr){
+                tail = tail->next;
+                ++taken;
+            }
+            sc.m_free = tail->next;
+            tail->next = nullptr;
+            return head;
+        }
+
+        void give(std::size_t index, freeBlock* head, freeBlock* tail)
+        {
+            sizeClass& sc = m_classes[index];
+            std::lock_guard<std::mutex> lock(sc.m_mutex);
+            tail->next = sc.m_free;
+            sc.m_free = head;
+        }
+    };
+
+    globalPool& global()
+    {
+        // Leaked on purpose, messages may still be released during static destruction
+        static globalPool* pool = new globalPool;
+        return *pool;
+    }
+
+    /*
+        Per thread cache of free blocks, refilled from and flushed to the global pool in batches
+    */
+    class threadCache
+    {
+    private:
+        std::array<freeBlock*, kClasses> m_free{};
+        std::array<std::size_t, kClasses> m_count{};
+
+        static std::size_t limit(std::size_t index)
+        {
+            return std::clamp<std::size_t>(kCacheBytes / class_size(index), 8, 1024);
+        }
+
+    public:
+        ~threadCache()
+        {
+            for(std::size_t index=0; index<kClasses; ++index){
+                if(m_free[index] == nullptr) continue;
+                freeBlock* tail = m_free[index];
+                while(tail->next != nullptr) tail = tail->next;
+                global().give(index, m_free[index], tail);
+            }
+        }
+
+        void* pop(std::size_t index)
+        {
+            if(m_free[index] == nullptr){
+                m_free[index] = global().take(index, limit(index) / 2, m_count[index]);
+            }
+            freeBlock* fb = m_free[index];
+            m_free[index] = fb->next;
+            --m_count[index];
+            return fb;
+        }
+
+        void push(std::size_t index, void* block)
+        {
+            freeBlock* fb = static_cast<freeBlock*>(block);
+            fb->next = m_free[index];
+            m_free[index] = fb;
+
+            if(++m_count[index] < limit(index)) return;
+
+            // Keep half, hand the rest back so threads that only allocate can reuse it
+            std::size_t keep = limit(index) / 2;
+            freeBlock* last = m_free[index];
+            for(std::size_t i=1; i<keep; ++i) last = last->next;
+            freeBlock* head = last->next;
+            freeBlock* tail = head;
+            while(tail->next != nullptr) tail = tail->next;
+            last->next = nullptr;
+            m_count[index] = keep;
+            global().give(index, head, tail);
+        }
+    };
+
+    threadCache& cache()
+    {
+        thread_local threadCache tc;
+        return tc;
+    }
+};
+
+/*
+    Buffer Pool
+*/
+
+void* networkLibrary::bufferPool::allocate(std::size_t size)
+{
+    if(size > max_block_size) return ::operator new(size);
+    return cache().pop(class_of(size));
+}
+
+void networkLibrary::bufferPool::deallocate(void* block, std::size_t size) noexcept
+{
+    if(block == nullptr) return;
+    if(size > max_block_size){
+        ::operator delete(block);
+        return;
+    }
+    cache().push(class_of(size), block);
+}
+
+std::size_t networkLibrary::bufferPool::block_size(std::size_t size)
+{
+    if(size > max_block_size) return size;
+    return class_size(class_of(size));
+}
+
+/*
+    Pooled Buffer
+*/
+
+networkLibrary::pooledBuffer::pooledBuffer(std::size_t size)
+    : m_data(static_cast<char*>(bufferPool::allocate(size))),
+      m_size(bufferPool::block_size(size))
+{
+
+}
+
+networkLibrary::pooledBuffer::pooledBuffer(pooledBuffer&& other) noexcept
+    : m_data(other.m_data),
+      m_size(other.m_size)
+{
+    other.m_data = nullptr;
+    other.m_size = 0;
+}
+
+networkLibrary::pooledBuffer& networkLibrary::pooledBuffer::operator=(pooledBuffer&& other) noexcept
+{
+    if(this != &other){
+        bufferPool::deallocate(m_data, m_size);
+        m_data = other.m_data;
+        m_size = other.m_size;
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+    return *this;
+}
+
+networkLibrary::pooledBuffer::~pooledBuffer()
+{
+    bufferPool::deallocate(m_data, m_size);
+}
+
+void networkLibrary::pooledBuffer::resize(std::size_t size, std::size_t keep)
+{
+    pooledBuffer grown(size);
+    std::memcpy(grown.m_data, m_data, std::min(keep, std::min(m_size, grown.m_size)));
+    *this = std::move(grown);
+}
@@ -0,0 +1,87 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+
+namespace networkLibrary
+{
+    /**
+     * @brief A process-wide slab pool of power-of-two sized memory blocks.
+     *
+     * Blocks are carved from large slabs and recycled through a small cache per thread,
+     * so in steady state allocating and freeing a block neither calls the heap nor takes
+     * a lock. A block may be freed on a different thread than the one that allocated it.
+     * Requests larger than the biggest size class go straight to the heap.
+     */
+    class bufferPool;
+
+    /**
+     * @brief A growable byte buffer whose storage is drawn from the bufferPool.
+     */
+    class pooledBuffer;
+};
+
+class networkLibrary::bufferPool
+{
+public:
+    static constexpr std::size_t min_block_size = 64;           ///< Size of the smallest size class.
+    static constexpr std::size_t max_block_size = 64 * 1024;    ///< Size of the largest size class.
+
+    bufferPool() = delete;
+
+    /**
+     * @brief Allocates a block of at least the given size.
+     * @param size Number of bytes required.
+     * @return Pointer to the block, aligned for any fundamental type.
+     */
+    static void* allocate(std::size_t size);
+
+    /**
+     * @brief Returns a block to the pool.
+     * @param block Pointer returned by allocate().
+     * @param size The size that was passed to allocate().
+     */
+    static void deallocate(void* block, std::size_t size) noexcept;
+
+    /**
+     * @brief The usable size of the block allocate() returns for the given size.
+     */
+    static std::size_t block_size(std::size_t size);
+};
+
+class networkLibrary::pooledBuffer
+{
+private:
+    char* m_data;       ///< Pooled storage, or nullptr when empty.
+    std::size_t m_size; ///< Usable size of the storage.
+
+public:
+    /**
+     * @brief Creates a buffer of at least the given size.
+     */
+    explicit pooledBuffer(std::size_t size);
+
+    pooledBuffer(const pooledBuffer &) = delete;
+    pooledBuffer &operator=(const pooledBuffer &) = delete;
+
+    pooledBuffer(pooledBuffer &&other) noexcept;
+    pooledBuffer &operator=(pooledBuffer &&other) noexcept;
+
+    /**
+     * @brief Returns the storage to the pool.
+     */
+    ~pooledBuffer();
+
+    /**
+     * @brief Moves the contents into a block of at least the given size.
+     * @param size New minimum size of the buffer, may be smaller than the current one.
+     * @param keep Number of leading bytes to preserve.
+     */
+    void resize(std::size_t size, std::size_t keep);
+
+    char* data() { return m_data; }
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+};
+
+#endif // BUFFER_POOL_H
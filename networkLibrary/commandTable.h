@@ -0,0 +1,169 @@
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace networkLibrary
+{
+    /**
+     * @brief A parsed "\name {arg}{arg}" command line; every part points into the line.
+     */
+    struct commandCall;
+
+    /**
+     * @brief Hash of a command name, usable in constant expressions (32 bit FNV-1a).
+     */
+    constexpr std::uint32_t command_hash(std::string_view name)
+    {
+        std::uint32_t h = 2166136261u;
+        for(char c : name){
+            h ^= static_cast<unsigned char>(c);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    /**
+     * @brief A registry of named commands with constant-time lookup.
+     *
+     * Commands live in a fixed-size open addressed table indexed by command_hash(), kept at
+     * most half full, so finding any command costs one hash of its name and, almost always,
+     * one comparison. Lookups never allocate. Commands are registered before the server
+     * starts, built-in ones first; registering is not safe while commands are looked up.
+     *
+     * @tparam Handler Callable run for a command.
+     * @tparam Capacity Number of slots, a power of two; at most half of them hold commands.
+     */
+    template <typename Handler, std::size_t Capacity = 64>
+    class commandTable;
+};
+
+struct networkLibrary::commandCall
+{
+    static constexpr std::size_t max_args = 4; ///< Brace groups kept; further ones are ignored.
+
+    std::string_view m_name;    ///< Command name without the backslash, e.g. "msg".
+    std::string_view m_rest;    ///< Everything after the name.
+    std::array<std::string_view, max_args> m_args; ///< Contents of the brace groups, in order.
+    std::size_t m_argc = 0;     ///< Number of brace groups found.
+
+    /**
+     * @brief Contents of a brace group, empty if the line has fewer groups.
+     */
+    std::string_view arg(std::size_t i) const
+    {
+        return i < m_argc ? m_args[i] : std::string_view();
+    }
+
+    /**
+     * @brief Splits a command line into its name and brace groups.
+     *
+     * The name ends at the first space or brace. An unclosed group runs to the end of the line.
+     * @param line The line, starting with a backslash.
+     * @param[out] call The parsed command.
+     * @return False if the line is not a command.
+     */
+    static bool parse(std::string_view line, commandCall &call)
+    {
+        if(line.empty() || line.front() != '\\') return false;
+        line.remove_prefix(1);
+
+        std::size_t end = line.find_first_of(" {");
+        if(end == std::string_view::npos) end = line.size();
+        call.m_name = line.substr(0, end);
+        call.m_rest = line.substr(end);
+        call.m_argc = 0;
+
+        std::string_view rest = call.m_rest;
+        while(call.m_argc < max_args){
+            std::size_t open = rest.find('{');
+            if(open == std::string_view::npos) break;
+            std::size_t close = rest.find('}', open + 1);
+            if(close == std::string_view::npos) close = rest.size();
+            call.m_args[call.m_argc++] = rest.substr(open + 1, close - open - 1);
+            if(close == rest.size()) break;
+            rest.remove_prefix(close + 1);
+        }
+        return true;
+    }
+};
+
+template <typename Handler, std::size_t Capacity>
+class networkLibrary::commandTable
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    /**
+     * @brief A registered command.
+     */
+    struct command
+    {
+        std::string m_name;         ///< Name without the backslash.
+        std::string m_usage;        ///< Arguments as shown by \help, e.g. "{name}{text}".
+        std::string m_description;  ///< One line description for \help.
+        Handler m_handler;          ///< Run when the command is received.
+    };
+
+private:
+    static constexpr std::uint16_t empty = 0xFFFF; ///< Marks an unused slot.
+
+    std::vector<command> m_commands;                ///< Commands in registration order.
+    std::array<std::uint16_t, Capacity> m_slots;    ///< Index into m_commands per slot.
+
+public:
+    commandTable()
+    {
+        m_slots.fill(empty);
+        m_commands.reserve(Capacity / 2);
+    }
+
+    commandTable(const commandTable &) = delete;
+    commandTable &operator=(const commandTable &) = delete;
+
+    /**
+     * @brief Registers a command.
+     * @return False if a command of that name exists or the table is full.
+     */
+    bool add(std::string name, std::string usage, std::string description, Handler handler)
+    {
+        if(m_commands.size() >= Capacity / 2 || find(name)) return false;
+
+        std::size_t slot = command_hash(name) & (Capacity - 1);
+        while(m_slots[slot] != empty) slot = (slot + 1) & (Capacity - 1);
+        m_slots[slot] = static_cast<std::uint16_t>(m_commands.size());
+        m_commands.push_back(command{std::move(name), std::move(usage), std::move(description), std::move(handler)});
+        return true;
+    }
+
+    /**
+     * @brief Finds a command by name.
+     * @return The command, or nullptr if there is none of that name.
+     */
+    const command *find(std::string_view name) const
+    {
+        std::size_t slot = command_hash(name) & (Capacity - 1);
+        while(m_slots[slot] != empty){
+            const command& cmd = m_commands[m_slots[slot]];
+            if(cmd.m_name == name) return &cmd;
+            slot = (slot + 1) & (Capacity - 1);
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Every command, in registration order.
+     */
+    const std::vector<command> &commands() const
+    {
+        return m_commands;
+    }
+};
+
+#endif // COMMAND_TABLE_H
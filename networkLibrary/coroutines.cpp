@@ -0,0 +1,197 @@
+#include "networkLibrary.h"
+
+/*
+    Coroutine sessions and clients
+
+    Built instead of the callback versions when NETWORKLIBRARY_COROUTINES is defined. A session
+    runs as two coroutines on its executor: the read loop, which also handles the messages and
+    so the "\hello" handshake, and the write loop, which drains the outbound queue. Boost 1.74
+    has neither awaitable operators nor channels, so a single frame cannot wait for the socket
+    and for queued messages at once; the write loop sleeps on a timer that never expires and
+    is woken by cancelling it. Both loops share the session's queue, buffers and metrics with
+    the callback version.
+*/
+
+namespace
+{
+    /**
+     * @brief Completion token resuming a coroutine with the error code instead of throwing it.
+     */
+    auto await_into(boost::system::error_code &ec)
+    {
+        return boost::asio::redirect_error(boost::asio::use_awaitable, ec);
+    }
+};
+
+/*
+    Chat Session
+*/
+
+void networkLibrary::chatSession::read_continous()
+{
+    auto self(shared_from_this());
+    if(m_strand){
+        boost::asio::co_spawn(*m_strand, read_loop(self), boost::asio::detached);
+        boost::asio::co_spawn(*m_strand, write_loop(self), boost::asio::detached);
+    }
+    else{
+        boost::asio::co_spawn(m_loop.m_io_context, read_loop(self), boost::asio::detached);
+        boost::asio::co_spawn(m_loop.m_io_context, write_loop(self), boost::asio::detached);
+    }
+}
+
+boost::asio::awaitable<void> networkLibrary::chatSession::read_loop(std::shared_ptr<chatSession> self)
+{
+    boost::system::error_code ec;
+    // An adopted session may bring input along
+    if(m_read_begin != m_read_end && !process_input(std::chrono::steady_clock::now())){
+        if(!m_throttled) close();
+        co_return;
+    }
+    while(true){
+        prepare_read();
+        m_reading = true;
+        std::size_t size = co_await m_socket.async_read_some(
+            boost::asio::buffer(m_read_buffer.data() + m_read_end, m_read_buffer.size() - m_read_end),
+            await_into(ec));
+        m_reading = false;
+        if(m_handoff){
+            // Whatever was read is handled by the next server
+            if(!ec) m_read_end += size;
+            check_parked();
+            co_return;
+        }
+        if(ec){
+            LOG_ERROR(m_serv.server_log, "Error Reading Data : {}", ec.message());
+            m_serv.remove_session(self);
+            break;
+        }
+        if(!handle_read(size)){
+            // resume_read() starts another read loop once the rate limits refill
+            if(m_throttled) co_return;
+            break;
+        }
+    }
+    // The write loop would otherwise wait for messages that are never written
+    close();
+}
+
+void networkLibrary::chatSession::resume_read(std::chrono::steady_clock::time_point _now)
+{
+    m_throttled = false;
+    if(!process_input(_now)) return;
+    if(m_strand) boost::asio::co_spawn(*m_strand, read_loop(shared_from_this()), boost::asio::detached);
+    else boost::asio::co_spawn(m_loop.m_io_context, read_loop(shared_from_this()), boost::asio::detached);
+}
+
+boost::asio::awaitable<void> networkLibrary::chatSession::write_loop(std::shared_ptr<chatSession> self)
+{
+    boost::system::error_code ec;
+    while(m_socket.is_open()){
+        networkLibrary::gatherView _buffers{};
+        {
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            if(m_handoff){
+                m_write_in_progress = false;
+                post_to_session([this, self](){ check_parked(); });
+                co_return;
+            }
+            if(m_write_in_progress) _buffers = gather();
+        }
+        if(_buffers.begin() == _buffers.end()){
+            // deliver() and flush_batch() set m_write_in_progress before waking the loop
+            co_await m_write_signal.async_wait(await_into(ec));
+            continue;
+        }
+
+        std::size_t size = co_await boost::asio::async_write(m_socket, _buffers, await_into(ec));
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        if(!write_done(ec, size)) co_return;
+        if(m_write_queue.empty()) m_write_in_progress = false;
+    }
+}
+
+void networkLibrary::chatSession::start_write()
+{
+    // The timer is only touched on the session's own executor, never on a foreign thread
+    if(running_in_this_thread()){
+        m_write_signal.cancel();
+    }
+    else{
+        auto self(shared_from_this());
+        post_to_session(
+            [this, self](){
+                m_write_signal.cancel();
+            });
+    }
+}
+
+/*
+    Asynchronous Client
+*/
+
+void networkLibrary::Client::asyncClient::connect()
+{
+    boost::asio::co_spawn(m_io_context, run(), boost::asio::detached);
+}
+
+boost::asio::awaitable<void> networkLibrary::Client::asyncClient::run()
+{
+    boost::system::error_code ec;
+    auto _endpoints = co_await m_resolver.async_resolve(m_ip, boost::lexical_cast<std::string>(m_port), await_into(ec));
+    if(!ec) co_await boost::asio::async_connect(m_socket, _endpoints, await_into(ec));
+    if(ec){
+        if(m_config.print_status) std::cout << "Error Occured while Connecting to the Server | Relaunch Client" << std::endl;
+        close_socket();
+        co_return;
+    }
+    m_connected = true;
+    // Queued lines are already coalesced into gather writes, Nagle would only hold back the last one
+    boost::system::error_code _ec;
+    m_socket.set_option(boost::asio::ip::tcp::no_delay(true), _ec);
+
+    if(m_config.binary_protocol){
+        // Queued lines wait for the answer, the server switches formats right after the hello
+        m_negotiating = true;
+        std::string hello = hello_line();
+        co_await boost::asio::async_write(m_socket, boost::asio::buffer(hello), await_into(ec));
+        if(ec){
+            close_socket();
+            co_return;
+        }
+    }
+    boost::asio::co_spawn(m_io_context, write_loop(), boost::asio::detached);
+
+    while(true){
+        co_await boost::asio::async_read(m_socket, boost::asio::dynamic_buffer(m_buffer), boost::asio::transfer_at_least(1), await_into(ec));
+        if(ec || !process_input()) break;
+    }
+    close_socket();
+}
+
+boost::asio::awaitable<void> networkLibrary::Client::asyncClient::write_loop()
+{
+    boost::system::error_code ec;
+    while(m_socket.is_open()){
+        if(m_negotiating || m_write_queue.empty()){
+            if(!m_negotiating && m_close_when_flushed) shutdown_send();
+            co_await m_write_signal.async_wait(await_into(ec));
+            continue;
+        }
+
+        m_write_in_progress = true;
+        co_await boost::asio::async_write(m_socket, gather(), await_into(ec));
+        m_write_in_progress = false;
+        if(ec){
+            if(m_config.print_status) std::cout << "Error writing to Server | Relaunch Client" <<std::endl;
+            close_socket();
+            co_return;
+        }
+        written();
+    }
+}
+
+void networkLibrary::Client::asyncClient::start_write()
+{
+    m_write_signal.cancel();
+}
@@ -0,0 +1,203 @@
+#ifndef EPOCH_DOMAIN_H
+#define EPOCH_DOMAIN_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace networkLibrary
+{
+    /**
+     * @brief Process-wide epoch-based reclamation for objects read without locks.
+     *
+     * A reader pins its thread with a guard before it loads a published pointer and keeps
+     * using what it loaded until the guard goes away. A writer that replaces such an object
+     * retires the old one, which is freed once every thread pinned before the replacement
+     * has let go. Pinning writes only the thread's own record, so readers on different
+     * threads share nothing but the read-mostly global epoch.
+     *
+     * Retired objects are freed at a quiescent point: every reclaim_interval outermost guards
+     * a thread releases, or when another object is retired.
+     */
+    class epochDomain;
+};
+
+class networkLibrary::epochDomain
+{
+private:
+    static constexpr std::uint64_t idle = 0; ///< Epoch of a thread that is not pinned.
+    static constexpr std::size_t reclaim_interval = 64; ///< Released guards per reclaim attempt of a thread.
+
+    /**
+     * @brief What one thread has pinned, reused by later threads once it has exited.
+     */
+    struct alignas(64) reader
+    {
+        std::atomic<std::uint64_t> m_epoch{idle}; ///< Epoch the thread pinned, idle if none.
+        std::atomic<bool> m_in_use{true}; ///< Whether a live thread owns the record.
+        reader* m_next = nullptr; ///< Next record, records are never freed.
+        std::size_t m_depth = 0; ///< Nested guards of the owning thread.
+        std::size_t m_released = 0; ///< Outermost guards the owning thread has released.
+    };
+
+    /**
+     * @brief An object waiting for its readers to go.
+     */
+    struct retired
+    {
+        std::uint64_t m_epoch; ///< Epoch in which it was replaced.
+        void* m_object; ///< The object.
+        void (*m_destroy)(void*); ///< Frees the object.
+    };
+
+    struct state
+    {
+        std::atomic<std::uint64_t> m_epoch{1}; ///< Current epoch, advanced by every retirement.
+        std::atomic<reader*> m_readers{nullptr}; ///< Lock-free list of every thread's record.
+        std::atomic<std::size_t> m_pending{0}; ///< Number of retired objects not freed yet.
+        std::mutex m_retired_mutex; ///< Guards the retired objects.
+        std::vector<retired> m_retired; ///< Retired objects not freed yet.
+    };
+
+    /**
+     * @brief The domain, never destroyed so threads exiting after main() can still use it.
+     */
+    static state &global()
+    {
+        static state* _state = new state;
+        return *_state;
+    }
+
+    /**
+     * @brief Takes a free record, or adds one.
+     */
+    static reader *acquire()
+    {
+        state& _state = global();
+        for(reader* _reader = _state.m_readers.load(std::memory_order_acquire); _reader; _reader = _reader->m_next){
+            bool _free = false;
+            if(!_reader->m_in_use.load(std::memory_order_relaxed)
+               && _reader->m_in_use.compare_exchange_strong(_free, true, std::memory_order_acquire)) return _reader;
+        }
+        reader* _reader = new reader;
+        _reader->m_next = _state.m_readers.load(std::memory_order_relaxed);
+        while(!_state.m_readers.compare_exchange_weak(_reader->m_next, _reader, std::memory_order_release, std::memory_order_relaxed)){
+        }
+        return _reader;
+    }
+
+    /**
+     * @brief The calling thread's record.
+     */
+    static reader &local()
+    {
+        struct handle
+        {
+            reader* m_reader = acquire();
+            ~handle() { m_reader->m_in_use.store(false, std::memory_order_release); }
+        };
+        thread_local handle _handle;
+        return *_handle.m_reader;
+    }
+
+public:
+    /**
+     * @brief Pins the calling thread while it exists; guards may nest.
+     *
+     * A guard must be released on the thread that created it.
+     */
+    class guard
+    {
+    private:
+        reader* m_reader; ///< Record of the pinned thread, nullptr once moved from.
+
+    public:
+        guard()
+            : m_reader(&local())
+        {
+            // Only the outermost guard pins, the inner ones are covered by it
+            if(m_reader->m_depth++ == 0) m_reader->m_epoch.store(global().m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        }
+
+        guard(guard &&other) noexcept
+            : m_reader(std::exchange(other.m_reader, nullptr))
+        {
+        }
+
+        guard(const guard &) = delete;
+        guard &operator=(const guard &) = delete;
+        guard &operator=(guard &&) = delete;
+
+        ~guard()
+        {
+            if(m_reader == nullptr || --m_reader->m_depth != 0) return;
+            m_reader->m_epoch.store(idle, std::memory_order_release);
+            // A thread pinned for long keeps objects pending, readers do not all rescan for them
+            if(++m_reader->m_released % reclaim_interval == 0 && global().m_pending.load(std::memory_order_relaxed) != 0) reclaim();
+        }
+    };
+
+    epochDomain() = delete;
+
+    /**
+     * @brief Hands over an object that readers may still use, to be freed once they are done.
+     *
+     * The replacement must already be published, with a seq_cst store.
+     * @param object The object.
+     * @param destroy Frees the object.
+     */
+    static void retire(void *object, void (*destroy)(void*))
+    {
+        state& _state = global();
+        // Threads pinned from now on see a later epoch, so they cannot have loaded the object
+        std::uint64_t _epoch = _state.m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::lock_guard<std::mutex> lock(_state.m_retired_mutex);
+            _state.m_retired.push_back(retired{_epoch, object, destroy});
+        }
+        _state.m_pending.fetch_add(1, std::memory_order_relaxed);
+        reclaim();
+    }
+
+    /**
+     * @brief Retires an object allocated with new.
+     */
+    template <typename T>
+    static void retire(const T *object)
+    {
+        retire(const_cast<T*>(object), [](void* _object){ delete static_cast<T*>(_object); });
+    }
+
+    /**
+     * @brief Frees every retired object that no pinned thread can still be using.
+     */
+    static void reclaim()
+    {
+        state& _state = global();
+        // Objects retired after this load may have readers the scan below misses
+        std::uint64_t _oldest = _state.m_epoch.load(std::memory_order_seq_cst);
+        for(reader* _reader = _state.m_readers.load(std::memory_order_acquire); _reader; _reader = _reader->m_next){
+            std::uint64_t _epoch = _reader->m_epoch.load(std::memory_order_seq_cst);
+            if(_epoch != idle) _oldest = std::min(_oldest, _epoch);
+        }
+
+        std::vector<retired> _freed;
+        {
+            std::lock_guard<std::mutex> lock(_state.m_retired_mutex);
+            auto _keep = std::partition(_state.m_retired.begin(), _state.m_retired.end(),
+                [_oldest](const retired &_object){ return _object.m_epoch >= _oldest; });
+            _freed.assign(_keep, _state.m_retired.end());
+            _state.m_retired.erase(_keep, _state.m_retired.end());
+        }
+        if(_freed.empty()) return;
+        _state.m_pending.fetch_sub(_freed.size(), std::memory_order_relaxed);
+        // Outside the lock, freeing an object may retire others
+        for(auto const& _object : _freed) _object.m_destroy(_object.m_object);
+    }
+};
+
+#endif // EPOCH_DOMAIN_H
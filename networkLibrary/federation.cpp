@@ -0,0 +1,563 @@
+#include "networkLibrary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace
+{
+    void put_u64(char *out, std::uint64_t value)
+    {
+        for(int i=7; i>=0; --i){
+            out[i] = static_cast<char>(value & 0xff);
+            value >>= 8;
+        }
+    }
+
+    std::uint64_t get_u64(const char *in)
+    {
+        std::uint64_t value = 0;
+        for(int i=0; i<8; ++i) value = (value << 8) | static_cast<unsigned char>(in[i]);
+        return value;
+    }
+
+    /**
+     * @brief A random node ID, never 0.
+     */
+    std::uint64_t random_node()
+    {
+        std::mt19937_64 _random(std::random_device{}());
+        return std::uniform_int_distribution<std::uint64_t>(1)(_random);
+    }
+
+    /**
+     * @brief Takes a name field off the front of a relay body.
+     * @return False if the body is too short for it.
+     */
+    bool take_name(std::string_view &body, std::string_view &name)
+    {
+        if(body.size() < 2) return false;
+        std::size_t _size = (static_cast<unsigned char>(body[0]) << 8) | static_cast<unsigned char>(body[1]);
+        if(body.size() < 2 + _size) return false;
+        name = body.substr(2, _size);
+        body.remove_prefix(2 + _size);
+        return true;
+    }
+};
+
+/*
+    Relay Link
+*/
+
+networkLibrary::Server::relayLink::relayLink(networkLibrary::Server::federation &fed, boost::asio::io_context &io_context, std::string host, std::string port)
+    : m_federation(fed),
+      m_strand(boost::asio::make_strand(io_context)),
+      m_socket(m_strand),
+      m_resolver(m_strand),
+      m_retry_timer(m_strand),
+      m_host(std::move(host)),
+      m_port(std::move(port)),
+      m_peer(0),
+      m_connected(false),
+      m_write_in_progress(false),
+      m_read_buffer(64 * 1024),
+      m_read_end(0)
+{
+}
+
+networkLibrary::Server::relayLink::relayLink(networkLibrary::Server::federation &fed, boost::asio::ip::tcp::socket socket)
+    : m_federation(fed),
+      m_strand(boost::asio::make_strand(fed.m_io_context)),
+      m_socket(std::move(socket)),
+      m_resolver(m_strand),
+      m_retry_timer(m_strand),
+      m_peer(0),
+      m_connected(false),
+      m_write_in_progress(false),
+      m_read_buffer(64 * 1024),
+      m_read_end(0)
+{
+}
+
+void networkLibrary::Server::relayLink::connect()
+{
+    auto self(shared_from_this());
+    m_resolver.async_resolve(m_host, m_port,
+        boost::asio::bind_executor(m_strand,
+        [this, self](boost::system::error_code ec, boost::asio::ip::tcp::resolver::results_type _results){
+            if(ec){
+                retry();
+                return;
+            }
+            boost::asio::async_connect(m_socket, _results,
+                boost::asio::bind_executor(m_strand,
+                [this, self](boost::system::error_code ec, const boost::asio::ip::tcp::endpoint&){
+                    if(ec){
+                        boost::system::error_code _ec;
+                        m_socket.close(_ec);
+                        retry();
+                        return;
+                    }
+                    LOG_INFO(m_federation.m_serv.server_log, "Relay link connected to {}:{}", m_host, m_port);
+                    start();
+                }));
+        }));
+}
+
+void networkLibrary::Server::relayLink::retry()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_federation.m_mutex);
+        if(m_federation.m_stopping) return;
+    }
+    auto self(shared_from_this());
+    m_retry_timer.expires_after(m_federation.m_serv.m_config.federation_retry);
+    m_retry_timer.async_wait(
+        boost::asio::bind_executor(m_strand,
+        [this, self](boost::system::error_code ec){
+            if(!ec) connect();
+        }));
+}
+
+void networkLibrary::Server::relayLink::start()
+{
+    boost::system::error_code _ec;
+    m_socket.set_option(boost::asio::ip::tcp::no_delay(true), _ec);
+    m_read_end = 0;
+    m_federation.link_up(*this);
+    read();
+}
+
+void networkLibrary::Server::relayLink::read()
+{
+    // Room for the largest frame: a name and a message of the largest client message each
+    const std::size_t _limit = 2 * m_federation.m_serv.m_config.max_message_size + 1024;
+    if(m_read_end == m_read_buffer.size()) m_read_buffer.resize(std::min(2 * m_read_buffer.size(), networkLibrary::Protocol::header_size + _limit));
+
+    auto self(shared_from_this());
+    m_socket.async_read_some(
+        boost::asio::buffer(m_read_buffer.data() + m_read_end, m_read_buffer.size() - m_read_end),
+        boost::asio::bind_executor(m_strand,
+        [this, self, _limit](boost::system::error_code ec, std::size_t _length){
+            if(ec){
+                fail();
+                return;
+            }
+            m_read_end += _length;
+
+            std::size_t _begin = 0;
+            networkLibrary::Protocol::extracted _frame;
+            while(true){
+                auto _status = networkLibrary::Protocol::extract_frame(m_read_buffer.data() + _begin, m_read_end - _begin, _limit, _frame);
+                if(_status == networkLibrary::Protocol::INCOMPLETE) break;
+                if(_status == networkLibrary::Protocol::TOO_LARGE || !m_federation.handle_frame(*this, _frame)){
+                    LOG_WARNING(m_federation.m_serv.server_log, "Dropping relay link to node {} after a malformed frame", m_peer.load());
+                    fail();
+                    return;
+                }
+                _begin += _frame.consumed;
+            }
+            if(_begin != 0){
+                std::memmove(m_read_buffer.data(), m_read_buffer.data() + _begin, m_read_end - _begin);
+                m_read_end -= _begin;
+            }
+            read();
+        }));
+}
+
+void networkLibrary::Server::relayLink::write()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        std::swap(m_queued, m_writing);
+        m_queued.clear();
+        if(m_writing.empty()){
+            m_write_in_progress = false;
+            return;
+        }
+    }
+
+    auto self(shared_from_this());
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_writing),
+        boost::asio::bind_executor(m_strand,
+        [this, self](boost::system::error_code ec, std::size_t){
+            if(ec){
+                {
+                    std::lock_guard<std::mutex> lock(m_write_mutex);
+                    m_write_in_progress = false;
+                }
+                fail();
+                return;
+            }
+            write();
+        }));
+}
+
+void networkLibrary::Server::relayLink::fail()
+{
+    if(!m_socket.is_open()) return;
+    boost::system::error_code _ec;
+    m_socket.close(_ec);
+    m_federation.link_down(*this);
+}
+
+bool networkLibrary::Server::relayLink::enqueue(std::string_view frame)
+{
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    if(!m_connected) return false;
+    if(m_queued.size() + frame.size() > m_federation.m_serv.m_config.federation_queue_limit){
+        // A peer this far behind gets the users and new traffic again once it reconnects
+        m_connected = false;
+        boost::asio::post(m_strand, [self = shared_from_this()](){ self->fail(); });
+        return false;
+    }
+    m_queued.append(frame);
+    if(!m_write_in_progress){
+        m_write_in_progress = true;
+        boost::asio::post(m_strand, [self = shared_from_this()](){ self->write(); });
+    }
+    return true;
+}
+
+void networkLibrary::Server::relayLink::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_connected = false;
+    }
+    boost::asio::post(m_strand, [self = shared_from_this()](){
+        boost::system::error_code ec;
+        self->m_retry_timer.cancel();
+        self->m_resolver.cancel();
+        self->m_socket.close(ec);
+    });
+}
+
+/*
+    Federation
+*/
+
+networkLibrary::Server::federation::federation(networkLibrary::Server::asyncServer &serv, boost::asio::io_context &io_context)
+    : m_serv(serv),
+      m_io_context(io_context),
+      m_node(serv.m_config.node_id != 0 ? serv.m_config.node_id : random_node()),
+      // Keeps growing across restarts, so the other nodes never take new frames for old ones
+      m_sequence(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()),
+      m_stopping(false)
+{
+}
+
+void networkLibrary::Server::federation::start()
+{
+    boost::system::error_code ec;
+    listen(ec);
+    if(ec) throw boost::system::system_error(ec, "Relay port");
+    connect_peers();
+}
+
+void networkLibrary::Server::federation::start(boost::system::error_code &ec)
+{
+    listen(ec);
+    connect_peers();
+}
+
+void networkLibrary::Server::federation::listen(boost::system::error_code &ec)
+{
+    ec.clear();
+    {
+        // Started again after a handoff that failed
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = false;
+    }
+    const serverConfig& _config = m_serv.m_config;
+    if(_config.federation_port == 0) return;
+
+    m_acceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(boost::asio::make_strand(m_io_context));
+    boost::asio::ip::address _address = boost::asio::ip::make_address(_config.federation_address, ec);
+    boost::asio::ip::tcp::endpoint _endpoint(_address, _config.federation_port);
+    if(!ec) m_acceptor->open(_endpoint.protocol(), ec);
+    if(!ec) m_acceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), ec);
+    if(!ec) m_acceptor->bind(_endpoint, ec);
+    if(!ec) m_acceptor->listen(boost::asio::socket_base::max_listen_connections, ec);
+    if(ec){
+        boost::system::error_code _ignored;
+        m_acceptor->close(_ignored);
+        return;
+    }
+    LOG_INFO(m_serv.server_log, "Node {} accepting relay links on {}:{}", m_node, _config.federation_address, port());
+    accept();
+}
+
+void networkLibrary::Server::federation::connect_peers()
+{
+    const serverConfig& _config = m_serv.m_config;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto const& _peer : _config.federation_peers){
+        std::size_t _colon = _peer.rfind(':');
+        if(_colon == std::string::npos || _colon == 0 || _colon + 1 == _peer.size()){
+            LOG_WARNING(m_serv.server_log, "Ignoring federation peer {}, expected host:port", _peer);
+            continue;
+        }
+        auto _link = std::make_shared<relayLink>(*this, m_io_context, _peer.substr(0, _colon), _peer.substr(_colon + 1));
+        m_links.push_back(_link);
+        boost::asio::post(_link->m_strand, [_link](){ _link->connect(); });
+    }
+}
+
+void networkLibrary::Server::federation::accept()
+{
+    m_acceptor->async_accept(
+        [this](boost::system::error_code ec, boost::asio::ip::tcp::socket _socket){
+            if(!ec){
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(!m_stopping){
+                    auto _link = std::make_shared<relayLink>(*this, std::move(_socket));
+                    m_links.push_back(_link);
+                    boost::asio::post(_link->m_strand, [_link](){ _link->start(); });
+                }
+            }
+            if(m_acceptor->is_open()) accept();
+        });
+}
+
+void networkLibrary::Server::federation::stop()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    if(m_acceptor){
+        boost::asio::post(m_acceptor->get_executor(), [this](){
+            boost::system::error_code ec;
+            m_acceptor->close(ec);
+        });
+    }
+    for(auto& _link : m_links) _link->close();
+    m_links.clear();
+}
+
+std::uint64_t networkLibrary::Server::federation::node() const
+{
+    return m_node;
+}
+
+unsigned int networkLibrary::Server::federation::port() const
+{
+    if(!m_acceptor) return 0;
+    boost::system::error_code ec;
+    return m_acceptor->local_endpoint(ec).port();
+}
+
+std::string_view networkLibrary::Server::federation::encode(std::uint8_t type, std::string_view name, std::string_view message)
+{
+    // Reused per thread, so relaying allocates nothing once the buffer has grown
+    thread_local std::string _frame;
+    const bool _named = type == networkLibrary::Protocol::RELAY_USER_JOIN || type == networkLibrary::Protocol::RELAY_USER_LEAVE
+                     || type == networkLibrary::Protocol::RELAY_ROOM || type == networkLibrary::Protocol::RELAY_DIRECT;
+    const std::size_t _body = networkLibrary::Protocol::relay_prefix_size + (_named ? 2 + name.size() : 0) + message.size();
+    _frame.resize(networkLibrary::Protocol::header_size + _body);
+
+    char* _out = _frame.data();
+    networkLibrary::Protocol::encode_header(_out, {static_cast<std::uint32_t>(_body), type, 0});
+    _out += networkLibrary::Protocol::header_size;
+    put_u64(_out, m_node);
+    put_u64(_out + 8, type == networkLibrary::Protocol::RELAY_HELLO ? 0 : m_sequence);
+    _out += networkLibrary::Protocol::relay_prefix_size;
+    if(_named){
+        _out[0] = static_cast<char>((name.size() >> 8) & 0xff);
+        _out[1] = static_cast<char>(name.size() & 0xff);
+        std::memcpy(_out + 2, name.data(), name.size());
+        _out += 2 + name.size();
+    }
+    std::memcpy(_out, message.data(), message.size());
+    return _frame;
+}
+
+bool networkLibrary::Server::federation::relay(std::uint8_t type, std::string_view name, std::string_view message, std::uint64_t node)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_links.empty()) return false;
+
+    ++m_sequence;
+    std::string_view _frame = encode(type, name, message);
+    bool _sent = false;
+    for(auto& _link : m_links){
+        if(node != 0 && _link->m_peer.load() != node) continue;
+        if(_link->enqueue(_frame)){
+            m_serv.m_metrics.add(networkLibrary::metricsRegistry::RELAY_FRAMES_OUT);
+            _sent = true;
+            // One copy reaches the node, a second link to it would only deliver a duplicate
+            if(node != 0) break;
+        }
+    }
+    return _sent;
+}
+
+void networkLibrary::Server::federation::link_up(networkLibrary::Server::relayLink &link)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_stopping) return;
+    {
+        std::lock_guard<std::mutex> _link_lock(link.m_write_mutex);
+        link.m_connected = true;
+        link.m_queued.clear();
+    }
+    link.enqueue(encode(networkLibrary::Protocol::RELAY_HELLO, {}, {}));
+
+    // Every user claimed before this point is announced here, later ones by user_joined()
+    for(auto const& _name : m_serv.m_user_index.names()){
+        ++m_sequence;
+        link.enqueue(encode(networkLibrary::Protocol::RELAY_USER_JOIN, _name, {}));
+    }
+}
+
+void networkLibrary::Server::federation::link_down(networkLibrary::Server::relayLink &link)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    {
+        std::lock_guard<std::mutex> _link_lock(link.m_write_mutex);
+        link.m_connected = false;
+        link.m_queued.clear();
+    }
+
+    std::uint64_t _peer = link.m_peer.exchange(0);
+    bool _other_link = std::any_of(m_links.begin(), m_links.end(), [_peer](auto const& _link){ return _link->m_peer.load() == _peer; });
+    if(_peer != 0 && !_other_link){
+        LOG_WARNING(m_serv.server_log, "Relay link to node {} lost", _peer);
+        std::lock_guard<std::mutex> _remote_lock(m_remote_mutex);
+        for(auto it = m_remote_users.begin(); it != m_remote_users.end();){
+            if(it->second == _peer) it = m_remote_users.erase(it);
+            else ++it;
+        }
+    }
+
+    if(link.m_host.empty()){
+        // Accepted links are gone for good, the peer reconnects with a new one
+        m_links.erase(std::remove_if(m_links.begin(), m_links.end(), [&link](auto const& _link){ return _link.get() == &link; }), m_links.end());
+    }
+    else{
+        lock.unlock();
+        link.retry();
+    }
+}
+
+bool networkLibrary::Server::federation::handle_frame(networkLibrary::Server::relayLink &link, const networkLibrary::Protocol::extracted &frame)
+{
+    std::string_view _body = frame.body;
+    if(_body.size() < networkLibrary::Protocol::relay_prefix_size) return false;
+    const std::uint64_t _origin = get_u64(_body.data());
+    const std::uint64_t _sequence = get_u64(_body.data() + 8);
+    _body.remove_prefix(networkLibrary::Protocol::relay_prefix_size);
+    const std::uint8_t _type = frame.header.type;
+
+    if(_type == networkLibrary::Protocol::RELAY_HELLO){
+        link.m_peer = _origin;
+        LOG_INFO(m_serv.server_log, "Relay link up with node {}", _origin);
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_remote_mutex);
+        std::uint64_t& _seen = m_seen[_origin];
+        if(_origin == m_node || _sequence <= _seen){
+            m_serv.m_metrics.add(networkLibrary::metricsRegistry::RELAY_DUPLICATES);
+            return true;
+        }
+        _seen = _sequence;
+    }
+    m_serv.m_metrics.add(networkLibrary::metricsRegistry::RELAY_FRAMES_IN);
+
+    std::string_view _name;
+    switch(_type){
+        case networkLibrary::Protocol::RELAY_USER_JOIN:{
+            if(!take_name(_body, _name)) return false;
+            std::string _user(_name);
+            // Claimed here too: the lower node keeps the name
+            auto _session = m_serv.m_user_index.find(_user);
+            if(_session && _origin > m_node) break;
+            if(_session) _session->lose_name(_user);
+
+            std::lock_guard<std::mutex> lock(m_remote_mutex);
+            auto it = m_remote_users.find(_user);
+            if(it == m_remote_users.end()) m_remote_users.emplace(std::move(_user), _origin);
+            else if(_origin < it->second) it->second = _origin;
+            break;
+        }
+        case networkLibrary::Protocol::RELAY_USER_LEAVE:{
+            if(!take_name(_body, _name)) return false;
+            std::lock_guard<std::mutex> lock(m_remote_mutex);
+            auto it = m_remote_users.find(std::string(_name));
+            if(it != m_remote_users.end() && it->second == _origin) m_remote_users.erase(it);
+            break;
+        }
+        case networkLibrary::Protocol::RELAY_BROADCAST:
+            m_serv.broadcast_local(chatMessage::make(_body));
+            break;
+        case networkLibrary::Protocol::RELAY_ROOM:{
+            if(!take_name(_body, _name)) return false;
+            std::string _room(_name);
+            networkLibrary::messagePtr _message = chatMessage::make(_body);
+            if(m_serv.m_config.history_size != 0) m_serv.record(m_serv.m_history.get(_room), _message);
+            networkLibrary::roomPtr _members = m_serv.m_rooms.find(_room);
+            if(_members) m_serv.write_room_local(_members, _message);
+            break;
+        }
+        case networkLibrary::Protocol::RELAY_DIRECT:{
+            if(!take_name(_body, _name)) return false;
+            auto _session = m_serv.find_session(std::string(_name));
+            if(_session) m_serv.write(_session, chatMessage::make(_body));
+            break;
+        }
+        default:
+            // Types added by newer nodes
+            break;
+    }
+    return true;
+}
+
+void networkLibrary::Server::federation::relay_broadcast(const networkLibrary::messagePtr &message)
+{
+    relay(networkLibrary::Protocol::RELAY_BROADCAST, {}, message->view());
+}
+
+void networkLibrary::Server::federation::relay_room(const std::string &room, const networkLibrary::messagePtr &message)
+{
+    relay(networkLibrary::Protocol::RELAY_ROOM, room, message->view());
+}
+
+bool networkLibrary::Server::federation::relay_direct(const std::string &name, const networkLibrary::messagePtr &message)
+{
+    std::uint64_t _node;
+    {
+        std::lock_guard<std::mutex> lock(m_remote_mutex);
+        auto it = m_remote_users.find(name);
+        if(it == m_remote_users.end()) return false;
+        _node = it->second;
+    }
+    return relay(networkLibrary::Protocol::RELAY_DIRECT, name, message->view(), _node);
+}
+
+void networkLibrary::Server::federation::user_joined(const std::string &name)
+{
+    relay(networkLibrary::Protocol::RELAY_USER_JOIN, name, {});
+}
+
+void networkLibrary::Server::federation::user_left(const std::string &name)
+{
+    relay(networkLibrary::Protocol::RELAY_USER_LEAVE, name, {});
+}
+
+bool networkLibrary::Server::federation::knows_user(const std::string &name) const
+{
+    std::lock_guard<std::mutex> lock(m_remote_mutex);
+    return m_remote_users.find(name) != m_remote_users.end();
+}
+
+std::vector<std::pair<std::string, std::uint64_t>> networkLibrary::Server::federation::remote_users() const
+{
+    std::vector<std::pair<std::string, std::uint64_t>> _users;
+    {
+        std::lock_guard<std::mutex> lock(m_remote_mutex);
+        _users.assign(m_remote_users.begin(), m_remote_users.end());
+    }
+    std::sort(_users.begin(), _users.end());
+    return _users;
+}
@@ -0,0 +1,124 @@
+#ifndef HANDLER_ALLOCATOR_H
+#define HANDLER_ALLOCATOR_H
+
+#include "bufferPool.h"
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio/detail/recycling_allocator.hpp>
+
+namespace networkLibrary
+{
+    /**
+     * @brief Allocator for the operation state of asynchronous operations.
+     *
+     * When recycling is on, operation state is drawn from the bufferPool, which keeps freed
+     * blocks in a per-thread cache and tolerates blocks freed on another thread. When it is
+     * off, allocation falls back to Asio's own per-thread recycling, the library default,
+     * so both can be compared on the same build.
+     *
+     * @tparam T Type of the allocated objects.
+     */
+    template <typename T>
+    class handlerAllocator;
+
+    /**
+     * @brief A completion handler carrying a handlerAllocator as its associated allocator.
+     * @tparam Handler Type of the wrapped handler.
+     */
+    template <typename Handler>
+    class allocatingHandler;
+
+    /**
+     * @brief Wraps a completion handler so that Asio allocates its operation with a handlerAllocator.
+     * @param recycle Whether to use the buffer pool or Asio's default allocation.
+     * @param handler The handler to wrap.
+     */
+    template <typename Handler>
+    allocatingHandler<typename std::decay<Handler>::type> make_handler(bool recycle, Handler &&handler);
+};
+
+template <typename T>
+class networkLibrary::handlerAllocator
+{
+private:
+    template <typename> friend class handlerAllocator;
+
+    bool m_recycle; ///< Whether blocks come from the buffer pool.
+
+public:
+    using value_type = T;
+
+    explicit handlerAllocator(bool recycle) noexcept
+        : m_recycle(recycle)
+    {
+    }
+
+    template <typename U>
+    handlerAllocator(const handlerAllocator<U> &other) noexcept
+        : m_recycle(other.m_recycle)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if(m_recycle) return static_cast<T*>(networkLibrary::bufferPool::allocate(sizeof(T) * n));
+        return boost::asio::detail::recycling_allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if(m_recycle) networkLibrary::bufferPool::deallocate(p, sizeof(T) * n);
+        else boost::asio::detail::recycling_allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const handlerAllocator<U> &other) const noexcept
+    {
+        return m_recycle == other.m_recycle;
+    }
+
+    template <typename U>
+    bool operator!=(const handlerAllocator<U> &other) const noexcept
+    {
+        return m_recycle != other.m_recycle;
+    }
+};
+
+template <typename Handler>
+class networkLibrary::allocatingHandler
+{
+private:
+    bool m_recycle;     ///< Allocation strategy handed to Asio.
+    Handler m_handler;  ///< The wrapped handler.
+
+public:
+    using allocator_type = handlerAllocator<Handler>;
+
+    allocatingHandler(bool recycle, Handler handler)
+        : m_recycle(recycle),
+          m_handler(std::move(handler))
+    {
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return allocator_type(m_recycle);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args)
+    {
+        m_handler(std::forward<Args>(args)...);
+    }
+};
+
+template <typename Handler>
+networkLibrary::allocatingHandler<typename std::decay<Handler>::type> networkLibrary::make_handler(bool recycle, Handler &&handler)
+{
+    return allocatingHandler<typename std::decay<Handler>::type>(recycle, std::forward<Handler>(handler));
+}
+
+#endif // HANDLER_ALLOCATOR_H
@@ -0,0 +1,169 @@
+#ifndef HISTORY_INDEX_H
+#define HISTORY_INDEX_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/circular_buffer.hpp>
+
+namespace networkLibrary
+{
+    /**
+     * @brief A sharded directory of bounded per-room message histories.
+     *
+     * Every room name has a ring holding its most recent messages. Rings outlive the rooms
+     * they belong to, so a room that empties and is created again still has its history,
+     * but only up to a number of rooms: past it the least recently used ring that no session
+     * holds is dropped, so joining ever new rooms cannot grow memory without bound.
+     * Messages are stored by handle, so recording and replaying them copies no message text.
+     *
+     * @tparam Message Handle type of the stored messages.
+     * @tparam Shards Number of independently locked shards of the directory.
+     */
+    template <typename Message, std::size_t Shards = 16>
+    class historyIndex;
+};
+
+template <typename Message, std::size_t Shards>
+class networkLibrary::historyIndex
+{
+public:
+    /**
+     * @brief The recent messages of one room, oldest first.
+     */
+    class ring
+    {
+    private:
+        const std::string m_name; ///< Name of the room.
+        mutable std::mutex m_mutex; ///< Guards the messages.
+        boost::circular_buffer<Message> m_messages; ///< The most recent messages.
+
+    public:
+        ring(std::string name, std::size_t capacity)
+            : m_name(std::move(name)),
+              m_messages(capacity)
+        {
+        }
+
+        ring(const ring &) = delete;
+        ring &operator=(const ring &) = delete;
+
+        /**
+         * @brief Name of the room.
+         */
+        const std::string &name() const
+        {
+            return m_name;
+        }
+
+        /**
+         * @brief Records a message, evicting the oldest one when the ring is full.
+         */
+        void push(Message message)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_messages.push_back(std::move(message));
+        }
+
+        /**
+         * @brief The recorded messages, oldest first.
+         */
+        std::vector<Message> snapshot() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return std::vector<Message>(m_messages.begin(), m_messages.end());
+        }
+    };
+
+    using ringPtr = std::shared_ptr<ring>; ///< Handle of a room's history.
+
+private:
+    /**
+     * @brief One independently locked part of the directory.
+     */
+    struct alignas(64) shard
+    {
+        std::mutex m_mutex; ///< Guards the rings of the shard.
+        std::list<std::string> m_recent; ///< Room names of the shard, most recently used first.
+        std::unordered_map<std::string, std::pair<ringPtr, std::list<std::string>::iterator>> m_rings; ///< Rings of the room names in the shard and their place in m_recent.
+    };
+
+    std::array<shard, Shards> m_shards; ///< The shards.
+    const std::size_t m_capacity; ///< Messages kept per room.
+    const std::size_t m_shard_rooms; ///< Rings a shard keeps before it drops unused ones.
+
+    /**
+     * @brief The shard a room name belongs to.
+     */
+    shard &shard_of(const std::string &name)
+    {
+        return m_shards[std::hash<std::string>()(name) % Shards];
+    }
+
+public:
+    /**
+     * @brief Constructs an empty directory.
+     * @param capacity Number of messages kept per room.
+     * @param rooms Number of rooms whose history is kept, more only while sessions hold them.
+     */
+    explicit historyIndex(std::size_t capacity, std::size_t rooms = 4096)
+        : m_capacity(capacity),
+          m_shard_rooms(std::max<std::size_t>(rooms / Shards, 1))
+    {
+    }
+
+    historyIndex(const historyIndex &) = delete;
+    historyIndex &operator=(const historyIndex &) = delete;
+
+    /**
+     * @brief The history of a room, created empty on first use.
+     * @param name Name of the room.
+     */
+    ringPtr get(const std::string &name)
+    {
+        shard& sh = shard_of(name);
+        std::lock_guard<std::mutex> lock(sh.m_mutex);
+        auto _found = sh.m_rings.find(name);
+        if(_found != sh.m_rings.end()){
+            sh.m_recent.splice(sh.m_recent.begin(), sh.m_recent, _found->second.second);
+            return _found->second.first;
+        }
+
+        // Rings are only handed out under the lock, so one held by the shard alone stays unused
+        for(auto it = sh.m_recent.end(); sh.m_rings.size() >= m_shard_rooms && it != sh.m_recent.begin(); ){
+            --it;
+            auto _old = sh.m_rings.find(*it);
+            if(_old->second.first.use_count() > 1) continue;
+            sh.m_rings.erase(_old);
+            it = sh.m_recent.erase(it);
+        }
+        sh.m_recent.push_front(name);
+        ringPtr _ring = std::make_shared<ring>(name, m_capacity);
+        sh.m_rings.emplace(name, std::make_pair(_ring, sh.m_recent.begin()));
+        return _ring;
+    }
+
+    /**
+     * @brief Number of rooms whose history is kept.
+     */
+    std::size_t size()
+    {
+        std::size_t _rooms = 0;
+        for(auto& sh : m_shards){
+            std::lock_guard<std::mutex> lock(sh.m_mutex);
+            _rooms += sh.m_rings.size();
+        }
+        return _rooms;
+    }
+};
+
+#endif // HISTORY_INDEX_H
@@ -0,0 +1,234 @@
+#include "hotRestart.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    void put_u32(std::string &out, std::uint32_t value)
+    {
+        for(int shift=24; shift>=0; shift-=8) out.push_back(static_cast<char>((value >> shift) & 0xff));
+    }
+
+    std::uint32_t get_u32(const char *in)
+    {
+        std::uint32_t value = 0;
+        for(int i=0; i<4; ++i) value = (value << 8) | static_cast<unsigned char>(in[i]);
+        return value;
+    }
+
+    void put_field(std::string &out, const std::string &field)
+    {
+        put_u32(out, static_cast<std::uint32_t>(field.size()));
+        out += field;
+    }
+
+    /**
+     * @brief Takes a length-prefixed field off the front of a payload.
+     * @return False if the payload is too short for it.
+     */
+    bool take_field(std::string_view &payload, std::string &field)
+    {
+        if(payload.size() < 4) return false;
+        std::size_t _size = get_u32(payload.data());
+        if(payload.size() - 4 < _size) return false;
+        field.assign(payload.substr(4, _size));
+        payload.remove_prefix(4 + _size);
+        return true;
+    }
+
+    bool write_all(int fd, const char *data, std::size_t size)
+    {
+        while(size > 0){
+            ssize_t _written = ::send(fd, data, size, MSG_NOSIGNAL);
+            if(_written < 0 && errno == EINTR) continue;
+            if(_written <= 0) return false;
+            data += _written;
+            size -= _written;
+        }
+        return true;
+    }
+
+    bool read_all(int fd, char *data, std::size_t size)
+    {
+        while(size > 0){
+            ssize_t _read = ::recv(fd, data, size, 0);
+            if(_read < 0 && errno == EINTR) continue;
+            if(_read <= 0) return false;
+            data += _read;
+            size -= _read;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Sends a record header, with a descriptor attached if fd is not -1, then the payload.
+     */
+    bool send_record(int channel, std::uint8_t type, int fd, const std::string &payload)
+    {
+        char _header[networkLibrary::HotRestart::header_size] = {};
+        std::string _length;
+        put_u32(_length, static_cast<std::uint32_t>(payload.size()));
+        std::memcpy(_header, _length.data(), 4);
+        _header[4] = static_cast<char>(type);
+
+        iovec _iov{_header, sizeof(_header)};
+        msghdr _msg{};
+        _msg.msg_iov = &_iov;
+        _msg.msg_iovlen = 1;
+        alignas(cmsghdr) char _control[CMSG_SPACE(sizeof(int))];
+        if(fd >= 0){
+            _msg.msg_control = _control;
+            _msg.msg_controllen = sizeof(_control);
+            cmsghdr* _cmsg = CMSG_FIRSTHDR(&_msg);
+            _cmsg->cmsg_level = SOL_SOCKET;
+            _cmsg->cmsg_type = SCM_RIGHTS;
+            _cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(_cmsg), &fd, sizeof(int));
+        }
+
+        // The descriptor travels with the first byte of the header, the rest may follow separately
+        ssize_t _sent;
+        do{
+            _sent = ::sendmsg(channel, &_msg, MSG_NOSIGNAL);
+        } while(_sent < 0 && errno == EINTR);
+        if(_sent <= 0) return false;
+        return write_all(channel, _header + _sent, sizeof(_header) - _sent)
+            && write_all(channel, payload.data(), payload.size());
+    }
+
+    void set_timeout(int channel, int option)
+    {
+        timeval _timeout{networkLibrary::HotRestart::timeout.count(), 0};
+        ::setsockopt(channel, SOL_SOCKET, option, &_timeout, sizeof(_timeout));
+    }
+
+    /**
+     * @brief Receives a record header and the descriptor attached to it, if any.
+     * @param[out] fd The descriptor, -1 if none came.
+     */
+    bool receive_header(int channel, char *header, int &fd)
+    {
+        fd = -1;
+        iovec _iov{header, networkLibrary::HotRestart::header_size};
+        msghdr _msg{};
+        _msg.msg_iov = &_iov;
+        _msg.msg_iovlen = 1;
+        alignas(cmsghdr) char _control[CMSG_SPACE(sizeof(int))];
+        _msg.msg_control = _control;
+        _msg.msg_controllen = sizeof(_control);
+
+        ssize_t _read;
+        do{
+            _read = ::recvmsg(channel, &_msg, MSG_CMSG_CLOEXEC);
+        } while(_read < 0 && errno == EINTR);
+        if(_read <= 0) return false;
+        for(cmsghdr* _cmsg = CMSG_FIRSTHDR(&_msg); _cmsg; _cmsg = CMSG_NXTHDR(&_msg, _cmsg)){
+            if(_cmsg->cmsg_level == SOL_SOCKET && _cmsg->cmsg_type == SCM_RIGHTS) std::memcpy(&fd, CMSG_DATA(_cmsg), sizeof(int));
+        }
+        return read_all(channel, header + _read, networkLibrary::HotRestart::header_size - _read);
+    }
+};
+
+int networkLibrary::HotRestart::request(const std::string &path)
+{
+    sockaddr_un _address{};
+    if(path.empty() || path.size() >= sizeof(_address.sun_path)) return -1;
+    _address.sun_family = AF_UNIX;
+    std::memcpy(_address.sun_path, path.data(), path.size());
+
+    int _channel = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(_channel < 0) return -1;
+    if(::connect(_channel, reinterpret_cast<sockaddr*>(&_address), sizeof(_address)) != 0
+       || !write_all(_channel, handoff_command.data(), handoff_command.size())){
+        ::close(_channel);
+        return -1;
+    }
+    // An old server that hangs must not keep the new one from starting
+    set_timeout(_channel, SO_RCVTIMEO);
+    return _channel;
+}
+
+bool networkLibrary::HotRestart::send(int channel, const transfer &sent)
+{
+    // A new server that hangs must not keep the old one from taking its sessions back
+    set_timeout(channel, SO_SNDTIMEO);
+    set_timeout(channel, SO_RCVTIMEO);
+    for(int _listener : sent.listeners){
+        if(!send_record(channel, LISTENER, _listener, {})) return false;
+    }
+
+    std::string _payload;
+    for(auto const& _session : sent.sessions){
+        _payload.clear();
+        _payload.push_back(static_cast<char>((_session.port >> 8) & 0xff));
+        _payload.push_back(static_cast<char>(_session.port & 0xff));
+        _payload.push_back(static_cast<char>(_session.protocol));
+        _payload.push_back(static_cast<char>(_session.flags));
+        put_field(_payload, _session.name);
+        put_field(_payload, _session.ip);
+        put_field(_payload, _session.room);
+        put_field(_payload, _session.input);
+        put_field(_payload, _session.output);
+        if(!send_record(channel, SESSION, _session.fd, _payload)) return false;
+    }
+    if(!send_record(channel, END, -1, {})) return false;
+
+    char _reply[adopted_reply.size()];
+    return read_all(channel, _reply, sizeof(_reply)) && std::string_view(_reply, sizeof(_reply)) == adopted_reply;
+}
+
+void networkLibrary::HotRestart::receive(int channel, transfer &received)
+{
+    char _header[header_size];
+    std::string _payload;
+    int _fd;
+    while(receive_header(channel, _header, _fd)){
+        _payload.resize(get_u32(_header));
+        if(!read_all(channel, _payload.data(), _payload.size())){
+            if(_fd >= 0) ::close(_fd);
+            return;
+        }
+
+        std::uint8_t _type = static_cast<std::uint8_t>(_header[4]);
+        if(_type == END){
+            // Until the reply is read, the old server may still take everything back
+            received.complete = write_all(channel, adopted_reply.data(), adopted_reply.size());
+            return;
+        }
+        if(_type == LISTENER && _fd >= 0){
+            received.listeners.push_back(_fd);
+            continue;
+        }
+
+        sessionState _session;
+        std::string_view _fields(_payload);
+        if(_type != SESSION || _fd < 0 || _fields.size() < 4){
+            if(_fd >= 0) ::close(_fd);
+            continue;
+        }
+        _session.fd = _fd;
+        _session.port = (static_cast<unsigned char>(_fields[0]) << 8) | static_cast<unsigned char>(_fields[1]);
+        _session.protocol = static_cast<std::uint8_t>(_fields[2]);
+        _session.flags = static_cast<std::uint8_t>(_fields[3]);
+        _fields.remove_prefix(4);
+        if(!take_field(_fields, _session.name) || !take_field(_fields, _session.ip) || !take_field(_fields, _session.room)
+           || !take_field(_fields, _session.input) || !take_field(_fields, _session.output)){
+            ::close(_fd);
+            continue;
+        }
+        received.sessions.push_back(std::move(_session));
+    }
+}
+
+void networkLibrary::HotRestart::close_all(transfer &unused)
+{
+    for(int _listener : unused.listeners) ::close(_listener);
+    for(auto const& _session : unused.sessions) ::close(_session.fd);
+    unused.listeners.clear();
+    unused.sessions.clear();
+}
@@ -0,0 +1,121 @@
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace networkLibrary
+{
+    /**
+     * @brief Hands the sockets of a running server to its successor over a Unix socket.
+     *
+     * A server started with a handoff path first connects to it: if a server is listening
+     * there, the new one sends "\handoff" and receives the old one's listening sockets and
+     * client connections as file descriptors (SCM_RIGHTS), together with what every session
+     * needs to go on. Once it has all of it, the new server replies "\adopted" and the old one
+     * stops. An old server that gets no reply within the timeout resumes its sessions, and a new
+     * server that got only part closes it and refuses to start. Either way the new server then
+     * listens on the path for its own successor.
+     *
+     * Every record is an 8 byte header, which carries the descriptor if the record has one,
+     * followed by its payload:
+     *
+     * | Bytes | Field                          |
+     * |-------|--------------------------------|
+     * | 0-3   | Payload length, big-endian     |
+     * | 4     | Record type                    |
+     * | 5-7   | Reserved, zero                 |
+     *
+     * A session payload is the client's port (2 bytes), the wire format and flags (1 byte
+     * each), then the name, IP address, room, unprocessed input and unsent output, each a
+     * 4 byte big-endian length and the bytes. Listeners come in loop order, then the sessions,
+     * then END.
+     */
+    namespace HotRestart
+    {
+        /**
+         * @brief Type of a handoff record.
+         */
+        enum recordType : std::uint8_t {
+            LISTENER = 1, ///< A listening socket, one per event loop; no payload.
+            SESSION = 2,  ///< A client connection and its session.
+            END = 3       ///< Nothing follows.
+        };
+
+        /**
+         * @brief Flag bits of a session record.
+         */
+        enum sessionFlags : std::uint8_t {
+            NAMED = 0x01,    ///< The client has claimed its name.
+            COMPRESS = 0x02  ///< Compression was negotiated.
+        };
+
+        constexpr std::size_t header_size = 8; ///< Size of a record header.
+        constexpr std::string_view handoff_command = "\\handoff\n"; ///< Request of the new server.
+        constexpr std::string_view adopted_reply = "\\adopted\n"; ///< Reply of the new server once everything arrived.
+        constexpr std::chrono::seconds timeout{10}; ///< Longest either server waits for the other.
+
+        /**
+         * @brief What a session hands to its successor.
+         */
+        struct sessionState
+        {
+            int fd = -1;              ///< The client connection.
+            std::string name;         ///< Name of the participant.
+            std::string ip;           ///< Client's IP address.
+            unsigned int port = 0;    ///< Client's port number.
+            std::uint8_t protocol = 0; ///< Protocol::Mode of the connection.
+            std::uint8_t flags = 0;   ///< sessionFlags.
+            std::string room;         ///< Room the participant is in, empty before it has a name.
+            std::string input;        ///< Received bytes not handled yet.
+            std::string output;       ///< Encoded bytes not written yet, starting where the last write stopped.
+        };
+
+        /**
+         * @brief Everything one server hands to the next.
+         */
+        struct transfer
+        {
+            std::vector<int> listeners;          ///< Listening sockets, in loop order.
+            std::vector<sessionState> sessions;  ///< Client connections.
+            bool complete = false;               ///< Whether END arrived, set by receive().
+        };
+
+        /**
+         * @brief Connects to the handoff path and asks the server there for its sockets.
+         * @param path The handoff path.
+         * @return The blocking connection, -1 if no server listens on the path.
+         */
+        int request(const std::string &path);
+
+        /**
+         * @brief Sends a whole transfer and END, then waits for the new server's reply.
+         *
+         * Blocks the calling thread until the reply arrives, each write and the reply giving up
+         * after the timeout. The descriptors stay open in the sender; close them afterwards if
+         * it succeeded, take the sessions back if not.
+         * @param channel Connection to the new server.
+         * @param sent What to send.
+         * @return False if the connection failed or the new server did not confirm.
+         */
+        bool send(int channel, const transfer &sent);
+
+        /**
+         * @brief Receives records until END or until the connection fails, and confirms a complete transfer.
+         * @param channel Connection to the old server.
+         * @param[out] received Everything that arrived whole; complete only if the reply was sent too.
+         */
+        void receive(int channel, transfer &received);
+
+        /**
+         * @brief Closes every descriptor of a transfer.
+         */
+        void close_all(transfer &unused);
+    };
+};
+
+#endif // HOT_RESTART_H
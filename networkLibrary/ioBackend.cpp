@@ -0,0 +1,71 @@
+#include "ioBackend.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+#include <unistd.h>
+
+#include <boost/asio/detail/config.hpp>
+
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+#include <liburing.h>
+#endif
+
+const char* networkLibrary::ioBackend::name()
+{
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+    return "io_uring";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+    return "epoll";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+    return "kqueue";
+#elif defined(BOOST_ASIO_HAS_DEV_POLL)
+    return "/dev/poll";
+#else
+    return "select";
+#endif
+}
+
+bool networkLibrary::ioBackend::usable(std::string &reason)
+{
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+    // The same call Asio makes, on a ring just large enough to prove it works
+    io_uring _ring;
+    int _result = ::io_uring_queue_init(4, &_ring, 0);
+    if(_result < 0){
+        reason = std::strerror(-_result);
+        return false;
+    }
+    ::io_uring_queue_exit(&_ring);
+#else
+    (void)reason;
+#endif
+    return true;
+}
+
+void networkLibrary::ioBackend::exec_fallback(char **argv, std::string &reason)
+{
+    // argv[0] may be a bare name found through PATH, the link names the file itself
+    char _self[PATH_MAX];
+    ssize_t _length = ::readlink("/proc/self/exe", _self, sizeof(_self));
+    if(_length <= 0 || _length == static_cast<ssize_t>(sizeof(_self))){
+        reason = std::string("no path of the running program : ") + std::strerror(errno);
+        return;
+    }
+    std::string _fallback = std::string(_self, _length) + fallback_suffix;
+    ::execv(_fallback.c_str(), argv);
+    reason = _fallback + " : " + std::strerror(errno);
+}
+
+bool networkLibrary::ioBackend::ensure_usable(char **argv)
+{
+    // Asio would only fail once the first socket is opened
+    std::string _reason;
+    if(usable(_reason)) return true;
+    std::cout << "I/O Backend " << name() << " is unavailable : " << _reason << ", falling back to epoll" << std::endl;
+    exec_fallback(argv, _reason);
+    std::cout << "No epoll build to fall back to : " << _reason << std::endl;
+    return false;
+}
@@ -0,0 +1,59 @@
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include <string>
+
+namespace networkLibrary
+{
+    /**
+     * @brief The reactor Asio runs sockets and timers on.
+     *
+     * Chosen when the library is built: CHATAPP_IO_URING selects io_uring where Boost and
+     * liburing support it, otherwise it is epoll on Linux. Asio cannot switch at run time, so
+     * an io_uring build also builds every program again on epoll, named with fallback_suffix,
+     * and a program calls ensure_usable() before it creates an io_context.
+     *
+     * Only sockets and timers run on the backend. The logger and the history segment log
+     * write files with blocking calls on their own threads: Boost 1.74 has no Asio file
+     * objects, which arrive with io_uring support in 1.78, so file I/O does not move to it.
+     */
+    namespace ioBackend
+    {
+        constexpr const char* fallback_suffix = "Epoll"; ///< Appended to a program's name for its epoll copy.
+
+        /**
+         * @brief Name of the backend, e.g. "epoll" or "io_uring".
+         */
+        const char* name();
+
+        /**
+         * @brief Checks that the kernel lets this process use the backend.
+         *
+         * io_uring may be missing from an old kernel, disabled by kernel.io_uring_disabled or
+         * refused by a seccomp profile; Asio would only fail on the first socket or timer.
+         * @param[out] reason Why not, if the backend is unusable.
+         * @return True if the backend works, always for epoll.
+         */
+        bool usable(std::string &reason);
+
+        /**
+         * @brief Replaces the process with the program's epoll copy, run with the same arguments.
+         *
+         * The copy is the running executable's path followed by fallback_suffix.
+         * @param argv The program's arguments, as passed to main().
+         * @param[out] reason Why not, if it returns.
+         */
+        void exec_fallback(char **argv, std::string &reason);
+
+        /**
+         * @brief Checks usable() and runs exec_fallback() if it says no, reporting both on stdout.
+         *
+         * Called by every program's main() before it creates an io_context.
+         * @param argv The program's arguments, as passed to main().
+         * @return True if the backend works; false if it does not and there is no epoll copy to run.
+         */
+        bool ensure_usable(char **argv);
+    };
+};
+
+#endif // IO_BACKEND_H
@@ -0,0 +1,143 @@
+#include "metricsRegistry.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+    /**
+     * @brief Largest value of a histogram bucket.
+     */
+    std::uint64_t bucket_bound(std::size_t bucket)
+    {
+        if(bucket >= 64) return UINT64_MAX;
+        return (std::uint64_t(1) << bucket) - 1;
+    }
+
+    void append_line(std::string &out, const char* format, const char* name, std::uint64_t value)
+    {
+        char line[160];
+        int len = std::snprintf(line, sizeof(line), format, name, static_cast<unsigned long long>(value));
+        if(len > 0) out.append(line, std::min<std::size_t>(len, sizeof(line) - 1));
+    }
+};
+
+std::uint64_t networkLibrary::metricsRegistry::distribution::percentile(double fraction) const
+{
+    if(m_count == 0) return 0;
+    std::uint64_t rank = static_cast<std::uint64_t>(fraction * m_count);
+    if(rank >= m_count) rank = m_count - 1;
+    std::uint64_t seen = 0;
+    for(std::size_t i=0; i<buckets; ++i){
+        seen += m_buckets[i];
+        if(seen > rank) return bucket_bound(i);
+    }
+    return bucket_bound(buckets - 1);
+}
+
+networkLibrary::metricsRegistry::snapshot networkLibrary::metricsRegistry::read() const
+{
+    snapshot snap;
+    for(auto const& sh : m_shards){
+        for(std::size_t c=0; c<COUNTERS; ++c) snap.m_counters[c] += sh.m_counters[c].load(std::memory_order_relaxed);
+        for(std::size_t h=0; h<HISTOGRAMS; ++h){
+            distribution& dist = snap.m_histograms[h];
+            for(std::size_t i=0; i<buckets; ++i){
+                std::uint64_t cnt = sh.m_buckets[h][i].load(std::memory_order_relaxed);
+                dist.m_buckets[i] += cnt;
+                dist.m_count += cnt;
+            }
+            dist.m_sum += sh.m_sums[h].load(std::memory_order_relaxed);
+        }
+    }
+    return snap;
+}
+
+std::string networkLibrary::metricsRegistry::render() const
+{
+    snapshot snap = read();
+    std::string out;
+
+    for(std::size_t c=0; c<COUNTERS; ++c){
+        append_line(out, "# TYPE chat_%s_total counter\n", name(counter(c)), 0);
+        append_line(out, "chat_%s_total %llu\n", name(counter(c)), snap.m_counters[c]);
+    }
+    append_line(out, "# TYPE chat_%s gauge\n", "connections_open", 0);
+    append_line(out, "chat_%s %llu\n", "connections_open", snap.m_counters[CONNECTIONS_ACCEPTED] - std::min(snap.m_counters[CONNECTIONS_ACCEPTED], snap.m_counters[CONNECTIONS_CLOSED]));
+
+    for(std::size_t h=0; h<HISTOGRAMS; ++h){
+        const distribution& dist = snap.m_histograms[h];
+        const char* _name = name(histogram(h));
+        append_line(out, "# TYPE chat_%s histogram\n", _name, 0);
+
+        // Cumulative buckets up to the last one holding a value
+        std::size_t last = 0;
+        for(std::size_t i=0; i<buckets; ++i) if(dist.m_buckets[i]) last = i;
+        std::uint64_t cumulative = 0;
+        for(std::size_t i=0; i<=last && i<64; ++i){
+            cumulative += dist.m_buckets[i];
+            char line[160];
+            int len = std::snprintf(line, sizeof(line), "chat_%s_bucket{le=\"%llu\"} %llu\n", _name,
+                                    static_cast<unsigned long long>(bucket_bound(i)), static_cast<unsigned long long>(cumulative));
+            if(len > 0) out.append(line, std::min<std::size_t>(len, sizeof(line) - 1));
+        }
+        append_line(out, "chat_%s_bucket{le=\"+Inf\"} %llu\n", _name, dist.m_count);
+        append_line(out, "chat_%s_sum %llu\n", _name, dist.m_sum);
+        append_line(out, "chat_%s_count %llu\n", _name, dist.m_count);
+    }
+    return out;
+}
+
+std::string networkLibrary::metricsRegistry::summary() const
+{
+    snapshot snap = read();
+    std::string out = "Server Stats:-\n";
+
+    for(std::size_t c=0; c<COUNTERS; ++c){
+        append_line(out, "    %-22s %llu\n", name(counter(c)), snap.m_counters[c]);
+    }
+    for(std::size_t h=0; h<HISTOGRAMS; ++h){
+        const distribution& dist = snap.m_histograms[h];
+        char line[200];
+        int len = std::snprintf(line, sizeof(line), "    %-22s count %llu  p50 <= %llu  p99 <= %llu  p999 <= %llu\n", name(histogram(h)),
+                                static_cast<unsigned long long>(dist.m_count),
+                                static_cast<unsigned long long>(dist.percentile(0.5)),
+                                static_cast<unsigned long long>(dist.percentile(0.99)),
+                                static_cast<unsigned long long>(dist.percentile(0.999)));
+        if(len > 0) out.append(line, std::min<std::size_t>(len, sizeof(line) - 1));
+    }
+    return out;
+}
+
+const char* networkLibrary::metricsRegistry::name(counter c)
+{
+    switch(c){
+        case CONNECTIONS_ACCEPTED: return "connections_accepted";
+        case CONNECTIONS_CLOSED: return "connections_closed";
+        case CONNECTIONS_DROPPED: return "connections_dropped";
+        case CONNECTIONS_TIMED_OUT: return "connections_timed_out";
+        case CONNECTIONS_REJECTED: return "connections_rejected";
+        case BYTES_IN: return "bytes_in";
+        case BYTES_OUT: return "bytes_out";
+        case MESSAGES_IN: return "messages_in";
+        case MESSAGES_OUT: return "messages_out";
+        case WRITES_OUT: return "writes_out";
+        case MESSAGES_DROPPED: return "messages_dropped";
+        case READS_THROTTLED: return "reads_throttled";
+        case RELAY_FRAMES_OUT: return "relay_frames_out";
+        case RELAY_FRAMES_IN: return "relay_frames_in";
+        case RELAY_DUPLICATES: return "relay_duplicates";
+        case SESSIONS_ADOPTED: return "sessions_adopted";
+        default: return "unknown";
+    }
+}
+
+const char* networkLibrary::metricsRegistry::name(histogram h)
+{
+    switch(h){
+        case QUEUE_DEPTH: return "queue_depth";
+        case HANDLER_LATENCY: return "handler_latency_ns";
+        case FANOUT_TIME: return "fanout_time_ns";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,174 @@
+#ifndef METRICS_REGISTRY_H
+#define METRICS_REGISTRY_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace networkLibrary
+{
+    /**
+     * @brief Counters and histograms of a server, updated from every IO thread.
+     *
+     * Every thread updates its own cache-line aligned shard with relaxed atomic adds, so an
+     * update never contends with other threads and costs a few nanoseconds. Reading sums the
+     * shards, which makes a snapshot approximate while updates are in flight but never torn
+     * per value.
+     *
+     * Histograms have power-of-two buckets: bucket i counts the values whose bit width is i,
+     * i.e. those in [2^(i-1), 2^i).
+     */
+    class metricsRegistry;
+};
+
+class networkLibrary::metricsRegistry
+{
+public:
+    /**
+     * @brief Monotonic counters.
+     */
+    enum counter : std::size_t {
+        CONNECTIONS_ACCEPTED,   ///< Connections accepted.
+        CONNECTIONS_CLOSED,     ///< Sessions that ended, for whatever reason.
+        CONNECTIONS_DROPPED,    ///< Sessions closed by the server, e.g. slow consumers and oversized messages.
+        CONNECTIONS_TIMED_OUT,  ///< Sessions closed for not completing the handshake or staying idle too long.
+        CONNECTIONS_REJECTED,   ///< Connections turned away because the server or the client's address was full.
+        BYTES_IN,               ///< Bytes read from clients.
+        BYTES_OUT,              ///< Bytes written to clients.
+        MESSAGES_IN,            ///< Lines or frames read from clients.
+        MESSAGES_OUT,           ///< Messages written to clients.
+        WRITES_OUT,             ///< Gather writes to clients, each normally one system call.
+        MESSAGES_DROPPED,       ///< Messages not queued for slow consumers.
+        READS_THROTTLED,        ///< Times a session stopped reading until its rate limits refilled.
+        RELAY_FRAMES_OUT,       ///< Frames queued for relay links to other nodes, once per link.
+        RELAY_FRAMES_IN,        ///< Frames received from other nodes and handled.
+        RELAY_DUPLICATES,       ///< Frames from other nodes dropped as already seen.
+        SESSIONS_ADOPTED,       ///< Client connections taken over from the previous server by a hot restart.
+        COUNTERS                ///< Number of counters.
+    };
+
+    /**
+     * @brief Distributions.
+     */
+    enum histogram : std::size_t {
+        QUEUE_DEPTH,            ///< Outbound queue length of a session after queueing a message.
+        HANDLER_LATENCY,        ///< Nanoseconds spent handling the messages of one read.
+        FANOUT_TIME,            ///< Nanoseconds an event loop spends queueing a broadcast or room message to its sessions.
+        HISTOGRAMS              ///< Number of histograms.
+    };
+
+    static constexpr std::size_t buckets = 65; ///< Histogram buckets, one per bit width of a 64 bit value.
+    static constexpr std::size_t shards = 32;  ///< Shards; threads beyond this share them.
+
+    /**
+     * @brief Totals of a histogram.
+     */
+    struct distribution
+    {
+        std::array<std::uint64_t, buckets> m_buckets{}; ///< Number of values per bucket.
+        std::uint64_t m_count = 0;  ///< Number of values.
+        std::uint64_t m_sum = 0;    ///< Sum of the values.
+
+        /**
+         * @brief Upper bound of the bucket holding the given fraction of the values.
+         */
+        std::uint64_t percentile(double fraction) const;
+    };
+
+    /**
+     * @brief Totals of every metric at one point in time.
+     */
+    struct snapshot
+    {
+        std::array<std::uint64_t, COUNTERS> m_counters{};  ///< Totals of the counters.
+        std::array<distribution, HISTOGRAMS> m_histograms; ///< Totals of the histograms.
+    };
+
+private:
+    /**
+     * @brief Metrics updated by one thread.
+     */
+    struct alignas(64) shard
+    {
+        std::array<std::atomic<std::uint64_t>, COUNTERS> m_counters{}; ///< Counter values.
+        std::array<std::array<std::atomic<std::uint64_t>, buckets>, HISTOGRAMS> m_buckets{}; ///< Histogram buckets.
+        std::array<std::atomic<std::uint64_t>, HISTOGRAMS> m_sums{}; ///< Histogram sums.
+    };
+
+    std::array<shard, shards> m_shards; ///< The shards.
+
+    /**
+     * @brief The shard of the calling thread.
+     */
+    shard &local();
+
+    /**
+     * @brief Bucket of a histogram value.
+     */
+    static std::size_t bucket_of(std::uint64_t value);
+
+public:
+    metricsRegistry() = default;
+
+    metricsRegistry(const metricsRegistry &) = delete;
+    metricsRegistry &operator=(const metricsRegistry &) = delete;
+
+    /**
+     * @brief Adds to a counter.
+     */
+    void add(counter c, std::uint64_t n = 1)
+    {
+        local().m_counters[c].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Records a value in a histogram.
+     */
+    void record(histogram h, std::uint64_t value)
+    {
+        shard& sh = local();
+        sh.m_buckets[h][bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        sh.m_sums[h].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Sums the shards.
+     */
+    snapshot read() const;
+
+    /**
+     * @brief Every metric in the Prometheus text exposition format, for the scrape endpoint.
+     */
+    std::string render() const;
+
+    /**
+     * @brief A short human readable summary, for the \stats command.
+     */
+    std::string summary() const;
+
+    /**
+     * @brief Name of a counter, e.g. "connections_accepted".
+     */
+    static const char* name(counter c);
+
+    /**
+     * @brief Name of a histogram, e.g. "handler_latency_ns".
+     */
+    static const char* name(histogram h);
+};
+
+inline networkLibrary::metricsRegistry::shard &networkLibrary::metricsRegistry::local()
+{
+    static std::atomic<std::size_t> next_thread{0};
+    static thread_local const std::size_t index = next_thread.fetch_add(1, std::memory_order_relaxed) % shards;
+    return m_shards[index];
+}
+
+inline std::size_t networkLibrary::metricsRegistry::bucket_of(std::uint64_t value)
+{
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+#endif // METRICS_REGISTRY_H
@@ -1,395 +1,2360 @@
 #include "networkLibrary.h"
 
+#include <new>
+#include <array>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    /**
+     * @brief One connection to the metrics endpoint.
+     */
+    struct metricsScrape
+    {
+        boost::asio::ip::tcp::socket m_socket;  ///< Connection of the scraper.
+        boost::asio::steady_timer m_deadline;   ///< Closes the connection if the scraper does not.
+        std::string m_response;                 ///< The response being written.
+        std::array<char, 512> m_discard;        ///< Scratch buffer for the discarded request.
+
+        explicit metricsScrape(boost::asio::ip::tcp::socket socket)
+            : m_socket(std::move(socket)),
+              m_deadline(m_socket.get_executor())
+        {
+        }
+
+        void close()
+        {
+            boost::system::error_code ec;
+            m_deadline.cancel();
+            m_socket.close(ec);
+        }
+    };
+
+    /**
+     * @brief Reads and discards until the scraper closes, so closing never resets the connection.
+     */
+    void discard_request(const std::shared_ptr<metricsScrape> &scrape)
+    {
+        scrape->m_socket.async_read_some(
+            boost::asio::buffer(scrape->m_discard),
+            [scrape](boost::system::error_code ec, std::size_t){
+                if(ec) scrape->close();
+                else discard_request(scrape);
+            });
+    }
+
+    /**
+     * @brief Answers a scrape with the metrics as a plain-text HTTP response.
+     */
+    void serve_scrape(const std::shared_ptr<metricsScrape> &scrape, const std::string &body)
+    {
+        scrape->m_response =
+            "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            "Connection: close\r\n"
+            "\r\n" + body;
+
+        boost::asio::async_write(
+            scrape->m_socket,
+            boost::asio::buffer(scrape->m_response),
+            [scrape](boost::system::error_code ec, std::size_t){
+                if(ec){
+                    scrape->close();
+                    return;
+                }
+                boost::system::error_code _ec;
+                scrape->m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send, _ec);
+                scrape->m_deadline.expires_after(std::chrono::seconds(1));
+                scrape->m_deadline.async_wait([scrape](boost::system::error_code ec){
+                    if(!ec) scrape->close();
+                });
+                discard_request(scrape);
+            });
+    }
+};
+
+/*
+    Chat Message
+*/
+
+namespace
+{
+    const char incompressible = 0; ///< Address marking a message whose compressed frame would not be smaller.
+};
+
+networkLibrary::chatMessage::chatMessage(std::size_t size)
+    : m_refs(0),
+      m_size(size),
+      m_deflated(nullptr)
+{
+
+}
+
+std::size_t networkLibrary::chatMessage::footprint(std::size_t size)
+{
+    return sizeof(chatMessage) + networkLibrary::Protocol::header_size + size + 1;
+}
+
+networkLibrary::chatMessage* networkLibrary::chatMessage::allocate(std::size_t size)
+{
+    void* raw = networkLibrary::bufferPool::allocate(footprint(size));
+    return new (raw) chatMessage(size);
+}
+
+std::size_t networkLibrary::chatMessage::deflated_footprint(std::size_t size)
+{
+    return sizeof(std::size_t) + networkLibrary::Protocol::header_size + size;
+}
+
+char* networkLibrary::chatMessage::storage()
+{
+    return reinterpret_cast<char*>(this + 1);
+}
+
+const char* networkLibrary::chatMessage::storage() const
+{
+    return reinterpret_cast<const char*>(this + 1);
+}
+
+networkLibrary::messagePtr networkLibrary::chatMessage::make(std::string_view body)
+{
+    return make({body});
+}
+
+networkLibrary::messagePtr networkLibrary::chatMessage::make(std::initializer_list<std::string_view> parts, std::uint8_t type)
+{
+    std::size_t sz = 0;
+    for(auto const& part : parts) sz += part.size();
+
+    // A trailing newline is the text encoding's terminator, not part of the body
+    for(auto it = parts.end(); it != parts.begin(); ){
+        --it;
+        if(it->empty()) continue;
+        if(it->back() == '\n') --sz;
+        break;
+    }
+
+    chatMessage* message = allocate(sz);
+    char* out = message->storage();
+    networkLibrary::Protocol::encode_header(out, networkLibrary::Protocol::frameHeader{static_cast<std::uint32_t>(sz), type, 0});
+    out += networkLibrary::Protocol::header_size;
+
+    std::size_t left = sz;
+    for(auto const& part : parts){
+        std::size_t cnt = std::min(left, part.size());
+        std::memcpy(out, part.data(), cnt);
+        out += cnt;
+        left -= cnt;
+    }
+    *out = '\n';
+
+    return messagePtr(message);
+}
+
+std::size_t networkLibrary::chatMessage::size() const
+{
+    return m_size;
+}
+
+std::string_view networkLibrary::chatMessage::view() const
+{
+    return std::string_view(storage() + networkLibrary::Protocol::header_size, m_size);
+}
+
+boost::asio::const_buffer networkLibrary::chatMessage::buffer(networkLibrary::Protocol::Mode mode) const
+{
+    if(mode == networkLibrary::Protocol::BINARY){
+        return boost::asio::const_buffer(storage(), networkLibrary::Protocol::header_size + m_size);
+    }
+    return boost::asio::const_buffer(storage() + networkLibrary::Protocol::header_size, m_size + 1);
+}
+
+const char* networkLibrary::chatMessage::deflate() const
+{
+    if(m_size < 2) return &incompressible;
+
+    // Layout: [frame length][frame header][compressed body], the stream must beat the plain body
+    char* block = static_cast<char*>(networkLibrary::bufferPool::allocate(deflated_footprint(m_size)));
+    char* frame = block + sizeof(std::size_t);
+    std::size_t length = networkLibrary::Protocol::compress(view().data(), m_size, frame + networkLibrary::Protocol::header_size, m_size - 1);
+    if(length == 0){
+        networkLibrary::bufferPool::deallocate(block, deflated_footprint(m_size));
+        return &incompressible;
+    }
+
+    std::uint8_t type = networkLibrary::Protocol::decode_header(storage()).type;
+    networkLibrary::Protocol::encode_header(frame, networkLibrary::Protocol::frameHeader{static_cast<std::uint32_t>(length), type, networkLibrary::Protocol::COMPRESSED});
+    length += networkLibrary::Protocol::header_size;
+    std::memcpy(block, &length, sizeof(length));
+    return block;
+}
+
+boost::asio::const_buffer networkLibrary::chatMessage::compressed_buffer() const
+{
+    const char* _deflated = m_deflated.load(std::memory_order_acquire);
+    if(_deflated == nullptr){
+        const char* _built = deflate();
+        // Recipients racing on the first compression keep whichever frame was installed first
+        if(m_deflated.compare_exchange_strong(_deflated, _built, std::memory_order_acq_rel, std::memory_order_acquire)){
+            _deflated = _built;
+        }
+        else if(_built != &incompressible){
+            networkLibrary::bufferPool::deallocate(const_cast<char*>(_built), deflated_footprint(m_size));
+        }
+    }
+    if(_deflated == &incompressible) return buffer(networkLibrary::Protocol::BINARY);
+
+    std::size_t length;
+    std::memcpy(&length, _deflated, sizeof(length));
+    return boost::asio::const_buffer(_deflated + sizeof(std::size_t), length);
+}
+
+void networkLibrary::intrusive_ptr_add_ref(const chatMessage* message)
+{
+    message->m_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void networkLibrary::intrusive_ptr_release(const chatMessage* message)
+{
+    if(message->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        std::size_t size = chatMessage::footprint(message->m_size);
+        const char* _deflated = message->m_deflated.load(std::memory_order_acquire);
+        if(_deflated != nullptr && _deflated != &incompressible){
+            networkLibrary::bufferPool::deallocate(const_cast<char*>(_deflated), chatMessage::deflated_footprint(message->m_size));
+        }
+        message->~chatMessage();
+        networkLibrary::bufferPool::deallocate(const_cast<chatMessage*>(message), size);
+    }
+}
+
 /*
     Asynchronous Server
 */
 
-networkLibrary::Server::asyncServer::asyncServer(boost::asio::io_context &io_context, unsigned int port_num)
-    : m_io_context(io_context),
-      m_port(port_num),
-      m_acceptor(
-          m_io_context,
-          boost::asio::ip::tcp::endpoint(
-              boost::asio::ip::tcp::v4(),
-              m_port)),
-      server_log(Logger::Location::STDOUT)
-{
-    // std::cout << "asyncServer(TCP/IP) started listening on Port : " << m_port << std::endl;
-    server_log.log({"asyncServer(TCP/IP) started listening on Port : ",std::to_string(m_port)},std::string(" "));
-    this->startAccept();
+networkLibrary::Server::asyncServer::asyncServer(boost::asio::io_context &io_context, unsigned int port_num, serverConfig config)
+    : m_port(port_num),
+      m_rooms(1),
+      m_config(config),
+      m_history(m_config.history_size, m_config.history_rooms),
+      m_stopping(false),
+      m_ping(chatMessage::make({networkLibrary::Protocol::ping_command}, networkLibrary::Protocol::PING)),
+      m_admission(m_config.max_connections, m_config.max_connections_per_address, m_config.address_message_rate, m_config.address_byte_rate, m_config.rate_burst),
+      m_handoff_phase(RELEASING),
+      m_handoff_pending(0),
+      m_handoff_channel(-1),
+      server_log(m_config.log_location, m_config.log_file, m_config.log_mode, m_config.log_overflow, m_config.log_capacity)
+{
+    open_history();
+    open_commands();
+    take_over();
+    open_loops({std::ref(io_context)}, false);
+    adopt_sessions();
+    open_metrics();
+    open_federation();
+    open_handoff();
+}
+
+networkLibrary::Server::asyncServer::asyncServer(const std::vector<std::reference_wrapper<boost::asio::io_context>> &io_contexts, unsigned int port_num, serverConfig config)
+    : m_port(port_num),
+      m_rooms(io_contexts.size()),
+      m_config(config),
+      m_history(m_config.history_size, m_config.history_rooms),
+      m_stopping(false),
+      m_ping(chatMessage::make({networkLibrary::Protocol::ping_command}, networkLibrary::Protocol::PING)),
+      m_admission(m_config.max_connections, m_config.max_connections_per_address, m_config.address_message_rate, m_config.address_byte_rate, m_config.rate_burst),
+      m_handoff_phase(RELEASING),
+      m_handoff_pending(0),
+      m_handoff_channel(-1),
+      server_log(m_config.log_location, m_config.log_file, m_config.log_mode, m_config.log_overflow, m_config.log_capacity)
+{
+    open_history();
+    open_commands();
+    take_over();
+    open_loops(io_contexts, true);
+    adopt_sessions();
+    open_metrics();
+    open_federation();
+    open_handoff();
+}
+
+networkLibrary::Server::asyncServer::~asyncServer()
+{
+    if(m_handoff_thread.joinable()) m_handoff_thread.join();
+}
+
+void networkLibrary::Server::asyncServer::open_history()
+{
+    if(m_config.history_size == 0 || m_config.history_directory.empty()) return;
+    m_history_log = std::make_unique<networkLibrary::segmentLog>(
+        m_config.history_directory,
+        m_config.history_segment_size,
+        m_config.history_segments_kept,
+        m_config.history_sync_interval);
+
+    std::size_t cnt = 0;
+    m_history_log->replay([this, &cnt](std::string_view _room_name, std::string_view _body){
+        m_history.get(std::string(_room_name))->push(chatMessage::make(_body));
+        ++cnt;
+    });
+    LOG_INFO(server_log, "Rebuilt history of {} messages from {}", cnt, m_config.history_directory);
+}
+
+void networkLibrary::Server::asyncServer::open_commands()
+{
+    networkLibrary::chatSession::register_commands(m_commands);
+    build_help();
+}
+
+void networkLibrary::Server::asyncServer::build_help()
+{
+    std::string message = "Client Commands - \n";
+    int cnt = 0;
+    for(auto const& _command : m_commands.commands()){
+        std::string _syntax = "\\" + _command.m_name;
+        if(!_command.m_usage.empty()) _syntax += " " + _command.m_usage;
+        if(_syntax.size() < 17) _syntax.resize(17, ' ');
+        message += "    " + std::to_string(++cnt) + ". " + _syntax + ": " + _command.m_description + "\n";
+    }
+    message += "\n";
+    m_help = chatMessage::make(message);
+}
+
+bool networkLibrary::Server::asyncServer::register_command(std::string name, std::string usage, std::string description, networkLibrary::commandHandler handler)
+{
+    if(!m_commands.add(std::move(name), std::move(usage), std::move(description), std::move(handler))) return false;
+    build_help();
+    return true;
+}
+
+void networkLibrary::Server::asyncServer::record(const networkLibrary::historyPtr &_history, const networkLibrary::messagePtr &_message)
+{
+    _history->push(_message);
+    if(m_history_log) m_history_log->append(_history->name(), _message->view());
+}
+
+void networkLibrary::Server::asyncServer::open_loops(const std::vector<std::reference_wrapper<boost::asio::io_context>> &io_contexts, bool per_loop)
+{
+    for(auto& io_context : io_contexts){
+        m_loops.push_back(
+            std::make_unique<serverLoop>(
+                *this,
+                m_loops.size(),
+                io_context.get(),
+                boost::asio::ip::tcp::endpoint(
+                    boost::asio::ip::tcp::v4(),
+                    m_port),
+                per_loop,
+                !per_loop,
+                m_loops.size() < m_handoff.listeners.size() ? m_handoff.listeners[m_loops.size()] : -1));
+        m_port = m_loops.back()->m_acceptor.local_endpoint().port();
+    }
+    // Connections waiting on listeners of loops this server does not have are reset
+    for(std::size_t i=m_loops.size(); i<m_handoff.listeners.size(); ++i) ::close(m_handoff.listeners[i]);
+    m_handoff.listeners.clear();
+    // std::cout << "asyncServer(TCP/IP) started listening on Port : " << m_port << std::endl;
+    LOG_INFO(server_log, "asyncServer(TCP/IP) started listening on Port : {} with {} event loop(s)", m_port, m_loops.size());
+    for(auto& loop : m_loops){
+        loop->startAccept();
+        loop->start_timers();
+    }
+}
+
+namespace
+{
+    /**
+     * @brief Opens, binds and listens, leaving the acceptor closed if any step fails.
+     */
+    template <typename Acceptor>
+    void listen_on(Acceptor &acceptor, const typename Acceptor::endpoint_type &endpoint, boost::system::error_code &ec)
+    {
+        acceptor.open(endpoint.protocol(), ec);
+        if(!ec) acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
+        if(!ec) acceptor.bind(endpoint, ec);
+        if(!ec) acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+        if(ec){
+            boost::system::error_code _ignored;
+            acceptor.close(_ignored);
+        }
+    }
+};
+
+void networkLibrary::Server::asyncServer::open_metrics()
+{
+    boost::system::error_code ec;
+    open_metrics(ec);
+    if(ec) throw boost::system::system_error(ec, "Metrics endpoint");
+}
+
+void networkLibrary::Server::asyncServer::open_metrics(boost::system::error_code &ec)
+{
+    ec.clear();
+    if(m_config.metrics_port == 0) return;
+
+    // Scrapes share one strand, so a scrape's timer and reads never run concurrently
+    m_metrics_acceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(boost::asio::make_strand(m_loops.front()->m_io_context));
+    boost::asio::ip::address _address = boost::asio::ip::make_address(m_config.metrics_address, ec);
+    if(!ec) listen_on(*m_metrics_acceptor, boost::asio::ip::tcp::endpoint(_address, m_config.metrics_port), ec);
+    if(ec) return;
+    LOG_INFO(server_log, "Metrics endpoint listening on {}:{}", m_config.metrics_address, metrics_port());
+    accept_metrics();
+}
+
+void networkLibrary::Server::asyncServer::accept_metrics()
+{
+    m_metrics_acceptor->async_accept(
+        [this](boost::system::error_code ec, boost::asio::ip::tcp::socket _socket){
+            if(!ec) serve_scrape(std::make_shared<metricsScrape>(std::move(_socket)), m_metrics.render());
+            if(m_metrics_acceptor->is_open()) accept_metrics();
+        });
+}
+
+void networkLibrary::Server::asyncServer::open_federation()
+{
+    if(m_config.federation_port == 0 && m_config.federation_peers.empty()) return;
+
+    m_federation = std::make_unique<federation>(*this, m_loops.front()->m_io_context);
+    m_federation->start();
+}
+
+void networkLibrary::Server::asyncServer::close_endpoints()
+{
+    if(m_metrics_acceptor){
+        boost::asio::post(m_metrics_acceptor->get_executor(), [this](){
+            boost::system::error_code ec;
+            m_metrics_acceptor->close(ec);
+        });
+    }
+    if(m_handoff_acceptor){
+        boost::asio::post(m_handoff_acceptor->get_executor(), [this](){
+            boost::system::error_code ec;
+            m_handoff_acceptor->close(ec);
+        });
+    }
+    if(m_federation) m_federation->stop();
+}
+
+/*
+    Hot Restart
+*/
+
+void networkLibrary::Server::asyncServer::take_over()
+{
+    if(m_config.handoff_path.empty()) return;
+    m_handoff_started = std::chrono::steady_clock::now();
+    int _channel = networkLibrary::HotRestart::request(m_config.handoff_path);
+    if(_channel < 0) return;
+
+    // Blocks until the previous server has parked every session
+    networkLibrary::HotRestart::receive(_channel, m_handoff);
+    ::close(_channel);
+    if(!m_handoff.complete){
+        // Unconfirmed, the previous server takes its sockets back and this one must not serve them too
+        networkLibrary::HotRestart::close_all(m_handoff);
+        LOG_ERROR(server_log, "Handoff through {} ended early, the previous server keeps its sockets", m_config.handoff_path);
+        throw std::runtime_error("Handoff through " + m_config.handoff_path + " ended early");
+    }
+    LOG_INFO(server_log, "Took over {} listener(s) and {} session(s) in {} us", m_handoff.listeners.size(), m_handoff.sessions.size(),
+             std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_handoff_started).count());
+}
+
+void networkLibrary::Server::asyncServer::adopt_sessions()
+{
+    std::size_t _next = 0;
+    for(auto& _state : m_handoff.sessions){
+        serverLoop& _loop = *m_loops[_next++ % m_loops.size()];
+        sockaddr_storage _address{};
+        socklen_t _length = sizeof(_address);
+        ::getsockname(_state.fd, reinterpret_cast<sockaddr*>(&_address), &_length);
+
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::socket _socket(_loop.m_io_context);
+        _socket.assign(_address.ss_family == AF_INET6 ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4(), _state.fd, ec);
+        if(ec){
+            ::close(_state.fd);
+            continue;
+        }
+
+        // Limits count the connection again, but it is never turned away
+        networkLibrary::admissionControl::ticket _ticket;
+        m_admission.admit(_state.ip, _ticket);
+        auto _session = std::make_shared<networkLibrary::chatSession>(std::move(_socket), *this, _loop, std::move(_ticket));
+        auto _adopted = std::make_shared<networkLibrary::HotRestart::sessionState>(std::move(_state));
+        _session->post_to_session([_session, _adopted](){ _session->adopt(*_adopted); });
+    }
+    m_handoff.sessions.clear();
+}
+
+void networkLibrary::Server::asyncServer::open_handoff()
+{
+    boost::system::error_code ec;
+    open_handoff(ec);
+    if(ec) throw boost::system::system_error(ec, "Handoff path " + m_config.handoff_path);
+}
+
+void networkLibrary::Server::asyncServer::open_handoff(boost::system::error_code &ec)
+{
+    ec.clear();
+    if(m_config.handoff_path.empty()) return;
+
+    // The previous server's acceptor keeps its socket file until it stops, take the path over
+    ::unlink(m_config.handoff_path.c_str());
+    m_handoff_acceptor = std::make_unique<boost::asio::local::stream_protocol::acceptor>(boost::asio::make_strand(m_loops.front()->m_io_context));
+    listen_on(*m_handoff_acceptor, boost::asio::local::stream_protocol::endpoint(m_config.handoff_path), ec);
+    if(ec) return;
+    LOG_INFO(server_log, "Waiting for the next server on {}", m_config.handoff_path);
+    accept_handoff();
+}
+
+void networkLibrary::Server::asyncServer::accept_handoff()
+{
+    m_handoff_acceptor->async_accept(
+        [this](boost::system::error_code ec, boost::asio::local::stream_protocol::socket _socket){
+            // A client that never sends its request must not hold up the next one
+            if(m_handoff_acceptor->is_open()) accept_handoff();
+            if(ec) return;
+            auto _request = std::make_shared<std::pair<boost::asio::local::stream_protocol::socket, std::array<char, networkLibrary::HotRestart::handoff_command.size()>>>(std::move(_socket), std::array<char, networkLibrary::HotRestart::handoff_command.size()>{});
+            // A successor asks right away; a silent client is dropped, and keeps no stopped server running
+            auto _deadline = std::make_shared<boost::asio::steady_timer>(_request->first.get_executor(), networkLibrary::HotRestart::timeout);
+            _deadline->async_wait([_request](boost::system::error_code ec){
+                if(!ec) _request->first.close(ec);
+            });
+            boost::asio::async_read(_request->first, boost::asio::buffer(_request->second),
+                [this, _request, _deadline](boost::system::error_code ec, std::size_t){
+                    _deadline->cancel();
+                    if(ec || std::string_view(_request->second.data(), _request->second.size()) != networkLibrary::HotRestart::handoff_command) return;
+                    // The sockets are sent with blocking writes, the next server reads them right away
+                    _request->first.native_non_blocking(false, ec);
+                    _request->first.non_blocking(false, ec);
+                    hand_off(_request->first.release());
+                });
+        });
+}
+
+void networkLibrary::Server::asyncServer::hand_off(int channel)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_handoff_mutex);
+        if(m_handoff_channel >= 0 || m_stopping){
+            ::close(channel);
+            return;
+        }
+        m_handoff_channel = channel;
+        m_handoff_started = std::chrono::steady_clock::now();
+        m_handoff_phase = RELEASING;
+        m_handoff_pending = m_loops.size();
+        m_handoff.listeners.assign(m_loops.size(), -1);
+    }
+    LOG_INFO(server_log, "Handing off to the next server");
+    // The next server opens them again once it has the sockets
+    close_endpoints();
+
+    for(auto& loop : m_loops){
+        serverLoop* _loop = loop.get();
+        boost::asio::post(_loop->m_io_context, [this, _loop](){
+            boost::system::error_code ec;
+            int _listener = _loop->m_acceptor.release(ec);
+            {
+                std::lock_guard<std::mutex> lock(m_handoff_mutex);
+                m_handoff.listeners[_loop->m_index] = ec ? -1 : _listener;
+            }
+            // Accepts that completed before the release start their sessions first
+            boost::asio::post(_loop->m_io_context, [this](){ handoff_step(); });
+        });
+    }
+}
+
+void networkLibrary::Server::asyncServer::handoff_step()
+{
+    std::vector<std::shared_ptr<networkLibrary::chatSession>> _sessions;
+    handoffPhase _phase;
+    {
+        std::lock_guard<std::mutex> lock(m_handoff_mutex);
+        if(--m_handoff_pending != 0) return;
+        if(m_handoff_phase == RELEASING){
+            // No session is added any more
+            for_each_session([this](const std::shared_ptr<networkLibrary::chatSession>& _session){
+                m_handoff_sessions.push_back(_session);
+            });
+            m_handoff_phase = SUSPENDING;
+        }
+        else if(m_handoff_phase == SUSPENDING){
+            // Every message read before the sessions parked is queued by now
+            m_handoff_phase = CAPTURING;
+        }
+        else{
+            boost::asio::post(m_loops.front()->m_io_context, [this](){ finish_handoff(); });
+            return;
+        }
+        _phase = m_handoff_phase;
+        _sessions = m_handoff_sessions;
+        // One more for this call, so the step cannot end before every session was asked
+        m_handoff_pending = _sessions.size() + 1;
+    }
+
+    for(auto const& _session : _sessions){
+        if(_phase == SUSPENDING){
+            _session->post_to_session([_session](){ _session->suspend(); });
+        }
+        else{
+            _session->post_to_session([this, _session](){
+                networkLibrary::HotRestart::sessionState _state;
+                if(_session->capture(_state)){
+                    std::lock_guard<std::mutex> lock(m_handoff_mutex);
+                    m_handoff.sessions.push_back(std::move(_state));
+                    m_handoff_captured.push_back(_session);
+                }
+                handoff_step();
+            });
+        }
+    }
+    handoff_step();
+}
+
+void networkLibrary::Server::asyncServer::finish_handoff()
+{
+    m_handoff_thread = std::thread([this](){
+        bool _adopted = networkLibrary::HotRestart::send(m_handoff_channel, m_handoff);
+        boost::asio::post(m_loops.front()->m_io_context, [this, _adopted](){ end_handoff(_adopted); });
+    });
+}
+
+void networkLibrary::Server::asyncServer::end_handoff(bool adopted)
+{
+    m_handoff_thread.join();
+    ::close(m_handoff_channel);
+    auto _elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_handoff_started).count();
+    if(!adopted){
+        LOG_ERROR(server_log, "Handoff failed after {} us, resuming {} session(s)", _elapsed, m_handoff_sessions.size());
+        roll_back();
+        return;
+    }
+    LOG_INFO(server_log, "Handed {} session(s) off in {} us", m_handoff.sessions.size(), _elapsed);
+
+    // The next server holds its own descriptors now
+    networkLibrary::HotRestart::close_all(m_handoff);
+    m_handoff_sessions.clear();
+    m_handoff_captured.clear();
+    stop();
+}
+
+void networkLibrary::Server::asyncServer::roll_back()
+{
+    std::vector<int> _listeners;
+    std::vector<networkLibrary::HotRestart::sessionState> _states;
+    std::vector<std::shared_ptr<networkLibrary::chatSession>> _sessions, _captured;
+    {
+        std::lock_guard<std::mutex> lock(m_handoff_mutex);
+        _listeners.swap(m_handoff.listeners);
+        _states.swap(m_handoff.sessions);
+        _sessions.swap(m_handoff_sessions);
+        _captured.swap(m_handoff_captured);
+        m_handoff_channel = -1;
+    }
+
+    for(auto& loop : m_loops){
+        serverLoop* _loop = loop.get();
+        int _listener = _loop->m_index < _listeners.size() ? _listeners[_loop->m_index] : -1;
+        if(_listener < 0) continue;
+        boost::asio::post(_loop->m_io_context, [_loop, _listener](){
+            boost::system::error_code ec;
+            _loop->m_acceptor.assign(boost::asio::ip::tcp::v4(), _listener, ec);
+            if(ec) ::close(_listener);
+            else _loop->startAccept();
+        });
+    }
+
+    // Sessions whose connection was already closed get an empty state and leave
+    std::unordered_map<const networkLibrary::chatSession*, std::size_t> _state_of;
+    for(std::size_t i=0; i<_captured.size(); ++i) _state_of[_captured[i].get()] = i;
+    for(auto const& _session : _sessions){
+        auto _state = std::make_shared<networkLibrary::HotRestart::sessionState>();
+        auto it = _state_of.find(_session.get());
+        if(it != _state_of.end()) *_state = std::move(_states[it->second]);
+        _session->post_to_session([_session, _state](){ _session->resume_handoff(*_state); });
+    }
+
+    // What close_endpoints() closed for the next server; the sessions are served even without it
+    boost::system::error_code ec;
+    open_metrics(ec);
+    if(ec) LOG_ERROR(server_log, "Metrics endpoint not reopened after the failed handoff : {}", ec.message());
+    if(m_federation){
+        m_federation->start(ec);
+        if(ec) LOG_ERROR(server_log, "Relay port not reopened after the failed handoff : {}", ec.message());
+    }
+    open_handoff(ec);
+    if(ec) LOG_ERROR(server_log, "Handoff path not reopened after the failed handoff : {}", ec.message());
+}
+
+unsigned int networkLibrary::Server::asyncServer::port() const
+{
+    return m_port;
+}
+
+unsigned int networkLibrary::Server::asyncServer::federation_port() const
+{
+    return m_federation ? m_federation->port() : 0;
+}
+
+unsigned int networkLibrary::Server::asyncServer::metrics_port() const
+{
+    if(!m_metrics_acceptor) return 0;
+    boost::system::error_code ec;
+    return m_metrics_acceptor->local_endpoint(ec).port();
+}
+
+networkLibrary::metricsRegistry &networkLibrary::Server::asyncServer::metrics()
+{
+    return m_metrics;
+}
+
+void networkLibrary::Server::asyncServer::stop()
+{
+    m_stopping = true;
+    for(auto& loop : m_loops){
+        serverLoop* _loop = loop.get();
+        boost::asio::post(
+            _loop->m_io_context,
+            networkLibrary::make_handler(m_config.recycle_handlers,
+            [_loop](){
+                boost::system::error_code ec;
+                _loop->m_acceptor.close(ec);
+                {
+                    std::lock_guard<std::mutex> lock(_loop->m_timer_mutex);
+                    _loop->m_wheel_running = false;
+                    _loop->m_wheel_timer.cancel();
+                }
+
+                for(auto& _session : _loop->m_chat_sessions.clear()){
+                    _session->departed();
+                    _session->close();
+                }
+            }));
+    }
+    close_endpoints();
+    m_user_index.clear();
+    m_rooms.clear();
+}
+
+void networkLibrary::Server::asyncServer::write(const std::shared_ptr<networkLibrary::chatSession> _session, networkLibrary::messagePtr _message)
+{
+    _session->m_loop.post_message(std::move(_message), _session);
+}
+
+void networkLibrary::Server::asyncServer::write(const std::shared_ptr<networkLibrary::chatSession> _session, std::string_view buf)
+{
+    write(_session, chatMessage::make(buf));
+}
+
+
+void networkLibrary::Server::asyncServer::write_broadcast(std::string_view buf)
+{
+    write_broadcast(chatMessage::make(buf));
+}
+
+void networkLibrary::Server::asyncServer::write_broadcast(networkLibrary::messagePtr _message)
+{
+    broadcast_local(_message);
+    if(m_federation) m_federation->relay_broadcast(_message);
+}
+
+void networkLibrary::Server::asyncServer::broadcast_local(const networkLibrary::messagePtr &_message)
+{
+    for(auto& loop : m_loops){
+        loop->post_message(_message, nullptr);
+    }
+}
+
+void networkLibrary::Server::asyncServer::write_room(const networkLibrary::roomPtr &_room, networkLibrary::messagePtr _message)
+{
+    write_room_local(_room, _message);
+    if(m_federation) m_federation->relay_room(_room->name(), _message);
+}
+
+void networkLibrary::Server::asyncServer::write_room_local(const networkLibrary::roomPtr &_room, const networkLibrary::messagePtr &_message)
+{
+    for(auto& loop : m_loops){
+        if(_room->members(loop->m_index).size() == 0) continue;
+        loop->post_message(_message, nullptr, _room);
+    }
+}
+
+std::vector<networkLibrary::roomPtr> networkLibrary::Server::asyncServer::rooms()
+{
+    return m_rooms.list();
+}
+
+void networkLibrary::Server::asyncServer::join_room(const std::shared_ptr<networkLibrary::chatSession> _session, const std::string &name)
+{
+    leave_room(_session);
+    _session->m_room = m_rooms.join(name, _session->m_loop.m_index, _session);
+    if(m_config.history_size == 0) return;
+
+    // Replayed by handle, every message is shared with the ring
+    _session->m_history = m_history.get(name);
+    for(auto const& _message : _session->m_history->snapshot()) _session->deliver(_message);
+}
+
+networkLibrary::roomPtr networkLibrary::Server::asyncServer::leave_room(const std::shared_ptr<networkLibrary::chatSession> _session)
+{
+    networkLibrary::roomPtr _room = std::move(_session->m_room);
+    _session->m_room.reset();
+    _session->m_history.reset();
+    if(_room) m_rooms.leave(_room, _session->m_loop.m_index, _session);
+    return _room;
+}
+
+void networkLibrary::Server::asyncServer::add_session(const std::shared_ptr<networkLibrary::chatSession> _session)
+{
+    _session->m_loop.m_chat_sessions.insert(_session);
+}
+
+std::size_t networkLibrary::Server::asyncServer::session_count() const
+{
+    std::size_t cnt = 0;
+    for(auto& loop : m_loops) cnt += loop->m_chat_sessions.size();
+    return cnt;
+}
+
+void networkLibrary::Server::asyncServer::remove_session(const std::shared_ptr<networkLibrary::chatSession> _session)
+{
+    if(_session->m_loop.m_chat_sessions.erase(_session)){
+        if(_session->m_named){
+            m_user_index.release(_session->m_name, _session.get());
+            if(m_federation) m_federation->user_left(_session->m_name);
+        }
+        _session->departed();
+    }
+    // Also after stop(), so that no room keeps the session alive
+    leave_room(_session);
+}
+
+std::shared_ptr<networkLibrary::chatSession> networkLibrary::Server::asyncServer::find_session(const std::string& name)
+{
+    return m_user_index.find(name);
+}
+
+bool networkLibrary::Server::asyncServer::valid_name(const std::string& name)
+{
+    if(name.empty() || name.front() == '\\') return false;
+    return name.find_first_of("{}") == std::string::npos;
+}
+
+std::pair<std::string,std::string> networkLibrary::Server::asyncServer::parse(std::string &recv_message)
+{   
+    std::pair<std::string,std::string> _parsed_pr;
+    std::string& name = _parsed_pr.first;
+    std::string& message = _parsed_pr.second;
+
+    int sz = recv_message.size();
+    int cnt = 0;
+
+    for(unsigned i=0; i<sz; ++i){
+        if(cnt==0){
+            if(recv_message[i] != ':') name += recv_message[i];
+            else{
+                cnt += 1;
+                while(!name.empty() && (name.back()==' ' || name.back()=='\n')) name.pop_back();
+            }
+        }
+        else{
+            if(!(message.empty() && (recv_message[i]==' ' || recv_message[i]=='\n'))) message += recv_message[i];
+        }
+    }
+    while(!message.empty() && (message.back()==' ' || message.back()=='\n')) message.pop_back();
+
+    return _parsed_pr;
+}
+
+/*
+    Server Loop
+*/
+
+namespace
+{
+    using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+};
+
+networkLibrary::Server::serverLoop::serverLoop(asyncServer &_serv, std::size_t _index, boost::asio::io_context &_io_context, const boost::asio::ip::tcp::endpoint &_endpoint, bool _reuse_port, bool _session_strands, int _listener)
+    : m_serv(_serv),
+      m_index(_index),
+      m_io_context(_io_context),
+      m_acceptor(m_io_context),
+      m_session_strands(_session_strands),
+      m_mailbox(nullptr),
+      m_batch_timer(m_io_context),
+      m_wheel_timer(m_io_context),
+      m_wheel_epoch(std::chrono::steady_clock::now()),
+      m_wheel_running(false)
+{
+    if(_listener >= 0){
+        // Still listening, connections made during the restart wait in its backlog
+        m_acceptor.assign(_endpoint.protocol(), _listener);
+        return;
+    }
+    m_acceptor.open(_endpoint.protocol());
+    m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+    if(_reuse_port) m_acceptor.set_option(reuse_port(true));
+    m_acceptor.bind(_endpoint);
+    m_acceptor.listen();
+}
+
+networkLibrary::Server::serverLoop::~serverLoop()
+{
+    mailboxItem* item = m_mailbox.exchange(nullptr, std::memory_order_acquire);
+    while(item){
+        mailboxItem* next = item->m_next;
+        mailboxItem::release(item);
+        item = next;
+    }
+}
+
+void networkLibrary::Server::serverLoop::startAccept()
+{
+    m_acceptor.async_accept(
+        m_io_context,
+        networkLibrary::make_handler(m_serv.m_config.recycle_handlers,
+        [this](boost::system::error_code ec, boost::asio::ip::tcp::socket _socket)
+        {
+                if (!ec)
+                {
+                    boost::system::error_code _ec;
+                    boost::asio::ip::tcp::endpoint _endpoint = _socket.remote_endpoint(_ec);
+                    std::string _ip = _ec ? std::string() : _endpoint.address().to_string();
+
+                    networkLibrary::admissionControl::ticket _ticket;
+                    networkLibrary::admissionControl::verdict _verdict = m_serv.m_admission.admit(_ip, _ticket);
+                    if(_verdict == networkLibrary::admissionControl::ADMITTED){
+                        m_serv.m_metrics.add(networkLibrary::metricsRegistry::CONNECTIONS_ACCEPTED);
+                        std::make_shared<networkLibrary::chatSession>(std::move(_socket), m_serv, *this, std::move(_ticket))->start();
+                    }
+                    else{
+                        reject(_socket, _ip, _verdict);
+                    }
+                }
+                if(m_acceptor.is_open()) startAccept();
+            }));
+}
+
+void networkLibrary::Server::serverLoop::reject(boost::asio::ip::tcp::socket &_socket, const std::string &_ip, networkLibrary::admissionControl::verdict _verdict)
+{
+    std::string_view _reason = (_verdict == networkLibrary::admissionControl::SERVER_FULL)
+        ? "Server is full, try again later\n"
+        : "Too many connections from your address\n";
+    LOG_WARNING(m_serv.server_log, "Rejected IP({}) : {}", _ip, _reason.substr(0, _reason.size() - 1));
+    m_serv.m_metrics.add(networkLibrary::metricsRegistry::CONNECTIONS_REJECTED);
+
+    // The send buffer of a new connection takes the line at once, the loop never waits for the client
+    boost::system::error_code ec;
+    _socket.non_blocking(true, ec);
+    _socket.write_some(boost::asio::buffer(_reason.data(), _reason.size()), ec);
+    _socket.close(ec);
+}
+
+networkLibrary::Server::serverLoop::mailboxItem* networkLibrary::Server::serverLoop::mailboxItem::make(networkLibrary::messagePtr _message, std::shared_ptr<networkLibrary::chatSession> _target, networkLibrary::roomPtr _room, mailboxItem* _next)
+{
+    void* raw = networkLibrary::bufferPool::allocate(sizeof(mailboxItem));
+    return new (raw) mailboxItem{std::move(_message), std::move(_target), std::move(_room), _next};
+}
+
+void networkLibrary::Server::serverLoop::mailboxItem::release(mailboxItem* _item)
+{
+    _item->~mailboxItem();
+    networkLibrary::bufferPool::deallocate(_item, sizeof(mailboxItem));
+}
+
+bool networkLibrary::Server::serverLoop::running_in_this_thread() const
+{
+    return m_io_context.get_executor().running_in_this_thread();
+}
+
+void networkLibrary::Server::serverLoop::post_message(networkLibrary::messagePtr _message, std::shared_ptr<networkLibrary::chatSession> _target, networkLibrary::roomPtr _room)
+{
+    if(m_serv.m_loops.size() == 1 || running_in_this_thread()){
+        deliver_local(_message, _target, _room);
+        return;
+    }
+
+    mailboxItem* item = mailboxItem::make(std::move(_message), std::move(_target), std::move(_room), m_mailbox.load(std::memory_order_relaxed));
+    while(!m_mailbox.compare_exchange_weak(item->m_next, item, std::memory_order_release, std::memory_order_relaxed)){
+    }
+    // Only the push onto an empty mailbox wakes the loop, later ones ride along
+    if(item->m_next == nullptr){
+        boost::asio::post(m_io_context, networkLibrary::make_handler(m_serv.m_config.recycle_handlers, [this](){ drain_mailbox(); }));
+    }
+}
+
+void networkLibrary::Server::serverLoop::drain_mailbox()
+{
+    mailboxItem* item = m_mailbox.exchange(nullptr, std::memory_order_acquire);
+
+    // The mailbox is a stack, reverse it to deliver in posting order
+    mailboxItem* ordered = nullptr;
+    while(item){
+        mailboxItem* next = item->m_next;
+        item->m_next = ordered;
+        ordered = item;
+        item = next;
+    }
+
+    while(ordered){
+        deliver_local(ordered->m_message, ordered->m_target, ordered->m_room);
+        mailboxItem* next = ordered->m_next;
+        mailboxItem::release(ordered);
+        ordered = next;
+    }
+}
+
+void networkLibrary::Server::serverLoop::deliver_local(const networkLibrary::messagePtr &_message, const std::shared_ptr<networkLibrary::chatSession> &_target, const networkLibrary::roomPtr &_room)
+{
+    if(_target){
+        _target->deliver(_message);
+        return;
+    }
+    auto _begin = std::chrono::steady_clock::now();
+    if(_room){
+        _room->members(m_index).for_each([&_message](const std::shared_ptr<networkLibrary::chatSession>& _session){
+            _session->deliver(_message, true);
+        });
+    }
+    else{
+        m_chat_sessions.for_each([&_message](const std::shared_ptr<networkLibrary::chatSession>& _session){
+            _session->deliver(_message, true);
+        });
+    }
+    m_serv.m_metrics.record(networkLibrary::metricsRegistry::FANOUT_TIME, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _begin).count());
+}
+
+void networkLibrary::Server::serverLoop::schedule_batch(std::shared_ptr<networkLibrary::chatSession> _session)
+{
+    std::lock_guard<std::mutex> lock(m_batch_mutex);
+    m_batched.push_back(std::move(_session));
+    if(m_batched.size() > 1) return;
+
+    // The first session of a tick starts it; the timer is only touched under the mutex
+    auto _flush = networkLibrary::make_handler(m_serv.m_config.recycle_handlers, [this](){ flush_batch(); });
+    if(m_serv.m_config.batch_window.count() == 0){
+        boost::asio::post(m_io_context, std::move(_flush));
+    }
+    else{
+        m_batch_timer.expires_after(m_serv.m_config.batch_window);
+        m_batch_timer.async_wait(
+            networkLibrary::make_handler(m_serv.m_config.recycle_handlers,
+            [this](boost::system::error_code ec){
+                if(ec == boost::asio::error::operation_aborted) return;
+                flush_batch();
+            }));
+    }
+}
+
+void networkLibrary::Server::serverLoop::flush_batch()
+{
+    std::vector<std::shared_ptr<networkLibrary::chatSession>> _sessions;
+    {
+        std::lock_guard<std::mutex> lock(m_batch_mutex);
+        _sessions.swap(m_batched);
+        m_batched.reserve(_sessions.size());
+    }
+    for(auto const& _session : _sessions) _session->flush_batch();
+}
+
+void networkLibrary::Server::serverLoop::start_timers()
+{
+    const serverConfig& config = m_serv.m_config;
+    // Throttled sessions are resumed by their timers too
+    bool _limited = config.session_message_rate > 0 || config.session_byte_rate > 0 || config.address_message_rate > 0 || config.address_byte_rate > 0;
+    if(!_limited && config.handshake_timeout.count() == 0 && config.heartbeat_interval.count() == 0 && config.idle_timeout.count() == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(m_timer_mutex);
+        m_wheel_running = true;
+    }
+    wait_timers();
+}
+
+void networkLibrary::Server::serverLoop::wait_timers()
+{
+    std::lock_guard<std::mutex> lock(m_timer_mutex);
+    if(!m_wheel_running) return;
+
+    // One timer per loop, however many sessions are waiting in the wheel
+    m_wheel_timer.expires_at(m_wheel_epoch + (m_timers.now() + 1) * m_serv.m_config.timer_tick);
+    m_wheel_timer.async_wait(
+        networkLibrary::make_handler(m_serv.m_config.recycle_handlers,
+        [this](boost::system::error_code ec){
+            if(ec == boost::asio::error::operation_aborted) return;
+            {
+                std::lock_guard<std::mutex> lock(m_timer_mutex);
+                std::uint64_t _tick = (std::chrono::steady_clock::now() - m_wheel_epoch) / m_serv.m_config.timer_tick;
+                m_timers.advance(_tick, [this](networkLibrary::chatSession& _session){
+                    // A session being destroyed waits for the mutex to cancel its timer, and is skipped
+                    if(auto _ptr = _session.weak_from_this().lock()) m_expired.push_back(std::move(_ptr));
+                });
+            }
+            for(auto const& _session : m_expired) _session->expire();
+            m_expired.clear();
+            wait_timers();
+        }));
+}
+
+void networkLibrary::Server::serverLoop::arm_timer(networkLibrary::chatSession &_session, std::chrono::steady_clock::duration _delay, bool _sooner)
+{
+    const auto _tick = m_serv.m_config.timer_tick;
+    std::lock_guard<std::mutex> lock(m_timer_mutex);
+    // The deadline is rounded up, a timer never fires early
+    std::uint64_t _deadline = (std::chrono::steady_clock::now() + _delay - m_wheel_epoch + _tick - std::chrono::steady_clock::duration(1)) / _tick;
+    if(_sooner && _session.m_timer.armed() && _session.m_timer.m_deadline <= std::max(_deadline, m_timers.now() + 1)) return;
+    m_timers.arm(_session.m_timer, _session, _deadline > m_timers.now() ? _deadline - m_timers.now() : 1);
+}
+
+void networkLibrary::Server::serverLoop::cancel_timer(networkLibrary::chatSession &_session)
+{
+    std::lock_guard<std::mutex> lock(m_timer_mutex);
+    m_timers.cancel(_session.m_timer);
+}
+
+/*
+    Chat Session
+*/
+
+networkLibrary::chatSession::chatSession(boost::asio::ip::tcp::socket _socket, networkLibrary::Server::asyncServer& _serv, networkLibrary::Server::serverLoop& _loop, networkLibrary::admissionControl::ticket _admission)
+    : m_serv(_serv),
+      m_loop(_loop),
+      m_socket(std::move(_socket)),
+      m_port(0),
+      m_write_queue(16),
+      m_write_inflight(0),
+      m_queued_bytes(0),
+      m_dropped(0),
+      m_write_in_progress(false),
+      m_write_batched(false),
+      m_dropping(false),
+      m_protocol(networkLibrary::Protocol::TEXT),
+      m_compress(false),
+      m_read_buffer(m_serv.m_config.read_buffer_size),
+      m_read_begin(0),
+      m_read_end(0),
+      m_name("New User"),
+      m_named(false),
+      m_admission(std::move(_admission)),
+      m_message_bucket(m_serv.m_config.session_message_rate, m_serv.m_config.rate_burst),
+      m_byte_bucket(m_serv.m_config.session_byte_rate, m_serv.m_config.rate_burst),
+      m_throttled(false),
+      m_handoff(false),
+      m_reading(false),
+      m_parked(false)
+#ifdef NETWORKLIBRARY_COROUTINES
+      , m_write_signal(m_loop.m_io_context, boost::asio::steady_timer::time_point::max())
+#endif
+{
+    m_write_buffers.reserve(m_serv.m_config.max_gather_messages);
+    if(m_loop.m_session_strands) m_strand.emplace(boost::asio::make_strand(m_loop.m_io_context));
+
+    boost::system::error_code ec;
+    boost::asio::ip::tcp::endpoint _endpoint = m_socket.remote_endpoint(ec);
+    if(!ec){
+        m_ip = _endpoint.address().to_string();
+        m_port = _endpoint.port();
+    }
+}
+
+void networkLibrary::chatSession::start()
+{
+    m_serv.add_session(shared_from_this());
+    m_connected_at = m_last_input = std::chrono::steady_clock::now();
+    check_timeouts();
+
+    // std::cout << "Client connected IP(" << m_ip << ":" << m_port << ")" << std::endl;
+    LOG_INFO(m_serv.server_log, "Client connected IP({}:{})", m_ip, m_port);
+
+    // Ask username //maybe add passwords later
+    deliver(chatMessage::make("Server asks Username : "));
+    // std::cout << "Asked IP(" << m_ip << ":" << m_port << ") for Username" << std::endl;
+    LOG_INFO(m_serv.server_log, "Asked IP({}:{}) for Username", m_ip, m_port);
+    read_continous();
+}
+
+void networkLibrary::chatSession::deliver(networkLibrary::messagePtr _message, bool _batched)
+{
+    const networkLibrary::Server::serverConfig& config = m_serv.m_config;
+    bool schedule = false;
+    bool disconnect = false;
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+
+        if(m_dropping){
+            ++m_dropped;
+            m_serv.m_metrics.add(networkLibrary::metricsRegistry::MESSAGES_DROPPED);
+            return;
+        }
+        // The compressed frame is built by the first such recipient and shared by the rest
+        boost::asio::const_buffer _buffer = (m_compress && _message->size() >= config.compression_threshold)
+            ? _message->compressed_buffer()
+            : _message->buffer(m_protocol);
+        // While handing off everything is queued for the next server, a slow consumer is its business
+        if(!m_handoff && !m_write_queue.empty() && m_queued_bytes + _buffer.size() > config.write_high_watermark){
+            if(config.slow_consumer_policy == networkLibrary::Server::serverConfig::DISCONNECT){
+                LOG_WARNING(m_serv.server_log, "Disconnecting slow consumer IP({}:{}) Username : {}", m_ip, m_port, name());
+                m_serv.m_metrics.add(networkLibrary::metricsRegistry::CONNECTIONS_DROPPED);
+                // Closing may broadcast the departure, which locks other sessions' queues
+                disconnect = true;
+            }
+            else{
+                LOG_WARNING(m_serv.server_log, "Dropping messages to slow consumer IP({}:{}) Username : {}", m_ip, m_port, name());
+                m_dropping = true;
+                m_dropped = 1;
+                m_serv.m_metrics.add(networkLibrary::metricsRegistry::MESSAGES_DROPPED);
+                return;
+            }
+        }
+        else{
+            if(m_write_queue.full()) m_write_queue.set_capacity(2 * m_write_queue.capacity());
+            m_queued_bytes += _buffer.size();
+            m_write_queue.push_back(queuedMessage{std::move(_message), _buffer});
+            m_serv.m_metrics.record(networkLibrary::metricsRegistry::QUEUE_DEPTH, m_write_queue.size());
+            if(m_write_in_progress || m_handoff) return;
+
+            // A batched message waits for the end of the tick unless the batch is full
+            if(_batched && config.batch_writes && m_write_queue.size() < config.batch_max_messages){
+                if(m_write_batched) return;
+                m_write_batched = true;
+                schedule = true;
+            }
+            else{
+                m_write_in_progress = true;
+            }
+        }
+    }
+
+    if(disconnect) close();
+    else if(schedule) m_loop.schedule_batch(shared_from_this());
+    else start_write();
+}
+
+void networkLibrary::chatSession::flush_batch()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_write_batched = false;
+        if(m_write_in_progress || m_write_queue.empty() || m_handoff) return;
+        m_write_in_progress = true;
+    }
+    start_write();
+}
+
+#ifndef NETWORKLIBRARY_COROUTINES
+void networkLibrary::chatSession::start_write()
+{
+    // The write is started on the session's own executor, never on a foreign thread
+    if(running_in_this_thread()){
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        write_queued();
+    }
+    else{
+        auto self(shared_from_this());
+        post_to_session(
+            [this, self](){
+                std::lock_guard<std::mutex> lock(m_write_mutex);
+                write_queued();
+            });
+    }
+}
+
+void networkLibrary::chatSession::write_queued()
+{
+    auto self(shared_from_this());
+    if(m_handoff){
+        m_write_in_progress = false;
+        post_to_session([this, self](){ check_parked(); });
+        return;
+    }
+    initiate(
+        [this, _buffers = gather()](auto _handler){
+            boost::asio::async_write(m_socket, _buffers, std::move(_handler));
+        },
+        [this, self](boost::system::error_code ec, std::size_t size)
+        {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        if(!write_done(ec, size)) return;
+        // A handoff stops the writes there
+        if(!m_write_queue.empty() || m_handoff) write_queued();
+        else m_write_in_progress = false;
+    });
+}
+
+void networkLibrary::chatSession::read_continous(){
+    auto self(shared_from_this());
+    prepare_read();
+
+    m_reading = true;
+    initiate(
+        [this](auto _handler){
+            m_socket.async_read_some(
+                boost::asio::buffer(m_read_buffer.data() + m_read_end, m_read_buffer.size() - m_read_end),
+                std::move(_handler));
+        },
+        [this, self](boost::system::error_code ec, std::size_t size)
+        {
+        m_reading = false;
+        if(m_handoff){
+            // Whatever was read is handled by the next server
+            if(!ec) m_read_end += size;
+            check_parked();
+            return;
+        }
+        if(ec){
+            // std::cout << "Error Reading Data : " << ec.message() << std::endl;
+            LOG_ERROR(m_serv.server_log, "Error Reading Data : {}", ec.message());
+            m_serv.remove_session(self);
+            return;
+        }
+        if(handle_read(size)) read_continous();
+    });
+}
+
+void networkLibrary::chatSession::resume_read(std::chrono::steady_clock::time_point _now)
+{
+    m_throttled = false;
+    if(process_input(_now)) read_continous();
+}
+#endif
+
+bool networkLibrary::chatSession::running_in_this_thread() const
+{
+    if(m_strand) return m_strand->running_in_this_thread();
+    return m_loop.running_in_this_thread();
+}
+
+networkLibrary::gatherView networkLibrary::chatSession::gather()
+{
+    m_write_buffers.clear();
+    std::size_t cnt = std::min(m_write_queue.size(), m_serv.m_config.max_gather_messages);
+    for(std::size_t i=0; i<cnt; ++i){
+        m_write_buffers.push_back(m_write_queue[i].m_buffer);
+    }
+    m_write_inflight = cnt;
+    return networkLibrary::gatherView{m_write_buffers.data(), m_write_buffers.data() + m_write_buffers.size()};
+}
+
+bool networkLibrary::chatSession::write_done(boost::system::error_code ec, std::size_t size)
+{
+    if(ec && m_handoff){
+        // What the cancelled write sent is on the wire, the next server sends the rest
+        while(size > 0 && size >= m_write_queue.front().m_buffer.size()){
+            size -= m_write_queue.front().m_buffer.size();
+            m_queued_bytes -= m_write_queue.front().m_buffer.size();
+            m_write_queue.pop_front();
+        }
+        if(size > 0){
+            m_write_queue.front().m_buffer += size;
+            m_queued_bytes -= size;
+        }
+        m_write_inflight = 0;
+        m_write_in_progress = false;
+        post_to_session([this, self = shared_from_this()](){ check_parked(); });
+        return false;
+    }
+    if(ec){
+        // std::cout << "Error Sending Data : " << ec.message() << std::endl;
+        LOG_ERROR(m_serv.server_log, "Error Sending Data : {}", ec.message());
+        m_write_queue.clear();
+        m_queued_bytes = 0;
+        m_serv.remove_session(shared_from_this());
+        return false;
+    }
+
+    m_serv.m_metrics.add(networkLibrary::metricsRegistry::BYTES_OUT, size);
+    m_serv.m_metrics.add(networkLibrary::metricsRegistry::MESSAGES_OUT, m_write_inflight);
+    m_serv.m_metrics.add(networkLibrary::metricsRegistry::WRITES_OUT);
+    for(std::size_t i=0; i<m_write_inflight; ++i){
+        m_queued_bytes -= m_write_queue.front().m_buffer.size();
+        m_write_queue.pop_front();
+    }
+    m_write_inflight = 0;
+
+    if(m_dropping && m_queued_bytes <= m_serv.m_config.write_low_watermark){
+        LOG_INFO(m_serv.server_log, "Resumed slow consumer IP({}:{}) after dropping {} messages", m_ip, m_port, m_dropped);
+        m_dropping = false;
+        m_dropped = 0;
+    }
+    return true;
+}
+
+void networkLibrary::chatSession::close()
+{
+    auto self(shared_from_this());
+    auto _close = networkLibrary::make_handler(m_serv.m_config.recycle_handlers,
+        [this, self](){
+            boost::system::error_code ec;
+            m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+            m_socket.close(ec);
+            // No read is pending to fail and remove the session
+            if(m_throttled) m_serv.remove_session(self);
+#ifdef NETWORKLIBRARY_COROUTINES
+            // Ends a write loop waiting for messages
+            m_write_signal.cancel();
+#endif
+        });
+    if(m_strand) boost::asio::dispatch(*m_strand, std::move(_close));
+    else boost::asio::dispatch(m_loop.m_io_context, std::move(_close));
+}
+
+void networkLibrary::chatSession::check_timeouts()
+{
+    // A session being handed off must not close its connection
+    if(!m_socket.is_open() || m_handoff) return;
+    const networkLibrary::Server::serverConfig& config = m_serv.m_config;
+    auto _now = std::chrono::steady_clock::now();
+
+    auto _time_out = [this](const char* _reason){
+        LOG_INFO(m_serv.server_log, "{} for IP({}:{}) Username : {}", _reason, m_ip, m_port, name());
+        m_serv.m_metrics.add(networkLibrary::metricsRegistry::CONNECTIONS_TIMED_OUT);
+        close();
+    };
+
+    auto _next = std::chrono::steady_clock::duration::max();
+    if(!m_named && config.handshake_timeout.count() != 0){
+        _next = m_connected_at + config.handshake_timeout - _now;
+        if(_next <= std::chrono::steady_clock::duration::zero()){
+            _time_out("Handshake timeout");
+            return;
+        }
+    }
+    else{
+        auto _idle = _now - m_last_input;
+        if(config.idle_timeout.count() != 0){
+            if(_idle >= config.idle_timeout){
+                _time_out("Idle timeout");
+                return;
+            }
+            _next = config.idle_timeout - _idle;
+        }
+        if(config.heartbeat_interval.count() != 0){
+            // Repeated every interval of silence until the client answers or times out
+            if(_idle >= config.heartbeat_interval) deliver(m_serv.m_ping);
+            _next = std::min<std::chrono::steady_clock::duration>(_next, config.heartbeat_interval - _idle % config.heartbeat_interval);
+        }
+    }
+    if(_next != std::chrono::steady_clock::duration::max()) m_loop.arm_timer(*this, _next);
+
+    // Throttling again only moves the timer sooner
+    if(m_throttled) resume_read(_now);
+}
+
+void networkLibrary::chatSession::expire()
+{
+    if(running_in_this_thread()){
+        check_timeouts();
+    }
+    else{
+        auto self(shared_from_this());
+        post_to_session(
+            [this, self](){
+                check_timeouts();
+            });
+    }
+}
+
+void networkLibrary::chatSession::suspend()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_handoff = true;
+    }
+    m_loop.cancel_timer(*this);
+    // The completions find m_handoff set and park instead of going on
+    boost::system::error_code ec;
+    m_socket.cancel(ec);
+#ifdef NETWORKLIBRARY_COROUTINES
+    m_write_signal.cancel();
+#endif
+    check_parked();
+}
+
+void networkLibrary::chatSession::check_parked()
+{
+    if(m_parked || m_reading) return;
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        if(!m_handoff || m_write_in_progress) return;
+    }
+    m_parked = true;
+    m_serv.handoff_step();
+}
+
+bool networkLibrary::chatSession::capture(networkLibrary::HotRestart::sessionState &state)
+{
+    if(!m_socket.is_open()) return false;
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        state.protocol = static_cast<std::uint8_t>(m_protocol);
+        if(m_compress) state.flags |= networkLibrary::HotRestart::COMPRESS;
+        for(std::size_t i=0; i<m_write_queue.size(); ++i){
+            state.output.append(static_cast<const char*>(m_write_queue[i].m_buffer.data()), m_write_queue[i].m_buffer.size());
+        }
+        m_write_queue.clear();
+        m_queued_bytes = 0;
+    }
+    state.input.assign(m_read_buffer.data() + m_read_begin, m_read_end - m_read_begin);
+    state.name = name();
+    if(m_named) state.flags |= networkLibrary::HotRestart::NAMED;
+    state.ip = m_ip;
+    state.port = m_port;
+    if(m_room) state.room = m_room->name();
+
+    boost::system::error_code ec;
+    state.fd = m_socket.release(ec);
+    return !ec;
+}
+
+void networkLibrary::chatSession::adopt(const networkLibrary::HotRestart::sessionState &state)
+{
+    auto self(shared_from_this());
+    m_serv.add_session(self);
+    m_connected_at = m_last_input = std::chrono::steady_clock::now();
+    m_ip = state.ip;
+    m_port = state.port;
+
+    bool _write = false;
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_protocol = static_cast<networkLibrary::Protocol::Mode>(state.protocol);
+        m_compress = (state.flags & networkLibrary::HotRestart::COMPRESS) != 0;
+        requeue(state.output);
+        m_write_in_progress = _write = !m_write_queue.empty();
+    }
+    if(_write) start_write();
+
+    if(state.flags & networkLibrary::HotRestart::NAMED){
+        if(m_serv.m_user_index.claim(state.name, self)){
+            set_name(state.name);
+            m_named = true;
+            if(m_serv.m_federation) m_serv.m_federation->user_joined(state.name);
+        }
+        else{
+            deliver(chatMessage::make({"Username ", state.name, " is taken, Server asks Username : "}));
+        }
+    }
+    if(m_named && !state.room.empty()){
+        // The client already has the room's history, nothing is replayed
+        m_room = m_serv.m_rooms.join(state.room, m_loop.m_index, self);
+        if(m_serv.m_config.history_size != 0) m_history = m_serv.m_history.get(state.room);
+    }
+
+    if(m_read_buffer.size() < state.input.size()) m_read_buffer.resize(state.input.size(), 0);
+    std::memcpy(m_read_buffer.data(), state.input.data(), state.input.size());
+    m_read_end = state.input.size();
+
+    m_serv.m_metrics.add(networkLibrary::metricsRegistry::SESSIONS_ADOPTED);
+    LOG_INFO(m_serv.server_log, "Adopted IP({}:{}) Username : {}", m_ip, m_port, name());
+    check_timeouts();
+#ifdef NETWORKLIBRARY_COROUTINES
+    // The read loop handles the input that came along first
+    read_continous();
+#else
+    if(process_input(m_last_input)) read_continous();
+#endif
 }
 
-void networkLibrary::Server::asyncServer::startAccept()
+void networkLibrary::chatSession::resume_handoff(const networkLibrary::HotRestart::sessionState &state)
 {
-    m_acceptor.async_accept(
-        [this](boost::system::error_code ec, boost::asio::ip::tcp::socket _socket)
-        {
-                if (!ec)
-                {
-                    std::make_shared<networkLibrary::chatSession>(std::move(_socket), *this)->start();
-                }
-                startAccept();
-            });
+    auto self(shared_from_this());
+    if(state.fd >= 0){
+        sockaddr_storage _address{};
+        socklen_t _length = sizeof(_address);
+        ::getsockname(state.fd, reinterpret_cast<sockaddr*>(&_address), &_length);
+        boost::system::error_code ec;
+        m_socket.assign(_address.ss_family == AF_INET6 ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4(), state.fd, ec);
+        if(ec) ::close(state.fd);
+    }
 
+    bool _write = false;
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_handoff = false;
+        // Messages delivered while parked queued up behind it
+        requeue(state.output);
+        m_write_in_progress = _write = !m_write_queue.empty();
+    }
+    m_parked = false;
+    if(!m_socket.is_open()){
+        m_serv.remove_session(self);
+        return;
+    }
+
+    LOG_INFO(m_serv.server_log, "Resumed IP({}:{}) Username : {}", m_ip, m_port, name());
+    // The input read while parked is still in the buffer, capture() only copied it
+#ifdef NETWORKLIBRARY_COROUTINES
+    // Both loops ended when the session parked; a throttled one reads again once the rate limits refill
+    if(!m_throttled) read_continous();
+    else if(m_strand) boost::asio::co_spawn(*m_strand, write_loop(self), boost::asio::detached);
+    else boost::asio::co_spawn(m_loop.m_io_context, write_loop(self), boost::asio::detached);
+    check_timeouts();
+#else
+    if(_write) start_write();
+    const bool _throttled = m_throttled;
+    check_timeouts();
+    if(!_throttled && process_input(std::chrono::steady_clock::now())) read_continous();
+#endif
 }
 
-void networkLibrary::Server::asyncServer::write(const std::shared_ptr<networkLibrary::chatSession> _session, boost::asio::mutable_buffers_1 _buf)
+void networkLibrary::chatSession::requeue(const std::string &output)
 {
-    char* buffer_ptr = boost::asio::buffer_cast<char*>(_buf);   
-    int sz = _buf.size();
-    if(buffer_ptr[sz-1]!='\n') _buf += '\n';
-    
-    boost::asio::
-        async_write(
-            _session->m_socket,
-            _buf, 
-            [this, &_session](boost::system::error_code ec, int size){
-                if(ec){
-                    // std::cout << "Error Sending Data : " << ec.message() << std::endl;
-                    remove_session(_session);
-                    server_log.log({"Error Sending Data :", ec.message()}," ");
-                }
-                else{
-                    //// std::cout << "Broadcast -> Sent Message to " << _session->m_name << std::endl;
-                }
-    });
+    if(output.empty()) return;
+    // Already encoded, make() only drops a final newline the text buffer puts back
+    networkLibrary::messagePtr _output = chatMessage::make(output);
+    boost::asio::const_buffer _buffer = (output.back() == '\n')
+        ? _output->buffer(networkLibrary::Protocol::TEXT)
+        : boost::asio::buffer(_output->view());
+    if(m_write_queue.full()) m_write_queue.set_capacity(2 * m_write_queue.capacity());
+    m_queued_bytes += _buffer.size();
+    m_write_queue.push_front(queuedMessage{std::move(_output), _buffer});
 }
 
-void networkLibrary::Server::asyncServer::write(const std::shared_ptr<networkLibrary::chatSession> _session, std::string buf)
+void networkLibrary::chatSession::prepare_read()
 {
-    if(buf.back()!='\n') buf += '\n';
-    boost::asio::mutable_buffers_1 _buf = boost::asio::buffer(buf);
-    write(_session, _buf);
+    // Keep the unread bytes at the front of the buffer and make room for more
+    if(m_read_begin > 0){
+        std::memmove(m_read_buffer.data(), m_read_buffer.data() + m_read_begin, m_read_end - m_read_begin);
+        m_read_end -= m_read_begin;
+        m_read_begin = 0;
+    }
+    if(m_read_end == m_read_buffer.size()) m_read_buffer.resize(2 * m_read_buffer.size(), m_read_end);
 }
 
-
-void networkLibrary::Server::asyncServer::write_broadcast(std::string buf)
+bool networkLibrary::chatSession::handle_read(std::size_t size)
 {
-    if(buf.back()!='\n') buf += '\n';
-    auto _buf = boost::asio::buffer(buf);
-    std::lock_guard<std::mutex> lock(_server_mutex);
-    for(auto& _session : m_chat_sessions){
-        write(_session, _buf);
-    }
+    m_read_end += size;
+    m_serv.m_metrics.add(networkLibrary::metricsRegistry::BYTES_IN, size);
+
+    auto _begin = std::chrono::steady_clock::now();
+    m_last_input = _begin;
+    bool _open = process_input(_begin);
+    m_serv.m_metrics.record(networkLibrary::metricsRegistry::HANDLER_LATENCY, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _begin).count());
+    return _open;
 }
 
-void networkLibrary::Server::asyncServer::add_session(const std::shared_ptr<networkLibrary::chatSession> _session)
+bool networkLibrary::chatSession::take_tokens(std::size_t _bytes, std::chrono::steady_clock::time_point _now)
 {
-    std::lock_guard<std::mutex> lock(_server_mutex);
-    m_chat_sessions.insert(_session);
+    if(!m_message_bucket.ready(_now) || !m_byte_bucket.ready(_now)) return false;
+    if(!m_admission.take(_bytes, _now)) return false;
+    m_message_bucket.take(1);
+    m_byte_bucket.take(_bytes);
+    return true;
 }
 
-void networkLibrary::Server::asyncServer::remove_session(const std::shared_ptr<networkLibrary::chatSession> _session)
+void networkLibrary::chatSession::throttle(std::chrono::steady_clock::time_point _now)
 {
-    std::lock_guard<std::mutex> lock(_server_mutex);
-    m_chat_sessions.erase(_session);
+    m_throttled = true;
+    m_serv.m_metrics.add(networkLibrary::metricsRegistry::READS_THROTTLED);
+    LOG_DEBUG(m_serv.server_log, "Throttled IP({}:{}) Username : {}", m_ip, m_port, name());
+
+    auto _wait = std::max({m_message_bucket.wait(_now), m_byte_bucket.wait(_now), m_admission.wait(_now)});
+    m_loop.arm_timer(*this, _wait, true);
 }
 
-std::pair<std::string,std::string> networkLibrary::Server::asyncServer::parse(std::string &recv_message)
-{   
-    std::pair<std::string,std::string> _parsed_pr;
-    std::string& name = _parsed_pr.first;
-    std::string& message = _parsed_pr.second;
+bool networkLibrary::chatSession::process_input(std::chrono::steady_clock::time_point _now)
+{
+    const std::size_t max_size = m_serv.m_config.max_message_size;
+    networkLibrary::Protocol::extracted _input;
 
-    int sz = recv_message.size();
-    int cnt = 0;
+    while(m_read_begin < m_read_end){
+        const char* data = m_read_buffer.data() + m_read_begin;
+        std::size_t size = m_read_end - m_read_begin;
+        networkLibrary::Protocol::extractStatus status = (m_protocol == networkLibrary::Protocol::BINARY)
+            ? networkLibrary::Protocol::extract_frame(data, size, max_size, _input)
+            : networkLibrary::Protocol::extract_line(data, size, max_size, _input);
 
-    for(unsigned i=0; i<sz; ++i){
-        if(cnt==0){
-            if(recv_message[i] != ':') name += recv_message[i];
-            else{
-                cnt += 1;
-                while(!name.empty() && (name.back()==' ' || name.back()=='\n')) name.pop_back();
+        if(status == networkLibrary::Protocol::INCOMPLETE) break;
+        if(status == networkLibrary::Protocol::TOO_LARGE){
+            LOG_WARNING(m_serv.server_log, "Message too large from IP({}:{})", m_ip, m_port);
+            m_serv.m_metrics.add(networkLibrary::metricsRegistry::CONNECTIONS_DROPPED);
+            m_serv.remove_session(shared_from_this());
+            close();
+            return false;
+        }
+
+        // The rest waits in the buffer, and no read is armed until the limits refill
+        if(!take_tokens(_input.consumed, _now)){
+            throttle(_now);
+            return false;
+        }
+
+        m_read_begin += _input.consumed;
+        m_serv.m_metrics.add(networkLibrary::metricsRegistry::MESSAGES_IN);
+        if(_input.header.flags & networkLibrary::Protocol::COMPRESSED){
+            static thread_local std::string _inflated;
+            if(!m_compress || !networkLibrary::Protocol::decompress(_input.body, max_size, _inflated)){
+                LOG_WARNING(m_serv.server_log, "Malformed compressed frame from IP({}:{})", m_ip, m_port);
+                m_serv.m_metrics.add(networkLibrary::metricsRegistry::CONNECTIONS_DROPPED);
+                m_serv.remove_session(shared_from_this());
+                close();
+                return false;
             }
+            _input.body = _inflated;
         }
-        else{
-            if(!(message.empty() && (recv_message[i]==' ' || recv_message[i]=='\n'))) message += recv_message[i];
+        if(_input.header.type == networkLibrary::Protocol::MESSAGE) handle_line(_input.body);
+        if(!m_socket.is_open()) return false;
+    }
+    if(m_read_begin == m_read_end){
+        m_read_begin = m_read_end = 0;
+        // Hand a buffer grown for one large message back to the pool
+        if(m_read_buffer.size() > m_serv.m_config.read_buffer_size){
+            m_read_buffer = networkLibrary::pooledBuffer(m_serv.m_config.read_buffer_size);
         }
     }
-    while(!message.empty() && (message.back()==' ' || message.back()=='\n')) message.pop_back();
-
-    return _parsed_pr;
+    return true;
 }
 
-/*
-    Chat Session
-*/
-
-networkLibrary::chatSession::chatSession(boost::asio::ip::tcp::socket _socket, networkLibrary::Server::asyncServer& _serv)
-    : m_socket(std::move(_socket)),
-      m_ip(m_socket.remote_endpoint().address().to_string()),
-      m_port(m_socket.remote_endpoint().port()),
-      m_serv(_serv)
+void networkLibrary::chatSession::negotiate(std::string_view line)
 {
+    bool binary = false, compress = false;
+    std::string_view features = line.substr(networkLibrary::Protocol::hello_command.size());
+    while(!features.empty()){
+        std::size_t start = features.find_first_not_of(' ');
+        if(start == std::string_view::npos) break;
+        features.remove_prefix(start);
+        std::string_view feature = features.substr(0, features.find(' '));
+        if(feature == networkLibrary::Protocol::binary_feature) binary = true;
+        else if(feature == networkLibrary::Protocol::deflate_feature) compress = m_serv.m_config.compression;
+        features.remove_prefix(feature.size());
+    }
+
+    if(!binary){
+        deliver(chatMessage::make(networkLibrary::Protocol::hello_command));
+        return;
+    }
 
+    // The reply still goes out as text, everything queued after it is framed
+    if(compress) deliver(chatMessage::make({networkLibrary::Protocol::hello_command, " ", networkLibrary::Protocol::binary_feature, " ", networkLibrary::Protocol::deflate_feature}));
+    else deliver(chatMessage::make({networkLibrary::Protocol::hello_command, " ", networkLibrary::Protocol::binary_feature}));
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_protocol = networkLibrary::Protocol::BINARY;
+        m_compress = compress;
+    }
+    LOG_INFO(m_serv.server_log, "IP({}:{}) switched to binary protocol{}", m_ip, m_port, compress ? " with compression" : "");
 }
 
-void networkLibrary::chatSession::start()
+void networkLibrary::chatSession::handle_line(std::string_view line)
 {
-    m_serv.add_session(shared_from_this());
-
     auto self(shared_from_this());
-    m_name = "New User";
-
-    // std::cout << "Client connected IP(" << m_ip << ":" << m_port << ")" << std::endl;
-    m_serv.server_log.log({std::string("Client connected IP("), m_ip, std::string(":"), std::to_string(m_port), std::string(")")}, std::string(" "));
-
-    // Ask username //maybe add passwords later
+    // A heartbeat answer has done its job by being read
+    if(line.empty() || line == networkLibrary::Protocol::pong_command) return;
 
-    std::string* temp_buffer = new std::string("Server asks Username : \n");
-    // m_buffer = "Server asks Username : \n";
-    
-    boost::asio::
-        async_write(m_socket, boost::asio::dynamic_buffer(*temp_buffer),
-                    [this, temp_buffer](boost::system::error_code ec, int size)
-                    {
-        if(ec){
-            // std::cout << "Error Sending Data : " << ec.message() << std::endl;
-            m_serv.server_log.log({"Error Sending Data :", ec.message()}," ");
-            m_serv.remove_session(shared_from_this());
+    if(!m_named){
+        std::string _name(line);
+        if(m_protocol == networkLibrary::Protocol::TEXT && line.substr(0, networkLibrary::Protocol::hello_command.size()) == networkLibrary::Protocol::hello_command){
+            negotiate(line);
+        }
+        else if(!networkLibrary::Server::asyncServer::valid_name(_name)){
+            deliver(chatMessage::make("Invalid Username, Server asks Username : "));
+        }
+        else if((m_serv.m_federation && m_serv.m_federation->knows_user(_name)) || !m_serv.m_user_index.claim(_name, self)){
+            deliver(chatMessage::make({"Username ", _name, " is taken, Server asks Username : "}));
         }
         else{
-            // std::cout << "Asked IP(" << m_ip << ":" << m_port << ") for Username" << std::endl;
-            m_serv.server_log.log({"Asked IP(", m_ip, ":", std::to_string(m_port), std::string(") for Username")},std::string(" "));
-            read_continous();
-        } 
-            delete temp_buffer;
-        });
+            set_name(_name);
+            m_named = true;
+            if(m_serv.m_federation) m_serv.m_federation->user_joined(_name);
+            // std::cout << "IP(" << m_ip << ":" << m_port << ") -> Username : " << m_name << std::endl;
+            LOG_INFO(m_serv.server_log, "IP({}:{}) -> Username : {}", m_ip, m_port, m_name);
+            m_serv.join_room(self, m_serv.m_config.default_room);
+            m_serv.write_broadcast(chatMessage::make({m_name, " joined the Server"}));
+        }
+    }
+    else if(line.front()=='\\'){
+        // std::cout << m_name << " asked for Special Command " << m_buffer << std::endl;
+        LOG_DEBUG(m_serv.server_log, "{} asked for Special Command {}", m_name, line);
+
+        networkLibrary::commandCall _call;
+        networkLibrary::commandCall::parse(line, _call);
+        const auto* _command = m_serv.m_commands.find(_call.m_name);
+        if(_command) _command->m_handler(self, _call);
+        else m_serv.write(self, chatMessage::make("Command Not Identified"));
+    }
+    else{
+        networkLibrary::messagePtr _message = chatMessage::make({m_name, " : ", line});
+        // std::cout << m_buffer << std::endl;
+        LOG_DEBUG(m_serv.server_log, "{}", _message->view());
+        if(m_history) m_serv.record(m_history, _message);
+        if(m_room) m_serv.write_room(m_room, _message);
+        else m_serv.write_broadcast(_message);
+    }
 }
 
-void networkLibrary::chatSession::read_continous(){
-    auto self(shared_from_this());
-    std::string* temp_buffer = new std::string;
-    boost::asio::
-        async_read_until(
-            m_socket, 
-            boost::asio::dynamic_buffer(*temp_buffer), 
-            "\n",
-            [this, self, temp_buffer](boost::system::error_code ec, int size)
-        {
-        if(ec){
-            // std::cout << "Error Reading Data : " << ec.message() << std::endl;
-            m_serv.server_log.log({"Error Reading Data : ", ec.message()}," ");
-            m_serv.remove_session(shared_from_this());
-        }
-        else{
-            read_continous();
-            while(!temp_buffer->empty() && temp_buffer->back()=='\n') temp_buffer->pop_back();
-            if(m_name == "New User"){
-                m_name = *temp_buffer;
-                // std::cout << "IP(" << m_ip << ":" << m_port << ") -> Username : " << m_name << std::endl;
-                m_serv.server_log.log({std::string("IP("), m_ip, std::string(":"), std::to_string(m_port), std::string(") -> Username :"), m_name}," ");
-                m_serv.write_broadcast(std::string (m_name+" joined the Server"));
+namespace
+{
+    constexpr std::string_view builtin_commands[] = {"help", "list", "name_change", "msg", "join", "leave", "rooms", "stats", "quit"};
+
+    constexpr bool distinct_slots()
+    {
+        constexpr std::size_t mask = 64 - 1;
+        for(std::size_t i=0; i<std::size(builtin_commands); ++i){
+            for(std::size_t j=0; j<i; ++j){
+                if((networkLibrary::command_hash(builtin_commands[i]) & mask) == (networkLibrary::command_hash(builtin_commands[j]) & mask)) return false;
             }
-            else if(temp_buffer->front()=='\\'){
-                /*
-                    Client Commands - 
-                        1. \help
-                        2. \list
-                        3. \name_change
-                        4. \msg
-                        5. \quit
-                */
-                std::string message;
-                // std::cout << m_name << " asked for Special Command " << m_buffer << std::endl;
-                m_serv.server_log.log({m_name, std::string("asked for Special Command"), *temp_buffer}," ");
-
-                if(*temp_buffer == "\\help"){
-                    message = 
-                    "Client Commands - \n"
-                    "    1. \\help            : List out Client Commands\n"
-                    "    2. \\list            : List of Connected Clients\n"
-                    "    3. \\name_change {}  : Change your name\n"
-                    "    4. \\msg {}{}        : Message Privately to some other Client\n"
-                    "    5. \\quit            : Quit the Chat-Room\n"
-                    "\n"
-                    ;
-                    std::shared_ptr<networkLibrary::chatSession> shared_session_ptr = self;
-                    m_serv.write(shared_session_ptr, message);
-                }
-                else if(*temp_buffer == "\\list"){
-                    message = "Clients in the Chat-Room:-\n";
-                    int cnt = 0;
-                    for(auto& _session: m_serv.m_chat_sessions){
-                        message += std::string("    ") + std::to_string(++cnt) + std::string(". ");
-                        message += _session->m_name;
-                        message += '\n';
-                    }
-                    std::shared_ptr<networkLibrary::chatSession> shared_session_ptr = self;
-                    m_serv.write(shared_session_ptr, message);
-                }
-                else if(temp_buffer->substr(0,12) == "\\name_change"){
-                    std::string _new_name;
-                    bool in = false;
-                    for(auto c: *temp_buffer){
-                        if(c=='}') in =false;
-                        if(in) _new_name += c;
-                        if(c=='{') in = true;
-                    }
-                    message = std::string("Changed Name of ") 
-                            + m_name 
-                            + std::string(" to ") 
-                            + _new_name;
-                    m_name = _new_name;
-                    // std::cout << message <<std::endl;
-                    m_serv.server_log.log(message);
-                    m_serv.write_broadcast(message);
-                } 
-                else if(temp_buffer->substr(0,4) == "\\msg"){
-                    std::string _send_to;
-                    std::string _message;
-                    bool in = false;
-                    int cntr = 0;
-                    for(auto c: *temp_buffer){
-                        if(c=='}'){
-                            in =false;
-                            ++cntr;
-                        }
-                        if(in && cntr==0) _send_to += c;
-                        if(in && cntr==1) _message += c;
-                        if(c=='{') in = true;
-                    }
-                    _message = m_name + " : " + _message; 
-    
-                    for(auto& _session: m_serv.m_chat_sessions){
-                        if(_session->m_name == _send_to){
-                            std::shared_ptr<networkLibrary::chatSession> shared_session_ptr = _session;
-                            m_serv.write(shared_session_ptr, _message);
-                            break;
-                        }
-                    }
-                }
-                else if(*temp_buffer == "\\quit"){
-                    m_serv.m_chat_sessions.erase(self);
-                    return;
+        }
+        return true;
+    }
+
+    // Every built-in command is then found with a single comparison
+    static_assert(distinct_slots(), "Built-in commands must hash to distinct slots of the command table");
+};
+
+void networkLibrary::chatSession::register_commands(networkLibrary::chatCommands &commands)
+{
+    /*
+        Client Commands - 
+            1. \help
+            2. \list
+            3. \name_change
+            4. \msg
+            5. \join
+            6. \leave
+            7. \rooms
+            8. \stats
+            9. \quit
+    */
+    using sessionPtr = std::shared_ptr<networkLibrary::chatSession>;
+
+    commands.add("help", "", "List out Client Commands",
+        [](const sessionPtr& self, const networkLibrary::commandCall&){
+            self->m_serv.write(self, self->m_serv.m_help);
+        });
+
+    commands.add("list", "", "List of Connected Clients",
+        [](const sessionPtr& self, const networkLibrary::commandCall&){
+            std::string message = "Clients in the Chat-Room:-\n";
+            int cnt = 0;
+            self->m_serv.for_each_session([&](const sessionPtr& _session){
+                message += std::string("    ") + std::to_string(++cnt) + std::string(". ");
+                message += _session->name();
+                message += '\n';
+            });
+            if(self->m_serv.m_federation){
+                for(auto const& [_name, _node] : self->m_serv.m_federation->remote_users()){
+                    message += "    " + std::to_string(++cnt) + ". " + _name + " (node " + std::to_string(_node) + ")\n";
                 }
-                else{
-                    message = "Command Not Identified";
-                    std::shared_ptr<networkLibrary::chatSession> shared_session_ptr = self;
-                    m_serv.write(shared_session_ptr, message);
+            }
+            self->m_serv.write(self, message);
+        });
+
+    commands.add("name_change", "{}", "Change your name",
+        [](const sessionPtr& self, const networkLibrary::commandCall& call){
+            networkLibrary::Server::asyncServer& _serv = self->m_serv;
+            std::string _new_name(call.arg(0));
+            if(!networkLibrary::Server::asyncServer::valid_name(_new_name)){
+                _serv.write(self, chatMessage::make({"Invalid Username ", _new_name}));
+            }
+            else if(_new_name == self->m_name){
+                // Nothing changes, nobody else needs to hear of it
+                _serv.write(self, chatMessage::make({"Username is already ", _new_name}));
+            }
+            else if((_serv.m_federation && _serv.m_federation->knows_user(_new_name)) || !_serv.m_user_index.rename(self->m_name, _new_name, self)){
+                _serv.write(self, chatMessage::make({"Username ", _new_name, " is taken"}));
+            }
+            else{
+                networkLibrary::messagePtr _message = chatMessage::make({"Changed Name of ", self->m_name, " to ", _new_name});
+                if(_serv.m_federation){
+                    _serv.m_federation->user_left(self->m_name);
+                    _serv.m_federation->user_joined(_new_name);
                 }
+                self->set_name(_new_name);
+                // std::cout << message <<std::endl;
+                LOG_INFO(_serv.server_log, "{}", _message->view());
+                _serv.write_broadcast(_message);
+            }
+        });
+
+    commands.add("msg", "{}{}", "Message Privately to some other Client",
+        [](const sessionPtr& self, const networkLibrary::commandCall& call){
+            networkLibrary::Server::asyncServer& _serv = self->m_serv;
+            std::string _name(call.arg(0));
+            networkLibrary::messagePtr _message = chatMessage::make({self->m_name, " : ", call.arg(1)});
+            sessionPtr _target = _serv.find_session(_name);
+            if(_target) _serv.write(_target, _message);
+            else if(!_serv.m_federation || !_serv.m_federation->relay_direct(_name, _message)) _serv.write(self, chatMessage::make({"No Client named ", call.arg(0)}));
+        });
+
+    commands.add("join", "{}", "Move to a room, creating it if needed",
+        [](const sessionPtr& self, const networkLibrary::commandCall& call){
+            networkLibrary::Server::asyncServer& _serv = self->m_serv;
+            std::string _room_name(call.arg(0));
+            if(!networkLibrary::Server::asyncServer::valid_name(_room_name)){
+                _serv.write(self, chatMessage::make({"Invalid Room ", _room_name}));
+            }
+            else if(self->m_room && self->m_room->name() == _room_name){
+                _serv.write(self, chatMessage::make({"Already in room ", _room_name}));
+            }
+            else{
+                self->switch_room(_room_name);
+            }
+        });
+
+    commands.add("leave", "", "Go back to the default room",
+        [](const sessionPtr& self, const networkLibrary::commandCall&){
+            const std::string& _default_room = self->m_serv.m_config.default_room;
+            if(self->m_room && self->m_room->name() == _default_room){
+                self->m_serv.write(self, chatMessage::make({"Already in the default room ", _default_room}));
             }
             else{
-                *temp_buffer = m_name + " : " + *temp_buffer;
-                // std::cout << m_buffer << std::endl;
-                m_serv.server_log.log(*temp_buffer);
-                m_serv.write_broadcast(*temp_buffer);
+                self->switch_room(_default_room);
+            }
+        });
+
+    commands.add("rooms", "", "List of Rooms and their sizes",
+        [](const sessionPtr& self, const networkLibrary::commandCall&){
+            std::vector<networkLibrary::roomPtr> _rooms = self->m_serv.rooms();
+            std::sort(_rooms.begin(), _rooms.end(), [](const networkLibrary::roomPtr& a, const networkLibrary::roomPtr& b){
+                return a->name() < b->name();
+            });
+            std::string message = "Rooms:-\n";
+            int cnt = 0;
+            for(auto const& _room : _rooms){
+                message += std::string("    ") + std::to_string(++cnt) + std::string(". ");
+                message += _room->name() + std::string(" (") + std::to_string(_room->size()) + std::string(")");
+                if(_room == self->m_room) message += " *";
+                message += '\n';
             }
-            // m_buffer.clear();
-            // read_continous();
-        } 
-            delete temp_buffer;
+            self->m_serv.write(self, message);
+        });
+
+    commands.add("stats", "", "Server counters and latency histograms",
+        [](const sessionPtr& self, const networkLibrary::commandCall&){
+            self->m_serv.write(self, self->m_serv.m_metrics.summary());
+        });
+
+    commands.add("quit", "", "Quit the Chat-Room",
+        [](const sessionPtr& self, const networkLibrary::commandCall&){
+            self->m_serv.remove_session(self);
+            self->close();
         });
 }
 
-networkLibrary::chatSession::~chatSession()
+void networkLibrary::chatSession::switch_room(const std::string &_room_name)
+{
+    auto self(shared_from_this());
+    networkLibrary::roomPtr _old_room = m_serv.leave_room(self);
+    if(_old_room) m_serv.write_room(_old_room, chatMessage::make({m_name, " left room ", _old_room->name()}));
+    m_serv.join_room(self, _room_name);
+    m_serv.write_room(m_room, chatMessage::make({m_name, " joined room ", _room_name}));
+}
+
+std::string networkLibrary::chatSession::name() const
+{
+    std::lock_guard<std::mutex> lock(m_name_mutex);
+    return m_name;
+}
+
+void networkLibrary::chatSession::set_name(const std::string& _name)
+{
+    std::lock_guard<std::mutex> lock(m_name_mutex);
+    m_name = _name;
+}
+
+void networkLibrary::chatSession::departed()
 {
+    m_loop.cancel_timer(*this);
+    std::string _name = name();
     // std::cout << "Disconnected IP(" << m_ip << ":" << m_port << ")" << " Username : " << m_name << std::endl;
-    m_serv.server_log.log({"Disconnected IP(",m_ip,":",std::to_string(m_port), ") Username :", m_name},std::string(" "));
-    m_serv.write_broadcast(std::string("Disconnected "+m_name));
+    LOG_INFO(m_serv.server_log, "Disconnected IP({}:{}) Username : {}", m_ip, m_port, _name);
+    m_serv.m_metrics.add(networkLibrary::metricsRegistry::CONNECTIONS_CLOSED);
+    if(!m_serv.m_stopping) m_serv.write_broadcast(chatMessage::make({"Disconnected ", _name}));
+}
+
+void networkLibrary::chatSession::lose_name(const std::string &_name)
+{
+    auto self(shared_from_this());
+    post_to_session(
+        [this, self, _name](){
+            // Renamed or gone since
+            if(!m_named || name() != _name || !m_socket.is_open()) return;
+            m_serv.m_user_index.release(_name, this);
+            if(m_serv.m_federation) m_serv.m_federation->user_left(_name);
+            m_serv.leave_room(self);
+            m_named = false;
+            set_name("New User");
+            LOG_WARNING(m_serv.server_log, "IP({}:{}) lost Username : {} to another node", m_ip, m_port, _name);
+            deliver(chatMessage::make({"Username ", _name, " is taken, Server asks Username : "}));
+        });
+}
+
+networkLibrary::chatSession::~chatSession()
+{
+    m_loop.cancel_timer(*this);
 }
 
 /*
     Asynchronous Client
 */
 
-networkLibrary::Client::asyncClient::asyncClient(boost::asio::io_context& _io_context , std::string _IPAddress, unsigned int _port)
+networkLibrary::Client::asyncClient::asyncClient(boost::asio::io_context& _io_context , std::string _IPAddress, unsigned int _port, clientConfig _config)
     :m_io_context(_io_context),
     m_ip(_IPAddress),
     m_port(_port),
     m_socket(m_io_context),
-    m_resolver(m_io_context)
+    m_resolver(m_io_context),
+    m_config(_config),
+    m_protocol(networkLibrary::Protocol::TEXT),
+    m_compress(false),
+    m_connected(false),
+    m_negotiating(false),
+    m_queued_bytes(0),
+    m_closed(false),
+    m_write_inflight(0),
+    m_write_in_progress(false),
+    m_close_when_flushed(false)
+#ifdef NETWORKLIBRARY_COROUTINES
+    , m_write_signal(m_io_context, boost::asio::steady_timer::time_point::max())
+#endif
+{
+    if(m_config.compression) m_config.binary_protocol = true;
+    m_write_buffers.reserve(2 * m_config.max_gather_messages);
+    connect();
+}
+
+std::string networkLibrary::Client::asyncClient::hello_line() const
+{
+    std::string hello = std::string(networkLibrary::Protocol::hello_command) + " " + std::string(networkLibrary::Protocol::binary_feature);
+    if(m_config.compression) hello += " " + std::string(networkLibrary::Protocol::deflate_feature);
+    hello += '\n';
+    return hello;
+}
+
+#ifndef NETWORKLIBRARY_COROUTINES
+void networkLibrary::Client::asyncClient::connect()
 {
     boost::asio::async_connect(
         m_socket,
         m_resolver.resolve(m_ip,boost::lexical_cast<std::string>(m_port)),
+        networkLibrary::make_handler(m_config.recycle_handlers,
         [this](boost::system::error_code ec, boost::asio::ip::tcp::endpoint _endpoint){
             if(ec){
-               std::cout << "Error Occured while Connecting to the Server | Relaunch Client" << std::endl;
+               if(m_config.print_status) std::cout << "Error Occured while Connecting to the Server | Relaunch Client" << std::endl;
+               close_socket();
+               return;
             }
-            else{
-                read_continous();
+            m_connected = true;
+            // Queued lines are already coalesced into gather writes, Nagle would only hold back the last one
+            boost::system::error_code _ec;
+            m_socket.set_option(boost::asio::ip::tcp::no_delay(true), _ec);
+            if(m_config.binary_protocol){
+                // Queued lines wait for the answer, the server switches formats right after the hello
+                m_negotiating = true;
+                m_write_in_progress = true;
+                auto hello = std::make_shared<std::string>(hello_line());
+                boost::asio::async_write(
+                    m_socket,
+                    boost::asio::buffer(*hello),
+                    networkLibrary::make_handler(m_config.recycle_handlers,
+                    [this, hello](boost::system::error_code ec, std::size_t length){
+                        m_write_in_progress = false;
+                        if(ec) close_socket();
+                        else start_write();
+                    }));
             }
-        });
+            else start_write();
+            read_continous();
+        }));
 }
 
 void networkLibrary::Client::asyncClient::read_continous()
 {
-    boost::asio::async_read_until(
+    boost::asio::async_read(
         m_socket,
         boost::asio::dynamic_buffer(m_buffer),
-        "\n",
-        [this](boost::system::error_code ec, int length){
+        boost::asio::transfer_at_least(1),
+        networkLibrary::make_handler(m_config.recycle_handlers,
+        [this](boost::system::error_code ec, std::size_t length){
             if(ec){
                 // std::cout << ec.message() << std::endl;
                 close_connection();
                 return;
             }
             else{
-                while(m_buffer.back()=='\n') m_buffer.pop_back();
-                std::cout << m_buffer.data() << std::endl;
-                m_buffer.clear();
-                read_continous();
+                if(process_input()) read_continous();
             }
-        }   
+        })
     );
 }
 
+void networkLibrary::Client::asyncClient::start_write()
+{
+    if(!m_connected || m_negotiating || m_write_in_progress) return;
+    if(m_write_queue.empty()){
+        if(m_close_when_flushed) shutdown_send();
+        return;
+    }
+    write_queued();
+}
+
+void networkLibrary::Client::asyncClient::write_queued()
+{
+    m_write_in_progress = true;
+    boost::asio::async_write(
+        m_socket,
+        gather(),
+        networkLibrary::make_handler(m_config.recycle_handlers,
+        [this](boost::system::error_code ec, std::size_t length){
+            m_write_in_progress = false;
+            if(ec){
+                if(m_config.print_status) std::cout << "Error writing to Server | Relaunch Client" <<std::endl;
+                close_socket();
+                return;
+            }
+            written();
+            start_write();
+        }));
+}
+#endif
+
+bool networkLibrary::Client::asyncClient::process_input()
+{
+    std::size_t offset = 0;
+    networkLibrary::Protocol::extracted _input;
+
+    while(offset < m_buffer.size()){
+        const char* data = m_buffer.data() + offset;
+        std::size_t size = m_buffer.size() - offset;
+        networkLibrary::Protocol::extractStatus status = (m_protocol == networkLibrary::Protocol::BINARY)
+            ? networkLibrary::Protocol::extract_frame(data, size, m_config.max_message_size, _input)
+            : networkLibrary::Protocol::extract_line(data, size, m_config.max_message_size, _input);
+
+        if(status == networkLibrary::Protocol::INCOMPLETE) break;
+        if(status == networkLibrary::Protocol::TOO_LARGE){
+            if(m_config.print_status) std::cout << "Message from Server too large | Relaunch Client" << std::endl;
+            close_connection();
+            return false;
+        }
+
+        offset += _input.consumed;
+        if(_input.header.flags & networkLibrary::Protocol::COMPRESSED){
+            if(!networkLibrary::Protocol::decompress(_input.body, m_config.max_message_size, m_inflated)){
+                if(m_config.print_status) std::cout << "Malformed compressed message from Server | Relaunch Client" << std::endl;
+                close_connection();
+                return false;
+            }
+            _input.body = m_inflated;
+        }
+        if(_input.header.type == networkLibrary::Protocol::MESSAGE) handle_message(_input.body);
+        else if(_input.header.type == networkLibrary::Protocol::PING) answer_heartbeat();
+    }
+    m_buffer.erase(0, offset);
+    return true;
+}
+
+void networkLibrary::Client::asyncClient::handle_message(std::string_view message)
+{
+    if(m_negotiating && message.substr(0, networkLibrary::Protocol::hello_command.size()) == networkLibrary::Protocol::hello_command){
+        if(message.find(networkLibrary::Protocol::binary_feature) != std::string_view::npos){
+            m_protocol = networkLibrary::Protocol::BINARY;
+            m_compress = message.find(networkLibrary::Protocol::deflate_feature) != std::string_view::npos;
+        }
+        m_negotiating = false;
+        start_write();
+        return;
+    }
+    if(m_protocol == networkLibrary::Protocol::TEXT && message == networkLibrary::Protocol::ping_command){
+        answer_heartbeat();
+        return;
+    }
+    if(m_config.on_message) m_config.on_message(message);
+    else std::cout << message << std::endl;
+}
+
+void networkLibrary::Client::asyncClient::answer_heartbeat()
+{
+    std::string _pong(networkLibrary::Protocol::pong_command);
+    _pong += '\n';
+    enqueue(std::move(_pong));
+}
+
+bool networkLibrary::Client::asyncClient::enqueue(std::string line)
+{
+    if(m_io_context.get_executor().running_in_this_thread()){
+        {
+            std::lock_guard<std::mutex> lock(m_intake_mutex);
+            if(m_closed) return false;
+            m_queued_bytes += line.size();
+        }
+        // Lines from other threads that are still in the intake were written first
+        drain_intake();
+        push_line(std::move(line));
+        start_write();
+        return true;
+    }
+
+    bool first = false;
+    {
+        std::unique_lock<std::mutex> lock(m_intake_mutex);
+        m_space.wait(lock, [this](){ return m_closed || m_queued_bytes < m_config.write_high_watermark; });
+        if(m_closed) return false;
+        m_queued_bytes += line.size();
+        first = m_intake.empty();
+        m_intake.push_back(std::move(line));
+    }
+    // One handler moves everything written until it runs
+    if(first){
+        boost::asio::post(
+            m_io_context,
+            networkLibrary::make_handler(m_config.recycle_handlers,
+            [this](){
+                drain_intake();
+                start_write();
+            }));
+    }
+    return true;
+}
+
+void networkLibrary::Client::asyncClient::drain_intake()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_intake_mutex);
+        if(m_intake.empty()) return;
+        m_intake.swap(m_draining);
+    }
+    for(auto& line : m_draining) push_line(std::move(line));
+    m_draining.clear();
+}
+
+void networkLibrary::Client::asyncClient::push_line(std::string line)
+{
+    std::size_t size = line.size();
+    m_write_queue.push_back(queuedLine{std::move(line), size, {}});
+}
+
+void networkLibrary::Client::asyncClient::shutdown_send()
+{
+    // The server closes its side once it has read everything, which ends the read loop
+    m_close_when_flushed = false;
+    boost::system::error_code ec;
+    m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+    {
+        std::lock_guard<std::mutex> lock(m_intake_mutex);
+        m_closed = true;
+    }
+    m_space.notify_all();
+}
+
+boost::asio::const_buffer networkLibrary::Client::asyncClient::encode(queuedLine& line)
+{
+    std::size_t body = line.m_line.size() - 1;
+    if(m_compress && body >= std::max<std::size_t>(m_config.compression_threshold, 2)){
+        // Sent compressed only when the stream is smaller than the line
+        std::string compressed(body - 1, '\0');
+        std::size_t length = networkLibrary::Protocol::compress(line.m_line.data(), body, &compressed[0], compressed.size());
+        if(length != 0){
+            compressed.resize(length);
+            line.m_line.swap(compressed);
+            networkLibrary::Protocol::encode_header(line.m_header.data(), networkLibrary::Protocol::frameHeader{static_cast<std::uint32_t>(length), networkLibrary::Protocol::MESSAGE, networkLibrary::Protocol::COMPRESSED});
+            return boost::asio::buffer(line.m_line);
+        }
+    }
+    networkLibrary::Protocol::encode_header(line.m_header.data(), networkLibrary::Protocol::frameHeader{static_cast<std::uint32_t>(body), networkLibrary::Protocol::MESSAGE, 0});
+    return boost::asio::buffer(line.m_line.data(), body);
+}
+
+networkLibrary::gatherView networkLibrary::Client::asyncClient::gather()
+{
+    m_write_buffers.clear();
+    m_write_inflight = std::min(m_write_queue.size(), m_config.max_gather_messages);
+    for(std::size_t i=0; i<m_write_inflight; ++i){
+        queuedLine& line = m_write_queue[i];
+        if(m_protocol == networkLibrary::Protocol::BINARY){
+            boost::asio::const_buffer _body = encode(line);
+            m_write_buffers.push_back(boost::asio::buffer(line.m_header));
+            m_write_buffers.push_back(_body);
+        }
+        else m_write_buffers.push_back(boost::asio::buffer(line.m_line));
+    }
+    return networkLibrary::gatherView{m_write_buffers.data(), m_write_buffers.data() + m_write_buffers.size()};
+}
+
+void networkLibrary::Client::asyncClient::written()
+{
+    std::size_t _written = 0;
+    for(std::size_t i=0; i<m_write_inflight; ++i){
+        _written += m_write_queue.front().m_size;
+        m_write_queue.pop_front();
+    }
+    m_write_inflight = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_intake_mutex);
+        m_queued_bytes -= _written;
+    }
+    m_space.notify_all();
+}
+
+void networkLibrary::Client::asyncClient::close_socket()
+{
+    if(m_socket.is_open()){
+        boost::system::error_code ec;
+        m_socket.close(ec);
+        if(m_config.print_status) std::cout << "Connection Socket Closed" << std::endl;
+    }
+#ifdef NETWORKLIBRARY_COROUTINES
+    // Ends a write loop waiting for lines
+    m_write_signal.cancel();
+#endif
+    {
+        std::lock_guard<std::mutex> lock(m_intake_mutex);
+        m_closed = true;
+    }
+    m_space.notify_all();
+}
+
 void networkLibrary::Client::asyncClient::close_connection()
 {
     boost::asio::post(
         m_io_context,
+        networkLibrary::make_handler(m_config.recycle_handlers,
         [this](){
-            m_socket.close();
-            std::cout << "Connection Socket Closed" << std::endl;
-        }
+            close_socket();
+        })
     );
 }
 
-bool networkLibrary::Client::asyncClient::write(std::string& buf)
+void networkLibrary::Client::asyncClient::close_when_flushed()
 {
-    std::string buffer = buf;
-    while(!buffer.empty() && (buffer.back()=='\n' || buffer.back()==' ')) buffer.pop_back();
-    reverse(buffer.begin(),buffer.end());
-    while(!buffer.empty() && (buffer.back()=='\n' || buffer.back()==' ')) buffer.pop_back();
-    reverse(buffer.begin(),buffer.end());
-            
-    if(buffer.empty()) return true;
-    buffer += '\n'; 
-    
-    if(buffer == "\\quit\n") return (!write_now(buffer));
-    
     boost::asio::post(
         m_io_context,
-        [this, buffer](){
-            boost::asio::async_write(
-                m_socket,
-                boost::asio::buffer(buffer),
-                [this](boost::system::error_code ec, int length){
-                    if(ec){
-                        std::cout << "Error writing to Server | Relaunch Client" <<std::endl;
-                        // m_socket.close();
-                        close_connection();
-                    }
-                    else{
-                        // Successfully Sent
-                    }
-                });
-        });
-    return true;    
+        networkLibrary::make_handler(m_config.recycle_handlers,
+        [this](){
+            drain_intake();
+            m_close_when_flushed = true;
+            start_write();
+        })
+    );
+}
+
+bool networkLibrary::Client::asyncClient::write(std::string_view message)
+{
+    // Trimmed in place, the only copy is the queued line
+    std::size_t first = message.find_first_not_of(" \n");
+    if(first == std::string_view::npos) return true;
+    message = message.substr(first, message.find_last_not_of(" \n") - first + 1);
+
+    std::string line;
+    line.reserve(message.size() + 1);
+    line.append(message);
+    line += '\n';
+
+    if(message == "\\quit") return (!write_now(std::move(line)));
+    return enqueue(std::move(line));
 }
 
 bool networkLibrary::Client::asyncClient::write_now(std::string message)
 {
-    //blocking call
-    boost::asio::write(
-        m_socket,
-        boost::asio::buffer(message)
-    );
-    return true;
+    if(message.empty() || message.back() != '\n') message += '\n';
+    return enqueue(std::move(message));
 }
 
 networkLibrary::Client::asyncClient::~asyncClient()
 {
-    std::cout << "Client Closed" << std::endl;
-}
\ No newline at end of file
+    if(m_config.print_status) std::cout << "Client Closed" << std::endl;
+}
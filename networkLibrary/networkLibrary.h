@@ -3,14 +3,42 @@
 
 
 #include "../utils/Logger.h"
+#include "sessionRegistry.h"
+#include "userIndex.h"
+#include "roomIndex.h"
+#include "historyIndex.h"
+#include "segmentLog.h"
+#include "metricsRegistry.h"
+#include "commandTable.h"
+#include "timingWheel.h"
+#include "admissionControl.h"
+#include "hotRestart.h"
+#include "ioBackend.h"
+#include "protocol.h"
+#include "bufferPool.h"
+#include "handlerAllocator.h"
+#include <array>
 #include <iostream>
+#include <chrono>
 #include <string>
-#include <set>
+#include <string_view>
+#include <initializer_list>
 #include <memory>
+#include <optional>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <functional>
+#include <utility> // Boost 1.74's awaitable.hpp uses std::exchange without including it
 
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/circular_buffer.hpp>
 
 /**
  * @brief The main namespace for the network library.
@@ -28,11 +56,85 @@ namespace networkLibrary
      */
     class chatSession;
 
+    /**
+     * @brief An immutable, reference-counted message ready to be written to clients.
+     * 
+     * A message is built once and every pending write holds a reference to it,
+     * so a broadcast costs one allocation regardless of the number of sessions.
+     */
+    class chatMessage;
+
+    /**
+     * @brief Handle to a shared immutable chat message.
+     */
+    using messagePtr = boost::intrusive_ptr<const chatMessage>;
+
+    void intrusive_ptr_add_ref(const chatMessage *message);
+    void intrusive_ptr_release(const chatMessage *message);
+
+    /**
+     * @brief Non-owning view of a gather list, so a write operation does not copy the list.
+     */
+    struct gatherView
+    {
+        using value_type = boost::asio::const_buffer;
+        using const_iterator = const boost::asio::const_buffer*;
+
+        const_iterator m_begin; ///< First buffer of the list.
+        const_iterator m_end;   ///< One past the last buffer of the list.
+
+        const_iterator begin() const { return m_begin; }
+        const_iterator end() const { return m_end; }
+    };
+
+    /**
+     * @brief Directory of the chat rooms of a server.
+     */
+    using chatRooms = roomIndex<chatSession>;
+
+    /**
+     * @brief Handle to a chat room, which stays valid after the room is torn down.
+     */
+    using roomPtr = chatRooms::roomPtr;
+
+    /**
+     * @brief Recent messages of every room of a server.
+     */
+    using chatHistory = historyIndex<messagePtr>;
+
+    /**
+     * @brief Handle to the recent messages of one room.
+     */
+    using historyPtr = chatHistory::ringPtr;
+
+    /**
+     * @brief Runs a client command for the session that sent it, on that session's executor.
+     */
+    using commandHandler = std::function<void(const std::shared_ptr<chatSession> &, const commandCall &)>;
+
+    /**
+     * @brief Commands understood by a server.
+     */
+    using chatCommands = commandTable<commandHandler>;
+
     /**
      * @brief Namespace containing server-related classes.
      */
     namespace Server
     {
+        /**
+         * @brief Tunable settings of an Asynchronous Server.
+         */
+        struct serverConfig;
+
+        /**
+         * @brief One event loop of an Asynchronous Server.
+         * 
+         * Owns an acceptor and the sessions accepted on it. Messages for those sessions
+         * that originate on another loop arrive through the loop's mailbox.
+         */
+        class serverLoop;
+
         /**
          * @brief An Asynchronous Server class for handling multiple chat sessions.
          * 
@@ -40,87 +142,971 @@ namespace networkLibrary
          * and is responsible to implement logic and send message to whichsoever client. 
          */
         class asyncServer;
+
+        /**
+         * @brief A persistent connection to another server of a federation.
+         */
+        class relayLink;
+
+        /**
+         * @brief Relays the traffic of an Asynchronous Server to the other servers of its federation.
+         * 
+         * Broadcasts and room messages are forwarded to every other node, direct messages to
+         * the node the recipient is on, and every node knows the users of all the others.
+         */
+        class federation;
+    };
+
+    /**
+     * @brief Namespace containing client-related classes.
+     */
+    namespace Client
+    {
+        /**
+         * @brief Tunable settings of an asynchronous client.
+         */
+        struct clientConfig;
+
+        /**
+         * @brief An asynchronous client class for connecting to the server.
+         */
+        class asyncClient;
+    };
+};
+
+/**
+ * @brief Immutable chat message whose encodings are stored inline after the object.
+ * 
+ * The storage holds a binary frame header, the body and a newline, so the text and the
+ * binary encoding of the same message are both views of a single allocation. The
+ * compressed frame is built by the first compressed recipient and shared by all others.
+ */
+class networkLibrary::chatMessage
+{
+private:
+    mutable std::atomic<std::size_t> m_refs; ///< Number of handles referring to the message.
+    std::size_t m_size; ///< Size of the body.
+    mutable std::atomic<const char*> m_deflated; ///< Pooled compressed frame after its length, nullptr until built.
+
+    /**
+     * @brief Constructs the message header; the payload is filled in by make().
+     * @param size Size of the body in bytes.
+     */
+    explicit chatMessage(std::size_t size);
+
+    /**
+     * @brief Allocates a message with room for the given body size.
+     * @param size Size of the body in bytes.
+     * @return Pointer to the new message, with a reference count of zero.
+     */
+    static chatMessage* allocate(std::size_t size);
+
+    /**
+     * @brief Number of pooled bytes a message with the given body size occupies.
+     */
+    static std::size_t footprint(std::size_t size);
+
+    /**
+     * @brief Writable access to the inline storage, used while building the message.
+     */
+    char* storage();
+
+    /**
+     * @brief Read access to the inline storage.
+     */
+    const char* storage() const;
+
+    /**
+     * @brief Number of pooled bytes the compressed frame of a message with the given body size may occupy.
+     */
+    static std::size_t deflated_footprint(std::size_t size);
+
+    /**
+     * @brief Builds the compressed frame.
+     * @return The pooled frame, or a marker if compressing does not make the message smaller.
+     */
+    const char* deflate() const;
+
+public:
+    chatMessage(const chatMessage &) = delete;
+    chatMessage &operator=(const chatMessage &) = delete;
+
+    /**
+     * @brief Builds a message from a single piece of text.
+     * @param body The message text. One trailing newline, if present, is not part of the body.
+     * @return Handle to the new message.
+     */
+    static messagePtr make(std::string_view body);
+
+    /**
+     * @brief Builds a message by concatenating several pieces of text in a single allocation.
+     * @param parts The pieces of text to join. One trailing newline, if present, is not part of the body.
+     * @param type Binary frame type of the message.
+     * @return Handle to the new message.
+     */
+    static messagePtr make(std::initializer_list<std::string_view> parts, std::uint8_t type = networkLibrary::Protocol::MESSAGE);
+
+    /**
+     * @brief Size of the body.
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief The message body.
+     */
+    std::string_view view() const;
+
+    /**
+     * @brief The message encoded for a connection, suitable for an asynchronous write.
+     * @param mode Wire format of the connection.
+     * @return The body followed by a newline in TEXT mode, a frame header followed by the body in BINARY mode.
+     */
+    boost::asio::const_buffer buffer(networkLibrary::Protocol::Mode mode) const;
+
+    /**
+     * @brief The message as a COMPRESSED binary frame, suitable for an asynchronous write.
+     * 
+     * The body is compressed on the first call only, whichever thread makes it; every later
+     * call returns the same bytes. Safe to call from several threads at once.
+     * @return The compressed frame, or the BINARY encoding if compressing does not make it smaller.
+     */
+    boost::asio::const_buffer compressed_buffer() const;
+
+    friend void networkLibrary::intrusive_ptr_add_ref(const chatMessage *message);
+    friend void networkLibrary::intrusive_ptr_release(const chatMessage *message);
+};
+
+/**
+ * @brief Tunable settings of an Asynchronous Server.
+ */
+struct networkLibrary::Server::serverConfig
+{
+    /**
+     * @brief What to do with a client whose outbound queue reaches the high watermark.
+     */
+    enum SlowConsumerPolicy {
+        DROP,       ///< Drop new messages until the queue drains below the low watermark.
+        DISCONNECT  ///< Close the connection.
+    };
+
+    Logger::Location log_location = Logger::Location::STDOUT; ///< Where the server log is written.
+    std::string log_file = "log.txt";                    ///< File of the TEXT_FILE and BINARY_FILE locations.
+    Logger::Mode log_mode = Logger::Mode::ASYNCHRONOUS;  ///< Whether a background thread writes the server log.
+    Logger::OverflowPolicy log_overflow = Logger::OverflowPolicy::DROP; ///< What logging does when the log queue is full.
+    std::size_t log_capacity = 8192;                     ///< Messages the log queue holds before the overflow policy applies.
+    std::size_t write_high_watermark = 1024 * 1024;      ///< Queued bytes at which a session is a slow consumer.
+    std::size_t write_low_watermark = 256 * 1024;        ///< Queued bytes below which a dropping session accepts messages again.
+    SlowConsumerPolicy slow_consumer_policy = DROP;      ///< Policy applied at the high watermark.
+    std::size_t max_gather_messages = 64;                ///< Most queued messages merged into one gather write.
+    std::size_t max_message_size = 64 * 1024;            ///< Largest accepted line or frame body from a client.
+    std::size_t read_buffer_size = 1024;                 ///< Initial size of a session's receive buffer.
+    bool recycle_handlers = true;                        ///< Allocate asynchronous operations from the buffer pool instead of Asio's default.
+    std::string default_room = "lobby";                  ///< Room every participant is in after choosing a username.
+    std::size_t history_size = 50;                       ///< Recent messages kept per room and replayed on join, 0 for none.
+    std::size_t history_rooms = 4096;                    ///< Rooms whose history is kept once nobody is in them, least recently used dropped first.
+    std::string history_directory;                       ///< Directory of the persistent history log, empty to keep history in memory only.
+    std::size_t history_segment_size = 16 * 1024 * 1024; ///< Size of one history log segment file.
+    std::size_t history_segments_kept = 4;               ///< Newest history log segments kept on disk.
+    std::chrono::milliseconds history_sync_interval = std::chrono::milliseconds(100); ///< Longest time a message waits to be synced to the history log.
+    unsigned int metrics_port = 0;                       ///< Port of the plain-text metrics endpoint, 0 to disable it.
+    std::string metrics_address = "127.0.0.1";           ///< Address the metrics endpoint listens on.
+    bool batch_writes = false;                           ///< Coalesce the broadcast and room messages of a tick into one write per session.
+    std::chrono::microseconds batch_window = std::chrono::microseconds(0); ///< Length of a tick, 0 for one turn of the event loop.
+    std::size_t batch_max_messages = 64;                 ///< Queued messages at which a session is written before its tick ends.
+    bool compression = true;                             ///< Let binary clients negotiate deflate compressed frames.
+    std::size_t compression_threshold = 512;             ///< Smallest body sent compressed to such clients, smaller ones go out as they are.
+    std::chrono::milliseconds timer_tick = std::chrono::milliseconds(100); ///< Resolution of the session timeouts.
+    std::chrono::milliseconds handshake_timeout = std::chrono::seconds(30); ///< Time a new client has to choose a username, 0 for no limit.
+    std::chrono::milliseconds heartbeat_interval = std::chrono::seconds(30); ///< Silence after which a client is sent "\ping", 0 for no heartbeats.
+    std::chrono::milliseconds idle_timeout = std::chrono::seconds(120); ///< Silence after which a client that finished the handshake is disconnected, 0 for no limit.
+    std::size_t max_connections = 0;                     ///< Sessions open at once, further connections are turned away; 0 for no limit.
+    std::size_t max_connections_per_address = 0;         ///< Sessions open at once from one client address, 0 for no limit.
+    double session_message_rate = 0;                     ///< Lines or frames per second a session may send, 0 for no limit.
+    double session_byte_rate = 0;                        ///< Bytes per second a session may send, 0 for no limit.
+    double address_message_rate = 0;                     ///< Lines or frames per second all sessions of one client address may send together, 0 for no limit.
+    double address_byte_rate = 0;                        ///< Bytes per second all sessions of one client address may send together, 0 for no limit.
+    std::chrono::milliseconds rate_burst = std::chrono::seconds(1); ///< Time at the full rate a client may send at once; more than timer_tick, which paces throttled reads.
+    std::uint64_t node_id = 0;                           ///< ID of the server in its federation, 0 for a random one.
+    unsigned int federation_port = 0;                    ///< Port other servers of the federation connect to, 0 to accept no relay links.
+    std::string federation_address = "127.0.0.1";       ///< Address relay links are accepted on.
+    std::vector<std::string> federation_peers;           ///< "host:port" of the servers to keep relay links to; every pair of servers needs one link.
+    std::chrono::milliseconds federation_retry = std::chrono::seconds(1); ///< Delay before a lost relay link to a peer is reconnected.
+    std::size_t federation_queue_limit = 64 * 1024 * 1024; ///< Bytes queued for a peer at which its link is dropped and reconnected.
+    std::string handoff_path;                            ///< Unix socket a restarted server takes the sockets over through, empty for no hot restart.
+};
+
+/**
+ * @brief Event loop of an Asynchronous Server with its acceptor, sessions and mailbox.
+ */
+class networkLibrary::Server::serverLoop
+{
+private:
+    /**
+     * @brief A message waiting in the mailbox of the loop.
+     *
+     * Items are drawn from the bufferPool by the posting thread and returned by the loop
+     * that delivers them, so a cross-loop broadcast does not touch the heap.
+     */
+    struct mailboxItem
+    {
+        networkLibrary::messagePtr m_message; ///< The message to deliver.
+        std::shared_ptr<networkLibrary::chatSession> m_target; ///< Recipient, or nullptr for every session of the loop.
+        networkLibrary::roomPtr m_room; ///< Room whose members on this loop receive the message, if there is no recipient.
+        mailboxItem* m_next; ///< Next item of the mailbox.
+
+        /**
+         * @brief Creates an item in a pooled block.
+         */
+        static mailboxItem* make(networkLibrary::messagePtr message, std::shared_ptr<networkLibrary::chatSession> target, networkLibrary::roomPtr room, mailboxItem* next);
+
+        /**
+         * @brief Destroys an item and returns its block to the pool.
+         */
+        static void release(mailboxItem* item);
+    };
+
+    asyncServer &m_serv; ///< Reference to the owning server.
+    const std::size_t m_index; ///< Position of the loop in the server, also the loop's partition of every room.
+    boost::asio::io_context &m_io_context; ///< IO context of the loop.
+    boost::asio::ip::tcp::acceptor m_acceptor; ///< Acceptor object for accepting new connections.
+    bool m_session_strands; ///< Whether sessions get their own strand, for loops run by several threads.
+    networkLibrary::sessionRegistry<chatSession> m_chat_sessions; ///< Sessions owned by the loop, iterated through lock-free snapshots.
+    std::atomic<mailboxItem*> m_mailbox; ///< Lock-free stack of messages posted from other loops.
+    std::mutex m_batch_mutex; ///< Guards the batched sessions and the tick timer.
+    std::vector<std::shared_ptr<networkLibrary::chatSession>> m_batched; ///< Sessions whose queued messages wait for the end of the tick.
+    boost::asio::steady_timer m_batch_timer; ///< Ends a tick when the batch window is not 0.
+    std::mutex m_timer_mutex; ///< Guards the timing wheel and the wheel's timer.
+    networkLibrary::timingWheel<chatSession> m_timers; ///< Timeouts and heartbeats of the loop's sessions.
+    boost::asio::steady_timer m_wheel_timer; ///< Advances the timing wheel once per serverConfig::timer_tick.
+    std::chrono::steady_clock::time_point m_wheel_epoch; ///< Time of the wheel's tick 0.
+    bool m_wheel_running; ///< Whether the wheel's timer runs, cleared by stop().
+    std::vector<std::shared_ptr<networkLibrary::chatSession>> m_expired; ///< Sessions whose timer fired, reused by every wheel tick.
+
+    /**
+     * @brief Starts accepting new chat sessions.
+     */
+    void startAccept();
+
+    /**
+     * @brief Tells a connection that was not admitted why, as far as its send buffer takes it, and closes it.
+     * @param socket The connection.
+     * @param ip Client address of the connection.
+     * @param verdict Why the connection was not admitted.
+     */
+    void reject(boost::asio::ip::tcp::socket &socket, const std::string &ip, networkLibrary::admissionControl::verdict verdict);
+
+    /**
+     * @brief Adds a session to the current tick, starting the tick if it is the first one.
+     * @param session Session with queued messages and no write in flight.
+     */
+    void schedule_batch(std::shared_ptr<networkLibrary::chatSession> session);
+
+    /**
+     * @brief Ends the tick, writing the queued messages of every session in it.
+     */
+    void flush_batch();
+
+    /**
+     * @brief Delivers every message of the mailbox, in the order they were posted.
+     */
+    void drain_mailbox();
+
+    /**
+     * @brief Starts advancing the timing wheel, unless every session timeout is disabled.
+     */
+    void start_timers();
+
+    /**
+     * @brief Waits for the next wheel tick, then hands every expired session timer to its session.
+     */
+    void wait_timers();
+
+    /**
+     * @brief Arms the timer of a session, moving it if it is armed.
+     * @param session The session.
+     * @param delay Time until the timer fires, rounded up to whole wheel ticks.
+     * @param sooner Whether an armed timer is only moved to an earlier tick.
+     */
+    void arm_timer(networkLibrary::chatSession &session, std::chrono::steady_clock::duration delay, bool sooner = false);
+
+    /**
+     * @brief Cancels the timer of a session.
+     * @param session The session.
+     */
+    void cancel_timer(networkLibrary::chatSession &session);
+
+    /**
+     * @brief Delivers a message on the loop's own thread.
+     * @param message The message to deliver.
+     * @param target Recipient, or nullptr for every session of the loop.
+     * @param room Without a recipient, the room whose members on this loop receive the message.
+     */
+    void deliver_local(const networkLibrary::messagePtr &message, const std::shared_ptr<networkLibrary::chatSession> &target, const networkLibrary::roomPtr &room);
+
+public:
+
+    friend class networkLibrary::Server::asyncServer;
+    friend class networkLibrary::chatSession;
+
+    /**
+     * @brief Constructs a loop listening on the given endpoint.
+     * @param serv The owning server.
+     * @param index Position of the loop in the server.
+     * @param io_context The IO context of the loop.
+     * @param endpoint Address and port to listen on.
+     * @param reuse_port Whether other loops listen on the same port (SO_REUSEPORT).
+     * @param session_strands Whether every session gets its own strand.
+     * @param listener Listening socket taken over from the previous server, -1 to bind a new one.
+     */
+    serverLoop(asyncServer &serv, std::size_t index, boost::asio::io_context &io_context, const boost::asio::ip::tcp::endpoint &endpoint, bool reuse_port, bool session_strands, int listener = -1);
+
+    serverLoop(const serverLoop &) = delete;
+
+    ~serverLoop();
+
+    /**
+     * @brief Whether the calling thread is running the loop.
+     */
+    bool running_in_this_thread() const;
+
+    /**
+     * @brief Hands a message to the loop for delivery.
+     * 
+     * Delivers immediately when called on the loop itself or when the loop is the server's
+     * only one, otherwise pushes the message onto the loop's mailbox.
+     * @param message The message to deliver.
+     * @param target Recipient, or nullptr for every session of the loop.
+     * @param room Without a recipient, the room whose members on this loop receive the message.
+     */
+    void post_message(networkLibrary::messagePtr message, std::shared_ptr<networkLibrary::chatSession> target, networkLibrary::roomPtr room = nullptr);
+};
+
+/**
+ * @brief A relay connection to another server, written in batches.
+ * 
+ * Frames queued while a write is in flight all go out in the next write, so a busy link
+ * makes few large writes. An outbound link reconnects after it is lost; an accepted link
+ * is dropped and waits for the peer to reconnect.
+ */
+class networkLibrary::Server::relayLink : public std::enable_shared_from_this<networkLibrary::Server::relayLink>
+{
+private:
+    federation &m_federation; ///< The owning federation.
+    boost::asio::strand<boost::asio::io_context::executor_type> m_strand; ///< Serialises the link's handlers.
+    boost::asio::ip::tcp::socket m_socket; ///< Connection to the peer.
+    boost::asio::ip::tcp::resolver m_resolver; ///< Resolves the peer of an outbound link.
+    boost::asio::steady_timer m_retry_timer; ///< Delays reconnecting an outbound link.
+    const std::string m_host; ///< Host of the peer of an outbound link, empty for an accepted link.
+    const std::string m_port; ///< Port of the peer of an outbound link.
+    std::atomic<std::uint64_t> m_peer; ///< Node ID of the peer, 0 until its hello arrives.
+
+    std::mutex m_write_mutex; ///< Guards the queued frames and the link's state.
+    std::string m_queued; ///< Frames waiting for the next write.
+    std::string m_writing; ///< Frames of the write in flight, swapped with m_queued to keep both allocations.
+    bool m_connected; ///< Whether frames are queued for the peer.
+    bool m_write_in_progress; ///< Whether a write is in flight.
+
+    std::vector<char> m_read_buffer; ///< Received bytes, frames are parsed in place.
+    std::size_t m_read_end; ///< End of the received bytes.
+
+    /**
+     * @brief Resolves and connects an outbound link, retrying until it succeeds or the federation stops.
+     */
+    void connect();
+
+    /**
+     * @brief Waits federation_retry and connects again.
+     */
+    void retry();
+
+    /**
+     * @brief Announces this node on a new connection and starts reading.
+     */
+    void start();
+
+    /**
+     * @brief Reads frames until the connection fails.
+     */
+    void read();
+
+    /**
+     * @brief Writes everything queued in one write, until the queue is empty.
+     */
+    void write();
+
+    /**
+     * @brief Closes the connection after an error; outbound links reconnect.
+     */
+    void fail();
+
+    /**
+     * @brief Queues an encoded frame; the federation's mutex orders the frames of all links.
+     * @param frame The frame.
+     * @return False if the link is not connected.
+     */
+    bool enqueue(std::string_view frame);
+
+public:
+
+    friend class networkLibrary::Server::federation;
+
+    /**
+     * @brief Constructs an outbound link; connect() is called by the federation.
+     * @param fed The owning federation.
+     * @param io_context IO context running the link.
+     * @param host Host of the peer.
+     * @param port Relay port of the peer.
+     */
+    relayLink(federation &fed, boost::asio::io_context &io_context, std::string host, std::string port);
+
+    /**
+     * @brief Constructs a link from an accepted connection.
+     * @param fed The owning federation.
+     * @param socket The accepted connection.
+     */
+    relayLink(federation &fed, boost::asio::ip::tcp::socket socket);
+
+    /**
+     * @brief Closes the connection for good, without reconnecting.
+     */
+    void close();
+};
+
+/**
+ * @brief The relay links of an Asynchronous Server and what it knows about the other nodes.
+ * 
+ * Nodes form a full mesh and only forward the traffic that originates on them, so no frame
+ * travels more than one link. Every frame carries its origin node and a sequence number that
+ * grows for every frame of that node, across restarts too; a node drops its own frames and
+ * any frame not newer than the last one from the same origin, so a duplicated link delivers
+ * nothing twice. Links run on the strands of the server's first loop.
+ */
+class networkLibrary::Server::federation
+{
+private:
+    asyncServer &m_serv; ///< The server whose traffic is relayed.
+    boost::asio::io_context &m_io_context; ///< IO context of the links and the acceptor.
+    const std::uint64_t m_node; ///< ID of this node.
+    std::unique_ptr<boost::asio::ip::tcp::acceptor> m_acceptor; ///< Acceptor of relay links, nullptr when none are accepted.
+
+    std::mutex m_mutex; ///< Guards the links and the sequence, so every link queues frames in sequence order.
+    std::vector<std::shared_ptr<relayLink>> m_links; ///< Outbound links, connected or not, and connected accepted links.
+    std::uint64_t m_sequence; ///< Sequence number of the last frame originating here.
+    bool m_stopping; ///< Set by stop(), after which links are not reconnected.
+
+    mutable std::mutex m_remote_mutex; ///< Guards what is known about the other nodes.
+    std::unordered_map<std::string, std::uint64_t> m_remote_users; ///< Users on other nodes, with the node each is on.
+    std::unordered_map<std::uint64_t, std::uint64_t> m_seen; ///< Sequence number of the last frame received from every origin.
+
+    /**
+     * @brief Accepts relay links from other nodes.
+     */
+    void accept();
+
+    /**
+     * @brief Starts accepting relay links, if a federation port is configured; also again after stop().
+     * @param[out] ec Why the relay port could not be bound; it then stays closed.
+     */
+    void listen(boost::system::error_code &ec);
+
+    /**
+     * @brief Starts a link to every configured peer.
+     */
+    void connect_peers();
+
+    /**
+     * @brief Encodes a frame originating here into a reused per-thread buffer; m_mutex must be held.
+     * @param type One of the relay frame types.
+     * @param name The name field, if the type has one.
+     * @param message The message field, if the type has one.
+     * @return The frame, valid until the next call on the thread.
+     */
+    std::string_view encode(std::uint8_t type, std::string_view name, std::string_view message);
+
+    /**
+     * @brief Queues a frame for every connected link, or only for the link to one node.
+     * @param type One of the relay frame types.
+     * @param name The name field, if the type has one.
+     * @param message The message field, if the type has one.
+     * @param node The only node to send to, 0 for all of them.
+     * @return False if no link took the frame.
+     */
+    bool relay(std::uint8_t type, std::string_view name, std::string_view message, std::uint64_t node = 0);
+
+    /**
+     * @brief Marks a link connected and queues the hello and the local users for it.
+     */
+    void link_up(relayLink &link);
+
+    /**
+     * @brief Marks a link disconnected and forgets the users of its peer.
+     */
+    void link_down(relayLink &link);
+
+    /**
+     * @brief Handles one frame received on a link.
+     * 
+     * Two nodes can claim the same name before either hears of the other's claim. Every node
+     * then gives the name to the lower node ID: the higher node's session loses it and is asked
+     * for another one, and the other nodes keep the lower node as its holder.
+     * @param link The link.
+     * @param frame The frame.
+     * @return False if the frame is malformed and the link must be dropped.
+     */
+    bool handle_frame(relayLink &link, const networkLibrary::Protocol::extracted &frame);
+
+public:
+
+    friend class networkLibrary::Server::relayLink;
+
+    /**
+     * @brief Constructs the federation of a server; start() opens it.
+     * @param serv The server.
+     * @param io_context IO context of the links, the server's first loop.
+     */
+    federation(asyncServer &serv, boost::asio::io_context &io_context);
+
+    federation(const federation &) = delete;
+    federation &operator=(const federation &) = delete;
+
+    /**
+     * @brief Starts accepting relay links, if a federation port is configured, and connects to the peers; also again after stop().
+     * @throws boost::system::system_error if the relay port cannot be bound, before connecting to any peer.
+     */
+    void start();
+
+    /**
+     * @brief Starts like start(), but connects to the peers even if the relay port cannot be bound.
+     * @param[out] ec Why the relay port could not be bound.
+     */
+    void start(boost::system::error_code &ec);
+
+    /**
+     * @brief Closes every link and stops accepting and reconnecting.
+     */
+    void stop();
+
+    /**
+     * @brief ID of this node.
+     */
+    std::uint64_t node() const;
+
+    /**
+     * @brief Port relay links are accepted on, 0 if none are.
+     */
+    unsigned int port() const;
+
+    /**
+     * @brief Sends a broadcast originating here to every other node.
+     */
+    void relay_broadcast(const networkLibrary::messagePtr &message);
+
+    /**
+     * @brief Sends a room message originating here to every other node.
+     */
+    void relay_room(const std::string &room, const networkLibrary::messagePtr &message);
+
+    /**
+     * @brief Sends a message to a user on another node.
+     * @return False if no other node is known to have the user.
+     */
+    bool relay_direct(const std::string &name, const networkLibrary::messagePtr &message);
+
+    /**
+     * @brief Tells the other nodes that a user claimed a name here.
+     */
+    void user_joined(const std::string &name);
+
+    /**
+     * @brief Tells the other nodes that a user released a name here.
+     */
+    void user_left(const std::string &name);
+
+    /**
+     * @brief Whether another node has a user of the given name.
+     */
+    bool knows_user(const std::string &name) const;
+
+    /**
+     * @brief Users on other nodes with the node each is on, sorted by name.
+     */
+    std::vector<std::pair<std::string, std::uint64_t>> remote_users() const;
+};
+
+/**
+ * @brief Asynchronous server class for handling chat sessions and sending message.
+ */
+class networkLibrary::Server::asyncServer
+{
+private:
+    unsigned int m_port; ///< Port number the server listens on.
+    std::vector<std::unique_ptr<serverLoop>> m_loops; ///< Event loops of the server, one per IO context.
+    networkLibrary::userIndex<chatSession> m_user_index; ///< Index from username to chat session.
+    networkLibrary::chatRooms m_rooms; ///< Chat rooms and their members.
+    serverConfig m_config; ///< Settings the server was started with.
+    networkLibrary::chatHistory m_history; ///< Recent messages of every room.
+    std::unique_ptr<networkLibrary::segmentLog> m_history_log; ///< Persistent history, or nullptr when it is kept in memory only.
+    std::atomic<bool> m_stopping; ///< Set once stop() has been called.
+    networkLibrary::metricsRegistry m_metrics; ///< Counters and histograms of the server.
+    networkLibrary::chatCommands m_commands; ///< Client commands, built-in ones first.
+    networkLibrary::messagePtr m_help; ///< Reply to \help, rebuilt when a command is registered.
+    networkLibrary::messagePtr m_ping; ///< Heartbeat sent to quiet clients.
+    networkLibrary::admissionControl m_admission; ///< Connection limits and the shared rate limits of client addresses.
+    std::unique_ptr<federation> m_federation; ///< Relay links to the other servers of the federation, nullptr without any.
+    std::unique_ptr<boost::asio::ip::tcp::acceptor> m_metrics_acceptor; ///< Acceptor of the metrics endpoint, or nullptr when it is disabled.
+    std::unique_ptr<boost::asio::local::stream_protocol::acceptor> m_handoff_acceptor; ///< Acceptor of the next server's handoff request, or nullptr without a handoff path.
+
+    /**
+     * @brief Steps of handing the server's sockets off, each waiting for every loop or session.
+     */
+    enum handoffPhase {
+        RELEASING,  ///< Loops give up their listening sockets.
+        SUSPENDING, ///< Sessions stop reading and writing.
+        CAPTURING   ///< Sessions give up their connections and state.
     };
 
+    std::mutex m_handoff_mutex; ///< Guards the handoff.
+    networkLibrary::HotRestart::transfer m_handoff; ///< Sockets taken over until they are adopted, or those being handed off.
+    handoffPhase m_handoff_phase; ///< Step of the handoff in progress.
+    std::size_t m_handoff_pending; ///< Loops or sessions the current step waits for.
+    std::vector<std::shared_ptr<networkLibrary::chatSession>> m_handoff_sessions; ///< Sessions being handed off.
+    std::vector<std::shared_ptr<networkLibrary::chatSession>> m_handoff_captured; ///< Session of every captured connection, in the order of m_handoff.sessions.
+    int m_handoff_channel; ///< Connection to the next server, -1 while no handoff is in progress.
+    std::thread m_handoff_thread; ///< Sends the sockets with blocking writes and waits for the next server, off the event loops.
+    std::chrono::steady_clock::time_point m_handoff_started; ///< When the handoff or the takeover began.
+    Logger server_log;
+
+    /**
+     * @brief Opens the persistent history log and rebuilds the room histories from its newest segment.
+     */
+    void open_history();
+
+    /**
+     * @brief Registers the built-in commands and builds the \help reply.
+     */
+    void open_commands();
+
+    /**
+     * @brief Rebuilds the \help reply from the registered commands.
+     */
+    void build_help();
+
+    /**
+     * @brief Records a chat message in a room's history and appends it to the history log.
+     * @param history History of the room the message was sent to.
+     * @param message The message.
+     */
+    void record(const networkLibrary::historyPtr &history, const networkLibrary::messagePtr &message);
+
+    /**
+     * @brief Creates one event loop per IO context and starts accepting on all of them.
+     * @param io_contexts The IO contexts of the loops.
+     * @param per_loop Whether each IO context is run by a single thread owning its sessions.
+     */
+    void open_loops(const std::vector<std::reference_wrapper<boost::asio::io_context>> &io_contexts, bool per_loop);
+
+    /**
+     * @brief Opens the metrics endpoint on the first event loop, if a metrics port is configured.
+     * @throws boost::system::system_error if the endpoint cannot be bound.
+     */
+    void open_metrics();
+
+    /**
+     * @brief Opens the metrics endpoint, if a metrics port is configured, without throwing.
+     * @param[out] ec Why the endpoint could not be bound; it then stays closed.
+     */
+    void open_metrics(boost::system::error_code &ec);
+
+    /**
+     * @brief Accepts scrapes of the metrics endpoint; each is answered with render() and closed.
+     */
+    void accept_metrics();
+
+    /**
+     * @brief Opens the relay links of the federation, if a federation port or peers are configured.
+     * @throws boost::system::system_error if the relay port cannot be bound.
+     */
+    void open_federation();
+
+    /**
+     * @brief Delivers a broadcast to the sessions of this node only.
+     * @param message The message.
+     */
+    void broadcast_local(const networkLibrary::messagePtr &message);
+
+    /**
+     * @brief Delivers a room message to the members of the room on this node only.
+     * @param room The room.
+     * @param message The message.
+     */
+    void write_room_local(const networkLibrary::roomPtr &room, const networkLibrary::messagePtr &message);
+
+    /**
+     * @brief Takes the sockets over from the server listening on the handoff path, if there is one.
+     */
+    void take_over();
+
+    /**
+     * @brief Starts a session for every client connection taken over, spread over the loops.
+     */
+    void adopt_sessions();
+
+    /**
+     * @brief Listens on the handoff path for the next server, if one is configured.
+     * @throws boost::system::system_error if the path cannot be bound.
+     */
+    void open_handoff();
+
+    /**
+     * @brief Listens on the handoff path, if one is configured, without throwing.
+     * @param[out] ec Why the path could not be bound; it then stays closed.
+     */
+    void open_handoff(boost::system::error_code &ec);
+
+    /**
+     * @brief Accepts the next server's handoff request.
+     */
+    void accept_handoff();
+
+    /**
+     * @brief Starts handing every socket off to the next server; the server stops once the next one confirms it has them.
+     * @param channel Blocking connection to the next server.
+     */
+    void hand_off(int channel);
+
+    /**
+     * @brief Counts a loop or session done with the current handoff step, and starts the next step after the last one.
+     */
+    void handoff_step();
+
+    /**
+     * @brief Sends the captured sockets to the next server on m_handoff_thread.
+     * 
+     * The writes block and the next server's reply can take up to HotRestart::timeout; the
+     * sessions are parked meanwhile, but the loops go on running everything else.
+     */
+    void finish_handoff();
+
+    /**
+     * @brief Stops once the next server confirmed it has the sockets, takes them back otherwise.
+     * @param adopted Whether the next server confirmed.
+     */
+    void end_handoff(bool adopted);
+
+    /**
+     * @brief Undoes a handoff that failed: the loops accept again, every session resumes and the endpoints reopen.
+     */
+    void roll_back();
+
+    /**
+     * @brief Closes the metrics endpoint, the federation and the handoff acceptor.
+     */
+    void close_endpoints();
+
+    /**
+     * @brief Adds a new chat session to the server.
+     * @param session Shared Pointer to the chat session to add.
+     */
+    void add_session(const std::shared_ptr<networkLibrary::chatSession> session);
+
+    /**
+     * @brief Removes a chat session from the server and releases its username.
+     * @param session Shared Pointer to the chat session to remove.
+     */
+    void remove_session(const std::shared_ptr<networkLibrary::chatSession> session);
+
+    /**
+     * @brief Moves a chat session into a room, leaving its current one, and replays the room's history to it.
+     * 
+     * The history is replayed after joining, so a message sent while the session joins may
+     * reach it twice but is never missed.
+     * @param session Shared Pointer to the chat session; must be called on its executor.
+     * @param name Name of the room, created if nobody is in it.
+     */
+    void join_room(const std::shared_ptr<networkLibrary::chatSession> session, const std::string &name);
+
+    /**
+     * @brief Takes a chat session out of its room, tearing the room down if it was the last member.
+     * @param session Shared Pointer to the chat session; must be called on its executor.
+     * @return The room that was left, or nullptr if the session was in none.
+     */
+    networkLibrary::roomPtr leave_room(const std::shared_ptr<networkLibrary::chatSession> session);
+
+    /**
+     * @brief Checks whether a string can be used as a username.
+     * @param name The proposed username.
+     * @return True if the name is non-empty and free of command characters.
+     */
+    static bool valid_name(const std::string &name);
+
+public:
+
+    /**
+     * @brief Parses a "name : message" line into the name and the message.
+     * @param[in,out] message The message to parse.
+     * @return A pair containing the parsed data.
+     */
+    static std::pair<std::string, std::string> parse(std::string &message);
+
+    friend class networkLibrary::chatSession;
+    friend class networkLibrary::Server::serverLoop;
+    friend class networkLibrary::Server::federation;
+    friend class networkLibrary::Server::relayLink;
+
+    /**
+     * @brief Constructs an asynchronous server.
+     * 
+     * The IO context may be run by any number of threads; every session runs its handlers
+     * on its own strand.
+     * @param io_context The IO context used for asynchronous operations.
+     * @param port The port number on which the server will listen, 0 for any free port.
+     * @param config Settings of the server.
+     */
+    asyncServer(boost::asio::io_context &io_context, unsigned int port, serverConfig config = serverConfig());
+
+    /**
+     * @brief Constructs an asynchronous server with one event loop per IO context.
+     * 
+     * Every IO context must be run by exactly one thread. Each loop has its own acceptor on
+     * the shared port (SO_REUSEPORT) and every session stays on the loop that accepted it.
+     * @param io_contexts The IO contexts, typically one per core.
+     * @param port The port number on which the server will listen, 0 for any free port.
+     * @param config Settings of the server.
+     */
+    asyncServer(const std::vector<std::reference_wrapper<boost::asio::io_context>> &io_contexts, unsigned int port, serverConfig config = serverConfig());
+
+    /**
+     * @brief Waits for a handoff's sending thread, if one ran.
+     */
+    ~asyncServer();
+
+    /**
+     * @brief The port number the server is listening on.
+     */
+    unsigned int port() const;
+
     /**
-     * @brief Namespace containing client-related classes.
+     * @brief Registers a client command, which then appears in \help.
+     * 
+     * Must be called before the IO contexts run. The handler receives the sending session and
+     * the parsed line, whose parts point into the session's receive buffer and are only valid
+     * during the call.
+     * @param name Name of the command without the backslash, e.g. "roll".
+     * @param usage Arguments as shown by \help, e.g. "{}" for one brace group.
+     * @param description One line description shown by \help.
+     * @param handler Function run for the command.
+     * @return False if the name is taken or no more commands fit.
      */
-    namespace Client
-    {
-        /**
-         * @brief An asynchronous client class for connecting to the server.
-         */
-        class asyncClient;
-    };
-};
+    bool register_command(std::string name, std::string usage, std::string description, networkLibrary::commandHandler handler);
 
-/**
- * @brief Asynchronous server class for handling chat sessions and sending message.
- */
-class networkLibrary::Server::asyncServer
-{
-private:
-    unsigned int m_port; ///< Port number the server listens on.
-    boost::asio::io_context &m_io_context; ///< Reference to the IO context.
-    boost::asio::ip::tcp::acceptor m_acceptor; ///< Acceptor object for accepting new connections.
-    std::set<std::shared_ptr<chatSession>> m_chat_sessions; ///< Set of active chat sessions.
-    std::mutex _server_mutex; ///< Mutex for thread-safe operations on the set of chat essions.
-    Logger server_log;
+    /**
+     * @brief The port of the metrics endpoint, 0 if it is disabled.
+     */
+    unsigned int metrics_port() const;
 
     /**
-     * @brief Starts accepting new chat sessions.
+     * @brief The port relay links of the federation are accepted on, 0 if none are.
      */
-    void startAccept();
+    unsigned int federation_port() const;
 
     /**
-     * @brief Parses a message into a pair of strings.
-     * @param[in,out] message The message to parse.
-     * @return A pair containing the parsed data.
+     * @brief Counters and histograms of the server.
      */
-    std::pair<std::string, std::string> parse(std::string &message);
+    networkLibrary::metricsRegistry &metrics();
 
     /**
-     * @brief Adds a new chat session to the server.
-     * @param session Shared Pointer to the chat session to add.
+     * @brief Stops accepting connections and closes every chat session.
+     * 
+     * Outstanding operations complete with an error, so the IO context runs out of work
+     * once the sessions are gone.
      */
-    void add_session(const std::shared_ptr<networkLibrary::chatSession> session);
+    void stop();
 
     /**
-     * @brief Removes a chat session from the server.
-     * @param session Shared Pointer to the chat session to remove.
+     * @brief Broadcasts a message to all connected chat sessions.
+     * 
+     * The text is copied once, into the message every session shares.
+     * @param message The message to broadcast.
      */
-    void remove_session(const std::shared_ptr<networkLibrary::chatSession> session);
+    void write_broadcast(std::string_view message);
 
-public:
+    /**
+     * @brief Broadcasts an already built message to all connected chat sessions.
+     * 
+     * Every session's pending write shares the same message, nothing is copied per session.
+     * In a federation the message also reaches the sessions of every other node.
+     * @param message The message to broadcast.
+     */
+    void write_broadcast(networkLibrary::messagePtr message);
 
-    friend class networkLibrary::chatSession;
+    /**
+     * @brief Sends a message to every member of a room.
+     * 
+     * Only the event loops with members in the room are involved, each walking just its own
+     * members, so the cost follows the size of the room rather than the number of sessions.
+     * In a federation the message also reaches the members of the room of that name on
+     * every other node.
+     * @param room The room.
+     * @param message The message to send.
+     */
+    void write_room(const networkLibrary::roomPtr &room, networkLibrary::messagePtr message);
 
     /**
-     * @brief Constructs an asynchronous server.
-     * @param io_context The IO context used for asynchronous operations.
-     * @param port The port number on which the server will listen.
+     * @brief Current chat rooms, in no particular order.
      */
-    asyncServer(boost::asio::io_context &io_context, unsigned int port);
+    std::vector<networkLibrary::roomPtr> rooms();
 
     /**
-     * @brief Broadcasts a message to all connected chat sessions.
-     * @param message The message to broadcast.
+     * @brief Number of connected chat sessions.
+     */
+    std::size_t session_count() const;
+
+    /**
+     * @brief Calls a function for every connected chat session.
+     * @param fn Function taking a const std::shared_ptr<chatSession>&.
+     */
+    template <typename Fn>
+    void for_each_session(Fn &&fn) const
+    {
+        for(auto const& loop : m_loops) loop->m_chat_sessions.for_each(fn);
+    }
+
+    /**
+     * @brief Finds the chat session of a connected user.
+     * @param name The username to look up.
+     * @return Shared Pointer to the chat session, or nullptr if no such user is connected.
      */
-    void write_broadcast(std::string message);
+    std::shared_ptr<networkLibrary::chatSession> find_session(const std::string &name);
 
     /**
      * @brief Sends a message to a specific chat session.
      * @param session Shared Pointer to the chat session to send the message to.
-     * @param message The message to send.
+     * @param message The message to send, copied once into the message that is queued.
      */
-    void write(const std::shared_ptr<networkLibrary::chatSession> session, std::string message);
+    void write(const std::shared_ptr<networkLibrary::chatSession> session, std::string_view message);
 
     /**
-     * @brief Sends a buffer to a specific chat session.
-     * @param session Shared Pointer to the chat session to send the buffer to.
-     * @param buffer The buffer to send.
+     * @brief Sends an already built message to a specific chat session.
+     * @param session Shared Pointer to the chat session to send the message to.
+     * @param message The message to send, kept alive until the write completes.
      */
-    void write(const std::shared_ptr<networkLibrary::chatSession> session, boost::asio::mutable_buffers_1 buffer);
+    void write(const std::shared_ptr<networkLibrary::chatSession> session, networkLibrary::messagePtr message);
+};
+
+/**
+ * @brief Tunable settings of an asynchronous client.
+ */
+struct networkLibrary::Client::clientConfig
+{
+    bool binary_protocol = false; ///< Negotiate length-prefixed binary frames with the server.
+    bool compression = false; ///< Also negotiate deflate compressed frames, implies binary_protocol.
+    std::size_t compression_threshold = 512; ///< Smallest line sent compressed once compression is negotiated.
+    std::size_t max_message_size = 16 * 1024 * 1024; ///< Largest accepted line or frame body from the server.
+    bool recycle_handlers = true; ///< Allocate asynchronous operations from the buffer pool instead of Asio's default.
+    bool print_status = true; ///< Print connection errors and closes to stdout.
+    std::size_t max_gather_messages = 64; ///< Most queued lines merged into one gather write.
+    std::size_t write_high_watermark = 4 * 1024 * 1024; ///< Queued bytes at which write() blocks callers outside the IO thread until the queue drains.
+    std::function<void(std::string_view)> on_message; ///< Called on the IO thread with every message from the server, which is printed when empty.
 };
 
 /**
@@ -129,48 +1115,187 @@ public:
 class networkLibrary::Client::asyncClient
 {
 private:
+    /**
+     * @brief A line in the outbound queue.
+     */
+    struct queuedLine
+    {
+        std::string m_line; ///< The line and its newline; replaced by the compressed body when sent compressed.
+        std::size_t m_size; ///< Bytes the line counts against the high watermark.
+        std::array<char, networkLibrary::Protocol::header_size> m_header; ///< Frame header, filled in when written in BINARY mode.
+    };
+
     boost::asio::io_context &m_io_context; ///< Reference to the IO context.
     std::string m_ip; ///< Server IP address.
     unsigned int m_port; ///< Server port number.
     boost::asio::ip::tcp::socket m_socket; ///< Socket for communication with the server.
     boost::asio::ip::tcp::resolver m_resolver; ///< Resolver for determining server address.
     std::string m_buffer; ///< Buffer for storing received data.
+    clientConfig m_config; ///< Settings the client was started with.
+    networkLibrary::Protocol::Mode m_protocol; ///< Wire format of the connection, only used on the IO thread.
+    bool m_compress; ///< Whether the server agreed to compressed frames, only used on the IO thread.
+    std::string m_inflated; ///< Body of the last compressed frame received, only used on the IO thread.
+    bool m_connected; ///< Whether the connection is established; lines wait in the queue until it is.
+    bool m_negotiating; ///< Whether a "\hello" is waiting for its answer; lines wait in the queue until it arrives.
+
+    std::mutex m_intake_mutex; ///< Guards m_intake, m_queued_bytes and m_closed.
+    std::condition_variable m_space; ///< Signalled when queued bytes drop or the connection closes.
+    std::vector<std::string> m_intake; ///< Lines written by other threads, not yet in the outbound queue.
+    std::vector<std::string> m_draining; ///< Lines being moved to the outbound queue, swapped with m_intake to keep both allocations.
+    std::size_t m_queued_bytes; ///< Bytes written and not yet sent.
+    bool m_closed; ///< Whether the connection is closed, after which writes fail.
+
+    std::deque<queuedLine> m_write_queue; ///< Lines waiting to be written, in-flight ones first; a deque so the write in flight keeps pointing at them as it grows.
+    std::vector<boost::asio::const_buffer> m_write_buffers; ///< Gather list of the write in flight.
+    std::size_t m_write_inflight; ///< Number of queued lines covered by the write in flight.
+    bool m_write_in_progress; ///< Whether an asynchronous write is in flight.
+    bool m_close_when_flushed; ///< Whether sending stops once the queue is empty.
+#ifdef NETWORKLIBRARY_COROUTINES
+    boost::asio::steady_timer m_write_signal; ///< Never expires; cancelled to wake the write loop.
+
+    /**
+     * @brief Connects, negotiates and reads until the connection closes, in one coroutine frame.
+     */
+    boost::asio::awaitable<void> run();
 
+    /**
+     * @brief Writes the outbound queue in gather writes, waiting on m_write_signal while there is nothing to write.
+     */
+    boost::asio::awaitable<void> write_loop();
+#else
     /**
      * @brief Continuously reads data from the server.
      */
     void read_continous();
 
+    /**
+     * @brief Writes the lines at the front of the outbound queue in one gather write.
+     */
+    void write_queued();
+#endif
+
+    /**
+     * @brief Resolves the server and connects to it, then starts reading and writing.
+     */
+    void connect();
+
+    /**
+     * @brief The "\hello" line negotiating the configured wire format.
+     */
+    std::string hello_line() const;
+
+    /**
+     * @brief Handles every complete line or frame in the receive buffer.
+     * @return False if the connection was closed.
+     */
+    bool process_input();
+
+    /**
+     * @brief Handles one message from the server.
+     * @param message The line or frame body.
+     */
+    void handle_message(std::string_view message);
+
+    /**
+     * @brief Queues the answer to a heartbeat of the server.
+     */
+    void answer_heartbeat();
+
+    /**
+     * @brief Queues a newline-terminated line, blocking callers outside the IO thread at the high watermark.
+     * @param line The line, including its newline.
+     * @return False if the connection is closed.
+     */
+    bool enqueue(std::string line);
+
+    /**
+     * @brief Moves the lines written by other threads to the outbound queue; runs on the IO thread.
+     */
+    void drain_intake();
+
+    /**
+     * @brief Adds a line to the outbound queue; runs on the IO thread.
+     * @param line The line, including its newline.
+     */
+    void push_line(std::string line);
+
+    /**
+     * @brief Writes the front of the outbound queue unless a write is in flight or the connection is not ready.
+     */
+    void start_write();
+
+    /**
+     * @brief Fills the gather list from the front of the outbound queue.
+     * @return View of the gather list, valid until the next call.
+     */
+    networkLibrary::gatherView gather();
+
+    /**
+     * @brief Removes the lines of a completed write from the outbound queue and wakes blocked writers.
+     */
+    void written();
+
+    /**
+     * @brief Shuts down the sending side once the queue is flushed, see close_when_flushed().
+     */
+    void shutdown_send();
+
+    /**
+     * @brief Encodes a queued line as a binary frame, compressing it when negotiated and worthwhile.
+     * @param line The queued line; its header is filled in.
+     * @return The frame body to write after the header.
+     */
+    boost::asio::const_buffer encode(queuedLine &line);
+
+    /**
+     * @brief Closes the socket and fails every later write; runs on the IO thread.
+     */
+    void close_socket();
+
 public:
     std::string m_username; ///< Username of the client.
 
     /**
      * @brief Constructs an asynchronous client.
-     * @param io_context The IO context used for asynchronous operations.
+     * @param io_context The IO context used for asynchronous operations, run by a single thread.
      * @param ip The IP address of the server.
      * @param port The port number of the server.
+     * @param config Settings of the client.
      */
-    asyncClient(boost::asio::io_context &io_context, std::string ip, unsigned int port);
+    asyncClient(boost::asio::io_context &io_context, std::string ip, unsigned int port, clientConfig config = clientConfig());
 
     /**
-     * @brief Sends a message to the server.
+     * @brief Queues a message for the server.
+     * 
+     * Leading and trailing spaces and newlines are trimmed and empty messages are ignored.
+     * Lines written before the connection is ready wait in the queue, and queued lines are
+     * merged into gather writes with only one write in flight. Safe to call from any thread;
+     * outside the IO thread it blocks while the queue holds write_high_watermark bytes.
      * @param message The message to send.
-     * @return True if the message was successfully sent, false otherwise.
+     * @return False if the message was "\quit" or the connection is closed.
      */
-    bool write(std::string &message);
+    bool write(std::string_view message);
 
     /**
-     * @brief Immediately sends a message to the server.
-     * @param message The message to send.
-     * @return True if the message was successfully sent, false otherwise.
+     * @brief Queues a message as it is, without trimming; it is written as soon as the lines before it.
+     * @param message The message to send, a newline is added if missing.
+     * @return False if the connection is closed.
      */
     bool write_now(std::string message);
 
     /**
-     * @brief Closes the connection to the server.
+     * @brief Closes the connection to the server; queued lines are discarded.
      */
     void close_connection();
 
+    /**
+     * @brief Stops sending once every queued line is written, after which writes fail.
+     * 
+     * Only the sending side is shut down, so nothing the server still sends is cut off; the
+     * connection closes when the server closes its side.
+     */
+    void close_when_flushed();
+
     /**
      * @brief Destructor for the asynchronous client.
      */
@@ -184,23 +1309,286 @@ class networkLibrary::chatSession : public std::enable_shared_from_this<networkL
 {
 private:
     networkLibrary::Server::asyncServer &m_serv; ///< Reference to the associated server.
+    networkLibrary::Server::serverLoop &m_loop; ///< The event loop owning the session.
     // std::string m_buffer; ///< Buffer for storing received data.
     boost::asio::ip::tcp::socket m_socket; ///< Socket for communication.
+    std::optional<boost::asio::strand<boost::asio::io_context::executor_type>> m_strand; ///< Strand serialising the session's handlers, empty on a single-threaded loop.
     std::string m_ip; ///< Client's IP address.
     unsigned int m_port; ///< Client's port number.
 
+    /**
+     * @brief A message in the outbound queue, with the encoding chosen when it was queued.
+     */
+    struct queuedMessage
+    {
+        networkLibrary::messagePtr m_message; ///< Keeps the message alive until it is written.
+        boost::asio::const_buffer m_buffer;   ///< The bytes to write.
+    };
+
+    std::mutex m_write_mutex; ///< Mutex for thread-safe operations on the outbound queue.
+    boost::circular_buffer<queuedMessage> m_write_queue; ///< Messages waiting to be written, in-flight ones first.
+    std::vector<boost::asio::const_buffer> m_write_buffers; ///< Gather list of the write in flight.
+    std::size_t m_write_inflight; ///< Number of queued messages covered by the write in flight.
+    std::size_t m_queued_bytes; ///< Bytes held by the outbound queue.
+    std::size_t m_dropped; ///< Messages dropped since the queue reached the high watermark.
+    bool m_write_in_progress; ///< Whether an asynchronous write is in flight.
+    bool m_write_batched; ///< Whether the session is in its loop's current tick.
+    bool m_dropping; ///< Whether new messages are dropped until the queue drains.
+    networkLibrary::Protocol::Mode m_protocol; ///< Wire format, changed under m_write_mutex.
+    bool m_compress; ///< Whether large messages are sent as compressed frames, changed under m_write_mutex.
+
+    networkLibrary::pooledBuffer m_read_buffer; ///< Pooled receive buffer, messages are parsed in place.
+    std::size_t m_read_begin; ///< Start of the unprocessed bytes in the receive buffer.
+    std::size_t m_read_end; ///< End of the received bytes in the receive buffer.
+
+    mutable std::mutex m_name_mutex; ///< Mutex for reading the name from other threads while it changes.
+    std::string m_name; ///< Name of the chat participant.
+    bool m_named; ///< Whether the participant has claimed a username.
+    networkLibrary::roomPtr m_room; ///< Room the participant talks in, only used on the session's executor.
+    networkLibrary::historyPtr m_history; ///< History of m_room, or nullptr when no history is kept.
+
+    networkLibrary::timingWheel<chatSession>::timer m_timer; ///< Entry of the session in its loop's timing wheel, guarded by the loop's timer mutex.
+    std::chrono::steady_clock::time_point m_connected_at; ///< When the client connected, for the handshake timeout.
+    std::chrono::steady_clock::time_point m_last_input; ///< When the client last sent anything; only stored on a read, the timer checks it when it fires.
+
+    networkLibrary::admissionControl::ticket m_admission; ///< The session's connection slots and its client address's rate limits.
+    networkLibrary::tokenBucket m_message_bucket; ///< Lines or frames the client may send, only used on the session's executor.
+    networkLibrary::tokenBucket m_byte_bucket; ///< Bytes the client may send, only used on the session's executor.
+    bool m_throttled; ///< Whether reading waits for the rate limits to refill, only used on the session's executor.
+
+    bool m_handoff; ///< Whether the session is being handed off to the next server, set on the session's executor under m_write_mutex.
+    bool m_reading; ///< Whether a read is pending, only used on the session's executor.
+    bool m_parked; ///< Whether the handed off session stopped reading and writing, only used on the session's executor.
+
+    /**
+     * @brief Changes the name of the participant.
+     * @param name The new name.
+     */
+    void set_name(const std::string &name);
+
+    /**
+     * @brief Logs, counts and announces the session leaving, once it is out of the loop's registry.
+     *
+     * Not left to the destructor: the registry may hold a session that left for a while.
+     */
+    void departed();
+
+    /**
+     * @brief Gives up a name another node won, and asks the client for a new one.
+     * 
+     * Does nothing if the session no longer holds the name by the time it runs on its executor.
+     * @param name The name lost.
+     */
+    void lose_name(const std::string &name);
+
+#ifdef NETWORKLIBRARY_COROUTINES
+    boost::asio::steady_timer m_write_signal; ///< Never expires; cancelled on the session's executor to wake the write loop.
+
+    /**
+     * @brief Reads and handles messages until the connection closes.
+     * @param self Keeps the session alive while the loop runs.
+     */
+    boost::asio::awaitable<void> read_loop(std::shared_ptr<chatSession> self);
+
+    /**
+     * @brief Writes the outbound queue in gather writes, waiting on m_write_signal while there is nothing to write.
+     * @param self Keeps the session alive while the loop runs.
+     */
+    boost::asio::awaitable<void> write_loop(std::shared_ptr<chatSession> self);
+#else
+    /**
+     * @brief Writes the messages at the front of the outbound queue in one gather write.
+     * 
+     * Must be called on the session's executor, with m_write_mutex held.
+     */
+    void write_queued();
+#endif
+
+    /**
+     * @brief Starts writing the outbound queue on the session's executor; m_write_in_progress must already be set.
+     */
+    void start_write();
+
+    /**
+     * @brief Fills the gather list from the front of the outbound queue; m_write_mutex must be held.
+     * @return View of the gather list, valid until the next call.
+     */
+    networkLibrary::gatherView gather();
+
+    /**
+     * @brief Accounts for a completed gather write and pops its messages; m_write_mutex must be held.
+     * @return False if the write failed, in which case the session is removed.
+     */
+    bool write_done(boost::system::error_code ec, std::size_t size);
+
+    /**
+     * @brief Keeps the unread bytes at the front of the receive buffer and makes room for more.
+     */
+    void prepare_read();
+
+    /**
+     * @brief Closes the connection of a client that timed out or sends a heartbeat, then re-arms the timer.
+     * 
+     * Runs on the session's executor when the timer fires. Reads never touch the timer: it
+     * fires at the earliest deadline possible since the last re-arm, and a later read only
+     * moves the next deadline, which is then armed instead.
+     */
+    void check_timeouts();
+
+    /**
+     * @brief Runs check_timeouts() on the session's executor; called by the loop when the timer fires.
+     */
+    void expire();
+
+    /**
+     * @brief Handles the bytes of one read.
+     * @param size Number of bytes read.
+     * @return False if the session was closed or throttled and must not read again.
+     */
+    bool handle_read(std::size_t size);
+
+    /**
+     * @brief Charges one message to the session's and its address's rate limits if none is exhausted.
+     * @param bytes Size of the message on the wire.
+     * @param now The current time.
+     * @return False if a limit is exhausted, in which case nothing is charged.
+     */
+    bool take_tokens(std::size_t bytes, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Stops reading until the rate limits refill; the session's timer resumes it.
+     * 
+     * No read is armed meanwhile, so the client's data backs up in the socket buffers and
+     * TCP slows the client down instead of the server buffering the flood.
+     * @param now The current time.
+     */
+    void throttle(std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Handles the input held back by throttle(), then reads again unless throttled anew.
+     * @param now The current time.
+     */
+    void resume_read(std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Writes the messages queued during the tick that just ended, unless a write is in flight.
+     */
+    void flush_batch();
+
+    /**
+     * @brief Whether the calling thread is running the session's executor.
+     */
+    bool running_in_this_thread() const;
+
+    /**
+     * @brief Starts an asynchronous operation on the socket with the session's allocator and executor.
+     * 
+     * The socket itself uses the loop's executor; on a loop with session strands the handler is
+     * bound to the strand, which keeps Asio from copying the strand into a type-erased executor
+     * for every operation.
+     * @param initiation Callable starting the operation with the prepared handler.
+     * @param handler The completion handler.
+     */
+    template <typename Initiation, typename Handler>
+    void initiate(Initiation &&initiation, Handler &&handler);
+
+    /**
+     * @brief Queues a handler on the session's executor, allocated like the session's operations.
+     * 
+     * Posts through the concrete strand or loop executor, so no type-erased executor is built.
+     * @param handler The handler to run.
+     */
+    template <typename Handler>
+    void post_to_session(Handler &&handler);
+
+    /**
+     * @brief Handles every complete message in the receive buffer, as far as the rate limits allow.
+     * @param now The current time, for the rate limits.
+     * @return False if the session was closed or throttled and must not read again.
+     */
+    bool process_input(std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Handles one line or frame body from the client.
+     * @param line The message, pointing into the receive buffer.
+     */
+    void handle_line(std::string_view line);
+
+    /**
+     * @brief Moves the participant to another room, announcing it in both rooms.
+     * @param room_name Name of the room to join.
+     */
+    void switch_room(const std::string &room_name);
+
+    /**
+     * @brief Answers a "\hello" negotiation and switches to the requested wire format and compression.
+     * @param line The negotiation line.
+     */
+    void negotiate(std::string_view line);
+
+    /**
+     * @brief Stops reading and writing for a handoff; the server is told once neither is pending.
+     * 
+     * Cancels the pending read and write. Bytes a cancelled write did not send stay queued
+     * and go to the next server with the rest of the queue.
+     */
+    void suspend();
+
+    /**
+     * @brief Tells the server the session is parked once neither a read nor a write is pending.
+     */
+    void check_parked();
+
+    /**
+     * @brief Gives up the connection of a parked session together with its state.
+     * @param[out] state The connection and the session's state.
+     * @return False if the connection was already closed.
+     */
+    bool capture(networkLibrary::HotRestart::sessionState &state);
+
+    /**
+     * @brief Resumes a session taken over from the previous server, without greeting or announcing it.
+     * @param state The session's state; its unsent output is written first.
+     */
+    void adopt(const networkLibrary::HotRestart::sessionState &state);
+
+    /**
+     * @brief Resumes a session whose handoff failed, on its connection and with its state as captured.
+     * @param state The state capture() took, with fd -1 if it took nothing; the session owns the descriptor afterwards.
+     */
+    void resume_handoff(const networkLibrary::HotRestart::sessionState &state);
+
+    /**
+     * @brief Puts output taken by capture() back in front of the write queue; m_write_mutex must be held.
+     * @param output The encoded bytes, starting where the last write stopped.
+     */
+    void requeue(const std::string &output);
+
+    /**
+     * @brief Registers the built-in client commands.
+     * @param commands The server's command table.
+     */
+    static void register_commands(networkLibrary::chatCommands &commands);
+
 public:
 
     friend class networkLibrary::Server::asyncServer;
+    friend class networkLibrary::Server::serverLoop;
+    friend class networkLibrary::Server::federation;
 
-    std::string m_name; ///< Name of the chat participant.
+    /**
+     * @brief Name of the chat participant, safe to call from any thread.
+     */
+    std::string name() const;
 
     /**
      * @brief Constructs a chat session.
      * @param socket The socket used for the chat session.
      * @param serv The server managing the session.
+     * @param loop The event loop that accepted the session.
+     * @param admission The connection's ticket from the server's admission control.
      */
-    chatSession(boost::asio::ip::tcp::socket socket, networkLibrary::Server::asyncServer &serv);
+    chatSession(boost::asio::ip::tcp::socket socket, networkLibrary::Server::asyncServer &serv, networkLibrary::Server::serverLoop &loop, networkLibrary::admissionControl::ticket admission);
 
     /**
      * @brief Destructor for the chat session.
@@ -214,8 +1602,43 @@ public:
 
     /**
      * @brief Continuously reads data from the client.
+     * 
+     * With coroutines this spawns the session's read and write loops.
      */
     void read_continous();
+
+    /**
+     * @brief Queues a message for delivery to the client.
+     * 
+     * Queued messages are merged into gather writes, so only one write is ever in flight.
+     * When the queue reaches the high watermark the server's slow consumer policy applies.
+     * With serverConfig::batch_writes a batched message waits for the end of the loop's tick,
+     * so that everything queued during the tick goes out in one write.
+     * @param message The message to send.
+     * @param batched Whether the message may wait for the end of the tick, as broadcasts do.
+     */
+    void deliver(networkLibrary::messagePtr message, bool batched = false);
+
+    /**
+     * @brief Closes the connection on the session's executor; outstanding operations complete with an error.
+     */
+    void close();
 };
 
+template <typename Initiation, typename Handler>
+void networkLibrary::chatSession::initiate(Initiation&& initiation, Handler&& handler)
+{
+    auto _handler = networkLibrary::make_handler(m_serv.m_config.recycle_handlers, std::forward<Handler>(handler));
+    if(m_strand) initiation(boost::asio::bind_executor(*m_strand, std::move(_handler)));
+    else initiation(std::move(_handler));
+}
+
+template <typename Handler>
+void networkLibrary::chatSession::post_to_session(Handler&& handler)
+{
+    auto _handler = networkLibrary::make_handler(m_serv.m_config.recycle_handlers, std::forward<Handler>(handler));
+    if(m_strand) boost::asio::post(*m_strand, std::move(_handler));
+    else boost::asio::post(m_loop.m_io_context, std::move(_handler));
+}
+
 #endif
\ No newline at end of file
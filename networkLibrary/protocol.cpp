@@ -0,0 +1,146 @@
+#include "protocol.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+namespace
+{
+    /**
+     * @brief Raw deflate context of one thread, reset between messages.
+     */
+    struct deflateContext
+    {
+        z_stream m_stream{};
+        bool m_ready;
+
+        deflateContext()
+        {
+            // Fastest level: messages are small and latency matters more than the last few percent
+            m_ready = deflateInit2(&m_stream, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        }
+
+        ~deflateContext()
+        {
+            if(m_ready) deflateEnd(&m_stream);
+        }
+    };
+
+    /**
+     * @brief Raw inflate context of one thread, reset between messages.
+     */
+    struct inflateContext
+    {
+        z_stream m_stream{};
+        bool m_ready;
+
+        inflateContext()
+        {
+            m_ready = inflateInit2(&m_stream, -MAX_WBITS) == Z_OK;
+        }
+
+        ~inflateContext()
+        {
+            if(m_ready) inflateEnd(&m_stream);
+        }
+    };
+};
+
+void networkLibrary::Protocol::encode_header(char* out, const frameHeader& header)
+{
+    out[0] = static_cast<char>((header.length >> 24) & 0xff);
+    out[1] = static_cast<char>((header.length >> 16) & 0xff);
+    out[2] = static_cast<char>((header.length >> 8) & 0xff);
+    out[3] = static_cast<char>(header.length & 0xff);
+    out[4] = static_cast<char>(header.type);
+    out[5] = static_cast<char>(header.flags);
+    out[6] = 0;
+    out[7] = 0;
+}
+
+networkLibrary::Protocol::frameHeader networkLibrary::Protocol::decode_header(const char* in)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(in);
+    frameHeader header;
+    header.length = (std::uint32_t(bytes[0]) << 24)
+                  | (std::uint32_t(bytes[1]) << 16)
+                  | (std::uint32_t(bytes[2]) << 8)
+                  | std::uint32_t(bytes[3]);
+    header.type = bytes[4];
+    header.flags = bytes[5];
+    return header;
+}
+
+networkLibrary::Protocol::extractStatus networkLibrary::Protocol::extract_line(const char* data, std::size_t size, std::size_t max_size, extracted& out)
+{
+    const void* newline = std::memchr(data, '\n', size);
+    if(newline == nullptr){
+        return size > max_size ? TOO_LARGE : INCOMPLETE;
+    }
+
+    std::size_t length = static_cast<const char*>(newline) - data;
+    if(length > max_size) return TOO_LARGE;
+
+    out.body = std::string_view(data, length);
+    out.header = frameHeader{static_cast<std::uint32_t>(length), MESSAGE, 0};
+    out.consumed = length + 1;
+    return COMPLETE;
+}
+
+networkLibrary::Protocol::extractStatus networkLibrary::Protocol::extract_frame(const char* data, std::size_t size, std::size_t max_size, extracted& out)
+{
+    if(size < header_size) return INCOMPLETE;
+
+    frameHeader header = decode_header(data);
+    if(header.length > max_size) return TOO_LARGE;
+    if(size < header_size + header.length) return INCOMPLETE;
+
+    out.body = std::string_view(data + header_size, header.length);
+    out.header = header;
+    out.consumed = header_size + header.length;
+    return COMPLETE;
+}
+
+std::size_t networkLibrary::Protocol::compress(const char* data, std::size_t size, char* out, std::size_t capacity)
+{
+    static thread_local deflateContext context;
+    if(!context.m_ready || size > UINT32_MAX || capacity == 0) return 0;
+
+    z_stream& stream = context.m_stream;
+    deflateReset(&stream);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef*>(out);
+    stream.avail_out = static_cast<uInt>(std::min<std::size_t>(capacity, UINT32_MAX));
+
+    if(deflate(&stream, Z_FINISH) != Z_STREAM_END) return 0;
+    return stream.total_out;
+}
+
+bool networkLibrary::Protocol::decompress(std::string_view in, std::size_t max_size, std::string& out)
+{
+    static thread_local inflateContext context;
+    out.clear();
+    if(!context.m_ready || in.size() > UINT32_MAX) return false;
+
+    z_stream& stream = context.m_stream;
+    inflateReset(&stream);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream.avail_in = static_cast<uInt>(in.size());
+
+    while(true){
+        std::size_t used = out.size();
+        std::size_t grow = std::min(max_size - used, std::max<std::size_t>({used, 4 * in.size(), 1024}));
+        if(grow == 0) return false;
+        out.resize(used + grow);
+        stream.next_out = reinterpret_cast<Bytef*>(&out[used]);
+        stream.avail_out = static_cast<uInt>(std::min<std::size_t>(grow, UINT32_MAX));
+
+        int status = inflate(&stream, Z_NO_FLUSH);
+        out.resize(used + grow - stream.avail_out);
+        if(status == Z_STREAM_END) return true;
+        // Room left without the end of the stream means the input ran out, i.e. it was truncated
+        if((status != Z_OK && status != Z_BUF_ERROR) || stream.avail_out != 0) return false;
+    }
+}
@@ -0,0 +1,179 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace networkLibrary
+{
+    /**
+     * @brief Wire formats spoken between the server and its clients.
+     * 
+     * Clients start in the legacy newline-delimited text mode. A client that sends
+     * "\hello binary" as its first line is answered with "\hello binary" and from then on
+     * both directions use length-prefixed frames: an 8 byte header followed by the body.
+     * 
+     * | Bytes | Field                          |
+     * |-------|--------------------------------|
+     * | 0-3   | Body length, big-endian        |
+     * | 4     | Frame type                     |
+     * | 5     | Flags                          |
+     * | 6-7   | Reserved, zero                 |
+     * 
+     * A client that adds "deflate" to its hello ("\hello binary deflate") and is answered with
+     * it may receive frames flagged COMPRESSED, whose body is the raw deflate stream of the
+     * actual body, and may send them too. Every compressed frame is a complete stream of its
+     * own, so the server compresses a broadcast once and sends the same bytes to every
+     * recipient; messages below a size threshold are sent as they are.
+     * 
+     * A server may send "\ping" to a client that has been quiet for a while, as a PING frame
+     * in BINARY mode; clients answer with "\pong", sent as an ordinary line or MESSAGE frame.
+     * Anything the server receives proves the client is alive, the answer only keeps a quiet
+     * client from reaching the server's idle timeout.
+     * 
+     * Federated servers relay traffic to each other over the same frames, with the relay types
+     * below; clients never see them. Every relay body starts with the 8 byte big-endian ID of
+     * the node the message originates from and its 8 byte big-endian sequence number on that
+     * node, followed by the fields of the type. A name field is a 2 byte big-endian length and
+     * the name; a message field takes the rest of the body.
+     * 
+     * | Type             | Fields after the origin and sequence |
+     * |------------------|--------------------------------------|
+     * | RELAY_HELLO      | none, sequence 0                     |
+     * | RELAY_USER_JOIN  | name                                 |
+     * | RELAY_USER_LEAVE | name                                 |
+     * | RELAY_BROADCAST  | message                              |
+     * | RELAY_ROOM       | room name, message                   |
+     * | RELAY_DIRECT     | recipient's name, message            |
+     */
+    namespace Protocol
+    {
+        /**
+         * @brief Wire format of a connection.
+         */
+        enum Mode {
+            TEXT,   ///< Newline-delimited lines.
+            BINARY  ///< Length-prefixed frames.
+        };
+
+        /**
+         * @brief Type of a binary frame.
+         */
+        enum frameType : std::uint8_t {
+            MESSAGE = 1, ///< A chat line or command, exactly like one text line.
+            PING = 2,    ///< Heartbeat from the server, its body is ping_command.
+            RELAY_HELLO = 16,      ///< First frame on a relay link, names the sending node.
+            RELAY_USER_JOIN = 17,  ///< A user claimed a name on the origin node.
+            RELAY_USER_LEAVE = 18, ///< A user released a name on the origin node.
+            RELAY_BROADCAST = 19,  ///< A message for every session.
+            RELAY_ROOM = 20,       ///< A message for the members of a room.
+            RELAY_DIRECT = 21      ///< A message for one user, sent only to the node it is on.
+        };
+
+        /**
+         * @brief Flag bits of a binary frame.
+         */
+        enum frameFlags : std::uint8_t {
+            COMPRESSED = 0x01 ///< The body is raw deflate data; only sent once "deflate" was negotiated.
+        };
+
+        constexpr std::size_t header_size = 8; ///< Size of a binary frame header.
+        constexpr std::size_t relay_prefix_size = 16; ///< Origin and sequence at the start of every relay body.
+        constexpr std::string_view hello_command = "\\hello"; ///< Negotiation command sent by new clients.
+        constexpr std::string_view binary_feature = "binary"; ///< Feature requesting binary framing.
+        constexpr std::string_view deflate_feature = "deflate"; ///< Feature requesting compressed frames, only together with binary.
+        constexpr std::string_view ping_command = "\\ping"; ///< Heartbeat sent by the server to a quiet client.
+        constexpr std::string_view pong_command = "\\pong"; ///< Answer of a client to a heartbeat.
+
+        /**
+         * @brief Decoded header of a binary frame.
+         */
+        struct frameHeader
+        {
+            std::uint32_t length; ///< Size of the body in bytes.
+            std::uint8_t type;    ///< One of frameType.
+            std::uint8_t flags;   ///< Frame flags.
+        };
+
+        /**
+         * @brief A message found in a receive buffer.
+         */
+        struct extracted
+        {
+            std::string_view body; ///< The message, pointing into the receive buffer.
+            frameHeader header;    ///< Header of the frame; type MESSAGE for text lines.
+            std::size_t consumed;  ///< Bytes of the receive buffer taken by the message.
+        };
+
+        /**
+         * @brief Result of looking for a message in a receive buffer.
+         */
+        enum extractStatus {
+            COMPLETE,   ///< A whole message was found.
+            INCOMPLETE, ///< More bytes are needed.
+            TOO_LARGE   ///< The message exceeds the size limit.
+        };
+
+        /**
+         * @brief Writes a frame header.
+         * @param out Destination of header_size bytes.
+         * @param header The header to encode.
+         */
+        void encode_header(char *out, const frameHeader &header);
+
+        /**
+         * @brief Reads a frame header.
+         * @param in Source of header_size bytes.
+         * @return The decoded header.
+         */
+        frameHeader decode_header(const char *in);
+
+        /**
+         * @brief Finds the first newline-terminated line of a buffer, without copying it.
+         * @param data Start of the received bytes.
+         * @param size Number of received bytes.
+         * @param max_size Largest accepted line.
+         * @param[out] out The line without its newline, when COMPLETE.
+         * @return Whether a line was found.
+         */
+        extractStatus extract_line(const char *data, std::size_t size, std::size_t max_size, extracted &out);
+
+        /**
+         * @brief Finds the first complete frame of a buffer, without copying it.
+         * @param data Start of the received bytes.
+         * @param size Number of received bytes.
+         * @param max_size Largest accepted body.
+         * @param[out] out The frame, when COMPLETE.
+         * @return Whether a frame was found.
+         */
+        extractStatus extract_frame(const char *data, std::size_t size, std::size_t max_size, extracted &out);
+
+        /**
+         * @brief Compresses a body into a raw deflate stream.
+         * 
+         * Uses a deflate context kept per thread and reset between calls, so its tables are
+         * allocated once per thread rather than once per message.
+         * @param data The body.
+         * @param size Size of the body.
+         * @param out Destination of the stream.
+         * @param capacity Room at out; a stream that does not fit is not worth sending.
+         * @return Size of the stream, 0 if it did not fit or compression failed.
+         */
+        std::size_t compress(const char *data, std::size_t size, char *out, std::size_t capacity);
+
+        /**
+         * @brief Decompresses the body of a COMPRESSED frame.
+         * 
+         * Uses an inflate context kept per thread and reset between calls.
+         * @param in The raw deflate stream.
+         * @param max_size Largest accepted decompressed body.
+         * @param[out] out The decompressed body.
+         * @return False if the stream is malformed, truncated or decompresses beyond max_size.
+         */
+        bool decompress(std::string_view in, std::size_t max_size, std::string &out);
+    };
+};
+
+#endif // PROTOCOL_H
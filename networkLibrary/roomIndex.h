@@ -0,0 +1,210 @@
+#ifndef ROOM_INDEX_H
+#define ROOM_INDEX_H
+
+#include "sessionRegistry.h"
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace networkLibrary
+{
+    /**
+     * @brief A sharded concurrent directory of chat rooms and their members.
+     *
+     * A room is created by the first session joining it and torn down when the last member
+     * leaves. Its members are split into one partition per event loop, so a message to the
+     * room is handed only to the loops that have members in it, and each loop walks only
+     * its own members. Fan-out therefore costs O(room size), not O(connected sessions).
+     *
+     * Joins and teardown of the same name are serialised by the name's shard, so a session
+     * never joins a room that has just been removed from the directory.
+     *
+     * @tparam Session Type of the member sessions.
+     * @tparam Shards Number of independently locked shards of the directory.
+     */
+    template <typename Session, std::size_t Shards = 16>
+    class roomIndex;
+};
+
+template <typename Session, std::size_t Shards>
+class networkLibrary::roomIndex
+{
+public:
+    using sessionPtr = std::shared_ptr<Session>; ///< Handle of a member.
+    using partition = networkLibrary::sessionRegistry<Session, 1>; ///< Members of a room on one event loop.
+
+    /**
+     * @brief A named room with its members, partitioned by event loop.
+     */
+    class room
+    {
+    private:
+        const std::string m_name; ///< Name of the room.
+        const std::size_t m_partitions; ///< Number of partitions.
+        std::unique_ptr<partition[]> m_members; ///< Members, one partition per event loop.
+
+        friend class roomIndex;
+
+    public:
+        room(std::string name, std::size_t partitions)
+            : m_name(std::move(name)),
+              m_partitions(partitions),
+              m_members(new partition[partitions])
+        {
+        }
+
+        room(const room &) = delete;
+        room &operator=(const room &) = delete;
+
+        /**
+         * @brief Name of the room.
+         */
+        const std::string &name() const
+        {
+            return m_name;
+        }
+
+        /**
+         * @brief Number of partitions, one per event loop.
+         */
+        std::size_t partitions() const
+        {
+            return m_partitions;
+        }
+
+        /**
+         * @brief Members of the room on one event loop.
+         * @param index Index of the event loop.
+         */
+        const partition &members(std::size_t index) const
+        {
+            return m_members[index];
+        }
+
+        /**
+         * @brief Number of members of the room.
+         */
+        std::size_t size() const
+        {
+            std::size_t sz = 0;
+            for(std::size_t i=0; i<m_partitions; ++i) sz += m_members[i].size();
+            return sz;
+        }
+    };
+
+    using roomPtr = std::shared_ptr<room>; ///< Handle of a room, keeps it alive after teardown.
+
+private:
+    /**
+     * @brief One independently locked part of the directory.
+     */
+    struct alignas(64) shard
+    {
+        std::mutex m_mutex; ///< Guards the rooms of the shard and their teardown.
+        std::unordered_map<std::string, roomPtr> m_rooms; ///< Rooms named in the shard.
+    };
+
+    std::array<shard, Shards> m_shards; ///< The shards.
+    const std::size_t m_partitions; ///< Partitions of every room.
+
+    /**
+     * @brief The shard a room name belongs to.
+     */
+    shard &shard_of(const std::string &name)
+    {
+        return m_shards[std::hash<std::string>()(name) % Shards];
+    }
+
+public:
+    /**
+     * @brief Constructs an empty directory.
+     * @param partitions Number of event loops the members are spread over.
+     */
+    explicit roomIndex(std::size_t partitions)
+        : m_partitions(partitions)
+    {
+    }
+
+    roomIndex(const roomIndex &) = delete;
+    roomIndex &operator=(const roomIndex &) = delete;
+
+    /**
+     * @brief Adds a session to a room, creating the room if it does not exist.
+     * @param name Name of the room.
+     * @param index Event loop of the session.
+     * @param session The joining session.
+     * @return The room.
+     */
+    roomPtr join(const std::string &name, std::size_t index, const sessionPtr &session)
+    {
+        shard& sh = shard_of(name);
+        std::lock_guard<std::mutex> lock(sh.m_mutex);
+        roomPtr& _room = sh.m_rooms[name];
+        if(!_room) _room = std::make_shared<room>(name, m_partitions);
+        _room->m_members[index].insert(session);
+        return _room;
+    }
+
+    /**
+     * @brief Removes a session from a room and tears the room down once it is empty.
+     * @param _room The room to leave.
+     * @param index Event loop of the session.
+     * @param session The leaving session.
+     */
+    void leave(const roomPtr &_room, std::size_t index, const sessionPtr &session)
+    {
+        if(!_room->m_members[index].erase(session)) return;
+
+        shard& sh = shard_of(_room->m_name);
+        std::lock_guard<std::mutex> lock(sh.m_mutex);
+        auto it = sh.m_rooms.find(_room->m_name);
+        if(it != sh.m_rooms.end() && it->second == _room && _room->size() == 0) sh.m_rooms.erase(it);
+    }
+
+    /**
+     * @brief Finds a room by name.
+     * @return The room, or nullptr if nobody is in it.
+     */
+    roomPtr find(const std::string &name)
+    {
+        shard& sh = shard_of(name);
+        std::lock_guard<std::mutex> lock(sh.m_mutex);
+        auto it = sh.m_rooms.find(name);
+        return it == sh.m_rooms.end() ? nullptr : it->second;
+    }
+
+    /**
+     * @brief All current rooms, in no particular order.
+     */
+    std::vector<roomPtr> list()
+    {
+        std::vector<roomPtr> rooms;
+        for(auto& sh : m_shards){
+            std::lock_guard<std::mutex> lock(sh.m_mutex);
+            for(auto const& entry : sh.m_rooms) rooms.push_back(entry.second);
+        }
+        return rooms;
+    }
+
+    /**
+     * @brief Removes every room and drops their members.
+     */
+    void clear()
+    {
+        for(auto& sh : m_shards){
+            std::lock_guard<std::mutex> lock(sh.m_mutex);
+            for(auto const& entry : sh.m_rooms){
+                for(std::size_t i=0; i<m_partitions; ++i) entry.second->m_members[i].clear();
+            }
+            sh.m_rooms.clear();
+        }
+    }
+};
+
+#endif // ROOM_INDEX_H
@@ -0,0 +1,278 @@
+#include "segmentLog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr std::uint16_t kMarker = 0xC4A7;   // Tells a record header from zero fill
+
+    std::uint32_t checksum(std::string_view key, std::string_view body)
+    {
+        // FNV-1a over the key and the body
+        std::uint32_t hash = 2166136261u;
+        for(unsigned char c : key) hash = (hash ^ c) * 16777619u;
+        for(unsigned char c : body) hash = (hash ^ c) * 16777619u;
+        return hash;
+    }
+
+    struct recordHeader
+    {
+        std::uint32_t body_size;
+        std::uint16_t key_size;
+        std::uint16_t marker;
+        std::uint32_t checksum;
+    };
+    static_assert(sizeof(recordHeader) == networkLibrary::segmentLog::header_size, "record header must be packed");
+
+    std::system_error file_error(const std::string &what, const std::string &path)
+    {
+        return std::system_error(errno, std::generic_category(), what + " " + path);
+    }
+
+    // Segment files are named segment-<8 digit number>.log
+    bool parse_segment(const std::string &file_name, std::uint32_t &segment)
+    {
+        unsigned int number;
+        char tail;
+        if(file_name.size() != 20 || std::sscanf(file_name.c_str(), "segment-%8u.lo%c", &number, &tail) != 2 || tail != 'g') return false;
+        segment = number;
+        return true;
+    }
+};
+
+networkLibrary::segmentLog::segmentLog(std::string directory, std::size_t segment_size, std::size_t segments_kept, std::chrono::milliseconds sync_interval)
+    : m_directory(std::move(directory)),
+      m_segments_kept(std::max<std::size_t>(segments_kept, 1)),
+      m_sync_interval(sync_interval),
+      m_segment_size(std::max<std::size_t>(segment_size, 4096)),
+      m_segment(0),
+      m_fd(-1),
+      m_map(nullptr),
+      m_map_size(0),
+      m_offset(0),
+      m_synced_offset(0),
+      m_appended(0),
+      m_synced(0),
+      m_dropped(0),
+      m_running(true)
+{
+    std::filesystem::create_directories(m_directory);
+
+    // Continue in the newest segment, older ones are never read again
+    std::uint32_t newest = 0;
+    for(auto const& entry : std::filesystem::directory_iterator(m_directory)){
+        std::uint32_t segment;
+        if(parse_segment(entry.path().filename().string(), segment)) newest = std::max(newest, segment);
+    }
+    open_segment(newest == 0 ? 1 : newest);
+
+    std::size_t length;
+    while((length = record_at(m_map + m_offset, m_map_size - m_offset)) > 0) m_offset += length;
+    m_synced_offset = m_offset;
+    m_recovered_segment = m_segment;
+    m_recovered_end = m_offset;
+
+    m_writer = std::thread([this](){ run(); });
+}
+
+networkLibrary::segmentLog::~segmentLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_wake.notify_all();
+    m_writer.join();
+    close_segment();
+}
+
+std::string networkLibrary::segmentLog::segment_path(std::uint32_t segment) const
+{
+    char file_name[32];
+    std::snprintf(file_name, sizeof(file_name), "segment-%08u.log", segment);
+    return (std::filesystem::path(m_directory) / file_name).string();
+}
+
+void networkLibrary::segmentLog::open_segment(std::uint32_t segment)
+{
+    const std::string path = segment_path(segment);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd < 0) throw file_error("open", path);
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || (st.st_size == 0 && ::ftruncate(fd, m_segment_size) != 0)){
+        std::system_error error = file_error("size", path);
+        ::close(fd);
+        throw error;
+    }
+    std::size_t size = st.st_size == 0 ? m_segment_size : static_cast<std::size_t>(st.st_size);
+
+    void* map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED){
+        std::system_error error = file_error("mmap", path);
+        ::close(fd);
+        throw error;
+    }
+
+    m_segment = segment;
+    m_fd = fd;
+    m_map = static_cast<char*>(map);
+    m_map_size = size;
+    m_offset = 0;
+    m_synced_offset = 0;
+}
+
+void networkLibrary::segmentLog::close_segment()
+{
+    if(m_map == nullptr) return;
+    ::msync(m_map, m_map_size, MS_SYNC);
+    ::munmap(m_map, m_map_size);
+    ::close(m_fd);
+    m_map = nullptr;
+    m_fd = -1;
+    m_map_size = 0;
+    m_offset = 0;
+    m_synced_offset = 0;
+}
+
+std::size_t networkLibrary::segmentLog::record_at(const char* data, std::size_t size)
+{
+    recordHeader header;
+    if(size < header_size) return 0;
+    std::memcpy(&header, data, header_size);
+    if(header.marker != kMarker) return 0;
+
+    const std::size_t length = header_size + header.key_size + header.body_size;
+    if(length > size) return 0;
+    std::string_view key(data + header_size, header.key_size);
+    std::string_view body(data + header_size + header.key_size, header.body_size);
+    if(checksum(key, body) != header.checksum) return 0;
+    return length;
+}
+
+void networkLibrary::segmentLog::replay(const std::function<void(std::string_view key, std::string_view body)> &fn) const
+{
+    if(m_recovered_end == 0) return;
+
+    // A read-only mapping of its own, the writer thread may have moved on to another segment
+    const std::string path = segment_path(m_recovered_segment);
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) throw file_error("open", path);
+    void* map = ::mmap(nullptr, m_recovered_end, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(map == MAP_FAILED) throw file_error("mmap", path);
+
+    const char* data = static_cast<const char*>(map);
+    for(std::size_t offset = 0; offset < m_recovered_end; ){
+        recordHeader header;
+        std::memcpy(&header, data + offset, header_size);
+        fn(std::string_view(data + offset + header_size, header.key_size),
+           std::string_view(data + offset + header_size + header.key_size, header.body_size));
+        offset += header_size + header.key_size + header.body_size;
+    }
+    ::munmap(map, m_recovered_end);
+}
+
+bool networkLibrary::segmentLog::append(std::string_view key, std::string_view body)
+{
+    const std::size_t length = header_size + key.size() + body.size();
+    if(key.size() > 0xFFFF || length > m_segment_size) return false;
+
+    recordHeader header;
+    header.body_size = body.size();
+    header.key_size = key.size();
+    header.marker = kMarker;
+    header.checksum = checksum(key, body);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Bounded, so a stalled disk costs records rather than memory
+    if(m_pending.size() + length > m_segment_size){
+        ++m_dropped;
+        return false;
+    }
+    m_pending.append(reinterpret_cast<const char*>(&header), header_size);
+    m_pending.append(key);
+    m_pending.append(body);
+    ++m_appended;
+    if(m_pending.size() >= m_segment_size / 2) m_wake.notify_all();
+    return true;
+}
+
+void networkLibrary::segmentLog::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const std::uint64_t target = m_appended;
+    m_wake.notify_all();
+    m_wake.wait(lock, [this, target](){ return m_synced >= target; });
+}
+
+std::uint64_t networkLibrary::segmentLog::dropped()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void networkLibrary::segmentLog::write_batch(const std::string &batch)
+{
+    static const std::size_t page = ::sysconf(_SC_PAGESIZE);
+
+    for(std::size_t pos = 0; pos < batch.size(); ){
+        recordHeader header;
+        std::memcpy(&header, batch.data() + pos, header_size);
+        const std::size_t length = header_size + header.key_size + header.body_size;
+
+        // No segment is mapped after a failed rotation, every batch retries it until one is
+        if(m_map == nullptr || m_offset + length > m_map_size){
+            close_segment();
+            open_segment(m_segment + 1);
+            if(m_segment > m_segments_kept){
+                std::remove(segment_path(m_segment - m_segments_kept).c_str());
+            }
+        }
+        std::memcpy(m_map + m_offset, batch.data() + pos, length);
+        m_offset += length;
+        pos += length;
+    }
+
+    // One msync for the whole batch, from the page holding the first new byte
+    const std::size_t start = m_synced_offset / page * page;
+    ::msync(m_map + start, m_offset - start, MS_SYNC);
+    m_synced_offset = m_offset;
+}
+
+void networkLibrary::segmentLog::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true){
+        // Records gather while the writer sleeps, appends only wake it when half a segment is pending
+        if(m_pending.empty()){
+            if(!m_running) break;
+            m_wake.wait_for(lock, m_sync_interval);
+            continue;
+        }
+
+        const std::uint64_t appended = m_appended;
+        m_batch.swap(m_pending);
+        lock.unlock();
+        try{
+            write_batch(m_batch);
+        }
+        catch(const std::system_error &){
+            // The next segment cannot be created; the records of this batch are lost
+        }
+        m_batch.clear();
+        lock.lock();
+        m_synced = appended;
+        m_wake.notify_all();
+    }
+}
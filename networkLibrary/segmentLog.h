@@ -0,0 +1,144 @@
+#ifndef SEGMENT_LOG_H
+#define SEGMENT_LOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace networkLibrary
+{
+    /**
+     * @brief An append-only log of keyed records, stored in memory-mapped segment files.
+     *
+     * append() only serialises the record into an in-memory batch, it never touches the
+     * disk. A background thread copies each batch into the mapped segment and makes it
+     * durable with a single msync, so io threads never wait for the disk. When a segment is
+     * full the next one is created; only the newest few segments are kept.
+     *
+     * Each record is a 12 byte header (4 byte body length, 2 byte key length, 2 byte marker,
+     * 4 byte checksum, host byte order) followed by the key and the body. Segments are
+     * zero-filled, so the first header that does not check out ends the log, which also
+     * discards a record torn by a crash.
+     */
+    class segmentLog;
+};
+
+class networkLibrary::segmentLog
+{
+private:
+    const std::string m_directory;      ///< Directory holding the segment files.
+    const std::size_t m_segments_kept;  ///< Number of newest segments kept on disk.
+    const std::chrono::milliseconds m_sync_interval; ///< Longest time an appended record waits for the disk.
+
+    const std::size_t m_segment_size;   ///< Size of a new segment file.
+    std::uint32_t m_segment;        ///< Number of the segment being written.
+    int m_fd;                       ///< Descriptor of the segment being written.
+    char* m_map;                    ///< Mapping of the segment being written, nullptr after a failed rotation.
+    std::size_t m_map_size;         ///< Size of the segment being written, which may predate m_segment_size.
+    std::size_t m_offset;           ///< End of the records in the segment being written.
+    std::size_t m_synced_offset;    ///< End of the records of the segment already synced.
+    std::uint32_t m_recovered_segment;  ///< Newest segment when the log was opened.
+    std::size_t m_recovered_end;        ///< End of its records when the log was opened.
+
+    std::mutex m_mutex;             ///< Guards the pending batch and the counters below.
+    std::condition_variable m_wake; ///< Wakes the writer thread and flush() callers.
+    std::string m_pending;          ///< Serialised records waiting for the writer thread.
+    std::string m_batch;            ///< Batch being written, swapped with m_pending.
+    std::uint64_t m_appended;       ///< Records appended so far.
+    std::uint64_t m_synced;         ///< Records written and synced so far.
+    std::uint64_t m_dropped;        ///< Records discarded because the batch was full.
+    bool m_running;                 ///< Cleared to stop the writer thread.
+    std::thread m_writer;           ///< Background writer thread.
+
+    /**
+     * @brief Path of a segment file.
+     */
+    std::string segment_path(std::uint32_t segment) const;
+
+    /**
+     * @brief Opens and maps a segment file, creating it zero-filled if it does not exist.
+     * @throws std::system_error if the file cannot be created or mapped.
+     */
+    void open_segment(std::uint32_t segment);
+
+    /**
+     * @brief Syncs and unmaps the segment being written.
+     *
+     * Resets the size and offsets too, so nothing is written through them until a segment is mapped again.
+     */
+    void close_segment();
+
+    /**
+     * @brief Length of the valid record at the start of a buffer.
+     * @param data The buffer, e.g. a mapped segment from some offset.
+     * @param size Bytes available in the buffer.
+     * @return 0 if there is no valid record there.
+     */
+    static std::size_t record_at(const char* data, std::size_t size);
+
+    /**
+     * @brief Copies a batch of serialised records into the segments and syncs them.
+     */
+    void write_batch(const std::string &batch);
+
+    /**
+     * @brief Body of the writer thread.
+     */
+    void run();
+
+public:
+    static constexpr std::size_t header_size = 12; ///< Size of a record header.
+
+    /**
+     * @brief Opens the log, continuing after the last valid record of the newest segment.
+     * @param directory Directory of the segment files, created if missing.
+     * @param segment_size Size of a new segment file.
+     * @param segments_kept Number of newest segments kept on disk, at least one.
+     * @param sync_interval Longest time an appended record waits before it is written and synced.
+     * @throws std::system_error if the directory or the segment cannot be opened.
+     */
+    segmentLog(std::string directory, std::size_t segment_size, std::size_t segments_kept, std::chrono::milliseconds sync_interval);
+
+    segmentLog(const segmentLog &) = delete;
+    segmentLog &operator=(const segmentLog &) = delete;
+
+    /**
+     * @brief Writes and syncs every appended record, then closes the segment.
+     */
+    ~segmentLog();
+
+    /**
+     * @brief Calls a function for every record of the newest segment, oldest first.
+     *
+     * Only the newest segment is read, so startup does not grow with the size of the log.
+     * Records appended since the log was opened are not included.
+     * @param fn Function taking the key and the body as std::string_view.
+     */
+    void replay(const std::function<void(std::string_view key, std::string_view body)> &fn) const;
+
+    /**
+     * @brief Queues a record for the writer thread; never waits for the disk.
+     * @param key Key of the record, at most 65535 bytes.
+     * @param body Body of the record.
+     * @return False if the record is too large for a segment or the pending batch is full.
+     */
+    bool append(std::string_view key, std::string_view body);
+
+    /**
+     * @brief Waits until every record appended so far is written and synced.
+     */
+    void flush();
+
+    /**
+     * @brief Number of records discarded because the writer thread fell a whole segment behind.
+     */
+    std::uint64_t dropped();
+};
+
+#endif // SEGMENT_LOG_H
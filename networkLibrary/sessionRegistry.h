@@ -0,0 +1,309 @@
+#ifndef SESSION_REGISTRY_H
+#define SESSION_REGISTRY_H
+
+#include "epochDomain.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace networkLibrary
+{
+    /**
+     * @brief A sharded, append-only set of sessions with tombstones.
+     * 
+     * Every shard publishes a block of slots. A membership change locks only its own shard:
+     * a join fills the next free slot and a leave marks its slot dead, both O(1). Readers take
+     * a snapshot of the shards and iterate it without holding any lock, skipping dead slots,
+     * so a broadcast never blocks accepts or disconnects. A slot is never written again once
+     * published; when a shard's block is full or holds more dead slots than live ones, its
+     * live sessions are copied into a new block, which keeps the cost amortised O(1).
+     * 
+     * Blocks are published through plain atomic pointers and a snapshot pins its thread in
+     * the epochDomain, so taking one touches no shared reference count or lock. A replaced
+     * block is retired, and with it the sessions in it, dead or not; a session that left is
+     * released once no snapshot taken before the replacement is left.
+     * 
+     * @tparam Session Type of the registered sessions.
+     * @tparam Shards Number of independently updated shards.
+     */
+    template <typename Session, std::size_t Shards = 16>
+    class sessionRegistry;
+};
+
+template <typename Session, std::size_t Shards>
+class networkLibrary::sessionRegistry
+{
+public:
+    using sessionPtr = std::shared_ptr<Session>; ///< Handle stored in the registry.
+    using members = std::vector<sessionPtr>; ///< Sessions taken out of the registry.
+
+private:
+    /**
+     * @brief One published slot of a block.
+     */
+    struct slot
+    {
+        sessionPtr m_session; ///< The session, written once before the slot is published.
+        std::atomic<bool> m_live; ///< Cleared when the session leaves.
+    };
+
+    /**
+     * @brief Append-only slots of one shard.
+     */
+    struct block
+    {
+        const std::size_t m_capacity; ///< Number of slots.
+        std::unique_ptr<slot[]> m_slots; ///< The slots.
+        std::atomic<std::size_t> m_used; ///< Slots published so far.
+
+        explicit block(std::size_t capacity)
+            : m_capacity(capacity),
+              m_slots(new slot[capacity]),
+              m_used(0)
+        {
+        }
+    };
+
+public:
+    /**
+     * @brief View of the whole registry at one point in time.
+     *
+     * Sessions that join later are not in it; sessions that leave later are skipped. It must
+     * be released on the thread that took it, and delays freeing replaced blocks while held.
+     */
+    class snapshot
+    {
+    private:
+        networkLibrary::epochDomain::guard m_guard; ///< Keeps the blocks from being freed.
+        std::array<const block*, Shards> m_blocks; ///< Published block of every shard.
+        std::array<std::size_t, Shards> m_used; ///< Slots of every block published when the snapshot was taken.
+
+        friend class sessionRegistry;
+
+    public:
+        /**
+         * @brief Calls a function for every session in the snapshot.
+         * @param fn Function taking a const sessionPtr&.
+         */
+        template <typename Fn>
+        void for_each(Fn &&fn) const
+        {
+            for(std::size_t i=0; i<Shards; ++i){
+                const slot* _slots = m_blocks[i]->m_slots.get();
+                for(std::size_t j=0; j<m_used[i]; ++j){
+                    if(_slots[j].m_live.load(std::memory_order_relaxed)) fn(_slots[j].m_session);
+                }
+            }
+        }
+
+        /**
+         * @brief Finds the first session matching a predicate.
+         * @param pred Predicate taking a const sessionPtr&.
+         * @return The matching session, or nullptr.
+         */
+        template <typename Pred>
+        sessionPtr find_if(Pred &&pred) const
+        {
+            for(std::size_t i=0; i<Shards; ++i){
+                const slot* _slots = m_blocks[i]->m_slots.get();
+                for(std::size_t j=0; j<m_used[i]; ++j){
+                    if(_slots[j].m_live.load(std::memory_order_relaxed) && pred(_slots[j].m_session)) return _slots[j].m_session;
+                }
+            }
+            return nullptr;
+        }
+
+        /**
+         * @brief Number of sessions in the snapshot that have not left.
+         */
+        std::size_t size() const
+        {
+            std::size_t sz = 0;
+            for_each([&sz](const sessionPtr &){ ++sz; });
+            return sz;
+        }
+    };
+
+private:
+    /**
+     * @brief One independently updated part of the registry.
+     */
+    struct alignas(64) shard
+    {
+        std::mutex m_writer_mutex; ///< Serializes membership changes of the shard.
+        block* m_block = nullptr; ///< Current block, only used by writers.
+        std::atomic<const block*> m_published{nullptr}; ///< The same block, as readers load it.
+        std::unordered_map<const Session*, std::size_t> m_index; ///< Slot of every live session, only used by writers.
+        std::size_t m_dead = 0; ///< Dead slots in m_block, only used by writers.
+    };
+
+    static constexpr std::size_t min_capacity = 16; ///< Slots of a shard's first block.
+
+    std::array<shard, Shards> m_shards; ///< The shards.
+    std::atomic<std::size_t> m_size; ///< Number of registered sessions.
+
+    /**
+     * @brief The shard a session belongs to.
+     */
+    shard &shard_of(const Session *session)
+    {
+        return m_shards[(std::hash<const Session*>()(session) >> 4) % Shards];
+    }
+
+    /**
+     * @brief Makes a block the current one of a shard and retires the one it replaces.
+     */
+    static void publish(shard &sh, block *next)
+    {
+        const block* _replaced = sh.m_block;
+        sh.m_block = next;
+        sh.m_published.store(next, std::memory_order_seq_cst);
+        networkLibrary::epochDomain::retire(_replaced);
+    }
+
+    /**
+     * @brief Publishes a new block holding the live sessions of a shard, with room for as many again.
+     */
+    static void compact(shard &sh)
+    {
+        const block& current = *sh.m_block;
+        block* next = new block(std::max(2 * sh.m_index.size(), min_capacity));
+        std::size_t used = 0;
+        for(std::size_t i=0; i<current.m_used.load(std::memory_order_relaxed); ++i){
+            const slot& _slot = current.m_slots[i];
+            if(!_slot.m_live.load(std::memory_order_relaxed)) continue;
+            next->m_slots[used].m_session = _slot.m_session;
+            next->m_slots[used].m_live.store(true, std::memory_order_relaxed);
+            sh.m_index[_slot.m_session.get()] = used++;
+        }
+        next->m_used.store(used, std::memory_order_relaxed);
+        sh.m_dead = 0;
+        publish(sh, next);
+    }
+
+public:
+    sessionRegistry()
+        : m_size(0)
+    {
+        for(auto& sh : m_shards){
+            sh.m_block = new block(min_capacity);
+            sh.m_published.store(sh.m_block, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Retires the blocks, snapshots taken on other threads may still be reading them.
+     */
+    ~sessionRegistry()
+    {
+        for(auto& sh : m_shards) networkLibrary::epochDomain::retire(static_cast<const block*>(sh.m_block));
+    }
+
+    sessionRegistry(const sessionRegistry &) = delete;
+    sessionRegistry &operator=(const sessionRegistry &) = delete;
+
+    /**
+     * @brief Adds a session to the registry.
+     * @param session The session to add.
+     * @return False if the session was already registered.
+     */
+    bool insert(const sessionPtr &session)
+    {
+        shard& sh = shard_of(session.get());
+        std::lock_guard<std::mutex> lock(sh.m_writer_mutex);
+        if(sh.m_index.count(session.get())) return false;
+        if(sh.m_block->m_used.load(std::memory_order_relaxed) == sh.m_block->m_capacity) compact(sh);
+
+        // Readers only look at the slot once m_used covers it
+        block& _block = *sh.m_block;
+        const std::size_t used = _block.m_used.load(std::memory_order_relaxed);
+        _block.m_slots[used].m_session = session;
+        _block.m_slots[used].m_live.store(true, std::memory_order_relaxed);
+        _block.m_used.store(used + 1, std::memory_order_release);
+        sh.m_index.emplace(session.get(), used);
+        m_size.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Removes a session from the registry.
+     * @param session The session to remove.
+     * @return False if the session was not registered.
+     */
+    bool erase(const sessionPtr &session)
+    {
+        shard& sh = shard_of(session.get());
+        std::lock_guard<std::mutex> lock(sh.m_writer_mutex);
+        auto it = sh.m_index.find(session.get());
+        if(it == sh.m_index.end()) return false;
+
+        sh.m_block->m_slots[it->second].m_live.store(false, std::memory_order_relaxed);
+        sh.m_index.erase(it);
+        // Dead slots keep their sessions alive, so they never outnumber the live ones
+        if(++sh.m_dead > sh.m_index.size()) compact(sh);
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Removes every session from the registry.
+     * @return The sessions that were registered.
+     */
+    members clear()
+    {
+        members removed;
+        for(auto& sh : m_shards){
+            std::lock_guard<std::mutex> lock(sh.m_writer_mutex);
+            const block& current = *sh.m_block;
+            for(std::size_t i=0; i<current.m_used.load(std::memory_order_relaxed); ++i){
+                if(current.m_slots[i].m_live.load(std::memory_order_relaxed)) removed.push_back(current.m_slots[i].m_session);
+            }
+            sh.m_index.clear();
+            sh.m_dead = 0;
+            publish(sh, new block(min_capacity));
+        }
+        m_size.store(0, std::memory_order_relaxed);
+        return removed;
+    }
+
+    /**
+     * @brief Takes a snapshot of the registry.
+     */
+    snapshot view() const
+    {
+        snapshot snap;
+        for(std::size_t i=0; i<Shards; ++i){
+            // Ordered after the pin, see epochDomain::retire()
+            snap.m_blocks[i] = m_shards[i].m_published.load(std::memory_order_seq_cst);
+            snap.m_used[i] = snap.m_blocks[i]->m_used.load(std::memory_order_acquire);
+        }
+        return snap;
+    }
+
+    /**
+     * @brief Calls a function for every session of a fresh snapshot.
+     * @param fn Function taking a const sessionPtr&.
+     */
+    template <typename Fn>
+    void for_each(Fn &&fn) const
+    {
+        view().for_each(std::forward<Fn>(fn));
+    }
+
+    /**
+     * @brief Number of registered sessions.
+     */
+    std::size_t size() const
+    {
+        return m_size.load(std::memory_order_relaxed);
+    }
+};
+
+#endif // SESSION_REGISTRY_H
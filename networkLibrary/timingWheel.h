@@ -0,0 +1,185 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace networkLibrary
+{
+    /**
+     * @brief A hierarchical timing wheel of intrusive timers, counted in ticks.
+     *
+     * Level 0 has one slot per tick for the next 256 ticks, every higher level has 256 slots
+     * of 256 times the span of the one below. Arming links the timer into the slot of its
+     * deadline and cancelling unlinks it, both O(1) and without allocating: the timer lives
+     * inside its owner. Advancing by a tick fires the current level 0 slot and, every 256
+     * ticks, cascades the next slot of the level above into the lower levels.
+     *
+     * The wheel is not thread-safe; its owner serialises access to it.
+     *
+     * @tparam Owner Type of the objects timers belong to, passed to the expiry callback.
+     * @tparam Levels Number of levels, covering 2^(8*Levels) ticks.
+     */
+    template <typename Owner, std::size_t Levels = 4>
+    class timingWheel;
+};
+
+template <typename Owner, std::size_t Levels>
+class networkLibrary::timingWheel
+{
+public:
+    /**
+     * @brief A timer, embedded in its owner; it must be cancelled before it is destroyed.
+     */
+    struct timer
+    {
+        timer* m_prev = nullptr;     ///< Previous timer of the slot, nullptr when not armed.
+        timer* m_next = nullptr;     ///< Next timer of the slot.
+        std::uint64_t m_deadline = 0; ///< Tick at which the timer fires.
+        Owner* m_owner = nullptr;    ///< Object passed to the expiry callback.
+
+        /**
+         * @brief Whether the timer is armed.
+         */
+        bool armed() const { return m_prev != nullptr; }
+    };
+
+    static constexpr std::size_t slot_bits = 8; ///< Bits of a tick consumed by each level.
+    static constexpr std::size_t slots = std::size_t(1) << slot_bits; ///< Slots per level.
+    static constexpr std::uint64_t max_delay = (std::uint64_t(1) << (slot_bits * Levels)) - 1; ///< Longest delay in ticks, longer ones are shortened.
+
+private:
+    std::array<std::array<timer, slots>, Levels> m_slots; ///< Sentinel of every slot's circular list.
+    std::uint64_t m_now;  ///< Current tick.
+    std::size_t m_size;   ///< Number of armed timers.
+
+    /**
+     * @brief Links an unarmed timer into the slot of its deadline, which is not before the current tick.
+     */
+    void link(timer &t)
+    {
+        std::uint64_t delay = t.m_deadline - m_now;
+        std::size_t level = 0;
+        while(level + 1 < Levels && delay >= (std::uint64_t(1) << (slot_bits * (level + 1)))) ++level;
+
+        timer& head = m_slots[level][(t.m_deadline >> (slot_bits * level)) & (slots - 1)];
+        t.m_prev = head.m_prev;
+        t.m_next = &head;
+        head.m_prev->m_next = &t;
+        head.m_prev = &t;
+    }
+
+    /**
+     * @brief Unlinks an armed timer from its slot.
+     */
+    static void unlink(timer &t)
+    {
+        t.m_prev->m_next = t.m_next;
+        t.m_next->m_prev = t.m_prev;
+        t.m_prev = t.m_next = nullptr;
+    }
+
+    /**
+     * @brief Moves the timers of a higher level slot down to the levels matching their remaining delay.
+     */
+    void cascade(timer &head)
+    {
+        timer* t = head.m_next;
+        head.m_prev = head.m_next = &head;
+        while(t != &head){
+            timer* next = t->m_next;
+            link(*t);
+            t = next;
+        }
+    }
+
+public:
+    /**
+     * @brief Constructs an empty wheel.
+     * @param now The current tick.
+     */
+    explicit timingWheel(std::uint64_t now = 0)
+        : m_now(now),
+          m_size(0)
+    {
+        for(auto& level : m_slots){
+            for(auto& head : level) head.m_prev = head.m_next = &head;
+        }
+    }
+
+    timingWheel(const timingWheel &) = delete;
+    timingWheel &operator=(const timingWheel &) = delete;
+
+    /**
+     * @brief The current tick.
+     */
+    std::uint64_t now() const
+    {
+        return m_now;
+    }
+
+    /**
+     * @brief Number of armed timers.
+     */
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * @brief Arms a timer, moving it if it is already armed.
+     * @param t The timer.
+     * @param owner Object passed to the expiry callback.
+     * @param delay Ticks from now until it fires, at least 1.
+     */
+    void arm(timer &t, Owner &owner, std::uint64_t delay)
+    {
+        if(t.armed()) unlink(t);
+        else ++m_size;
+        if(delay == 0) delay = 1;
+        if(delay > max_delay) delay = max_delay;
+        t.m_owner = &owner;
+        t.m_deadline = m_now + delay;
+        link(t);
+    }
+
+    /**
+     * @brief Cancels a timer; does nothing if it is not armed.
+     */
+    void cancel(timer &t)
+    {
+        if(!t.armed()) return;
+        unlink(t);
+        --m_size;
+    }
+
+    /**
+     * @brief Advances the wheel tick by tick, firing every timer whose deadline is passed.
+     *
+     * A fired timer is unarmed before the callback runs, so the callback may arm it again.
+     * @param now The tick to advance to; earlier ticks are ignored.
+     * @param expired Callback taking the Owner& of every fired timer.
+     */
+    template <typename Fn>
+    void advance(std::uint64_t now, Fn &&expired)
+    {
+        while(m_now < now){
+            ++m_now;
+            for(std::size_t level = 1; level < Levels; ++level){
+                if(m_now & ((std::uint64_t(1) << (slot_bits * level)) - 1)) break;
+                cascade(m_slots[level][(m_now >> (slot_bits * level)) & (slots - 1)]);
+            }
+
+            timer& head = m_slots[0][m_now & (slots - 1)];
+            while(head.m_next != &head){
+                timer& t = *head.m_next;
+                unlink(t);
+                --m_size;
+                expired(*t.m_owner);
+            }
+        }
+    }
+};
+
+#endif // TIMING_WHEEL_H
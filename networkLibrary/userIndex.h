@@ -0,0 +1,170 @@
+#ifndef USER_INDEX_H
+#define USER_INDEX_H
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace networkLibrary
+{
+    /**
+     * @brief A sharded concurrent hash index from username to session.
+     * 
+     * Names are unique: a name can only be claimed while no live session holds it.
+     * Lookups, claims and renames lock only the shards of the names involved, so direct
+     * messages are routed in constant time however many users are connected.
+     * 
+     * The index holds weak references; the session registry owns the sessions.
+     * 
+     * @tparam Session Type of the indexed sessions.
+     * @tparam Shards Number of independently locked shards.
+     */
+    template <typename Session, std::size_t Shards = 16>
+    class userIndex;
+};
+
+template <typename Session, std::size_t Shards>
+class networkLibrary::userIndex
+{
+public:
+    using sessionPtr = std::shared_ptr<Session>; ///< Handle returned by lookups.
+
+private:
+    /**
+     * @brief One independently locked part of the index.
+     */
+    struct alignas(64) shard
+    {
+        std::mutex m_mutex; ///< Guards the names of the shard.
+        std::unordered_map<std::string, std::weak_ptr<Session>> m_names; ///< Names held in the shard.
+    };
+
+    std::array<shard, Shards> m_shards; ///< The shards.
+
+    /**
+     * @brief The shard a name belongs to.
+     */
+    shard &shard_of(const std::string &name)
+    {
+        return m_shards[std::hash<std::string>()(name) % Shards];
+    }
+
+    /**
+     * @brief Whether a name is held by a live session other than the given one; the shard must be locked.
+     */
+    static bool taken(shard &sh, const std::string &name, const Session *session = nullptr)
+    {
+        auto it = sh.m_names.find(name);
+        if(it == sh.m_names.end()) return false;
+        auto holder = it->second.lock();
+        return holder && holder.get() != session;
+    }
+
+public:
+    userIndex() = default;
+    userIndex(const userIndex &) = delete;
+    userIndex &operator=(const userIndex &) = delete;
+
+    /**
+     * @brief Claims a name for a session.
+     * @param name The name to claim.
+     * @param session The session claiming it.
+     * @return False if the name is held by another live session.
+     */
+    bool claim(const std::string &name, const sessionPtr &session)
+    {
+        shard& sh = shard_of(name);
+        std::lock_guard<std::mutex> lock(sh.m_mutex);
+        if(taken(sh, name)) return false;
+        sh.m_names[name] = session;
+        return true;
+    }
+
+    /**
+     * @brief Atomically moves a session from one name to another.
+     * 
+     * No other session can observe the old name as free before the new one is held.
+     * Moving to the name the session already holds changes nothing and succeeds.
+     * @param old_name The name currently held by the session.
+     * @param new_name The name to move to.
+     * @param session The session being renamed.
+     * @return False if the new name is held by another live session.
+     */
+    bool rename(const std::string &old_name, const std::string &new_name, const sessionPtr &session)
+    {
+        shard& from = shard_of(old_name);
+        shard& to = shard_of(new_name);
+
+        std::unique_lock<std::mutex> lock_from(from.m_mutex, std::defer_lock);
+        std::unique_lock<std::mutex> lock_to(to.m_mutex, std::defer_lock);
+        if(&from == &to) lock_from.lock();
+        else std::lock(lock_from, lock_to);
+
+        if(taken(to, new_name, session.get())) return false;
+        auto it = from.m_names.find(old_name);
+        if(it != from.m_names.end() && it->second.lock() == session) from.m_names.erase(it);
+        to.m_names[new_name] = session;
+        return true;
+    }
+
+    /**
+     * @brief Releases a name, if it is still held by the given session.
+     * @param name The name to release.
+     * @param session The session releasing it.
+     */
+    void release(const std::string &name, const Session *session)
+    {
+        shard& sh = shard_of(name);
+        std::lock_guard<std::mutex> lock(sh.m_mutex);
+        auto it = sh.m_names.find(name);
+        if(it == sh.m_names.end()) return;
+        auto holder = it->second.lock();
+        if(!holder || holder.get() == session) sh.m_names.erase(it);
+    }
+
+    /**
+     * @brief Finds the session holding a name.
+     * @param name The name to look up.
+     * @return The session, or nullptr if no live session holds the name.
+     */
+    sessionPtr find(const std::string &name)
+    {
+        shard& sh = shard_of(name);
+        std::lock_guard<std::mutex> lock(sh.m_mutex);
+        auto it = sh.m_names.find(name);
+        return it == sh.m_names.end() ? nullptr : it->second.lock();
+    }
+
+    /**
+     * @brief Names held by live sessions, locking one shard at a time.
+     */
+    std::vector<std::string> names()
+    {
+        std::vector<std::string> _names;
+        for(auto& sh : m_shards){
+            std::lock_guard<std::mutex> lock(sh.m_mutex);
+            for(auto const& [_name, _session] : sh.m_names){
+                if(!_session.expired()) _names.push_back(_name);
+            }
+        }
+        return _names;
+    }
+
+    /**
+     * @brief Removes every name from the index.
+     */
+    void clear()
+    {
+        for(auto& sh : m_shards){
+            std::lock_guard<std::mutex> lock(sh.m_mutex);
+            sh.m_names.clear();
+        }
+    }
+};
+
+#endif // USER_INDEX_H
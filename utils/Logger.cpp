@@ -1,5 +1,55 @@
 #include "Logger.h"
 
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+    /*
+        Binary log layout, integers in host byte order:
+            run marker  "CHATLOG1", written each time the file is opened; format IDs restart
+            format      'F' u32 id, u8 level, u32 length, format text
+            record      'R' u32 format, u8 level, i64 time, u64 thread, u32 length, arguments
+        Each argument is a tag followed by its value:
+            'i' i64, 'u' u64, 'd' double, 's' u32 length and the bytes
+    */
+    const char kMagic[] = "CHATLOG1";
+    constexpr std::size_t kMagicSize = sizeof(kMagic) - 1;
+
+    struct formatInfo
+    {
+        Logger::Level level;
+        const char* format;
+    };
+
+    // Format 0 carries the text of Logger::log()
+    std::mutex g_registry_mutex;
+    std::vector<formatInfo> g_registry = {{Logger::Level::INFO, "{}"}};
+
+    template <typename T>
+    void append_raw(std::string &out, T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    bool read_raw(std::istream &in, T &value)
+    {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+
+    template <typename T>
+    bool take_raw(std::string_view &in, T &value)
+    {
+        if(in.size() < sizeof(value)) return false;
+        std::memcpy(&value, in.data(), sizeof(value));
+        in.remove_prefix(sizeof(value));
+        return true;
+    }
+};
+
 Logger::Logger()
     :m_Location(Location::DISABLED)
 {
@@ -15,14 +65,46 @@ Logger::Logger(const Location location)
 Logger::Logger(const Location location, const std::string fileName)
     :m_Location(location),
      m_FileName(fileName.substr((int)fileName.size()-4,4)!=".txt" ? fileName : fileName + ".txt")
-{   
+{
+    if(!init()) std::cout << "Error! -> Logger::Logger" <<std::endl;
+}
+
+Logger::Logger(const Location location, const std::string fileName, const Mode mode, const OverflowPolicy policy, std::size_t capacity)
+    :m_FileName(fileName),
+     m_Location(location),
+     m_Mode(mode),
+     m_Policy(policy)
+{
+    if(m_Mode == Mode::ASYNCHRONOUS){
+        m_Capacity = 2;
+        while(m_Capacity < capacity) m_Capacity <<= 1;
+        m_Ring.reset(new Entry[m_Capacity]);
+        for(std::size_t i=0; i<m_Capacity; ++i){
+            m_Ring[i].m_Sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // The start line is queued before the writer thread exists, so it is written first
     if(!init()) std::cout << "Error! -> Logger::Logger" <<std::endl;
+
+    if(m_Mode == Mode::ASYNCHRONOUS && m_Location != Location::DISABLED){
+        m_Running = true;
+        m_Writer = std::thread([this](){ run(); });
+    }
 }
 
 Logger::~Logger(){
     log("====================LOG END======================");
     log();
-    if(m_Location == Location::TEXT_FILE){
+    if(m_Writer.joinable()){
+        m_Running = false;
+        {
+            std::lock_guard<std::mutex> _lock(m_WakeMutex);
+        }
+        m_Wake.notify_all();
+        m_Writer.join();
+    }
+    if(m_Location == Location::TEXT_FILE || m_Location == Location::BINARY_FILE){
         m_OutStream.close();
     }
 }
@@ -32,19 +114,51 @@ bool Logger::init()
     /*
         Output Stream with appending into text file
     */
-    if(m_Location == Location::DISABLED) return false;
+    if(m_Location == Location::DISABLED) return true;
     if(m_Location == Location::TEXT_FILE){
-        m_OutStream.open(m_FileName, std::ios_base::app);    
+        m_OutStream.open(m_FileName, std::ios_base::app);
+        if(!m_OutStream.is_open()) return false;
+    }
+    if(m_Location == Location::BINARY_FILE){
+        m_OutStream.open(m_FileName, std::ios_base::app | std::ios_base::binary);
         if(!m_OutStream.is_open()) return false;
+        m_OutStream.write(kMagic, kMagicSize);
     }
     if(m_Location == Location::STDOUT){
         m_OutStream.basic_ios<char>::rdbuf(std::cout.rdbuf());
     }
-    m_ClassName = "Logger"; 
+    m_ClassName = "Logger";
     log("====================LOG START====================");
     return true;
 }
 
+bool Logger::enabled() const
+{
+    return m_Location != Location::DISABLED;
+}
+
+std::size_t Logger::dropped() const
+{
+    return m_Dropped.load(std::memory_order_relaxed);
+}
+
+void Logger::flush()
+{
+    if(m_Location == Location::DISABLED) return;
+    if(!m_Writer.joinable()){
+        std::lock_guard<std::mutex> _lock(m_mutex);
+        m_OutStream.flush();
+        return;
+    }
+
+    const std::size_t target = m_Head.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> _lock(m_WakeMutex);
+    m_Wake.notify_all();
+    while(m_Written.load(std::memory_order_acquire) < target){
+        m_Wake.wait_for(_lock, std::chrono::milliseconds(1));
+    }
+}
+
 bool Logger::log()
 {
     return log("");
@@ -55,38 +169,380 @@ bool Logger::log(const std::string& str)
     return log({str},"");
 }
 
+bool Logger::ready()
+{
+    if((m_Location == Location::TEXT_FILE || m_Location == Location::BINARY_FILE) && !m_OutStream.is_open()){
+        std::cout << "Error-> Logger::log!" <<std::endl;
+        return false;
+    }
+    return true;
+}
+
 bool Logger::log(const std::initializer_list<std::string> &list_str, std::string sep)
 {
-    /*
-        Gets the current time and outputs in the log file 
-    */
     if(m_Location == Location::DISABLED) return true;
     // if(m_Location == Location::STDOUT) return true;     //Change later
-    if(m_Location == Location::TEXT_FILE && !m_OutStream.is_open()){
-        std::cout << "Error-> Logger::log!" <<std::endl;
-        return false;
+    if(!ready()) return false;
+    const bool binary = m_Location == Location::BINARY_FILE;
+    if(m_Mode == Mode::ASYNCHRONOUS){
+        std::size_t pos;
+        Entry* entry = claim(pos);
+        if(entry == nullptr) return false;
+        format(list_str, sep, entry->m_Text, binary);
+        commit(entry, pos, Level::INFO, 0);
+        return true;
     }
+
+    /*
+        Gets the current time and outputs in the log file
+    */
     std::lock_guard<std::mutex> _lock(m_mutex);
-    time_t now = time(0); 
-    tm* timeinfo = localtime(&now); 
-    char timestamp[20]; 
-    strftime(
-        timestamp, 
-        sizeof(timestamp), 
-        "%Y-%m-%d %H:%M:%S", 
-        timeinfo
-        ); 
-    
-    m_OutStream  << timestamp  << " (" << std::this_thread::get_id() << ") -> ";
+    format(list_str, sep, m_Scratch, binary);
+    write_line(time(0), std::this_thread::get_id(), Level::INFO, 0, m_Scratch);
+    m_OutStream.flush();
+    return true;
+}
+
+void Logger::format(const std::initializer_list<std::string> &list_str, const std::string &sep, std::string &out, bool binary)
+{
+    out.clear();
+    if(binary){
+        out += 's';
+        append_raw<std::uint32_t>(out, 0);
+    }
     for(int i=0; i<(int)list_str.size(); i++){
         for(auto const &c: *(list_str.begin()+i)){
-            if(c!='\n')    
-                m_OutStream << c;
+            if(c!='\n')
+                out += c;
         }
         if(i!=int(list_str.size())-1)
-            m_OutStream << sep;
+            out += sep;
+    }
+    if(binary){
+        std::uint32_t length = out.size() - 1 - sizeof(std::uint32_t);
+        std::memcpy(&out[1], &length, sizeof(length));
+    }
+}
+
+std::uint32_t Logger::register_format(Level level, const char* format)
+{
+    std::lock_guard<std::mutex> _lock(g_registry_mutex);
+    g_registry.push_back({level, format});
+    return g_registry.size() - 1;
+}
+
+const char* Logger::level_name(Level level)
+{
+    switch(level){
+        case Level::TRACE: return "TRACE";
+        case Level::DEBUG: return "DEBUG";
+        case Level::INFO: return "INFO";
+        case Level::WARNING: return "WARNING";
+        case Level::ERROR: return "ERROR";
+        default: return "OFF";
+    }
+}
+
+void Logger::put_signed(std::string &out, long long value, bool binary)
+{
+    if(binary){
+        out += 'i';
+        append_raw<std::int64_t>(out, value);
+        return;
+    }
+    char buffer[24];
+    out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+}
+
+void Logger::put_unsigned(std::string &out, unsigned long long value, bool binary)
+{
+    if(binary){
+        out += 'u';
+        append_raw<std::uint64_t>(out, value);
+        return;
+    }
+    char buffer[24];
+    out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+}
+
+void Logger::put_double(std::string &out, double value, bool binary)
+{
+    if(binary){
+        out += 'd';
+        append_raw<double>(out, value);
+        return;
+    }
+    char buffer[32];
+    out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+}
+
+void Logger::put_string(std::string &out, std::string_view value, bool binary)
+{
+    // Binary logs keep the bytes as they are, decode() drops the newlines
+    if(binary){
+        out += 's';
+        append_raw<std::uint32_t>(out, value.size());
+        out.append(value);
+        return;
+    }
+    while(!value.empty()){
+        std::size_t end = value.find('\n');
+        out.append(value.substr(0, end));
+        if(end == std::string_view::npos) break;
+        value.remove_prefix(end + 1);
+    }
+}
+
+const char* Logger::put_literal(std::string &out, const char* format)
+{
+    for(; *format != '\0'; ++format){
+        if(format[0] == '{' && format[1] == '}') return format + 2;
+        if(*format != '\n') out += *format;
+    }
+    return format;
+}
+
+const char* Logger::timestamp(std::time_t now)
+{
+    if(now != m_CachedSecond){
+        format_time(now, m_CachedTimestamp);
+        m_CachedSecond = now;
+    }
+    return m_CachedTimestamp;
+}
+
+void Logger::format_time(std::time_t now, char* buffer)
+{
+    tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    strftime(
+        buffer,
+        20,
+        "%Y-%m-%d %H:%M:%S",
+        &timeinfo
+        );
+}
+
+void Logger::write_line(std::time_t now, std::thread::id thread, Level level, std::uint32_t format, const std::string &text)
+{
+    // Threads are numbered once, as std::thread::id prints them
+    auto number = m_ThreadNumbers.find(thread);
+    if(number == m_ThreadNumbers.end()){
+        std::ostringstream printed;
+        printed << thread;
+        number = m_ThreadNumbers.emplace(thread, std::stoull(printed.str())).first;
+    }
+
+    if(m_Location != Location::BINARY_FILE){
+        m_OutStream << timestamp(now) << " (" << number->second << ") " << level_name(level) << " -> " << text << '\n';
+        return;
+    }
+
+    // Describe a format the first time this file uses it
+    if(format >= m_Defined.size()) m_Defined.resize(format + 1, false);
+    if(!m_Defined[format]){
+        formatInfo info;
+        {
+            std::lock_guard<std::mutex> _lock(g_registry_mutex);
+            info = g_registry[format];
+        }
+        std::string definition(1, 'F');
+        append_raw<std::uint32_t>(definition, format);
+        append_raw<std::uint8_t>(definition, info.level);
+        append_raw<std::uint32_t>(definition, std::strlen(info.format));
+        definition += info.format;
+        m_OutStream.write(definition.data(), definition.size());
+        m_Defined[format] = true;
+    }
+
+    char header[1 + 4 + 1 + 8 + 8 + 4];
+    const std::uint8_t _level = level;
+    const std::int64_t _time = now;
+    const std::uint32_t _length = text.size();
+    header[0] = 'R';
+    std::memcpy(header + 1, &format, 4);
+    std::memcpy(header + 5, &_level, 1);
+    std::memcpy(header + 6, &_time, 8);
+    std::memcpy(header + 14, &number->second, 8);
+    std::memcpy(header + 22, &_length, 4);
+    m_OutStream.write(header, sizeof(header));
+    m_OutStream.write(text.data(), text.size());
+}
+
+bool Logger::decode(std::istream &in, std::ostream &out)
+{
+    std::vector<std::string> formats;
+    std::string payload;
+    std::string line;
+    char timestamp[20];
+    char tag;
+    while(in.get(tag)){
+        if(tag == kMagic[0]){
+            char rest[kMagicSize - 1];
+            if(!in.read(rest, sizeof(rest)) || std::memcmp(rest, kMagic + 1, sizeof(rest)) != 0) return false;
+            formats.clear();
+            continue;
+        }
+
+        std::uint32_t format;
+        std::uint8_t level;
+        std::uint32_t length;
+        if(tag == 'F'){
+            if(!read_raw(in, format) || !read_raw(in, level) || !read_raw(in, length)) return false;
+            if(format >= formats.size()) formats.resize(format + 1);
+            formats[format].resize(length);
+            if(!in.read(&formats[format][0], length)) return false;
+            continue;
+        }
+        if(tag != 'R') return false;
+
+        std::int64_t now;
+        std::uint64_t thread;
+        if(!read_raw(in, format) || !read_raw(in, level) || !read_raw(in, now) || !read_raw(in, thread) || !read_raw(in, length)) return false;
+        payload.resize(length);
+        if(!in.read(&payload[0], length)) return false;
+        if(format >= formats.size()) return false;
+
+        // Substitute the arguments in order, the same way the text log does
+        line.clear();
+        std::string_view args(payload);
+        const char* rest = formats[format].c_str();
+        while(!args.empty()){
+            rest = put_literal(line, rest);
+            char type = args.front();
+            args.remove_prefix(1);
+            if(type == 'i'){
+                std::int64_t value;
+                if(!take_raw(args, value)) return false;
+                put_signed(line, value, false);
+            }
+            else if(type == 'u'){
+                std::uint64_t value;
+                if(!take_raw(args, value)) return false;
+                put_unsigned(line, value, false);
+            }
+            else if(type == 'd'){
+                double value;
+                if(!take_raw(args, value)) return false;
+                put_double(line, value, false);
+            }
+            else if(type == 's'){
+                std::uint32_t size;
+                if(!take_raw(args, size) || args.size() < size) return false;
+                put_string(line, args.substr(0, size), false);
+                args.remove_prefix(size);
+            }
+            else return false;
+        }
+        put_literal(line, rest);
+
+        format_time(now, timestamp);
+        out << timestamp << " (" << thread << ") " << level_name(static_cast<Level>(level)) << " -> " << line << '\n';
+    }
+    return in.eof();
+}
+
+Logger::Entry* Logger::claim(std::size_t &pos)
+{
+    /*
+        Bounded multi-producer ring: a slot whose sequence equals the claimed position is free,
+        sequence position + 1 marks it written, and the writer hands it back for the next lap.
+    */
+    const std::size_t mask = m_Capacity - 1;
+    pos = m_Head.load(std::memory_order_relaxed);
+    while(true){
+        Entry* entry = &m_Ring[pos & mask];
+        std::size_t seq = entry->m_Sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if(diff == 0){
+            if(m_Head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return entry;
+        }
+        else if(diff < 0){
+            if(m_Policy == OverflowPolicy::DROP){
+                m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            std::unique_lock<std::mutex> _lock(m_WakeMutex);
+            m_Wake.notify_all();
+            m_Wake.wait_for(_lock, std::chrono::milliseconds(1));
+            pos = m_Head.load(std::memory_order_relaxed);
+        }
+        else{
+            pos = m_Head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::commit(Entry* entry, std::size_t pos, Level level, std::uint32_t format)
+{
+    entry->m_Time = time(0);
+    entry->m_Thread = std::this_thread::get_id();
+    entry->m_Level = level;
+    entry->m_Format = format;
+    entry->m_Sequence.store(pos + 1, std::memory_order_release);
+
+    // A wake-up lost to a race is covered by the writer's timed wait
+    if(pos + 1 - m_Written.load(std::memory_order_relaxed) >= m_Capacity / 2 && m_Sleeping.load(std::memory_order_relaxed)){
+        m_Wake.notify_all();
+    }
+}
+
+std::size_t Logger::write_batch()
+{
+    const std::size_t mask = m_Capacity - 1;
+    std::size_t cnt = 0;
+    while(true){
+        Entry& entry = m_Ring[m_Tail & mask];
+        if(entry.m_Sequence.load(std::memory_order_acquire) != m_Tail + 1) break;
+
+        write_line(entry.m_Time, entry.m_Thread, entry.m_Level, entry.m_Format, entry.m_Text);
+        entry.m_Text.clear();
+        entry.m_Sequence.store(m_Tail + m_Capacity, std::memory_order_release);
+        ++m_Tail;
+        ++cnt;
+    }
+
+    std::size_t dropped = m_Dropped.load(std::memory_order_relaxed);
+    if(dropped != m_Reported){
+        static const std::uint32_t _format_id = register_format(Level::WARNING, "Logger dropped {} messages");
+        std::string note;
+        encode(note, "Logger dropped {} messages", dropped - m_Reported);
+        write_line(time(0), std::this_thread::get_id(), Level::WARNING, _format_id, note);
+        m_Reported = dropped;
+        ++cnt;
+    }
+    if(cnt == 0) return 0;
+
+    m_OutStream.flush();
+    m_Written.store(m_Tail, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> _lock(m_WakeMutex);
+    }
+    m_Wake.notify_all();
+    return cnt;
+}
+
+void Logger::run()
+{
+    /*
+        The writer wakes on a short interval and writes whatever accumulated, so a burst of
+        log lines costs one write and one flush. Producers only wake it early when the ring
+        is half full.
+    */
+    while(true){
+        write_batch();
+        // Producers are gone once the destructor stops the thread, drain what is left
+        if(!m_Running.load(std::memory_order_acquire)){
+            while(write_batch() > 0){
+            }
+            break;
+        }
+
+        std::unique_lock<std::mutex> _lock(m_WakeMutex);
+        m_Sleeping.store(true);
+        if(m_Running.load(std::memory_order_acquire)){
+            m_Wake.wait_for(_lock, std::chrono::milliseconds(10));
+        }
+        m_Sleeping.store(false);
     }
-    m_OutStream << '\n';
-    flush(m_OutStream);
-    return true; 
 }
@@ -4,14 +4,61 @@
 #include <iostream>
 #include <fstream>   // for including ofstream
 #include <string>    // for dealing with names
-#include <ctime>     // for writing time 
-#include <mutex>     // for mutex lock handling 
-#include <thread>    // for thread handling 
+#include <ctime>     // for writing time
+#include <mutex>     // for mutex lock handling
+#include <thread>    // for thread handling
+#include <atomic>    // for the lock-free ring buffer
+#include <memory>    // for owning the ring buffer
+#include <vector>    // for tracking described formats
+#include <condition_variable> // for waking the writer thread
+#include <cstdint>   // for the binary record layout
+#include <string_view>      // for logging arguments without copies
+#include <type_traits>      // for encoding arguments by type
+#include <unordered_map>    // for numbering threads in binary logs
+
+/**
+ * @brief Lowest severity whose log statements are compiled in, see Logger::Level.
+ *
+ * Set through the CHATAPP_LOG_LEVEL CMake option. Statements below it are discarded at compile
+ * time, together with the evaluation of their arguments.
+ */
+#ifndef LOGGER_MIN_LEVEL
+#define LOGGER_MIN_LEVEL 0
+#endif
+
+/**
+ * @brief Logs a formatted message when its level is compiled in and the logger is enabled.
+ *
+ * Every "{}" in the format is replaced by the next argument. The format must be a string literal;
+ * it is registered once per call site and binary logs refer to it by that ID.
+ */
+#define LOGGER_LOG(logger, level, format, ...) \
+    do{ \
+        if constexpr((level) >= LOGGER_MIN_LEVEL){ \
+            static_assert(Logger::placeholders(format) == decltype(Logger::count(__VA_ARGS__))::value, \
+                          "Log format and argument count do not match"); \
+            static const std::uint32_t _format_id = Logger::register_format((level), (format)); \
+            if((logger).enabled()) (logger).write((level), _format_id, (format), ##__VA_ARGS__); \
+        } \
+    } while(0)
+
+#define LOG_TRACE(logger, format, ...) LOGGER_LOG(logger, Logger::Level::TRACE, format, ##__VA_ARGS__)
+#define LOG_DEBUG(logger, format, ...) LOGGER_LOG(logger, Logger::Level::DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(logger, format, ...) LOGGER_LOG(logger, Logger::Level::INFO, format, ##__VA_ARGS__)
+#define LOG_WARNING(logger, format, ...) LOGGER_LOG(logger, Logger::Level::WARNING, format, ##__VA_ARGS__)
+#define LOG_ERROR(logger, format, ...) LOGGER_LOG(logger, Logger::Level::ERROR, format, ##__VA_ARGS__)
 
 /**
  * @brief A class for logging messages to different locations such as text files or databases.
  *
  * The Logger class provides functionality to log messages to various locations depending on the configuration.
+ *
+ * In asynchronous mode, log() only copies the message into a lock-free ring buffer. A background
+ * writer thread formats and writes the buffered messages in batches and flushes once per batch.
+ *
+ * Messages logged through the LOG_* macros carry a severity level and a format with "{}"
+ * placeholders. A binary log stores the format ID and the raw arguments instead of the text;
+ * decode() turns it back into the text format.
  */
 
 class Logger {
@@ -22,14 +69,77 @@ public:
     enum Location {
         DISABLED,   ///< Logging is disabled.
         TEXT_FILE,  ///< Log messages to a text file.
-        STDOUT    ///< Log messages to terminal.
+        STDOUT,     ///< Log messages to terminal.
+        BINARY_FILE ///< Log format IDs and raw arguments to a file, see decode().
+    };
+
+    /**
+     * @brief Enum representing the severity of a message.
+     */
+    enum Level {
+        TRACE,      ///< Per message detail.
+        DEBUG,      ///< Chat traffic.
+        INFO,       ///< Connections, commands and other events.
+        WARNING,    ///< Recoverable problems such as slow consumers.
+        ERROR,      ///< Failed operations.
+        OFF         ///< Only as a compile-time threshold, compiles every statement out.
+    };
+
+    /**
+     * @brief Enum representing who writes the messages.
+     */
+    enum Mode {
+        SYNCHRONOUS,    ///< The logging thread formats and writes every message itself.
+        ASYNCHRONOUS    ///< Messages are queued and written by a background thread.
+    };
+
+    /**
+     * @brief Enum representing what an asynchronous log() does when the ring buffer is full.
+     */
+    enum OverflowPolicy {
+        DROP,   ///< Discard the message and count it.
+        BLOCK   ///< Wait until the writer thread makes room.
     };
 
 private:
-    std::mutex m_mutex;             ///< Mutex Lock 
+    /**
+     * @brief One slot of the ring buffer.
+     */
+    struct Entry {
+        std::atomic<std::size_t> m_Sequence;    ///< Position the slot is ready for, see log().
+        std::time_t m_Time;                     ///< When the message was logged.
+        std::thread::id m_Thread;               ///< Thread that logged the message.
+        Level m_Level;                          ///< Severity of the message.
+        std::uint32_t m_Format;                 ///< Registered format of the message.
+        std::string m_Text;                     ///< The text, or the encoded arguments in a binary log; its capacity is reused.
+    };
+
+    std::mutex m_mutex;             ///< Mutex Lock
     const std::string m_FileName;   ///< The name of the file where logs will be written.
     std::ofstream m_OutStream;      ///< Output stream for writing to the log file.
     const Location m_Location;      ///< The location where logs should be written.
+    const Mode m_Mode = SYNCHRONOUS;        ///< Whether messages are written by a background thread.
+    const OverflowPolicy m_Policy = DROP;   ///< What to do when the ring buffer is full.
+    std::string m_Scratch;                  ///< Formatting buffer of the synchronous mode, guarded by m_mutex.
+
+    std::unique_ptr<Entry[]> m_Ring;        ///< Ring buffer of queued messages.
+    std::size_t m_Capacity = 0;             ///< Number of slots in the ring buffer, a power of two.
+    alignas(64) std::atomic<std::size_t> m_Head{0}; ///< Next position claimed by a producer.
+    alignas(64) std::size_t m_Tail = 0;             ///< Next position read by the writer thread.
+    std::size_t m_Reported = 0;             ///< Dropped messages already reported in the log.
+    std::atomic<std::size_t> m_Written{0};  ///< Positions below this have been written out.
+    std::atomic<std::size_t> m_Dropped{0};  ///< Messages discarded because the ring buffer was full.
+    std::atomic<bool> m_Running{false};     ///< Cleared to stop the writer thread.
+    std::atomic<bool> m_Sleeping{false};    ///< Whether the writer thread waits for messages.
+    std::mutex m_WakeMutex;                 ///< Mutex for the wake-up condition.
+    std::condition_variable m_Wake;         ///< Wakes the writer thread or producers waiting for room.
+    std::thread m_Writer;                   ///< Background writer thread.
+
+    std::time_t m_CachedSecond = -1;    ///< Second the cached timestamp belongs to.
+    char m_CachedTimestamp[20] = {};    ///< Formatted timestamp of m_CachedSecond.
+
+    std::vector<bool> m_Defined;    ///< Format IDs already described in the binary log.
+    std::unordered_map<std::thread::id, std::uint64_t> m_ThreadNumbers; ///< Printed form of thread IDs for the binary log.
 
     /**
      * @brief Initializes the logger based on the specified location.
@@ -37,6 +147,80 @@ private:
      */
     bool init();
 
+    /**
+     * @brief Checks that messages can be written.
+     */
+    bool ready();
+
+    /**
+     * @brief Joins the messages with the separator, dropping newlines.
+     * @param binary Whether to encode the joined text as the single argument of a binary record.
+     */
+    static void format(const std::initializer_list<std::string> &messages, const std::string &sep, std::string &out, bool binary);
+
+    /**
+     * @brief Encodes the arguments as text substituted into the format, or as binary arguments.
+     */
+    template <typename... Args>
+    void encode(std::string &out, const char* format, const Args&... args) const;
+
+    /**
+     * @brief Encodes one argument.
+     * @param binary Whether to write a tagged raw value instead of text.
+     */
+    template <typename T>
+    static void put(std::string &out, const T &value, bool binary);
+
+    static void put_signed(std::string &out, long long value, bool binary);
+    static void put_unsigned(std::string &out, unsigned long long value, bool binary);
+    static void put_double(std::string &out, double value, bool binary);
+    static void put_string(std::string &out, std::string_view value, bool binary);
+
+    /**
+     * @brief Appends the format text up to the next placeholder, dropping newlines.
+     * @return The format text after the placeholder.
+     */
+    static const char* put_literal(std::string &out, const char* format);
+
+    /**
+     * @brief Formatted timestamp of the given second, recomputed only when the second changes.
+     */
+    const char* timestamp(std::time_t now);
+
+    /**
+     * @brief Formats a second as local time into a buffer of at least 20 characters.
+     */
+    static void format_time(std::time_t now, char* buffer);
+
+    /**
+     * @brief Writes one message, a text line or a binary record, to the output stream without flushing it.
+     * @param text The text, or the encoded arguments in a binary log.
+     */
+    void write_line(std::time_t now, std::thread::id thread, Level level, std::uint32_t format, const std::string &text);
+
+    /**
+     * @brief Claims a ring buffer slot for a message, applying the overflow policy when it is full.
+     * @param pos Set to the claimed position.
+     * @return The slot, or nullptr if the message was dropped.
+     */
+    Entry* claim(std::size_t &pos);
+
+    /**
+     * @brief Stamps a filled slot and hands it to the writer thread.
+     */
+    void commit(Entry* entry, std::size_t pos, Level level, std::uint32_t format);
+
+    /**
+     * @brief Body of the writer thread: writes batches until stopped and the ring buffer is empty.
+     */
+    void run();
+
+    /**
+     * @brief Writes every queued message that is ready, then flushes once.
+     * @return Number of messages written.
+     */
+    std::size_t write_batch();
+
 protected:
     std::string m_ClassName;  ///< The name of the class, intended for use by derived classes.
 
@@ -59,6 +243,16 @@ public:
      */
     Logger(const Location loc, const std::string fileName);
 
+    /**
+     * @brief Constructor that selects synchronous or asynchronous writing.
+     * @param loc The location where logs should be written.
+     * @param fileName The name of the file where logs will be written.
+     * @param mode Whether a background thread writes the messages.
+     * @param policy What an asynchronous log() does when the ring buffer is full.
+     * @param capacity Number of messages the ring buffer holds, rounded up to a power of two.
+     */
+    Logger(const Location loc, const std::string fileName, const Mode mode, const OverflowPolicy policy = DROP, std::size_t capacity = 8192);
+
     /**
      * @brief Copy constructor is deleted to prevent copying of the logger.
      */
@@ -66,9 +260,75 @@ public:
 
     /**
      * @brief Destructor that cleans up resources used by the logger.
+     *
+     * In asynchronous mode every message logged before the destructor is written and flushed
+     * before the writer thread exits.
      */
     ~Logger();
 
+    /**
+     * @brief Whether messages are written anywhere, so callers can skip building them.
+     */
+    bool enabled() const;
+
+    /**
+     * @brief Number of messages discarded because the ring buffer was full.
+     */
+    std::size_t dropped() const;
+
+    /**
+     * @brief Waits until every message logged so far has been written and flushed.
+     */
+    void flush();
+
+    /**
+     * @brief Registers a format string. The LOG_* macros do this once per call site.
+     * @return The ID binary logs refer to the format by.
+     */
+    static std::uint32_t register_format(Level level, const char* format);
+
+    /**
+     * @brief Number of "{}" placeholders in a format.
+     */
+    static constexpr std::size_t placeholders(const char* format)
+    {
+        std::size_t cnt = 0;
+        for(; *format != '\0'; ++format){
+            if(format[0] == '{' && format[1] == '}') ++cnt;
+        }
+        return cnt;
+    }
+
+    /**
+     * @brief Number of arguments, only used unevaluated by the LOG_* macros.
+     */
+    template <typename... Args>
+    static std::integral_constant<std::size_t, sizeof...(Args)> count(const Args&...);
+
+    /**
+     * @brief Name of a level as written in the log.
+     */
+    static const char* level_name(Level level);
+
+    /**
+     * @brief Converts a binary log to the text format.
+     * @param in Stream positioned at the start of a binary log.
+     * @param out Stream the text lines are written to.
+     * @return False if the log is malformed or truncated; the lines before that are still written.
+     */
+    static bool decode(std::istream &in, std::ostream &out);
+
+    /**
+     * @brief Logs a formatted message, normally called through the LOG_* macros.
+     * @param level Severity of the message.
+     * @param format_id ID returned by register_format() for the format.
+     * @param format Format with one "{}" per argument.
+     * @param args Integers, floating point numbers, characters or strings.
+     * @return True if the log was successful, false otherwise.
+     */
+    template <typename... Args>
+    bool write(Level level, std::uint32_t format_id, const char* format, const Args&... args);
+
     /**
      * @brief Logs an empty string.
      * @return True if the log was successful, false otherwise.
@@ -90,4 +350,49 @@ public:
     bool log(const std::initializer_list<std::string> &messages, std::string);
 };
 
+template <typename... Args>
+bool Logger::write(Level level, std::uint32_t format_id, const char* format, const Args&... args)
+{
+    if(m_Location == Location::DISABLED) return true;
+    if(!ready()) return false;
+    if(m_Mode == Mode::ASYNCHRONOUS){
+        std::size_t pos;
+        Entry* entry = claim(pos);
+        if(entry == nullptr) return false;
+        encode(entry->m_Text, format, args...);
+        commit(entry, pos, level, format_id);
+        return true;
+    }
+
+    std::lock_guard<std::mutex> _lock(m_mutex);
+    encode(m_Scratch, format, args...);
+    write_line(time(0), std::this_thread::get_id(), level, format_id, m_Scratch);
+    m_OutStream.flush();
+    return true;
+}
+
+template <typename... Args>
+void Logger::encode(std::string &out, const char* format, const Args&... args) const
+{
+    out.clear();
+    if(m_Location == Location::BINARY_FILE){
+        (put(out, args, true), ...);
+        return;
+    }
+    ((format = put_literal(out, format), put(out, args, false)), ...);
+    put_literal(out, format);
+}
+
+template <typename T>
+void Logger::put(std::string &out, const T &value, bool binary)
+{
+    if constexpr(std::is_same<T, bool>::value) put_unsigned(out, value, binary);
+    else if constexpr(std::is_same<T, char>::value) put_string(out, std::string_view(&value, 1), binary);
+    else if constexpr(std::is_integral<T>::value && std::is_signed<T>::value) put_signed(out, value, binary);
+    else if constexpr(std::is_integral<T>::value) put_unsigned(out, value, binary);
+    else if constexpr(std::is_floating_point<T>::value) put_double(out, value, binary);
+    else if constexpr(std::is_enum<T>::value) put_signed(out, static_cast<long long>(value), binary);
+    else put_string(out, std::string_view(value), binary);
+}
+
 #endif // LOGGER_H
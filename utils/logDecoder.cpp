@@ -0,0 +1,39 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "Logger.h"
+
+/*
+    Converts a log written with Logger::Location::BINARY_FILE to the text log format.
+*/
+int main(int argc, char* argv[]){
+    if(argc < 2 || argc > 3){
+        std::cout << "Incorrect Format" << std::endl;
+        std::cout << "Required - <logDecoder> <Binary Log> [Text Log]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1], std::ios_base::binary);
+    if(!in.is_open()){
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::ofstream file;
+    if(argc == 3){
+        file.open(argv[2]);
+        if(!file.is_open()){
+            std::cerr << "Cannot open " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = argc == 3 ? file : std::cout;
+
+    if(!Logger::decode(in, out)){
+        out.flush();
+        std::cerr << "Malformed or truncated log " << argv[1] << std::endl;
+        return 1;
+    }
+    return 0;
+}